@@ -1 +1 @@
-prefast /LOG=devlog /VIEW NMAKE
+prefast /LOG=devlog /VIEW NMAKE
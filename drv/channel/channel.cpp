@@ -11,11 +11,13 @@ __checkReturn
 NTSTATUS
 ChannelInitPort (
     __in ProcessHelper* ProcessHlp,
-    __in FilteringSystem* FltSystem
+    __in FilteringSystem* FltSystem,
+    __in PFltQuotas QuotaLimits
     )
 {
     ASSERT( ProcessHlp );
     ASSERT( FltSystem );
+    ASSERT( QuotaLimits );
 
     NTSTATUS status = ProcessHlp->AddRef();
     if ( !NT_SUCCESS( status ) )
@@ -35,6 +37,7 @@ ChannelInitPort (
 
     gPort.m_FltSystem = FltSystem;
     gPort.m_ProcessHelper = ProcessHlp;
+    gPort.m_QuotaLimits = *QuotaLimits;
 
     ExInitializeRundownProtection( &gPort.m_RefClientPort );
     ExWaitForRundownProtectionRelease( &gPort.m_RefClientPort );
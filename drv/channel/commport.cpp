@@ -123,6 +123,8 @@ PortConnect (
             __leave;
         }
 
+        pPortContext->m_pFltStorage->SetQuotaLimits( &gPort.m_QuotaLimits );
+
         /// \todo  revise single port connection
         gPort.m_FltSystem->Attach( pPortContext->m_pFltStorage );
 
@@ -210,74 +212,164 @@ PortPostEmptyMessages (
 
 __checkReturn
 NTSTATUS
-ProceedChainGeneric (
-    __in FiltersStorage* FltStorage,
-    __in PCHAIN_ENTRY Entry,
-    __out PULONG FilterId
+ValidateChainParams (
+    __in PFltParam Params,
+    __in ULONG ParamsCount,
+    __in PVOID End,
+    __in BOOLEAN BoxItems,
+    __out PVOID* Next
     )
 {
-    NTSTATUS status = FltStorage->AddFilterUnsafe(
-        Entry->m_Filter->m_Interceptor,
-        Entry->m_Filter->m_OperationId,
-        Entry->m_Filter->m_FunctionMi,
-        Entry->m_Filter->m_OperationType,
-        Entry->m_Filter->m_GroupId,
-        Entry->m_Filter->m_Verdict,
-        UlongToHandle( Entry->m_Filter->m_CleanupProcessId ),
-        Entry->m_Filter->m_RequestTimeout,
-        Entry->m_Filter->m_WishMask,
-        Entry->m_Filter->m_ParamsCount,
-        Entry->m_Filter->m_Params,
-        FilterId
-        );
+    PFltParam pParam = Params;
 
-    return status;
+    for ( ULONG cou = 0; cou < ParamsCount; cou++ )
+    {
+        // last parameter may end right after its data
+        if (
+            (PUCHAR) pParam > (PUCHAR) End
+            ||
+            (ULONG_PTR) ( (PUCHAR) End - (PUCHAR) pParam ) < FIELD_OFFSET( FltParam, m_Data.m_Data )
+            )
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        ULONG_PTR datasize = (PUCHAR) End - (PUCHAR) pParam - FIELD_OFFSET( FltParam, m_Data.m_Data );
+        if ( pParam->m_Data.m_Size > datasize )
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        // data is in the buffer - same checks as the storage does
+        NTSTATUS status = FltValidateParam( pParam, BoxItems );
+        if ( !NT_SUCCESS( status ) )
+        {
+            return status;
+        }
+
+        pParam = (PFltParam) Add2Ptr(
+            pParam,
+            sizeof( FltParam ) + pParam->m_Data.m_Size
+            );
+    }
+
+    *Next = pParam;
+
+    return STATUS_SUCCESS;
 }
 
 __checkReturn
 NTSTATUS
-ProceedChainBox (
-    __in FiltersStorage* FltStorage,
-    __in PCHAIN_ENTRY pEntry,
-    __out PULONG FilterId
+ValidateChainEntry (
+    __in PCHAIN_ENTRY Entry,
+    __in PVOID End,
+    __out PVOID* Next
     )
 {
-    NTSTATUS status = STATUS_UNSUCCESSFUL;
-    PFLTBOX pBox = pEntry[0].m_Box;
+    if ( (PUCHAR) Entry > (PUCHAR) End )
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
 
-    switch ( pBox->m_Operation )
+    ULONG_PTR size = (PUCHAR) End - (PUCHAR) Entry;
+    if ( size < FIELD_OFFSET( CHAIN_ENTRY, m_Filter ) )
     {
-    case _fltbox_add:
-        status = FltStorage->CreateBoxUnsafe(
-            &pBox->m_Guid,
-            pBox->Items.m_ParamsCount,
-            pBox->Items.m_Params,
-            FilterId
-            );
-        
-        break;
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    size -= FIELD_OFFSET( CHAIN_ENTRY, m_Filter );
+
+    switch( Entry->m_Operation )
+    {
+    case _fltchain_add:
+        {
+            PFILTER pFilter = Entry->m_Filter;
+
+            if (
+                size < FIELD_OFFSET( FILTER, m_Params )
+                ||
+                !pFilter->m_GroupId
+                ||
+                !pFilter->m_Verdict
+                ||
+                !pFilter->m_WishMask
+                )
+            {
+                return STATUS_INVALID_PARAMETER;
+            }
+
+            return ValidateChainParams(
+                pFilter->m_Params,
+                pFilter->m_ParamsCount,
+                End,
+                FALSE,
+                Next
+                );
+        }
+
+    case _fltbox_create:
+        {
+            PFLTBOX pBox = Entry->m_Box;
+
+            if (
+                size < FIELD_OFFSET( FLTBOX, Items.m_Params )
+                ||
+                _fltbox_add != pBox->m_Operation
+                )
+            {
+                return STATUS_INVALID_PARAMETER;
+            }
+
+            return ValidateChainParams(
+                pBox->Items.m_Params,
+                pBox->Items.m_ParamsCount,
+                End,
+                TRUE,
+                Next
+                );
+        }
+
+    case _fltbox_release:
+        if ( size < FIELD_OFFSET( FLTBOX, Items ) )
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        *Next = Add2Ptr( Entry->m_Box, FIELD_OFFSET( FLTBOX, Items ) );
+
+        return STATUS_SUCCESS;
+
+    case _fltchain_del:
+        // storage has no way to remove a single filter
+        return STATUS_NOT_SUPPORTED;
 
     default:
-        __debugbreak();
+        break;
     }
 
-    return status;
+    return STATUS_NOT_SUPPORTED;
 }
 
-__checkReturn
-NTSTATUS
-ReleaseChainBox (
-    __in FiltersStorage* FltStorage,
-    __in PCHAIN_ENTRY pEntry
+void
+PrepareChainItem (
+    __in PCHAIN_ENTRY Entry,
+    __out PFltChainItem Item
     )
 {
-    PFLTBOX pBox = pEntry[0].m_Box;
-
-    NTSTATUS status = FltStorage->ReleaseBoxUnsafe(
-        &pBox->m_Guid
-        );
-    
-    return status;
+    PFILTER pFilter = Entry->m_Filter;
+
+    Item->m_Interceptor = pFilter->m_Interceptor;
+    Item->m_OperationId = pFilter->m_OperationId;
+    Item->m_FunctionMi = pFilter->m_FunctionMi;
+    Item->m_OperationType = pFilter->m_OperationType;
+    Item->m_GroupId = pFilter->m_GroupId;
+    Item->m_Verdict = pFilter->m_Verdict;
+    Item->m_ProcessId = UlongToHandle( pFilter->m_CleanupProcessId );
+    Item->m_RequestTimeout = pFilter->m_RequestTimeout;
+    Item->m_WishMask = pFilter->m_WishMask;
+    Item->m_ParamsCount = pFilter->m_ParamsCount;
+    Item->m_Params = pFilter->m_Params;
+    Item->m_FilterId = 0;
 }
 
 __checkReturn
@@ -285,53 +377,194 @@ NTSTATUS
 ProceedChain (
     __in FiltersStorage* FltStorage,
     __in PFILTERS_CHAIN Chain,
-    __out_opt PULONG FilterId
+    __in ULONG ChainSize,
+    __out_ecount(Chain->m_Count) PULONG FilterIds
     )
 {
     NTSTATUS status = STATUS_SUCCESS;
 
     ASSERT( ARGUMENT_PRESENT( Chain ) );
+    ASSERT( Chain->m_Count );
+
+    PVOID pEnd = Add2Ptr( Chain, ChainSize );
+    ULONG count = Chain->m_Count;
+    ULONG itemscount = 0;
+    ULONG stagedcount = 0;
+
+    PFltChainItem pItems = NULL;
+    PFltBoxStage pStages = NULL;
+    PCHAIN_ENTRY* pEntries = NULL;
+    BOOLEAN bLocked = FALSE;
 
-    if ( Chain->m_Count != 1 )
+    __try
     {
-        __debugbreak();     //   
-        return STATUS_NOT_SUPPORTED;
-    }
+        pItems = (PFltChainItem) ExAllocatePoolWithTag(
+            PagedPool,
+            ( sizeof( FltChainItem ) + sizeof( FltBoxStage ) + sizeof( PCHAIN_ENTRY ) ) * count,
+            'hcSA'
+            );
 
-    FltStorage->Lock();
+        if ( !pItems )
+        {
+            status = STATUS_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
 
-    PCHAIN_ENTRY pEntry = Chain->m_Entry;
+        pStages = (PFltBoxStage) Add2Ptr( pItems, sizeof( FltChainItem ) * count );
+        pEntries = (PCHAIN_ENTRY*) Add2Ptr( pStages, sizeof( FltBoxStage ) * count );
 
-    for ( ULONG item = 0; item < Chain->m_Count; item++ )
-    {
-        switch( pEntry->m_Operation )
+        // every entry is checked before anything is applied. Entries
+        // follow each other aligned as CHAIN_ENTRY
+        PCHAIN_ENTRY pEntry = Chain->m_Entry;
+
+        for ( ULONG item = 0; item < count; item++ )
         {
-        case _fltchain_add:
-            status = ProceedChainGeneric( FltStorage, pEntry, FilterId );
-            break;
+            PVOID pNext;
 
-        case _fltchain_del:
-            __debugbreak();
+            status = ValidateChainEntry( pEntry, pEnd, &pNext );
+            if ( !NT_SUCCESS( status ) )
+            {
+                __leave;
+            }
 
-            break;
+            pEntries[ item ] = pEntry;
+            pEntry = (PCHAIN_ENTRY) ALIGN_UP_POINTER_BY( pNext, TYPE_ALIGNMENT( CHAIN_ENTRY ) );
+        }
 
-        case _fltbox_create:
-            status = ProceedChainBox( FltStorage, pEntry, FilterId );
+        FltStorage->Lock();
+        bLocked = TRUE;
 
-            break;
+        // boxes are staged in chain order - filters of the chain may
+        // refer to them. Nothing of a box is seen before filters are in
+        for ( ULONG item = 0; item < count; item++ )
+        {
+            pEntry = pEntries[ item ];
+            FilterIds[ item ] = 0;
 
-        case _fltbox_release:
-            status = ReleaseChainBox( FltStorage, pEntry );
+            switch( pEntry->m_Operation )
+            {
+            case _fltchain_add:
+                PrepareChainItem( pEntry, &pItems[ itemscount++ ] );
+                break;
+
+            case _fltbox_create:
+                status = FltStorage->StageBoxUnsafe(
+                    &pEntry->m_Box->m_Guid,
+                    pEntry->m_Box->Items.m_ParamsCount,
+                    pEntry->m_Box->Items.m_Params,
+                    &pStages[ stagedcount ]
+                    );
 
-            break;
+                break;
+
+            case _fltbox_release:
+                status = FltStorage->StageBoxReleaseUnsafe(
+                    &pEntry->m_Box->m_Guid,
+                    &pStages[ stagedcount ]
+                    );
+
+                break;
+            }
+
+            if ( !NT_SUCCESS( status ) )
+            {
+                __leave;
+            }
+
+            if ( _fltchain_add != pEntry->m_Operation )
+            {
+                stagedcount++;
+            }
+        }
+
+        // filters are published at once - sets are rebuilt one time
+        if ( itemscount )
+        {
+            status = FltStorage->AddFiltersUnsafe( itemscount, pItems );
+            if ( !NT_SUCCESS( status ) )
+            {
+                __leave;
+            }
+        }
+
+        // applying a stage does not fail
+        itemscount = 0;
+        stagedcount = 0;
+        for ( ULONG item = 0; item < count; item++ )
+        {
+            if ( _fltchain_add == pEntries[ item ]->m_Operation )
+            {
+                FilterIds[ item ] = pItems[ itemscount++ ].m_FilterId;
+            }
+            else
+            {
+                FltStorage->ApplyBoxUnsafe( &pStages[ stagedcount++ ], &FilterIds[ item ] );
+            }
         }
+
+        stagedcount = 0;
     }
+    __finally
+    {
+        // chain failed - boxes are left as they were
+        while ( stagedcount )
+        {
+            FltStorage->CancelBoxUnsafe( &pStages[ --stagedcount ] );
+        }
 
-    FltStorage->UnLock();
+        if ( bLocked )
+        {
+            FltStorage->UnLock();
+        }
+
+        if ( pItems )
+        {
+            FREE_POOL( pItems );
+        }
+    }
 
     return status;
 }
 
+__checkReturn
+NTSTATUS
+CaptureUserBuffer (
+    __in PVOID Source,
+    __in ULONG Size,
+    __deref_out PVOID* Captured
+    )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+
+    PVOID pBuffer = ExAllocatePoolWithTag( PagedPool, Size, 'hcSA' );
+    if ( !pBuffer )
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    // chain is read several times - user must not change it meanwhile
+    __try
+    {
+        RtlCopyMemory( pBuffer, Source, Size );
+    }
+
+    __except ( EXCEPTION_EXECUTE_HANDLER )
+    {
+        status = GetExceptionCode();
+    }
+
+    if ( !NT_SUCCESS( status ) )
+    {
+        FREE_POOL( pBuffer );
+
+        return status;
+    }
+
+    *Captured = pBuffer;
+
+    return STATUS_SUCCESS;
+}
+
 __checkReturn
 NTSTATUS
 CopyDataToUserBuffer (
@@ -472,30 +705,151 @@ PortMessageNotify (
         
         case  ntfcom_FiltersChain:
             {
-                PFILTERS_CHAIN pChain = (PFILTERS_CHAIN) pCommand->m_Data;
                 ULONG size = InputBufferSize - FIELD_OFFSET( NOTIFY_COMMAND, m_Data );
+                PFILTERS_CHAIN pChain = NULL;
+                PULONG pFilterIds = NULL;
 
-                ULONG FilterId;
+                status = CaptureUserBuffer( pCommand->m_Data, size, (PVOID*) &pChain );
+                if ( !NT_SUCCESS( status ) )
+                {
+                    break;
+                }
 
-                status = ProceedChain(
-                    pPortContext->m_pFltStorage,
-                    pChain,
-                    &FilterId
-                    );
+                // an entry takes at least as much as its id
+                ULONG count = 0;
+                if ( size >= FIELD_OFFSET( FILTERS_CHAIN, m_Entry ) )
+                {
+                    count = pChain->m_Count;
+                }
+
+                if ( !count || count > size / sizeof( ULONG ) )
+                {
+                    status = STATUS_INVALID_PARAMETER;
+                }
+                else if ( OutputBuffer && OutputBufferSize < count * sizeof( ULONG ) )
+                {
+                    // nothing is applied
+                    status = STATUS_BUFFER_TOO_SMALL;
+                }
+                else
+                {
+                    pFilterIds = (PULONG) ExAllocatePoolWithTag(
+                        PagedPool,
+                        count * sizeof( ULONG ),
+                        'hcSA'
+                        );
 
+                    status = pFilterIds ? STATUS_SUCCESS : STATUS_INSUFFICIENT_RESOURCES;
+                }
+
+                if ( NT_SUCCESS( status ) )
+                {
+                    status = ProceedChain(
+                        pPortContext->m_pFltStorage,
+                        pChain,
+                        size,
+                        pFilterIds
+                        );
+                }
+
+                // ids in chain order, 0 for box release
                 if ( NT_SUCCESS( status ) && OutputBuffer )
                 {
                     status = CopyDataToUserBuffer(
                         OutputBuffer,
                         OutputBufferSize,
-                        &FilterId,
-                        sizeof( FilterId ),
+                        pFilterIds,
+                        count * sizeof( ULONG ),
                         ReturnOutputBufferLength
                         );
                 }
+
+                if ( pFilterIds )
+                {
+                    FREE_POOL( pFilterIds );
+                }
+
+                FREE_POOL( pChain );
             }
             break;
         
+        case ntfcom_Quotas:
+            {
+                ULONG size = InputBufferSize - FIELD_OFFSET( NOTIFY_COMMAND, m_Data );
+                PNC_QUOTAS pQuotas = NULL;
+
+                if ( size < sizeof( NC_QUOTAS ) )
+                {
+                    status = STATUS_INVALID_PARAMETER;
+                    break;
+                }
+
+                status = CaptureUserBuffer( pCommand->m_Data, sizeof( NC_QUOTAS ), (PVOID*) &pQuotas );
+                if ( !NT_SUCCESS( status ) )
+                {
+                    break;
+                }
+
+                FltQuotas quotas;
+                quotas.m_Filters = pQuotas->m_Filters;
+                quotas.m_Boxes = pQuotas->m_Boxes;
+                quotas.m_PolicyBytes = (LONG64) pQuotas->m_PolicyBytes;
+                if ( quotas.m_PolicyBytes < 0 )
+                {
+                    // above signed range - the limit of the driver
+                    quotas.m_PolicyBytes = 0;
+                }
+
+                pPortContext->m_pFltStorage->SetQuotas( &quotas );
+
+                FREE_POOL( pQuotas );
+            }
+            break;
+
+        case ntfcom_Statistics:
+            if ( !OutputBuffer )
+            {
+                status = STATUS_INVALID_PARAMETER;
+            }
+            else
+            {
+                FltQuotas quotas;
+                FltUsage usage;
+
+                pPortContext->m_pFltStorage->QueryQuotas( &quotas );
+                pPortContext->m_pFltStorage->QueryUsage( &usage );
+
+                NC_STATISTICS statistics;
+                RtlZeroMemory( &statistics, sizeof( statistics ) );
+
+                statistics.m_Quotas.m_Filters = quotas.m_Filters;
+                statistics.m_Quotas.m_Boxes = quotas.m_Boxes;
+                statistics.m_Quotas.m_PolicyBytes = quotas.m_PolicyBytes;
+
+                statistics.m_Filters = usage.m_Filters;
+                statistics.m_Boxes = usage.m_Boxes;
+                statistics.m_PolicyBytes = usage.m_PolicyBytes;
+                statistics.m_Rejected = usage.m_Rejected;
+
+                statistics.m_Sets = usage.m_Sets;
+                statistics.m_Params = usage.m_Params;
+                statistics.m_FiltersBytes = usage.m_FiltersBytes;
+                statistics.m_ParamsBytes = usage.m_ParamsBytes;
+                statistics.m_PositionsBytes = usage.m_PositionsBytes;
+                statistics.m_CompiledBytes = usage.m_CompiledBytes;
+                statistics.m_BoxesBytes = usage.m_BoxesBytes;
+                statistics.m_CacheBytes = usage.m_CacheBytes;
+
+                status = CopyDataToUserBuffer(
+                    OutputBuffer,
+                    OutputBufferSize,
+                    &statistics,
+                    sizeof( statistics ),
+                    ReturnOutputBufferLength
+                    );
+            }
+            break;
+
         case ntfcom_IoSupport:
             if ( !InputBuffer || InputBufferSize <= sizeof( IO_SUPPORT ) )
             {
@@ -613,7 +967,7 @@ PortAllocateMessage (
     {
         if ( FlagOn( ParamsMask, (PARAMS_MASK) 1 << cou ) )
         {
-            status = Event->QueryParameter (
+            status = Event->GetParameter (
                 (Parameters) cou,
                 &data,
                 &datasize
@@ -643,11 +997,7 @@ PortAllocateMessage (
         return STATUS_NOT_SUPPORTED;
     }
 
-    pMsg = (PMESSAGE_DATA) ExAllocatePoolWithTag(
-        PagedPool,
-        messageSize,
-        'gmSA'
-        );
+    pMsg = (PMESSAGE_DATA) MemSlabAllocate( messageSize, 'gmSA' );
 
     if ( !pMsg )
     {
@@ -669,7 +1019,7 @@ PortAllocateMessage (
     {
         if ( FlagOn( ParamsMask, (PARAMS_MASK) 1 << cou ) )
         {
-            status = Event->QueryParameter(
+            status = Event->GetParameter(
                 (Parameters) cou,
                 &data,
                 &datasize
@@ -714,7 +1064,7 @@ PortReleaseMessage (
         return;
     }
 
-    FREE_POOL( Message );
+    FREE_SLAB( Message );
 }
 
 __checkReturn
@@ -9,6 +9,7 @@ typedef struct _PortGlobals
     PFLT_PORT           m_ClientPort;
     FilteringSystem*    m_FltSystem;
     ProcessHelper*      m_ProcessHelper;
+    FltQuotas           m_QuotaLimits;      // of every client storage
 } PortGlobals;
 
 extern PortGlobals gPort;
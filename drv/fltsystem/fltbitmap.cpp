@@ -0,0 +1,336 @@
+#include "../inc/commonkrnl.h"
+#include "../inc/memmgr.h"
+#include "fltbitmap.h"
+
+ULONG FltBitmap::m_AllocTag = 'mbSA';
+
+FltBitmap::FltBitmap (
+    )
+{
+    RtlZeroMemory( m_Inline, sizeof( m_Inline ) );
+
+    m_Buffer = m_Inline;
+    m_BitsCount = 0;
+    m_WordsCount = FLT_BITMAP_INLINE_WORDS;
+}
+
+FltBitmap::~FltBitmap (
+    )
+{
+    if ( m_Buffer != m_Inline )
+    {
+        FREE_SLAB( m_Buffer );
+    }
+}
+
+__checkReturn
+NTSTATUS
+FltBitmap::Resize (
+    __in ULONG BitsCount
+    )
+{
+    ULONG words = FltBitmapWords( BitsCount );
+
+    if ( words > m_WordsCount )
+    {
+        // grow twice to keep adding filters one by one cheap
+        ULONG newwords = max( words, m_WordsCount * 2 );
+
+        // match results of every event above inline size
+        ULONG64* pBuffer = (ULONG64*) MemSlabAllocate(
+            sizeof( ULONG64 ) * newwords,
+            m_AllocTag
+            );
+
+        if ( !pBuffer )
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        RtlCopyMemory( pBuffer, m_Buffer, sizeof( ULONG64 ) * m_WordsCount );
+        RtlZeroMemory(
+            &pBuffer[ m_WordsCount ],
+            sizeof( ULONG64 ) * ( newwords - m_WordsCount )
+            );
+
+        if ( m_Buffer != m_Inline )
+        {
+            FREE_SLAB( m_Buffer );
+        }
+
+        m_Buffer = pBuffer;
+        m_WordsCount = newwords;
+    }
+    else if ( BitsCount < m_BitsCount )
+    {
+        // bits above size are always clear
+        ULONG tail = BitsCount % FLT_BITMAP_WORD_BITS;
+        ULONG from = BitsCount / FLT_BITMAP_WORD_BITS;
+
+        if ( tail )
+        {
+            m_Buffer[ from ] &= ( 1ULL << tail ) - 1;
+            from++;
+        }
+
+        RtlZeroMemory(
+            &m_Buffer[ from ],
+            sizeof( ULONG64 ) * ( FltBitmapWords( m_BitsCount ) - from )
+            );
+    }
+
+    m_BitsCount = BitsCount;
+
+    return STATUS_SUCCESS;
+}
+
+void
+FltBitmap::ClearAll (
+    )
+{
+    RtlZeroMemory( m_Buffer, sizeof( ULONG64 ) * FltBitmapWords( m_BitsCount ) );
+}
+
+void
+FltBitmap::SetAll (
+    )
+{
+    ULONG words = FltBitmapWords( m_BitsCount );
+    if ( !words )
+    {
+        return;
+    }
+
+    RtlFillMemory( m_Buffer, sizeof( ULONG64 ) * words, 0xff );
+
+    ULONG tail = m_BitsCount % FLT_BITMAP_WORD_BITS;
+    if ( tail )
+    {
+        m_Buffer[ words - 1 ] &= ( 1ULL << tail ) - 1;
+    }
+}
+
+void
+FltBitmap::SetComplement (
+    __in FltBitmap* Source
+    )
+{
+    ASSERT( Source->m_BitsCount >= m_BitsCount );
+
+    ULONG words = FltBitmapWords( m_BitsCount );
+    if ( !words )
+    {
+        return;
+    }
+
+    for ( ULONG idx = 0; idx < words; idx++ )
+    {
+        m_Buffer[ idx ] = ~Source->m_Buffer[ idx ];
+    }
+
+    ULONG tail = m_BitsCount % FLT_BITMAP_WORD_BITS;
+    if ( tail )
+    {
+        m_Buffer[ words - 1 ] &= ( 1ULL << tail ) - 1;
+    }
+}
+
+__checkReturn
+ULONG
+FltBitmap::FindClear (
+    __in ULONG From
+    )
+{
+    if ( From >= m_BitsCount )
+    {
+        return FLT_BITMAP_NOT_FOUND;
+    }
+
+    ULONG words = FltBitmapWords( m_BitsCount );
+    ULONG idx = From / FLT_BITMAP_WORD_BITS;
+
+    ULONG64 word = ~m_Buffer[ idx ] & ( ~0ULL << ( From % FLT_BITMAP_WORD_BITS ) );
+
+    while ( TRUE )
+    {
+        if ( word )
+        {
+            ULONG position = idx * FLT_BITMAP_WORD_BITS + FltBitmapWordLowest( word );
+
+            return position < m_BitsCount ? position : FLT_BITMAP_NOT_FOUND;
+        }
+
+        idx++;
+        if ( idx == words )
+        {
+            break;
+        }
+
+        word = ~m_Buffer[ idx ];
+    }
+
+    return FLT_BITMAP_NOT_FOUND;
+}
+
+__checkReturn
+ULONG
+FltBitmap::FindSet (
+    __in ULONG From
+    )
+{
+    if ( From >= m_BitsCount )
+    {
+        return FLT_BITMAP_NOT_FOUND;
+    }
+
+    ULONG words = FltBitmapWords( m_BitsCount );
+    ULONG idx = From / FLT_BITMAP_WORD_BITS;
+
+    ULONG64 word = m_Buffer[ idx ] & ( ~0ULL << ( From % FLT_BITMAP_WORD_BITS ) );
+
+    while ( TRUE )
+    {
+        if ( word )
+        {
+            // bits above size are always clear
+            return idx * FLT_BITMAP_WORD_BITS + FltBitmapWordLowest( word );
+        }
+
+        idx++;
+        if ( idx == words )
+        {
+            break;
+        }
+
+        word = m_Buffer[ idx ];
+    }
+
+    return FLT_BITMAP_NOT_FOUND;
+}
+
+__checkReturn
+ULONG
+FltBitmap::NumberOfSetBits (
+    )
+{
+    ULONG count = 0;
+    ULONG words = FltBitmapWords( m_BitsCount );
+
+    for ( ULONG idx = 0; idx < words; idx++ )
+    {
+        count += FltBitmapWordCount( m_Buffer[ idx ] );
+    }
+
+    return count;
+}
+
+void
+FltBitmap::Or (
+    __in FltBitmap* Source
+    )
+{
+    ASSERT( Source->m_BitsCount == m_BitsCount );
+
+    ULONG words = FltBitmapWords( m_BitsCount );
+
+    for ( ULONG idx = 0; idx < words; idx++ )
+    {
+        m_Buffer[ idx ] |= Source->m_Buffer[ idx ];
+    }
+}
+
+void
+FltBitmap::OrMasked (
+    __in FltBitmap* Source,
+    __in FltBitmap* Mask,
+    __in BOOLEAN Invert
+    )
+{
+    ASSERT( Source->m_BitsCount == m_BitsCount );
+    ASSERT( Mask->m_BitsCount == m_BitsCount );
+
+    ULONG words = FltBitmapWords( m_BitsCount );
+
+    // bits of Mask above size are clear, inverted Source does not leak
+    ULONG64 invert = Invert ? ~0ULL : 0;
+
+    for ( ULONG idx = 0; idx < words; idx++ )
+    {
+        m_Buffer[ idx ] |= ( Source->m_Buffer[ idx ] ^ invert ) & Mask->m_Buffer[ idx ];
+    }
+}
+
+__checkReturn
+BOOLEAN
+FltBitmap::Intersects (
+    __in PRTL_BITMAP Bitmap
+    )
+{
+    // RTL_BITMAP is kept in 32 bit words, low one first
+    ULONG bits = min( m_BitsCount, Bitmap->SizeOfBitMap );
+    ULONG ulongs = ( bits + 31 ) / 32;
+    ULONG64 hit = 0;
+
+    for ( ULONG idx = 0; idx < ulongs; idx++ )
+    {
+        ULONG word = Bitmap->Buffer[ idx ];
+
+        if ( idx == ulongs - 1 && ( bits % 32 ) )
+        {
+            word &= ( 1UL << ( bits % 32 ) ) - 1;
+        }
+
+        hit |= ( m_Buffer[ idx / 2 ] >> ( ( idx % 2 ) * 32 ) ) & word;
+    }
+
+    return hit ? TRUE : FALSE;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+FltIdList::FltIdList (
+    )
+{
+    m_Ids = m_Inline;
+    m_Count = 0;
+    m_Capacity = FLT_IDLIST_INLINE;
+}
+
+FltIdList::~FltIdList (
+    )
+{
+    if ( m_Ids != m_Inline )
+    {
+        FREE_SLAB( m_Ids );
+    }
+}
+
+__checkReturn
+NTSTATUS
+FltIdList::Growp (
+    )
+{
+    ULONG capacity = m_Capacity * 2;
+
+    PULONG pIds = (PULONG) MemSlabAllocate(
+        sizeof( ULONG ) * capacity,
+        FltBitmap::m_AllocTag
+        );
+
+    if ( !pIds )
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlCopyMemory( pIds, m_Ids, sizeof( ULONG ) * m_Count );
+
+    if ( m_Ids != m_Inline )
+    {
+        FREE_SLAB( m_Ids );
+    }
+
+    m_Ids = pIds;
+    m_Capacity = capacity;
+
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,312 @@
+#pragma once
+
+//!
+//    \description - growable bitmap for filter positions. Bits are kept in
+//                   64-bit words, scans and counts work on a whole word at
+//                   a time. First FLT_BITMAP_INLINE_BITS bits live inside
+//                   the object, pool buffer used only above this size.
+//!
+
+#include <intrin.h>
+
+#define FLT_BITMAP_WORD_BITS        64
+#define FLT_BITMAP_INLINE_BITS      256
+#define FLT_BITMAP_INLINE_WORDS     ( FLT_BITMAP_INLINE_BITS / FLT_BITMAP_WORD_BITS )
+#define FLT_BITMAP_NOT_FOUND        ( (ULONG) -1 )
+#define FLT_IDLIST_INLINE           32
+
+#define FltBitmapWords( _bits ) \
+    ( ( ( _bits ) + FLT_BITMAP_WORD_BITS - 1 ) / FLT_BITMAP_WORD_BITS )
+
+FORCEINLINE
+ULONG
+FltBitmapWordCount (
+    __in ULONG64 Word
+    )
+{
+    // parallel count in 64-bit register, no popcnt instruction requirement
+    Word = Word - ( ( Word >> 1 ) & 0x5555555555555555ULL );
+    Word = ( Word & 0x3333333333333333ULL ) + ( ( Word >> 2 ) & 0x3333333333333333ULL );
+    Word = ( Word + ( Word >> 4 ) ) & 0x0f0f0f0f0f0f0f0fULL;
+
+    return (ULONG) ( ( Word * 0x0101010101010101ULL ) >> 56 );
+}
+
+FORCEINLINE
+ULONG
+FltBitmapWordLowest (
+    __in ULONG64 Word
+    )
+{
+    // Word must be non zero
+    ULONG index;
+
+#if defined (_WIN64)
+    _BitScanForward64( &index, Word );
+#else
+    if ( !_BitScanForward( &index, (ULONG) Word ) )
+    {
+        _BitScanForward( &index, (ULONG) ( Word >> 32 ) );
+        index += 32;
+    }
+#endif // _WIN64
+
+    return index;
+}
+
+class FltBitmap
+{
+public:
+    static ULONG    m_AllocTag;
+
+public:
+    FltBitmap();
+    ~FltBitmap();
+
+    __checkReturn
+    NTSTATUS
+    Resize (
+        __in ULONG BitsCount
+        );
+
+    void
+    ClearAll();
+
+    void
+    SetAll();
+
+    void
+    SetComplement (
+        __in FltBitmap* Source
+        );
+
+    // bitmaps have the same size
+    void
+    Or (
+        __in FltBitmap* Source
+        );
+
+    // Mask bits where Source is set (clear when Invert)
+    void
+    OrMasked (
+        __in FltBitmap* Source,
+        __in FltBitmap* Mask,
+        __in BOOLEAN Invert
+        );
+
+    // any bit set in both, sizes may differ
+    __checkReturn
+    BOOLEAN
+    Intersects (
+        __in PRTL_BITMAP Bitmap
+        );
+
+    __checkReturn
+    ULONG
+    FindClear (
+        __in ULONG From
+        );
+
+    __checkReturn
+    ULONG
+    FindSet (
+        __in ULONG From
+        );
+
+    __checkReturn
+    ULONG
+    NumberOfSetBits();
+
+    ULONG
+    GetSize (
+        )
+    {
+        return m_BitsCount;
+    }
+
+    BOOLEAN
+    Test (
+        __in ULONG Position
+        )
+    {
+        ASSERT( Position < m_BitsCount );
+
+        return ( m_Buffer[ Position / FLT_BITMAP_WORD_BITS ]
+            >> ( Position % FLT_BITMAP_WORD_BITS ) ) & 1;
+    }
+
+    void
+    Set (
+        __in ULONG Position
+        )
+    {
+        ASSERT( Position < m_BitsCount );
+
+        m_Buffer[ Position / FLT_BITMAP_WORD_BITS ] |=
+            1ULL << ( Position % FLT_BITMAP_WORD_BITS );
+    }
+
+    void
+    Clear (
+        __in ULONG Position
+        )
+    {
+        ASSERT( Position < m_BitsCount );
+
+        m_Buffer[ Position / FLT_BITMAP_WORD_BITS ] &=
+            ~( 1ULL << ( Position % FLT_BITMAP_WORD_BITS ) );
+    }
+
+    // clear bits of the word, bits above the size are not reported
+    ULONG64
+    GetClearBits (
+        __in ULONG Word
+        )
+    {
+        ASSERT( Word < FltBitmapWords( m_BitsCount ) );
+
+        ULONG64 bits = ~m_Buffer[ Word ];
+
+        ULONG tail = m_BitsCount - Word * FLT_BITMAP_WORD_BITS;
+        if ( tail < FLT_BITMAP_WORD_BITS )
+        {
+            bits &= ( 1ULL << tail ) - 1;
+        }
+
+        return bits;
+    }
+
+private:
+    ULONG64*        m_Buffer;
+    ULONG           m_BitsCount;
+    ULONG           m_WordsCount;
+    ULONG64         m_Inline[ FLT_BITMAP_INLINE_WORDS ];
+};
+
+//!
+//    \description - growable list of positions, first FLT_IDLIST_INLINE
+//                   ones live inside the object
+//!
+class FltIdList
+{
+public:
+    FltIdList();
+    ~FltIdList();
+
+    __checkReturn
+    NTSTATUS
+    Append (
+        __in ULONG Id
+        )
+    {
+        if ( m_Count == m_Capacity )
+        {
+            NTSTATUS status = Growp();
+            if ( !NT_SUCCESS( status ) )
+            {
+                return status;
+            }
+        }
+
+        m_Ids[ m_Count++ ] = Id;
+
+        return STATUS_SUCCESS;
+    }
+
+    ULONG
+    Pop (
+        )
+    {
+        ASSERT( m_Count );
+
+        return m_Ids[ --m_Count ];
+    }
+
+    ULONG
+    Get (
+        __in ULONG Idx
+        )
+    {
+        ASSERT( Idx < m_Count );
+
+        return m_Ids[ Idx ];
+    }
+
+    ULONG
+    GetCount (
+        )
+    {
+        return m_Count;
+    }
+
+private:
+    __checkReturn
+    NTSTATUS
+    Growp();
+
+private:
+    PULONG          m_Ids;
+    ULONG           m_Count;
+    ULONG           m_Capacity;
+    ULONG           m_Inline[ FLT_IDLIST_INLINE ];
+};
+
+//!
+//    \description - bitmap filled by index probes. Bits are listed in the
+//                   order they are set, caller visits hits without a scan.
+//                   No memory for the list - IsListed is FALSE and only the
+//                   bitmap is valid.
+//!
+class FltHits : public FltBitmap
+{
+public:
+    FltHits (
+        )
+    {
+        m_Listed = TRUE;
+    }
+
+    void
+    Set (
+        __in ULONG Position
+        )
+    {
+        if ( Test( Position ) )
+        {
+            return;
+        }
+
+        FltBitmap::Set( Position );
+
+        if ( m_Listed && !NT_SUCCESS( m_List.Append( Position ) ) )
+        {
+            m_Listed = FALSE;
+        }
+    }
+
+    BOOLEAN
+    IsListed (
+        )
+    {
+        return m_Listed;
+    }
+
+    ULONG
+    GetCount (
+        )
+    {
+        return m_List.GetCount();
+    }
+
+    ULONG
+    GetHit (
+        __in ULONG Idx
+        )
+    {
+        return m_List.Get( Idx );
+    }
+
+private:
+    FltIdList       m_List;
+    BOOLEAN         m_Listed;
+};
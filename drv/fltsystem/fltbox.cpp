@@ -1,375 +1,1181 @@
-#include "../inc/commonkrnl.h"
-#include "../inc/memmgr.h"
-#include "fltchecks.h"
-#include "fltbox.h"
-
-#include "fltbox.tmh"
-
-ULONG FilterBox::m_AllocTag = 'bfSA';
-
-typedef struct _BoxFilterItem
-{
-    static ULONG        m_AllocTag;
-    LIST_ENTRY          m_List;
-    ULONG               m_Position;
-    ParamCheckEntry*    m_Param;
-} BoxFilterItem, *PBoxFilterItem;
-
-ULONG BoxFilterItem::m_AllocTag = 'ibSA';
-
-FilterBox::FilterBox (
-    __in LPGUID Guid
-    )
-{
-    m_RefCount = 0;
-    m_Guid = *Guid;
-
-    m_NextFreePosition = 0;
-    
-    InitializeListHead( &m_Items );
-}
-
-FilterBox::~FilterBox (
-    )
-{
-    PBoxFilterItem pEntry = NULL;
-
-    PLIST_ENTRY Flink = m_Items.Flink;
-    while ( Flink != &m_Items )
-    {
-        pEntry = CONTAINING_RECORD(
-            Flink,
-            BoxFilterItem,
-            m_List
-            );
-
-        Flink = Flink->Flink;
-        RemoveEntryList( &pEntry->m_List );
-
-        FREE_OBJECT( pEntry->m_Param );
-        FREE_POOL( pEntry );
-    }
-}
-
-__checkReturn
-NTSTATUS
-FilterBox::AddRef (
-    )
-{
-    InterlockedIncrement( &m_RefCount );
-
-    return STATUS_SUCCESS;
-}
-
-void
-FilterBox::Release (
-    )
-{
-    LONG refcount = InterlockedDecrement( &m_RefCount );
-
-    if ( refcount < 0 )
-    {
-        ASSERT( FALSE );
-        /// \todo CRASH!!!
-    }
-
-    if ( !refcount )
-    {
-        /// \todo  
-    }
-}
-
-__checkReturn
-NTSTATUS
-FilterBox::AddParams (
-    __in ULONG ParamsCount,
-    __in PFltParam Params,
-    __out PULONG Position
-    )
-{
-    if ( !ParamsCount || !Params )
-    {
-        return STATUS_INVALID_PARAMETER;
-    }
-
-    if ( ParamsCount != 1 ) /// \todo fix allocation size next lines when switch to multiple params
-    {
-        return STATUS_NOT_SUPPORTED;
-    }
-
-    NTSTATUS status = STATUS_UNSUCCESSFUL;
-
-    PBoxFilterItem fltitem = NULL;
-
-    __try
-    {
-        fltitem = ( PBoxFilterItem ) ExAllocatePoolWithTag(
-            PagedPool,
-            sizeof( BoxFilterItem ) + Params->m_Data.m_Size,
-            BoxFilterItem::m_AllocTag
-            );
-
-        if ( !fltitem )
-        {
-            status = STATUS_INSUFFICIENT_RESOURCES;
-            
-            __leave;
-        }
-
-        fltitem->m_Param = new (
-            PagedPool,
-            m_AllocTag
-            ) ParamCheckEntry;
-
-        if ( !fltitem->m_Param )
-        {
-            status = STATUS_INSUFFICIENT_RESOURCES;
-            
-            __leave;
-        }
-
-        fltitem->m_Position = m_NextFreePosition++;
-        *Position = fltitem->m_Position;
-
-        fltitem->m_Param->m_Type = CheckEntryGeneric;
-        fltitem->m_Param->m_Flags = Params->m_Flags;
-    
-        fltitem->m_Param->Generic.m_Parameter = Params->m_ParameterId;
-        fltitem->m_Param->Generic.m_Operation = Params->m_Operation;
-    
-        status = fltitem->m_Param->Attach(
-            Params->m_Data.m_Size,
-            ParamsCount,
-            Params->m_Data.m_Data
-            );
-    }
-    __finally
-    {
-        if ( !NT_SUCCESS( status ) )
-        {
-            __debugbreak(); // nct
-
-            if ( fltitem )
-            {
-                FREE_OBJECT( fltitem->m_Param );
-                FREE_POOL( fltitem );
-            }
-        }
-        else
-        {
-            InsertHeadList( &m_Items, &fltitem->m_List );
-        }
-    }
-
-    return status;
-}
-
-NTSTATUS
-FilterBox::MatchEvent (
-    __in EventData *Event,
-    __in PRTL_BITMAP Affecting
-    )
-{
-    /// \todo   -         \
-    //        
-    if ( IsListEmpty( &m_Items ) )
-    {
-        return STATUS_SUCCESS;
-    }
-
-    NTSTATUS status = STATUS_SUCCESS;
-    
-    PBoxFilterItem pEntry = NULL;
-
-    PLIST_ENTRY Flink = m_Items.Flink;
-    while ( Flink != &m_Items )
-    {
-        pEntry = CONTAINING_RECORD(
-            Flink,
-            BoxFilterItem,
-            m_List
-            );
-
-        Flink = Flink->Flink;
-        
-        if ( pEntry->m_Position > Affecting->SizeOfBitMap )
-        {
-            __debugbreak(); //nct
-            continue;
-        }
-
-        if ( !RtlCheckBit( Affecting, pEntry->m_Position ) )
-        {
-            continue;
-        }
-
-        status = CheckEntry( pEntry->m_Param, Event );
-        if ( NT_SUCCESS( status ) )
-        {
-            break;
-        }
-    }
-
-    return status;
-}
-
-
-//////////////////////////////////////////////////////////////////////////
-
-FilterBoxList::FilterBoxList (
-    )
-{
-    FltInitializePushLock( &m_AccessLock );
-    InitializeListHead( &m_List );
-}
-
-FilterBoxList::~FilterBoxList (
-    )
-{
-    FltDeletePushLock( &m_AccessLock );
-
-    FilterBox* pEntry = NULL;
-
-    PLIST_ENTRY Flink = m_List.Flink;
-    while ( Flink != &m_List )
-    {
-        pEntry = CONTAINING_RECORD(
-            Flink,
-            FilterBox,
-            m_List
-            );
-
-        Flink = Flink->Flink;
-        RemoveEntryList( &pEntry->m_List );
-
-        ASSERT( !pEntry->m_RefCount );
-        pEntry->FilterBox::~FilterBox();
-        FREE_POOL( pEntry );
-    }
-}
-
-__checkReturn
-NTSTATUS
-FilterBoxList::GetOrCreateBox (
-    __in LPGUID Guid,
-    __deref_out_opt PFilterBox* FltBox
-    )
-{
-    ASSERT( Guid );
-
-    NTSTATUS status = STATUS_INSUFFICIENT_RESOURCES;
-    FilterBox* fltbox = NULL;
-
-    FltAcquirePushLockExclusive( &m_AccessLock );
-
-    fltbox = LookupBoxp( Guid );
-    if ( !fltbox )
-    {
-        fltbox = CreateNewp( Guid );
-    }
-
-    FltReleasePushLock( &m_AccessLock );
-
-    if ( fltbox )
-    {
-        fltbox->AddRef();
-
-        *FltBox = fltbox;
-        status = STATUS_SUCCESS;
-    }
-    
-    return status;
-}
-
-__checkReturn
-NTSTATUS
-FilterBoxList::ReleaseBox (
-    __in LPGUID Guid
-    )
-{
-    FilterBox* box = LookupBoxp( Guid );
-    if ( !box )
-    {
-        return STATUS_NOT_FOUND;
-    }
-
-    box->Release();
-
-    return STATUS_SUCCESS;
-}
-
-FilterBox*
-FilterBoxList::LookupBox (
-    __in LPGUID Guid
-    )
-{
-    FilterBox* box = LookupBoxp( Guid );
-    if ( !box )
-    {
-        return NULL;
-    }
-
-    box->AddRef();
-    
-    return box;
-}
-
-FilterBox*
-FilterBoxList::CreateNewp (
-    __in LPGUID Guid
-    )
-{
-    ASSERT( Guid );
-
-    FilterBox* pFltBox = ( FilterBox* ) ExAllocatePoolWithTag(
-        PagedPool,
-        sizeof( FilterBox ),
-        FilterBox::m_AllocTag
-        );
-
-    if ( !pFltBox )
-    {
-        return NULL;
-    }
-
-    pFltBox->FilterBox::FilterBox( Guid );
-    pFltBox->AddRef();
-
-    InsertHeadList( &m_List, &pFltBox->m_List );
-
-    return pFltBox;
-}
-
-FilterBox*
-FilterBoxList::LookupBoxp (
-    __in LPGUID Guid
-    )
-{
-    ASSERT( Guid );
-
-    if ( IsListEmpty( &m_List ) )
-    {
-        return NULL;
-    }
-
-    FilterBox* pEntry = NULL;
-
-    PLIST_ENTRY Flink = m_List.Flink;
-    while ( Flink != &m_List )
-    {
-        pEntry = CONTAINING_RECORD(
-            Flink,
-            FilterBox,
-            m_List
-            );
-
-        Flink = Flink->Flink;
-
-        if ( IsEqualGUID( *Guid, pEntry->m_Guid ) )
-        {
-            return pEntry;
-        }
-    }
-
-    return NULL;
-}
+#include "../inc/commonkrnl.h"
+#include "../inc/memmgr.h"
+#include "fltchecks.h"
+#include "fltbox.h"
+#include "fltequ.h"
+#include "fltrange.h"
+#include "fltprefix.h"
+
+#include "fltbox.tmh"
+
+ULONG FilterBox::m_AllocTag = 'bfSA';
+
+#define FLT_BOX_NO_GROUP        0xff
+
+typedef struct _BoxFilterItem
+{
+    static ULONG        m_AllocTag;
+    LIST_ENTRY          m_List;
+    ULONG               m_Position;
+    ULONG               m_DataSize;     // value bytes as they came
+    ParamCheckEntry*    m_Param;
+} BoxFilterItem, *PBoxFilterItem;
+
+ULONG BoxFilterItem::m_AllocTag = 'ibSA';
+
+// compiled items of one parameter by the result they pass with
+typedef struct _BoxParamGroup
+{
+    ULONG               m_ParameterId;
+    FltBitmap           m_Found;        // value found by an index
+    FltBitmap           m_NotFound;     // negated - present and not found
+    FltBitmap           m_Absent;       // parameter is not queried
+} BoxParamGroup, *PBoxParamGroup;
+
+typedef struct _BoxMatcher
+{
+    _BoxMatcher()
+    {
+        m_Covered = 0;
+        m_GroupsCount = 0;
+        m_Groups = NULL;
+    }
+
+    ~_BoxMatcher()
+    {
+        if ( m_Groups )
+        {
+            delete[] m_Groups;
+        }
+    }
+
+    FilterEquIndex      m_Equ;          // check numbers are positions
+    FilterRangeIndex    m_Ranges;
+    PatternIndex        m_Patterns;
+    PrefixIndex         m_Prefixes;
+    ULONG               m_Covered;      // items below this position are compiled
+    FltBitmap           m_Compiled;
+    ULONG               m_GroupsCount;
+    PBoxParamGroup      m_Groups;
+} BoxMatcher, *PBoxMatcher;
+
+BOOLEAN
+IsBoxCompiledp (
+    __in ParamCheckEntry* Param
+    )
+{
+    return FilterEquIndex::IsIndexed( Param )
+        || FilterRangeIndex::IsIndexed( Param )
+        || PatternIndex::IsIndexed( Param )
+        || PrefixIndex::IsIndexed( Param );
+}
+
+void
+DestroyBoxMatcherp (
+    __in PVOID Matcher
+    )
+{
+    PBoxMatcher pMatcher = (PBoxMatcher) Matcher;
+
+    FREE_OBJECT( pMatcher );
+}
+
+FilterBox::FilterBox (
+    __in LPGUID Guid
+    )
+{
+    m_RefCount = 1;
+    m_Listed = TRUE;
+    m_Guid = *Guid;
+
+    m_PolicyBytes = 0;
+    m_ItemsBytes = 0;
+
+    FltInitializePushLock( &m_AccessLock );
+    m_NextFreePosition = 0;
+    
+    InitializeListHead( &m_Items );
+
+    m_Matcher = NULL;
+    m_CompilableItems = 0;
+    m_CompiledItems = 0;
+}
+
+FilterBox::~FilterBox (
+    )
+{
+    PBoxFilterItem pEntry = NULL;
+
+    PLIST_ENTRY Flink = m_Items.Flink;
+    while ( Flink != &m_Items )
+    {
+        pEntry = CONTAINING_RECORD(
+            Flink,
+            BoxFilterItem,
+            m_List
+            );
+
+        Flink = Flink->Flink;
+        RemoveEntryList( &pEntry->m_List );
+
+        FREE_OBJECT( pEntry->m_Param );
+        FREE_POOL( pEntry );
+    }
+
+    DestroyBoxMatcherp( m_Matcher );
+
+    FltDeletePushLock( &m_AccessLock );
+}
+
+__checkReturn
+NTSTATUS
+FilterBox::AddRef (
+    )
+{
+    // LookupBox runs without the lock - never revive a box being removed
+    for ( ; ; )
+    {
+        LONG refcount = m_RefCount;
+        if ( !refcount )
+        {
+            return STATUS_DELETE_PENDING;
+        }
+
+        if ( refcount == InterlockedCompareExchange( &m_RefCount, refcount + 1, refcount ) )
+        {
+            return STATUS_SUCCESS;
+        }
+    }
+}
+
+LONG
+FilterBox::Release (
+    )
+{
+    LONG refcount = InterlockedDecrement( &m_RefCount );
+
+    if ( refcount < 0 )
+    {
+        ASSERT( FALSE );
+        /// \todo CRASH!!!
+    }
+
+    // last reference - the list retires the box on the next write
+    return refcount;
+}
+
+__checkReturn
+NTSTATUS
+FilterBox::PrepareParams (
+    __in ULONG ParamsCount,
+    __in PFltParam Params,
+    __deref_out PBoxFilterItem* Item
+    )
+{
+    if ( !ParamsCount || !Params )
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if ( ParamsCount != 1 ) /// \todo fix allocation size next lines when switch to multiple params
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    NTSTATUS status = STATUS_UNSUCCESSFUL;
+
+    PBoxFilterItem fltitem = NULL;
+
+    __try
+    {
+        fltitem = ( PBoxFilterItem ) ExAllocatePoolWithTag(
+            PagedPool,
+            sizeof( BoxFilterItem ) + Params->m_Data.m_Size,
+            BoxFilterItem::m_AllocTag
+            );
+
+        if ( !fltitem )
+        {
+            status = STATUS_INSUFFICIENT_RESOURCES;
+            
+            __leave;
+        }
+
+        fltitem->m_DataSize = Params->m_Data.m_Size;
+        fltitem->m_Param = new (
+            PagedPool,
+            m_AllocTag
+            ) ParamCheckEntry;
+
+        if ( !fltitem->m_Param )
+        {
+            status = STATUS_INSUFFICIENT_RESOURCES;
+            
+            __leave;
+        }
+
+        fltitem->m_Param->m_Type = CheckEntryGeneric;
+        fltitem->m_Param->m_Flags = Params->m_Flags;
+    
+        fltitem->m_Param->Generic.m_Parameter = Params->m_ParameterId;
+        fltitem->m_Param->Generic.m_Operation = Params->m_Operation;
+    
+        // patterns of box items may come without count
+        status = fltitem->m_Param->Attach(
+            Params->m_Data.m_Size,
+            Params->m_Data.m_Count ? Params->m_Data.m_Count : 1,
+            Params->m_Data.m_Data
+            );
+    }
+    __finally
+    {
+        if ( !NT_SUCCESS( status ) )
+        {
+            if ( fltitem )
+            {
+                FREE_OBJECT( fltitem->m_Param );
+                FREE_POOL( fltitem );
+            }
+        }
+        else
+        {
+            *Item = fltitem;
+        }
+    }
+
+    return status;
+}
+
+void
+FilterBox::FreeParams (
+    __in PBoxFilterItem Item
+    )
+{
+    FREE_OBJECT( Item->m_Param );
+    FREE_POOL( Item );
+}
+
+ULONG
+FilterBox::InsertParams (
+    __in PBoxFilterItem Item
+    )
+{
+    FltRetired retired;
+    FltRetiredInit( &retired );
+
+    FltAcquirePushLockExclusive( &m_AccessLock );
+
+    Item->m_Position = m_NextFreePosition++;
+    Item->m_Param->m_CheckIdx = Item->m_Position;
+
+    // readers walk Flink without the lock - link filled item
+    Item->m_List.Flink = m_Items.Flink;
+    Item->m_List.Blink = &m_Items;
+
+    m_PolicyBytes += sizeof( FltParam ) + Item->m_DataSize;
+    m_ItemsBytes += sizeof( BoxFilterItem ) + sizeof( ParamCheckEntry )
+        + FIELD_OFFSET( FltCheckData, m_Data ) + 2 * Item->m_DataSize;
+
+    KeMemoryBarrier();
+
+    m_Items.Flink->Blink = &Item->m_List;
+    m_Items.Flink = &Item->m_List;
+
+    if ( IsBoxCompiledp( Item->m_Param ) )
+    {
+        m_CompilableItems++;
+        RebuildMatcherp( &retired );
+    }
+
+    FltReleasePushLock( &m_AccessLock );
+
+    FltRetiredRelease( &retired );
+
+    return Item->m_Position;
+}
+
+__checkReturn
+NTSTATUS
+AddBoxItemp (
+    __in PBoxMatcher Matcher,
+    __in ParamCheckEntry* Param,
+    __in ULONG Position,
+    __inout_ecount(PARAMETER_MAXIMUM + 1) PUCHAR GroupIdx
+    )
+{
+    ULONG parameter = Param->Generic.m_Parameter;
+    NTSTATUS status = STATUS_SUCCESS;
+
+    if ( FilterEquIndex::IsIndexed( Param ) )
+    {
+        status = Matcher->m_Equ.AddEntry( Param );
+    }
+    else if ( FilterRangeIndex::IsIndexed( Param ) )
+    {
+        status = Matcher->m_Ranges.Add( Param, Position );
+    }
+    else if ( PatternIndex::IsIndexed( Param ) )
+    {
+        status = Matcher->m_Patterns.Add( Param, Position );
+    }
+    else
+    {
+        status = Matcher->m_Prefixes.Add( Param, Position );
+    }
+
+    if ( !NT_SUCCESS( status ) )
+    {
+        return status;
+    }
+
+    if ( FLT_BOX_NO_GROUP == GroupIdx[ parameter ] )
+    {
+        GroupIdx[ parameter ] = (UCHAR) Matcher->m_GroupsCount++;
+
+        PBoxParamGroup pGroup = &Matcher->m_Groups[ GroupIdx[ parameter ] ];
+        pGroup->m_ParameterId = parameter;
+
+        status = pGroup->m_Found.Resize( Matcher->m_Covered );
+        if ( NT_SUCCESS( status ) )
+        {
+            status = pGroup->m_NotFound.Resize( Matcher->m_Covered );
+        }
+
+        if ( NT_SUCCESS( status ) )
+        {
+            status = pGroup->m_Absent.Resize( Matcher->m_Covered );
+        }
+
+        if ( !NT_SUCCESS( status ) )
+        {
+            return status;
+        }
+    }
+
+    // the same results as CheckEntryByResult gives
+    PBoxParamGroup pGroup = &Matcher->m_Groups[ GroupIdx[ parameter ] ];
+
+    if ( FlagOn( Param->m_Flags, FltFlags_Negation ) )
+    {
+        pGroup->m_NotFound.Set( Position );
+    }
+    else
+    {
+        pGroup->m_Found.Set( Position );
+
+        if ( !FlagOn( Param->m_Flags, FltFlags_BePresent ) )
+        {
+            pGroup->m_Absent.Set( Position );
+        }
+    }
+
+    Matcher->m_Compiled.Set( Position );
+
+    return STATUS_SUCCESS;
+}
+
+void
+FilterBox::RebuildMatcherp (
+    __inout PFltRetired Retired
+    )
+{
+    // items added after last build are checked one by one - rebuild when
+    // they are a quarter of compiled ones
+    if ( m_CompilableItems - m_CompiledItems < max( 1, m_CompiledItems / 4 ) )
+    {
+        return;
+    }
+
+    PBoxMatcher pMatcher = new ( PagedPool, m_AllocTag ) BoxMatcher;
+    if ( !pMatcher )
+    {
+        return;
+    }
+
+    pMatcher->m_Covered = m_NextFreePosition;
+
+    UCHAR groupidx[ PARAMETER_MAXIMUM + 1 ];
+    PARAMS_MASK params = 0;
+    ULONG groupscount = 0;
+
+    PBoxFilterItem pEntry = NULL;
+    NTSTATUS status = STATUS_SUCCESS;
+
+    RtlFillMemory( groupidx, sizeof( groupidx ), FLT_BOX_NO_GROUP );
+
+    PLIST_ENTRY Flink = m_Items.Flink;
+    while ( Flink != &m_Items )
+    {
+        pEntry = CONTAINING_RECORD( Flink, BoxFilterItem, m_List );
+        Flink = Flink->Flink;
+
+        if (
+            IsBoxCompiledp( pEntry->m_Param )
+            &&
+            !FlagOn( params, Id2Bit( pEntry->m_Param->Generic.m_Parameter ) )
+            )
+        {
+            SetFlag( params, Id2Bit( pEntry->m_Param->Generic.m_Parameter ) );
+            groupscount++;
+        }
+    }
+
+    __try
+    {
+        status = pMatcher->m_Compiled.Resize( pMatcher->m_Covered );
+        if ( !NT_SUCCESS( status ) )
+        {
+            __leave;
+        }
+
+        if ( groupscount )
+        {
+            pMatcher->m_Groups = new ( PagedPool, m_AllocTag ) BoxParamGroup[ groupscount ];
+            if ( !pMatcher->m_Groups )
+            {
+                status = STATUS_INSUFFICIENT_RESOURCES;
+                __leave;
+            }
+        }
+
+        Flink = m_Items.Flink;
+        while ( Flink != &m_Items )
+        {
+            pEntry = CONTAINING_RECORD( Flink, BoxFilterItem, m_List );
+            Flink = Flink->Flink;
+
+            if ( !IsBoxCompiledp( pEntry->m_Param ) )
+            {
+                continue;
+            }
+
+            status = AddBoxItemp( pMatcher, pEntry->m_Param, pEntry->m_Position, groupidx );
+            if ( !NT_SUCCESS( status ) )
+            {
+                __leave;
+            }
+        }
+
+        pMatcher->m_Ranges.Build();
+
+        status = pMatcher->m_Patterns.Build();
+        if ( !NT_SUCCESS( status ) )
+        {
+            __leave;
+        }
+
+        status = pMatcher->m_Prefixes.Build();
+    }
+    __finally
+    {
+        if ( !NT_SUCCESS( status ) )
+        {
+            // previous matcher is kept until next try
+            FREE_OBJECT( pMatcher );
+        }
+    }
+
+    if ( !pMatcher )
+    {
+        return;
+    }
+
+    PBoxMatcher pOldMatcher = m_Matcher;
+
+    KeMemoryBarrier();
+    m_Matcher = pMatcher;
+    m_CompiledItems = m_CompilableItems;
+
+    FltRetire( Retired, pOldMatcher, DestroyBoxMatcherp );
+}
+
+__checkReturn
+NTSTATUS
+MatchBoxMatcherp (
+    __in PBoxMatcher Matcher,
+    __in EventData *Event,
+    __in PRTL_BITMAP Affecting,
+    __out PBOOLEAN Affected
+    )
+{
+    FltHits found;
+    FltBitmap passed;
+
+    NTSTATUS status = found.Resize( Matcher->m_Covered );
+    if ( NT_SUCCESS( status ) )
+    {
+        status = passed.Resize( Matcher->m_Covered );
+    }
+
+    if ( !NT_SUCCESS( status ) )
+    {
+        return status;
+    }
+
+    // one query and one probe of every index per parameter
+    for ( ULONG idx = 0; idx < Matcher->m_GroupsCount; idx++ )
+    {
+        PBoxParamGroup pGroup = &Matcher->m_Groups[ idx ];
+        ULONG parameter = pGroup->m_ParameterId;
+
+        PVOID pData;
+        ULONG datasize;
+
+        if ( !NT_SUCCESS( Event->GetParameter( parameter, &pData, &datasize ) ) )
+        {
+            passed.Or( &pGroup->m_Absent );
+            continue;
+        }
+
+        Matcher->m_Equ.Probe( parameter, pData, datasize, &found );
+        Matcher->m_Ranges.Probe( parameter, pData, datasize, &found );
+
+        if ( Matcher->m_Patterns.Contains( parameter ) )
+        {
+            status = Matcher->m_Patterns.Match( parameter, pData, datasize, &found );
+        }
+
+        if ( NT_SUCCESS( status ) && Matcher->m_Prefixes.Contains( parameter ) )
+        {
+            status = Matcher->m_Prefixes.Match( parameter, pData, datasize, &found );
+        }
+
+        if ( !NT_SUCCESS( status ) )
+        {
+            return status;
+        }
+
+        passed.OrMasked( &found, &pGroup->m_Found, FALSE );
+        passed.OrMasked( &found, &pGroup->m_NotFound, TRUE );
+    }
+
+    *Affected = Matcher->m_Compiled.Intersects( Affecting );
+
+    return passed.Intersects( Affecting ) ? STATUS_SUCCESS : STATUS_UNSUCCESSFUL;
+}
+
+NTSTATUS
+FilterBox::MatchEvent (
+    __in EventData *Event,
+    __in PRTL_BITMAP Affecting
+    )
+{
+    /// \todo   -        
+    //        
+    PBoxMatcher pMatcher = m_Matcher;
+
+    if ( IsListEmpty( &m_Items ) )
+    {
+        return STATUS_SUCCESS;
+    }
+
+    // box without affecting items does not restrict the event
+    BOOLEAN bAffected = FALSE;
+    ULONG covered = 0;
+
+    if ( pMatcher )
+    {
+        NTSTATUS status = MatchBoxMatcherp( pMatcher, Event, Affecting, &bAffected );
+        if ( NT_SUCCESS( status ) )
+        {
+            return STATUS_SUCCESS;
+        }
+
+        if ( STATUS_UNSUCCESSFUL == status )
+        {
+            covered = pMatcher->m_Covered;
+        }
+        else
+        {
+            // no memory - every item is checked
+            bAffected = FALSE;
+        }
+    }
+
+    PBoxFilterItem pEntry = NULL;
+
+    PLIST_ENTRY Flink = m_Items.Flink;
+    while ( Flink != &m_Items )
+    {
+        pEntry = CONTAINING_RECORD(
+            Flink,
+            BoxFilterItem,
+            m_List
+            );
+
+        Flink = Flink->Flink;
+
+        if ( pEntry->m_Position < covered && IsBoxCompiledp( pEntry->m_Param ) )
+        {
+            continue;
+        }
+
+        if ( pEntry->m_Position > Affecting->SizeOfBitMap )
+        {
+            __debugbreak(); //nct
+            continue;
+        }
+
+        if ( !RtlCheckBit( Affecting, pEntry->m_Position ) )
+        {
+            continue;
+        }
+
+        bAffected = TRUE;
+
+        if ( NT_SUCCESS( CheckEntry( pEntry->m_Param, Event ) ) )
+        {
+            return STATUS_SUCCESS;
+        }
+    }
+
+    return bAffected ? STATUS_UNSUCCESSFUL : STATUS_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+ULONG FilterBoxList::m_AllocTag = 'btSA';
+
+void
+DestroyBoxp (
+    __in PVOID Box
+    )
+{
+    FilterBox* pBox = (FilterBox*) Box;
+
+    pBox->FilterBox::~FilterBox();
+    ExFreePool( pBox );
+}
+
+FilterBoxList::FilterBoxList (
+    )
+{
+    FltInitializePushLock( &m_AccessLock );
+    m_Table = NULL;
+
+    m_Boxes = 0;
+    m_PolicyBytes = 0;
+}
+
+FilterBoxList::~FilterBoxList (
+    )
+{
+    FltDeletePushLock( &m_AccessLock );
+
+    PBoxTable pTable = m_Table;
+    if ( !pTable )
+    {
+        return;
+    }
+
+    for ( ULONG slot = 0; slot < pTable->m_SlotsCount; slot++ )
+    {
+        FilterBox* pEntry = pTable->m_Slots[ slot ];
+        if ( !pEntry || FLT_BOX_REMOVED == pEntry )
+        {
+            continue;
+        }
+
+        ASSERT( !pEntry->m_RefCount );
+        DestroyBoxp( pEntry );
+    }
+
+    ExFreePool( pTable );
+}
+
+__checkReturn
+NTSTATUS
+FilterBoxList::GetOrCreateBox (
+    __in LPGUID Guid,
+    __deref_out_opt PFilterBox* FltBox,
+    __out PBOOLEAN Listed
+    )
+{
+    ASSERT( Guid );
+
+    NTSTATUS status = STATUS_UNSUCCESSFUL;
+    FilterBox* fltbox = NULL;
+    BOOLEAN listed = FALSE;
+
+    FltRetired retired;
+    FltRetiredInit( &retired );
+
+    FltAcquirePushLockExclusive( &m_AccessLock );
+
+    __try
+    {
+        ULONG slot = m_Table ? LookupBoxp( m_Table, Guid ) : FLT_BOX_NO_SLOT;
+        if ( FLT_BOX_NO_SLOT != slot )
+        {
+            fltbox = m_Table->m_Slots[ slot ];
+
+            status = fltbox->AddRef();
+            if ( NT_SUCCESS( status ) )
+            {
+                // released box still referenced by filters is listed again
+                if ( !fltbox->m_Listed )
+                {
+                    status = fltbox->AddRef();
+                    ASSERT( NT_SUCCESS( status ) );
+
+                    fltbox->m_Listed = TRUE;
+                    listed = TRUE;
+                }
+
+                __leave;
+            }
+
+            // no references left - new box takes the GUID
+            Removep( slot, &retired );
+            fltbox = NULL;
+        }
+
+        status = Reservep( &retired );
+        if ( !NT_SUCCESS( status ) )
+        {
+            __leave;
+        }
+
+        fltbox = CreateNewp( Guid );
+        if ( !fltbox )
+        {
+            status = STATUS_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+
+        // reference of the caller, list keeps the initial one
+        status = fltbox->AddRef();
+        ASSERT( NT_SUCCESS( status ) );
+
+        Insertp( fltbox );
+        listed = TRUE;
+    }
+    __finally
+    {
+        FltReleasePushLock( &m_AccessLock );
+    }
+
+    // readers do not take the lock, grace period is waited outside of it
+    FltRetiredRelease( &retired );
+
+    if ( NT_SUCCESS( status ) )
+    {
+        *FltBox = fltbox;
+        *Listed = listed;
+    }
+
+    return status;
+}
+
+__checkReturn
+NTSTATUS
+FilterBoxList::DetachBox (
+    __in LPGUID Guid,
+    __deref_out_opt PFilterBox* FltBox
+    )
+{
+    ASSERT( Guid );
+
+    NTSTATUS status = STATUS_NOT_FOUND;
+
+    FltRetired retired;
+    FltRetiredInit( &retired );
+
+    FltAcquirePushLockExclusive( &m_AccessLock );
+
+    __try
+    {
+        ULONG slot = m_Table ? LookupBoxp( m_Table, Guid ) : FLT_BOX_NO_SLOT;
+        if ( FLT_BOX_NO_SLOT == slot )
+        {
+            __leave;
+        }
+
+        FilterBox* pBox = m_Table->m_Slots[ slot ];
+
+        // reference of the list is taken once, references of filters
+        // are never taken here
+        if ( pBox->m_Listed )
+        {
+            pBox->m_Listed = FALSE;
+            *FltBox = pBox;
+            status = STATUS_SUCCESS;
+
+            __leave;
+        }
+
+        if ( !pBox->m_RefCount )
+        {
+            Removep( slot, &retired );
+        }
+    }
+    __finally
+    {
+        FltReleasePushLock( &m_AccessLock );
+    }
+
+    FltRetiredRelease( &retired );
+
+    return status;
+}
+
+void
+FilterBoxList::AttachBox (
+    __in FilterBox* Box
+    )
+{
+    FltAcquirePushLockExclusive( &m_AccessLock );
+
+    ASSERT( !Box->m_Listed );
+    Box->m_Listed = TRUE;
+
+    FltReleasePushLock( &m_AccessLock );
+}
+
+ULONG
+FilterBoxList::InsertParams (
+    __in FilterBox* Box,
+    __in PBoxFilterItem Item
+    )
+{
+    LONG64 policybytes = Box->m_PolicyBytes;
+
+    ULONG position = Box->InsertParams( Item );
+
+    // removed box takes its bytes along
+    FltAcquirePushLockExclusive( &m_AccessLock );
+
+    m_PolicyBytes += Box->m_PolicyBytes - policybytes;
+
+    FltReleasePushLock( &m_AccessLock );
+
+    return position;
+}
+
+void
+FilterBoxList::DropBox (
+    __in FilterBox* Box
+    )
+{
+    FltRetired retired;
+    FltRetiredInit( &retired );
+
+    FltAcquirePushLockExclusive( &m_AccessLock );
+
+    if ( !Box->Release() )
+    {
+        ULONG slot = LookupBoxp( m_Table, &Box->m_Guid );
+        if ( FLT_BOX_NO_SLOT != slot && Box == m_Table->m_Slots[ slot ] )
+        {
+            Removep( slot, &retired );
+        }
+    }
+
+    FltReleasePushLock( &m_AccessLock );
+
+    FltRetiredRelease( &retired );
+}
+
+FilterBox*
+FilterBoxList::LookupBox (
+    __in LPGUID Guid
+    )
+{
+    ASSERT( Guid );
+
+    FilterBox* box = NULL;
+
+    // table and boxes are freed after grace period
+    FltEpochToken token;
+    FltEpochEnter( &token );
+
+    PBoxTable pTable = m_Table;
+    if ( pTable )
+    {
+        ULONG slot = LookupBoxp( pTable, Guid );
+        if ( FLT_BOX_NO_SLOT != slot )
+        {
+            // slot may be removed by writer meanwhile
+            box = pTable->m_Slots[ slot ];
+            if ( FLT_BOX_REMOVED == box || !NT_SUCCESS( box->AddRef() ) )
+            {
+                box = NULL;
+            }
+        }
+    }
+
+    FltEpochLeave( &token );
+
+    return box;
+}
+
+void
+FilterBoxList::QueryCharge (
+    __out PULONG Boxes,
+    __out PLONG64 PolicyBytes
+    )
+{
+    *Boxes = m_Boxes;
+    *PolicyBytes = m_PolicyBytes;
+}
+
+void
+FilterBoxList::QueryMemory (
+    __out PLONG64 MemoryBytes
+    )
+{
+    *MemoryBytes = 0;
+
+    FltAcquirePushLockShared( &m_AccessLock );
+
+    PBoxTable pTable = m_Table;
+    if ( pTable )
+    {
+        *MemoryBytes = FIELD_OFFSET( BoxTable, m_Slots )
+            + sizeof( FilterBox* ) * pTable->m_SlotsCount;
+
+        for ( ULONG slot = 0; slot < pTable->m_SlotsCount; slot++ )
+        {
+            FilterBox* pBox = pTable->m_Slots[ slot ];
+            if ( !pBox || FLT_BOX_REMOVED == pBox )
+            {
+                continue;
+            }
+
+            *MemoryBytes += sizeof( FilterBox ) + pBox->m_ItemsBytes;
+        }
+    }
+
+    FltReleasePushLock( &m_AccessLock );
+}
+
+ULONG
+FilterBoxList::GetHash (
+    __in LPGUID Guid
+    )
+{
+    // FNV-1a
+    ULONG hash = 2166136261;
+    PUCHAR ptr = (PUCHAR) Guid;
+
+    for ( ULONG idx = 0; idx < sizeof( GUID ); idx++ )
+    {
+        hash ^= ptr[ idx ];
+        hash *= 16777619;
+    }
+
+    return hash;
+}
+
+FilterBox*
+FilterBoxList::CreateNewp (
+    __in LPGUID Guid
+    )
+{
+    ASSERT( Guid );
+
+    FilterBox* pFltBox = ( FilterBox* ) ExAllocatePoolWithTag(
+        PagedPool,
+        sizeof( FilterBox ),
+        FilterBox::m_AllocTag
+        );
+
+    if ( !pFltBox )
+    {
+        return NULL;
+    }
+
+    new ( pFltBox ) FilterBox( Guid );
+
+    return pFltBox;
+}
+
+ULONG
+FilterBoxList::LookupBoxp (
+    __in PBoxTable Table,
+    __in LPGUID Guid
+    )
+{
+    ASSERT( Guid );
+
+    ULONG mask = Table->m_SlotsCount - 1;
+    ULONG slot = GetHash( Guid ) & mask;
+
+    // table always has free slots
+    for ( ; ; )
+    {
+        FilterBox* pEntry = Table->m_Slots[ slot ];
+        if ( !pEntry )
+        {
+            break;
+        }
+
+        if ( FLT_BOX_REMOVED != pEntry && IsEqualGUID( *Guid, pEntry->m_Guid ) )
+        {
+            return slot;
+        }
+
+        slot = ( slot + 1 ) & mask;
+    }
+
+    return FLT_BOX_NO_SLOT;
+}
+
+__checkReturn
+NTSTATUS
+FilterBoxList::Reservep (
+    __inout PFltRetired Retired
+    )
+{
+    PBoxTable pTable = m_Table;
+    if ( pTable && ( pTable->m_Used + 1 ) * 2 <= pTable->m_SlotsCount )
+    {
+        return STATUS_SUCCESS;
+    }
+
+    ULONG count = 0;
+    ULONG dropped = 0;
+    if ( pTable )
+    {
+        for ( ULONG slot = 0; slot < pTable->m_SlotsCount; slot++ )
+        {
+            FilterBox* pEntry = pTable->m_Slots[ slot ];
+            if ( !pEntry || FLT_BOX_REMOVED == pEntry )
+            {
+                continue;
+            }
+
+            if ( pEntry->m_RefCount )
+            {
+                count++;
+            }
+            else
+            {
+                dropped++;
+            }
+        }
+    }
+
+    // dropped boxes and the old table
+    NTSTATUS status = FltRetiredReserve( Retired, dropped + 1 );
+    if ( !NT_SUCCESS( status ) )
+    {
+        return status;
+    }
+
+    // new table is filled up to a quarter
+    ULONG slotscount = FLT_BOX_MIN_SLOTS;
+    while ( slotscount < ( count + 1 ) * 4 )
+    {
+        slotscount *= 2;
+    }
+
+    PBoxTable pNewTable = (PBoxTable) ExAllocatePoolWithTag(
+        PagedPool,
+        FIELD_OFFSET( BoxTable, m_Slots ) + sizeof( FilterBox* ) * slotscount,
+        m_AllocTag
+        );
+
+    if ( !pNewTable )
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    pNewTable->m_SlotsCount = slotscount;
+    pNewTable->m_Used = 0;
+
+    RtlZeroMemory( (PVOID) pNewTable->m_Slots, sizeof( FilterBox* ) * slotscount );
+
+    // rehash into the new table, readers still walk the old one.
+    // Boxes without references are dropped
+    if ( pTable )
+    {
+        for ( ULONG slot = 0; slot < pTable->m_SlotsCount; slot++ )
+        {
+            FilterBox* pEntry = pTable->m_Slots[ slot ];
+            if ( !pEntry || FLT_BOX_REMOVED == pEntry )
+            {
+                continue;
+            }
+
+            if ( !pEntry->m_RefCount )
+            {
+                RetireBoxp( pEntry, Retired );
+                continue;
+            }
+
+            ULONG mask = slotscount - 1;
+            ULONG newslot = GetHash( &pEntry->m_Guid ) & mask;
+            while ( pNewTable->m_Slots[ newslot ] )
+            {
+                newslot = ( newslot + 1 ) & mask;
+            }
+
+            pNewTable->m_Slots[ newslot ] = pEntry;
+            pNewTable->m_Used++;
+        }
+    }
+
+    KeMemoryBarrier();
+    m_Table = pNewTable;
+
+    FltRetire( Retired, pTable, NULL );
+
+    return STATUS_SUCCESS;
+}
+
+void
+FilterBoxList::Insertp (
+    __in FilterBox* Box
+    )
+{
+    PBoxTable pTable = m_Table;
+
+    ASSERT( pTable );
+    ASSERT( ( pTable->m_Used + 1 ) * 2 <= pTable->m_SlotsCount );
+
+    ULONG mask = pTable->m_SlotsCount - 1;
+    ULONG slot = GetHash( &Box->m_Guid ) & mask;
+
+    // removed slots are not reused, probe chains of readers stay intact
+    while ( pTable->m_Slots[ slot ] )
+    {
+        slot = ( slot + 1 ) & mask;
+    }
+
+    // box is constructed before it is visible
+    KeMemoryBarrier();
+    pTable->m_Slots[ slot ] = Box;
+    pTable->m_Used++;
+
+    m_Boxes++;
+    m_PolicyBytes += Box->m_PolicyBytes;
+}
+
+void
+FilterBoxList::Removep (
+    __in ULONG Slot,
+    __inout PFltRetired Retired
+    )
+{
+    PBoxTable pTable = m_Table;
+    FilterBox* pEntry = pTable->m_Slots[ Slot ];
+
+    ASSERT( pEntry && FLT_BOX_REMOVED != pEntry );
+
+    pTable->m_Slots[ Slot ] = FLT_BOX_REMOVED;
+
+    RetireBoxp( pEntry, Retired );
+}
+
+void
+FilterBoxList::RetireBoxp (
+    __in FilterBox* Box,
+    __inout PFltRetired Retired
+    )
+{
+    m_Boxes--;
+    m_PolicyBytes -= Box->m_PolicyBytes;
+
+    FltRetire( Retired, Box, DestroyBoxp );
+}
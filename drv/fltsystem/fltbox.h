@@ -1,93 +1,225 @@
-#pragma once
-
-#include "../inc/fltevents.h"
-
-class FilterBox
-{
-public:
-    static ULONG    m_AllocTag;
-
-public:
-    FilterBox (
-        __in LPGUID Guid
-        );
-
-    ~FilterBox();
-
-    __checkReturn
-    NTSTATUS
-    AddRef();
-
-    void
-    Release();
-
-    __checkReturn
-    NTSTATUS
-    AddParams (
-        __in ULONG ParamsCount,
-        __in PFltParam Params,
-        __out PULONG Position
-        );
-
-    NTSTATUS
-    MatchEvent (
-        __in EventData *Event,
-        __in PRTL_BITMAP Affecting
-        );
-
-public:
-    LIST_ENTRY      m_List;
-    LONG            m_RefCount;
-    GUID            m_Guid;
-
-private:
-    ULONG           m_NextFreePosition;
-
-    LIST_ENTRY      m_Items;
-};
-
-#define PFilterBox FilterBox*
-
-//////////////////////////////////////////////////////////////////////////
-
-class FilterBoxList
-{
-public:
-    FilterBoxList();
-    ~FilterBoxList();
-
-    __checkReturn
-    NTSTATUS
-    GetOrCreateBox (
-        __in LPGUID Guid,
-        __deref_out_opt PFilterBox* FltBox
-        );
-
-    __checkReturn
-    NTSTATUS
-    ReleaseBox (
-        __in LPGUID Guid
-    );
-
-    FilterBox*
-    LookupBox (
-        __in LPGUID Guid
-        );
-
-private:
-    FilterBox*
-    CreateNewp (
-        __in LPGUID Guid
-        );
-
-    FilterBox*
-    LookupBoxp (
-        __in LPGUID Guid
-        );
-
-private:
-    EX_PUSH_LOCK    m_AccessLock;
-    LIST_ENTRY      m_List;
-};
-
-#define PFilterBoxList FilterBoxList*
+#pragma once
+
+#include "../inc/fltevents.h"
+#include "fltpattern.h"
+#include "fltepoch.h"
+
+struct _BoxMatcher;
+
+class FilterBox
+{
+public:
+    static ULONG    m_AllocTag;
+
+public:
+    FilterBox (
+        __in LPGUID Guid
+        );
+
+    ~FilterBox();
+
+    // fails when the last reference is gone - box is being removed
+    __checkReturn
+    NTSTATUS
+    AddRef();
+
+    // returns references left
+    LONG
+    Release();
+
+    // item is built apart from any box, InsertParams links it
+    static
+    __checkReturn
+    NTSTATUS
+    PrepareParams (
+        __in ULONG ParamsCount,
+        __in PFltParam Params,
+        __deref_out struct _BoxFilterItem** Item
+        );
+
+    static
+    void
+    FreeParams (
+        __in struct _BoxFilterItem* Item
+        );
+
+    // returns position of the item
+    ULONG
+    InsertParams (
+        __in struct _BoxFilterItem* Item
+        );
+
+    // caller is inside of epoch section, items are walked without the lock.
+    // Compiled items are probed once per parameter, result is intersected
+    // with Affecting by words
+    NTSTATUS
+    MatchEvent (
+        __in EventData *Event,
+        __in PRTL_BITMAP Affecting
+        );
+
+public:
+    volatile LONG   m_RefCount;
+    BOOLEAN         m_Listed;           // list holds a reference, under list lock
+    GUID            m_Guid;
+
+    // items added, writers only
+    LONG64          m_PolicyBytes;      // params as they came
+    LONG64          m_ItemsBytes;       // items with check entries
+
+private:
+    void
+    RebuildMatcherp (
+        __inout PFltRetired Retired
+        );
+
+private:
+    EX_PUSH_LOCK    m_AccessLock;       // writers only
+    ULONG           m_NextFreePosition;
+
+    LIST_ENTRY      m_Items;            // newest first, never shrinks
+
+    struct _BoxMatcher* volatile m_Matcher;
+    ULONG           m_CompilableItems;
+    ULONG           m_CompiledItems;    // items in m_Matcher
+};
+
+#define PFilterBox FilterBox*
+
+//////////////////////////////////////////////////////////////////////////
+
+#define FLT_BOX_MIN_SLOTS       16
+#define FLT_BOX_NO_SLOT         ( (ULONG) -1 )
+#define FLT_BOX_REMOVED         ( (FilterBox*) 1 )
+
+// open addressing by GUID hash, load is kept under a half
+typedef struct _BoxTable
+{
+    ULONG                   m_SlotsCount;   // power of 2
+    ULONG                   m_Used;         // boxes and removed slots
+    FilterBox* volatile     m_Slots[1];
+} BoxTable, *PBoxTable;
+
+//!
+//    \description - boxes by GUID. LookupBox runs without the lock inside
+//                   of epoch section: a slot is filled once and only turns
+//                   into FLT_BOX_REMOVED, table grows into a new allocation.
+//                   Boxes without references stay in the table until the
+//                   next writer finds them and retires them.
+//!
+
+class FilterBoxList
+{
+public:
+    static ULONG    m_AllocTag;
+
+public:
+    FilterBoxList();
+    ~FilterBoxList();
+
+    // Listed - reference of the list is taken by this call
+    __checkReturn
+    NTSTATUS
+    GetOrCreateBox (
+        __in LPGUID Guid,
+        __deref_out_opt PFilterBox* FltBox,
+        __out PBOOLEAN Listed
+        );
+
+    // reference of the list moves to the caller, AttachBox returns it
+    // and DropBox releases it
+    __checkReturn
+    NTSTATUS
+    DetachBox (
+        __in LPGUID Guid,
+        __deref_out_opt PFilterBox* FltBox
+        );
+
+    void
+    AttachBox (
+        __in FilterBox* Box
+        );
+
+    // box without references is removed at once
+    void
+    DropBox (
+        __in FilterBox* Box
+        );
+
+    // item of a box taken from the list, charged to the list. Returns
+    // position of the item
+    ULONG
+    InsertParams (
+        __in FilterBox* Box,
+        __in struct _BoxFilterItem* Item
+        );
+
+    FilterBox*
+    LookupBox (
+        __in LPGUID Guid
+        );
+
+    // boxes of the table and their items, removed ones are not counted
+    void
+    QueryCharge (
+        __out PULONG Boxes,
+        __out PLONG64 PolicyBytes
+        );
+
+    // walks the table
+    void
+    QueryMemory (
+        __out PLONG64 MemoryBytes
+        );
+
+private:
+    static
+    ULONG
+    GetHash (
+        __in LPGUID Guid
+        );
+
+    FilterBox*
+    CreateNewp (
+        __in LPGUID Guid
+        );
+
+    ULONG
+    LookupBoxp (
+        __in PBoxTable Table,
+        __in LPGUID Guid
+        );
+
+    __checkReturn
+    NTSTATUS
+    Reservep (
+        __inout PFltRetired Retired
+        );
+
+    void
+    Insertp (
+        __in FilterBox* Box
+        );
+
+    void
+    Removep (
+        __in ULONG Slot,
+        __inout PFltRetired Retired
+        );
+
+    void
+    RetireBoxp (
+        __in FilterBox* Box,
+        __inout PFltRetired Retired
+        );
+
+private:
+    EX_PUSH_LOCK        m_AccessLock;   // writers only
+    PBoxTable volatile  m_Table;
+
+    // kept by writers, they all run under the storage lock
+    ULONG               m_Boxes;
+    LONG64              m_PolicyBytes;
+};
+
+#define PFilterBoxList FilterBoxList*
@@ -0,0 +1,414 @@
+#include "../inc/commonkrnl.h"
+#include "../inc/memmgr.h"
+#include "fltcache.h"
+
+ULONG FltVerdictCache::m_AllocTag = 'cvSA';
+
+#define FLT_CACHE_FNV_BASIS     2166136261
+#define FLT_CACHE_FNV_PRIME     16777619
+
+ULONG
+FltCacheHashp (
+    __in ULONG Hash,
+    __in PVOID Data,
+    __in ULONG Size
+    )
+{
+    PUCHAR pData = (PUCHAR) Data;
+    for ( ULONG idx = 0; idx < Size; idx++ )
+    {
+        Hash = ( Hash ^ pData[ idx ] ) * FLT_CACHE_FNV_PRIME;
+    }
+
+    return Hash;
+}
+
+FltVerdictCache::FltVerdictCache (
+    )
+{
+    RtlZeroMemory( m_Counters, sizeof( m_Counters ) );
+    RtlZeroMemory( m_Entries, sizeof( m_Entries ) );
+}
+
+FltVerdictCache::~FltVerdictCache (
+    )
+{
+}
+
+__checkReturn
+BOOLEAN
+FltVerdictCache::BuildKey (
+    __in EventData* Event,
+    __in PARAMS_MASK Params,
+    __out PFltCacheKey Key
+    )
+{
+    Key->m_Ids[0] = Event->GetInterceptorId();
+    Key->m_Ids[1] = Event->GetOperationId();
+    Key->m_Ids[2] = Event->GetMinor();
+    Key->m_Ids[3] = Event->GetOperationType();
+    Key->m_Count = 0;
+    Key->m_Size = sizeof( Key->m_Ids );
+    Key->m_Hash = FltCacheHashp( FLT_CACHE_FNV_BASIS, Key->m_Ids, sizeof( Key->m_Ids ) );
+
+    for ( ULONG id = 0; id < _PARAMS_COUNT && Params; id++ )
+    {
+        if ( !( Params & Id2Bit( id ) ) )
+        {
+            continue;
+        }
+
+        Params &= ~Id2Bit( id );
+
+        if ( Key->m_Count == FLT_CACHE_CHUNKS )
+        {
+            return FALSE;
+        }
+
+        PFltCacheChunk pChunk = &Key->m_Chunks[ Key->m_Count++ ];
+        pChunk->m_ParameterId = id;
+
+        // absent parameter is a part of the key as well
+        NTSTATUS status = Event->GetParameter( id, &pChunk->m_Data, &pChunk->m_Size );
+        if ( !NT_SUCCESS( status ) )
+        {
+            pChunk->m_Data = NULL;
+            pChunk->m_Size = FLT_CACHE_ABSENT;
+        }
+
+        Key->m_Hash = FltCacheHashp( Key->m_Hash, &pChunk->m_ParameterId, sizeof( ULONG ) );
+        Key->m_Hash = FltCacheHashp( Key->m_Hash, &pChunk->m_Size, sizeof( ULONG ) );
+        Key->m_Size += 2 * sizeof( ULONG );
+
+        if ( pChunk->m_Data )
+        {
+            if ( pChunk->m_Size > FLT_CACHE_KEY_MAX )
+            {
+                return FALSE;
+            }
+
+            Key->m_Hash = FltCacheHashp( Key->m_Hash, pChunk->m_Data, pChunk->m_Size );
+            Key->m_Size += pChunk->m_Size;
+        }
+
+        if ( Key->m_Size > FLT_CACHE_KEY_MAX )
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+__checkReturn
+BOOLEAN
+FltVerdictCache::Lookup (
+    __in PFltCacheKey Key,
+    __in LONG Generation,
+    __in EventData* Event,
+    __out PVERDICT Verdict,
+    __out PPARAMS_MASK ParamsMask
+    )
+{
+    PFltCacheEntry pEntries = &m_Entries[ ( Key->m_Hash % FLT_CACHE_SETS ) * FLT_CACHE_WAYS ];
+
+    VERDICT verdict = VERDICT_NOT_FILTERED;
+    PARAMS_MASK mask = 0;
+    ULONG itemscount = 0;
+    AggregationItem items[ FLT_CACHE_GROUPS ];
+
+    BOOLEAN bFound = FALSE;
+
+    for ( ULONG way = 0; way < FLT_CACHE_WAYS && !bFound; way++ )
+    {
+        PFltCacheEntry pEntry = &pEntries[ way ];
+
+        LONG sequence = pEntry->m_Sequence;
+        if ( ( sequence & 1 ) || pEntry->m_Hash != Key->m_Hash )
+        {
+            continue;
+        }
+
+        // data is read after the sequence
+        KeMemoryBarrier();
+
+        if ( !IsKeyEqualp( Key, pEntry ) || pEntry->m_Generation != Generation )
+        {
+            continue;
+        }
+
+        verdict = pEntry->m_Verdict;
+        mask = pEntry->m_ParamsMask;
+        itemscount = pEntry->m_ItemsCount;
+
+        if ( itemscount > FLT_CACHE_GROUPS )
+        {
+            // torn read
+            continue;
+        }
+
+        RtlCopyMemory( items, pEntry->m_Items, sizeof( AggregationItem ) * itemscount );
+
+        KeMemoryBarrier();
+
+        if ( sequence != pEntry->m_Sequence )
+        {
+            continue;
+        }
+
+        if ( !pEntry->m_Referenced )
+        {
+            pEntry->m_Referenced = TRUE;
+        }
+
+        bFound = TRUE;
+    }
+
+    if ( bFound && itemscount )
+    {
+        NTSTATUS status = Event->m_Aggregator.Allocate( itemscount );
+        if ( !NT_SUCCESS( status ) )
+        {
+            bFound = FALSE;
+        }
+
+        for ( ULONG idx = 0; idx < itemscount && bFound; idx++ )
+        {
+            status = Event->m_Aggregator.PlaceValue(
+                idx,
+                items[ idx ].m_FilterId,
+                items[ idx ].m_Verdict
+                );
+
+            ASSERT( NT_SUCCESS( status ) );
+        }
+    }
+
+    PFltCacheCounters pCounters = GetCountersp();
+
+    if ( !bFound )
+    {
+        InterlockedExchangeAdd64( &pCounters->m_Misses, 1 );
+
+        return FALSE;
+    }
+
+    InterlockedExchangeAdd64( &pCounters->m_Hits, 1 );
+
+    // no match - GetVerdict leaves the mask as is
+    *Verdict = verdict;
+    if ( VERDICT_NOT_FILTERED != verdict )
+    {
+        *ParamsMask = mask;
+    }
+
+    return TRUE;
+}
+
+void
+FltVerdictCache::Insert (
+    __in PFltCacheKey Key,
+    __in LONG Generation,
+    __in EventData* Event,
+    __in VERDICT Verdict,
+    __in PARAMS_MASK ParamsMask
+    )
+{
+    ULONG itemscount = Event->m_Aggregator.GetCount();
+    if ( itemscount > FLT_CACHE_GROUPS )
+    {
+        CountBypass();
+
+        return;
+    }
+
+    PFltCacheEntry pEntries = &m_Entries[ ( Key->m_Hash % FLT_CACHE_SETS ) * FLT_CACHE_WAYS ];
+    PFltCacheEntry pVictim = NULL;
+
+    // same key (other thread was first), empty or stale entry
+    for ( ULONG way = 0; way < FLT_CACHE_WAYS; way++ )
+    {
+        PFltCacheEntry pEntry = &pEntries[ way ];
+
+        if (
+            !pEntry->m_KeySize
+            ||
+            pEntry->m_Generation != Generation
+            ||
+            ( pEntry->m_Hash == Key->m_Hash && pEntry->m_KeySize == Key->m_Size )
+            )
+        {
+            pVictim = pEntry;
+            break;
+        }
+    }
+
+    BOOLEAN bEvicted = FALSE;
+
+    if ( !pVictim )
+    {
+        // clock - entry without hits since previous scan
+        for ( ULONG way = 0; way < FLT_CACHE_WAYS; way++ )
+        {
+            PFltCacheEntry pEntry = &pEntries[ way ];
+
+            if ( !pEntry->m_Referenced )
+            {
+                pVictim = pEntry;
+                break;
+            }
+
+            pEntry->m_Referenced = FALSE;
+        }
+
+        if ( !pVictim )
+        {
+            pVictim = &pEntries[ ( Key->m_Hash >> 16 ) % FLT_CACHE_WAYS ];
+        }
+
+        bEvicted = TRUE;
+    }
+
+    LONG sequence = pVictim->m_Sequence;
+    if (
+        ( sequence & 1 )
+        ||
+        sequence != InterlockedCompareExchange( &pVictim->m_Sequence, sequence + 1, sequence )
+        )
+    {
+        // other writer owns the entry - skip, next miss retries
+        return;
+    }
+
+    pVictim->m_Generation = Generation;
+    pVictim->m_Hash = Key->m_Hash;
+    pVictim->m_KeySize = Key->m_Size;
+    pVictim->m_Referenced = FALSE;
+    pVictim->m_Verdict = Verdict;
+    pVictim->m_ParamsMask = ParamsMask;
+    pVictim->m_ItemsCount = itemscount;
+
+    for ( ULONG idx = 0; idx < itemscount; idx++ )
+    {
+        pVictim->m_Items[ idx ].m_FilterId = Event->m_Aggregator.GetFilterId( idx );
+        pVictim->m_Items[ idx ].m_Verdict = Event->m_Aggregator.GetVerdict( idx );
+    }
+
+    CopyKeyp( Key, pVictim );
+
+    KeMemoryBarrier();
+    InterlockedIncrement( &pVictim->m_Sequence );
+
+    if ( bEvicted )
+    {
+        InterlockedExchangeAdd64( &GetCountersp()->m_Evictions, 1 );
+    }
+}
+
+void
+FltVerdictCache::CountBypass (
+    )
+{
+    InterlockedExchangeAdd64( &GetCountersp()->m_Bypassed, 1 );
+}
+
+void
+FltVerdictCache::QueryStatistics (
+    __out PFltCacheStatistics Statistics
+    )
+{
+    RtlZeroMemory( Statistics, sizeof( FltCacheStatistics ) );
+
+    for ( ULONG idx = 0; idx < FLT_CACHE_STRIPES; idx++ )
+    {
+        Statistics->m_Hits += m_Counters[ idx ].m_Hits;
+        Statistics->m_Misses += m_Counters[ idx ].m_Misses;
+        Statistics->m_Evictions += m_Counters[ idx ].m_Evictions;
+        Statistics->m_Bypassed += m_Counters[ idx ].m_Bypassed;
+    }
+}
+
+PFltCacheCounters
+FltVerdictCache::GetCountersp (
+    )
+{
+    // interlocked on a line shared by one processor only
+    return &m_Counters[ KeGetCurrentProcessorNumber() % FLT_CACHE_STRIPES ];
+}
+
+BOOLEAN
+FltVerdictCache::IsKeyEqualp (
+    __in PFltCacheKey Key,
+    __in PFltCacheEntry Entry
+    )
+{
+    if ( Entry->m_KeySize != Key->m_Size )
+    {
+        return FALSE;
+    }
+
+    // same layout as CopyKeyp, sizes are checked by BuildKey
+    PUCHAR pKey = Entry->m_Key;
+
+    if ( !RtlEqualMemory( pKey, Key->m_Ids, sizeof( Key->m_Ids ) ) )
+    {
+        return FALSE;
+    }
+
+    pKey += sizeof( Key->m_Ids );
+
+    for ( ULONG idx = 0; idx < Key->m_Count; idx++ )
+    {
+        PFltCacheChunk pChunk = &Key->m_Chunks[ idx ];
+
+        if (
+            ( (PULONG) pKey )[0] != pChunk->m_ParameterId
+            ||
+            ( (PULONG) pKey )[1] != pChunk->m_Size
+            )
+        {
+            return FALSE;
+        }
+
+        pKey += 2 * sizeof( ULONG );
+
+        if ( pChunk->m_Data )
+        {
+            if ( !RtlEqualMemory( pKey, pChunk->m_Data, pChunk->m_Size ) )
+            {
+                return FALSE;
+            }
+
+            pKey += pChunk->m_Size;
+        }
+    }
+
+    return TRUE;
+}
+
+void
+FltVerdictCache::CopyKeyp (
+    __in PFltCacheKey Key,
+    __out PFltCacheEntry Entry
+    )
+{
+    PUCHAR pKey = Entry->m_Key;
+
+    RtlCopyMemory( pKey, Key->m_Ids, sizeof( Key->m_Ids ) );
+    pKey += sizeof( Key->m_Ids );
+
+    for ( ULONG idx = 0; idx < Key->m_Count; idx++ )
+    {
+        PFltCacheChunk pChunk = &Key->m_Chunks[ idx ];
+
+        ( (PULONG) pKey )[0] = pChunk->m_ParameterId;
+        ( (PULONG) pKey )[1] = pChunk->m_Size;
+        pKey += 2 * sizeof( ULONG );
+
+        if ( pChunk->m_Data )
+        {
+            RtlCopyMemory( pKey, pChunk->m_Data, pChunk->m_Size );
+            pKey += pChunk->m_Size;
+        }
+    }
+}
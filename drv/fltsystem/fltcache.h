@@ -0,0 +1,134 @@
+#pragma once
+
+#include "../inc/fltstorage.h"
+
+//!
+//    \description - verdict memoization. Processes re-open the same objects
+//                   many times - result of Filters::GetVerdict is kept per
+//                   fingerprint of the parameters the set reads (event ids
+//                   and values of every parameter used by checks). Key is
+//                   compared byte by byte, hash only selects the set.
+//
+//                   Entries are guarded by sequence counter: reader copies
+//                   the result and rechecks the sequence, writer owns the
+//                   entry while the sequence is odd. Hits write nothing
+//                   shared. Storage generation invalidates all entries.
+//!
+
+#define FLT_CACHE_SETS          256
+#define FLT_CACHE_WAYS          4
+#define FLT_CACHE_KEY_MAX       384     // bytes, longer keys are not cached
+#define FLT_CACHE_CHUNKS        16      // parameters in key
+#define FLT_CACHE_GROUPS        16      // aggregation items in entry
+#define FLT_CACHE_STRIPES       16
+#define FLT_CACHE_ABSENT        ( (ULONG) -1 )
+
+typedef struct _FltCacheChunk
+{
+    ULONG               m_ParameterId;
+    ULONG               m_Size;         // FLT_CACHE_ABSENT - not queried
+    PVOID               m_Data;
+} FltCacheChunk, *PFltCacheChunk;
+
+// points to event data, valid while the event is
+typedef struct _FltCacheKey
+{
+    ULONG               m_Ids[4];       // interceptor, operation, minor, type
+    ULONG               m_Hash;
+    ULONG               m_Size;         // serialized
+    ULONG               m_Count;
+    FltCacheChunk       m_Chunks[ FLT_CACHE_CHUNKS ];
+} FltCacheKey, *PFltCacheKey;
+
+typedef struct _FltCacheEntry
+{
+    volatile LONG       m_Sequence;     // odd - entry is being written
+    LONG                m_Generation;
+    ULONG               m_Hash;
+    ULONG               m_KeySize;      // 0 - empty
+    volatile BOOLEAN    m_Referenced;   // hit since last eviction scan
+    VERDICT             m_Verdict;
+    PARAMS_MASK         m_ParamsMask;
+    ULONG               m_ItemsCount;
+    AggregationItem     m_Items[ FLT_CACHE_GROUPS ];
+    UCHAR               m_Key[ FLT_CACHE_KEY_MAX ];
+} FltCacheEntry, *PFltCacheEntry;
+
+typedef struct _FltCacheCounters
+{
+    volatile LONG64     m_Hits;
+    volatile LONG64     m_Misses;
+    volatile LONG64     m_Evictions;
+    volatile LONG64     m_Bypassed;
+    UCHAR               m_Padding[ SYSTEM_CACHE_ALIGNMENT_SIZE - 4 * sizeof( LONG64 ) ];
+} FltCacheCounters, *PFltCacheCounters;
+
+class FltVerdictCache
+{
+public:
+    static ULONG        m_AllocTag;
+
+public:
+    FltVerdictCache();
+    ~FltVerdictCache();
+
+    // FALSE - event has more parameters or longer data than entry holds
+    __checkReturn
+    static
+    BOOLEAN
+    BuildKey (
+        __in EventData* Event,
+        __in PARAMS_MASK Params,
+        __out PFltCacheKey Key
+        );
+
+    // fills verdict, wish mask and event aggregation on hit
+    __checkReturn
+    BOOLEAN
+    Lookup (
+        __in PFltCacheKey Key,
+        __in LONG Generation,
+        __in EventData* Event,
+        __out PVERDICT Verdict,
+        __out PPARAMS_MASK ParamsMask
+        );
+
+    void
+    Insert (
+        __in PFltCacheKey Key,
+        __in LONG Generation,
+        __in EventData* Event,
+        __in VERDICT Verdict,
+        __in PARAMS_MASK ParamsMask
+        );
+
+    void
+    CountBypass (
+        );
+
+    void
+    QueryStatistics (
+        __out PFltCacheStatistics Statistics
+        );
+
+private:
+    PFltCacheCounters
+    GetCountersp (
+        );
+
+    BOOLEAN
+    IsKeyEqualp (
+        __in PFltCacheKey Key,
+        __in PFltCacheEntry Entry
+        );
+
+    void
+    CopyKeyp (
+        __in PFltCacheKey Key,
+        __out PFltCacheEntry Entry
+        );
+
+private:
+    FltCacheCounters    m_Counters[ FLT_CACHE_STRIPES ];
+    FltCacheEntry       m_Entries[ FLT_CACHE_SETS * FLT_CACHE_WAYS ];
+};
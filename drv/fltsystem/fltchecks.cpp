@@ -1,18 +1,31 @@
 #include "../inc/commonkrnl.h"
 #include "../inc/memmgr.h"
+#include "../../inc/accessch.h"
 #include "fltbox.h"
 #include "fltchecks.h"
+#include "fltvalues.h"
 
 #include "fltchecks.tmh"
 
+// x64 kernel code may use SSE2 without saving floating point state
+#if defined (_M_AMD64) || defined (__x86_64__)
+#include <emmintrin.h>
+#define FLT_FOLD_SSE2
+#endif
+
 ULONG ParamCheckEntry::m_AllocTag = 'ecSA';
+ULONG ParamCheckTable::m_AllocTag = 'tpSA';
 
 ParamCheckEntry::ParamCheckEntry (
     )
 {
     m_Flags = 0;
     m_PosCount = 0;
+    m_PosCapacity = 0;
     m_FilterPosList = NULL;
+    m_Hash = 0;
+    m_HashNext = NULL;
+    m_CheckIdx = (ULONG) -1;
     m_Type = CheckEntryInvalid;
 }
 
@@ -27,18 +40,22 @@ ParamCheckEntry::~ParamCheckEntry (
         break;
 
     case CheckEntryGeneric:
-        FREE_POOL( Generic.m_CheckData );
+        FREE_SLAB( Generic.m_CheckData );
         break;
 
     case CheckEntryBox:
-        Container.m_Box->Release();
+        // lookup may fail - box referenced by filter is not created
+        if ( Container.m_Box )
+        {
+            Container.m_Box->Release();
+        }
+
         FREE_POOL( Container.m_Affecting );
         break;
 
     default:
-        {
-            __debugbreak();
-        }
+        ASSERT( FALSE );
+        break;
     }
 }
 
@@ -50,8 +67,7 @@ ParamCheckEntry::Attach (
     __in PUCHAR Data
     )
 {
-     Generic.m_CheckData = (PFltCheckData) ExAllocatePoolWithTag(
-        PagedPool,
+     Generic.m_CheckData = (PFltCheckData) MemSlabAllocate(
         sizeof( FltCheckData ) + DataSize,
         m_AllocTag
         );
@@ -64,15 +80,405 @@ ParamCheckEntry::Attach (
     Generic.m_CheckData->m_DataSize = DataSize;
     Generic.m_CheckData->m_Count = Count;
     
-    RtlCopyMemory(
-        Generic.m_CheckData->m_Data,
-        Data,
-        DataSize
-        );
+    if ( FltOp_pattern == Generic.m_Operation || FltOp_prefix == Generic.m_Operation )
+    {
+        // folded once here instead of every event
+        FltFoldString(
+            (PWCHAR) Generic.m_CheckData->m_Data,
+            (PWCHAR) Data,
+            DataSize / sizeof( WCHAR )
+            );
+    }
+    else
+    {
+        RtlCopyMemory(
+            Generic.m_CheckData->m_Data,
+            Data,
+            DataSize
+            );
+
+        if ( FltOp_equ == Generic.m_Operation && Count > 1 )
+        {
+            FltSortValues( Generic.m_CheckData->m_Data, DataSize / Count, Count );
+        }
+    }
         
     return STATUS_SUCCESS;
 }
 
+__checkReturn
+NTSTATUS
+ParamCheckEntry::AddPosition (
+    __in ULONG Position
+    )
+{
+    if ( m_PosCount == m_PosCapacity )
+    {
+        ULONG capacity = m_PosCapacity ? m_PosCapacity * 2 : 1;
+
+        PosListItemType* pList = (PosListItemType*) ExAllocatePoolWithTag(
+            PagedPool,
+            sizeof( PosListItemType ) * capacity,
+            m_AllocTag
+            );
+
+        if ( !pList )
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        if ( m_PosCount )
+        {
+            RtlCopyMemory(
+                pList,
+                m_FilterPosList,
+                sizeof( PosListItemType ) * m_PosCount
+                );
+        }
+
+        FREE_POOL( m_FilterPosList );
+
+        m_FilterPosList = pList;
+        m_PosCapacity = capacity;
+    }
+
+    m_FilterPosList[ m_PosCount ] = Position;
+    m_PosCount++;
+
+    return STATUS_SUCCESS;
+}
+
+ULONG
+ParamCheckEntry::RemovePosition (
+    __in ULONG Position
+    )
+{
+    ULONG idxto = 0;
+
+    for ( ULONG idx = 0; idx < m_PosCount; idx++ )
+    {
+        if ( m_FilterPosList[ idx ] != Position )
+        {
+            m_FilterPosList[ idxto++ ] = m_FilterPosList[ idx ];
+        }
+    }
+
+    ULONG removed = m_PosCount - idxto;
+    m_PosCount = idxto;
+
+    return removed;
+}
+
+BOOLEAN
+ParamCheckEntry::IsEqual (
+    __in PFltParam Param
+    )
+{
+    if (
+        CheckEntryGeneric != m_Type
+        ||
+        Generic.m_Parameter != Param->m_ParameterId
+        ||
+        Generic.m_Operation != Param->m_Operation
+        ||
+        m_Flags != Param->m_Flags
+        ||
+        Generic.m_CheckData->m_Count != Param->m_Data.m_Count
+        ||
+        Generic.m_CheckData->m_DataSize != Param->m_Data.m_Size
+        )
+    {
+        return FALSE;
+    }
+
+    if ( FltOp_pattern == Generic.m_Operation || FltOp_prefix == Generic.m_Operation )
+    {
+        // stored folded - masks different in case only are the same
+        PWCHAR pStored = (PWCHAR) Generic.m_CheckData->m_Data;
+        PWCHAR pPattern = (PWCHAR) Param->m_Data.m_Data;
+
+        for ( ULONG idx = 0; idx < Param->m_Data.m_Size / sizeof( WCHAR ); idx++ )
+        {
+            if ( pStored[ idx ] != FltFoldChar( pPattern[ idx ] ) )
+            {
+                return FALSE;
+            }
+        }
+
+        return TRUE;
+    }
+
+    if ( FltOp_equ == Generic.m_Operation && Param->m_Data.m_Count > 1 )
+    {
+        // stored sorted - the same values in other order are the same set
+        ULONG itemsize = Param->m_Data.m_Size / Param->m_Data.m_Count;
+        PUCHAR pValue = Param->m_Data.m_Data;
+
+        for ( ULONG item = 0; item < Param->m_Data.m_Count; item++ )
+        {
+            if ( !FltFindValue(
+                Generic.m_CheckData->m_Data,
+                itemsize,
+                Generic.m_CheckData->m_Count,
+                pValue
+                ) )
+            {
+                return FALSE;
+            }
+
+            pValue += itemsize;
+        }
+
+        return TRUE;
+    }
+
+    if ( Param->m_Data.m_Size != RtlCompareMemory(
+        Generic.m_CheckData->m_Data,
+        Param->m_Data.m_Data,
+        Param->m_Data.m_Size
+        ) )
+    {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+ParamCheckTable::ParamCheckTable (
+    )
+{
+    m_Buckets = NULL;
+    m_BucketsCount = 0;
+    m_Count = 0;
+}
+
+ParamCheckTable::~ParamCheckTable (
+    )
+{
+    // entries belong to Filters
+    FREE_POOL( m_Buckets );
+}
+
+ULONG
+ParamCheckTable::GetHash (
+    __in PFltParam Param
+    )
+{
+    // FNV-1a
+    ULONG hash = 2166136261 ^ Param->m_ParameterId;
+    hash = ( hash ^ Param->m_Operation ) * 16777619;
+    hash = ( hash ^ Param->m_Flags ) * 16777619;
+    hash = ( hash ^ Param->m_Data.m_Count ) * 16777619;
+
+    if ( FltOp_pattern == Param->m_Operation || FltOp_prefix == Param->m_Operation )
+    {
+        PWCHAR pPattern = (PWCHAR) Param->m_Data.m_Data;
+        for ( ULONG idx = 0; idx < Param->m_Data.m_Size / sizeof( WCHAR ); idx++ )
+        {
+            hash ^= FltFoldChar( pPattern[ idx ] );
+            hash *= 16777619;
+        }
+
+        return hash;
+    }
+
+    PUCHAR ptr = Param->m_Data.m_Data;
+
+    if ( FltOp_equ == Param->m_Operation && Param->m_Data.m_Count > 1 )
+    {
+        // order of values does not change the hash
+        ULONG itemsize = Param->m_Data.m_Size / Param->m_Data.m_Count;
+        ULONG sum = 0;
+
+        for ( ULONG item = 0; item < Param->m_Data.m_Count; item++ )
+        {
+            ULONG itemhash = 2166136261;
+            for ( ULONG idx = 0; idx < itemsize; idx++ )
+            {
+                itemhash ^= ptr[ idx ];
+                itemhash *= 16777619;
+            }
+
+            sum += itemhash;
+            ptr += itemsize;
+        }
+
+        return ( hash ^ sum ) * 16777619;
+    }
+
+    for ( ULONG idx = 0; idx < Param->m_Data.m_Size; idx++ )
+    {
+        hash ^= ptr[ idx ];
+        hash *= 16777619;
+    }
+
+    return hash;
+}
+
+ParamCheckEntry*
+ParamCheckTable::Lookup (
+    __in PFltParam Param,
+    __in ULONG Hash
+    )
+{
+    if ( !m_Buckets )
+    {
+        return NULL;
+    }
+
+    ParamCheckEntry* pEntry = m_Buckets[ Hash & ( m_BucketsCount - 1 ) ];
+    while ( pEntry )
+    {
+        if ( pEntry->m_Hash == Hash && pEntry->IsEqual( Param ) )
+        {
+            return pEntry;
+        }
+
+        pEntry = pEntry->m_HashNext;
+    }
+
+    return NULL;
+}
+
+void
+ParamCheckTable::Insert (
+    __in ParamCheckEntry* Entry
+    )
+{
+    ASSERT( CheckEntryGeneric == Entry->m_Type );
+
+    if ( m_Count >= m_BucketsCount )
+    {
+        Growp();
+    }
+
+    if ( !m_Buckets )
+    {
+        Entry->m_HashNext = NULL;
+        return;
+    }
+
+    ULONG bucket = Entry->m_Hash & ( m_BucketsCount - 1 );
+    Entry->m_HashNext = m_Buckets[ bucket ];
+    m_Buckets[ bucket ] = Entry;
+    m_Count++;
+}
+
+void
+ParamCheckTable::Remove (
+    __in ParamCheckEntry* Entry
+    )
+{
+    if ( !m_Buckets )
+    {
+        return;
+    }
+
+    ParamCheckEntry** ppLink = &m_Buckets[ Entry->m_Hash & ( m_BucketsCount - 1 ) ];
+    while ( *ppLink )
+    {
+        if ( *ppLink == Entry )
+        {
+            *ppLink = Entry->m_HashNext;
+            Entry->m_HashNext = NULL;
+            m_Count--;
+
+            break;
+        }
+
+        ppLink = &( *ppLink )->m_HashNext;
+    }
+}
+
+void
+ParamCheckTable::Growp (
+    )
+{
+    ULONG bucketscount = m_BucketsCount ? m_BucketsCount * 2 : PARAM_TABLE_MIN_BUCKETS;
+
+    ParamCheckEntry** pBuckets = (ParamCheckEntry**) ExAllocatePoolWithTag(
+        PagedPool,
+        sizeof( ParamCheckEntry* ) * bucketscount,
+        m_AllocTag
+        );
+
+    if ( !pBuckets )
+    {
+        return;
+    }
+
+    RtlZeroMemory( pBuckets, sizeof( ParamCheckEntry* ) * bucketscount );
+
+    for ( ULONG idx = 0; idx < m_BucketsCount; idx++ )
+    {
+        ParamCheckEntry* pEntry = m_Buckets[ idx ];
+        while ( pEntry )
+        {
+            ParamCheckEntry* pNext = pEntry->m_HashNext;
+            ULONG bucket = pEntry->m_Hash & ( bucketscount - 1 );
+
+            pEntry->m_HashNext = pBuckets[ bucket ];
+            pBuckets[ bucket ] = pEntry;
+
+            pEntry = pNext;
+        }
+    }
+
+    FREE_POOL( m_Buckets );
+
+    m_Buckets = pBuckets;
+    m_BucketsCount = bucketscount;
+}
+
+void
+FltFoldString (
+    __out_ecount(Length) PWCHAR Destination,
+    __in_ecount(Length) PWCHAR Source,
+    __in ULONG Length
+    )
+{
+    ULONG idx = 0;
+
+#if defined (FLT_FOLD_SSE2)
+    // 8 code units at a time while they are ASCII
+    const __m128i nonascii = _mm_set1_epi16( (SHORT) 0xff80 );
+    const __m128i below = _mm_set1_epi16( L'a' - 1 );
+    const __m128i above = _mm_set1_epi16( L'z' + 1 );
+    const __m128i delta = _mm_set1_epi16( L'a' - L'A' );
+    const __m128i zero = _mm_setzero_si128();
+
+    for ( ; idx + 8 <= Length; idx += 8 )
+    {
+        __m128i chars = _mm_loadu_si128( (__m128i*) &Source[ idx ] );
+
+        __m128i ascii = _mm_cmpeq_epi16( _mm_and_si128( chars, nonascii ), zero );
+        if ( 0xffff != _mm_movemask_epi8( ascii ) )
+        {
+            for ( ULONG cou = idx; cou < idx + 8; cou++ )
+            {
+                Destination[ cou ] = FltFoldChar( Source[ cou ] );
+            }
+
+            continue;
+        }
+
+        // ASCII is positive as signed 16 bit
+        __m128i lower = _mm_and_si128(
+            _mm_cmpgt_epi16( chars, below ),
+            _mm_cmplt_epi16( chars, above )
+            );
+
+        chars = _mm_sub_epi16( chars, _mm_and_si128( lower, delta ) );
+        _mm_storeu_si128( (__m128i*) &Destination[ idx ], chars );
+    }
+#endif // FLT_FOLD_SSE2
+
+    for ( ; idx < Length; idx++ )
+    {
+        Destination[ idx ] = FltFoldChar( Source[ idx ] );
+    }
+}
+
 __checkReturn
 NTSTATUS
 CheckMask (
@@ -121,7 +527,7 @@ CheckMask (
             {
                 StringStart += ask_cnt;
 
-                while ( StringStart <= StringEnd && *StringStart != *PatternStart )
+                while ( StringStart <= StringEnd && FltFoldChar( *StringStart ) != *PatternStart )
                 {
                     StringStart++;
                 }
@@ -134,7 +540,7 @@ CheckMask (
         }
         else
         {
-            if ( '?' != *PatternStart && *StringStart != *PatternStart )
+            if ( '?' != *PatternStart && FltFoldChar( *StringStart ) != *PatternStart )
             {
                 if ( !asterisk_ptr )
                 {
@@ -172,6 +578,78 @@ CheckMask (
     return STATUS_SUCCESS;
 }
 
+ULONG
+FltTrimPrefix (
+    __in_ecount(Length) PWCHAR Prefix,
+    __in ULONG Length
+    )
+{
+    while ( Length && ( !Prefix[ Length - 1 ] || L'\\' == Prefix[ Length - 1 ] ) )
+    {
+        Length--;
+    }
+
+    return Length;
+}
+
+__checkReturn
+NTSTATUS
+CheckPrefix (
+    __in_ecount(PrefixLength) PWCHAR Prefix,
+    __in ULONG PrefixLength,
+    __in_ecount(Length) PWCHAR String,
+    __in ULONG Length
+    )
+{
+    ULONG position = 0;
+    ULONG stringposition = 0;
+
+    // component by component, path may have more of them
+    for ( ; ; )
+    {
+        ULONG end = position;
+        while ( end < PrefixLength && L'\\' != Prefix[ end ] )
+        {
+            end++;
+        }
+
+        ULONG stringend = stringposition;
+        while ( stringend < Length && L'\\' != String[ stringend ] )
+        {
+            stringend++;
+        }
+
+        if ( end - position != 1 || L'*' != Prefix[ position ] )
+        {
+            if ( end - position != stringend - stringposition )
+            {
+                return STATUS_UNSUCCESSFUL;
+            }
+
+            for ( ULONG idx = 0; idx < end - position; idx++ )
+            {
+                if ( FltFoldChar( String[ stringposition + idx ] ) != Prefix[ position + idx ] )
+                {
+                    return STATUS_UNSUCCESSFUL;
+                }
+            }
+        }
+
+        if ( end >= PrefixLength )
+        {
+            return STATUS_SUCCESS;
+        }
+
+        if ( stringend >= Length )
+        {
+            return STATUS_UNSUCCESSFUL;
+        }
+
+        position = end + 1;
+        stringposition = stringend + 1;
+    }
+}
+
 __checkReturn
 __drv_valueIs( STATUS_SUCCESS; STATUS_UNSUCCESSFUL; STATUS_NOT_FOUND )
 NTSTATUS
@@ -182,7 +660,7 @@ CheckGeneric (
 {
     PVOID pData;
     ULONG datasize;
-    NTSTATUS status = Event->QueryParameter(
+    NTSTATUS status = Event->GetParameter(
         Entry->Generic.m_Parameter,
         &pData,
         &datasize
@@ -202,90 +680,83 @@ CheckGeneric (
 
     FltCheckData* pCheck = Entry->Generic.m_CheckData;
 
-    PVOID ptr = pCheck->m_Data;
-
-    ULONG item;
     switch( Entry->Generic.m_Operation )
     {
     case FltOp_equ:
+        // value of the event has other width - never equal
         if ( datasize
             != 
             pCheck->m_DataSize / pCheck->m_Count )
         {
-            __debugbreak();
             break;
         }
         
-        for ( item = 0; item < pCheck->m_Count; item++ )
+        // values are sorted by Attach
+        if ( FltFindValue( pCheck->m_Data, datasize, pCheck->m_Count, pData ) )
         {
-            if ( datasize == RtlCompareMemory(
-                ptr,
-                pData,
-                datasize
-                ) )
-            {
-                status = STATUS_SUCCESS;    
-                break;
-            }
-
-            ptr = Add2Ptr( ptr, datasize );
+            status = STATUS_SUCCESS;
         }
 
         break;
 
     case FltOp_and:
-        ASSERT( pCheck->m_Count == 1 );
-
         if ( datasize
             !=
             pCheck->m_DataSize / pCheck->m_Count )
         {
-            __debugbreak();
             break;
         }
 
-        if ( datasize == sizeof( ULONG ) )
+        if ( FltTestMasks( pCheck->m_Data, datasize, pCheck->m_Count, pData ) )
         {
-            PULONG pu1 = (PULONG) ptr;
-            PULONG pu2 = (PULONG) pData;
-            if ( *pu1 & *pu2 )
-            {
-                status = STATUS_SUCCESS;
-                break;
-            }
-        }
-        else
-        {
-            __debugbreak(); //not impelemented
+            status = STATUS_SUCCESS;
         }
 
         break;
 
-    case FltOp_pattern:
+    case FltOp_less:
+    case FltOp_greater:
+    case FltOp_range:
+        // width is checked when filter is added, parameter may differ
+        if (
+            datasize != pCheck->m_DataSize / pCheck->m_Count
+            ||
+            !FltIsOrderedWidth( datasize )
+            )
         {
-            /// \todo upper cased string have to be acquired as QueryParameter with UPPER_CASE flag
+            break;
+        }
 
-            UNICODE_STRING ussrc;
-            RtlInitEmptyUnicodeString( &ussrc, ( PWCHAR ) pData, (USHORT) datasize );
-            ussrc.Length = ussrc.MaximumLength;
+        if ( FltTestOrdered(
+            Entry->Generic.m_Operation,
+            pCheck->m_Data,
+            datasize,
+            pCheck->m_Count,
+            pData
+            ) )
+        {
+            status = STATUS_SUCCESS;
+        }
 
-            UNICODE_STRING usdest;
-            RtlInitEmptyUnicodeString( &usdest, NULL, 0 );
+        break;
 
-            status = RtlUpcaseUnicodeString( &usdest, &ussrc, TRUE );
+    case FltOp_pattern:
+        // pattern is folded, string is folded by CheckMask
+        status = CheckMask(
+            ( PWCHAR ) pCheck->m_Data,
+            ( PWCHAR ) Add2Ptr( pCheck->m_Data, pCheck->m_DataSize - sizeof( WCHAR ) ),
+            ( PWCHAR ) pData,
+            ( PWCHAR ) Add2Ptr( pData, datasize - sizeof( WCHAR ) )
+            );
+        break;
 
-            if ( NT_SUCCESS( status ) )
-            {
-                status = CheckMask(
-                    ( PWCHAR ) pCheck->m_Data,
-                    ( PWCHAR ) Add2Ptr( pCheck->m_Data, pCheck->m_DataSize - sizeof( WCHAR ) ),
-                    ( PWCHAR ) usdest.Buffer,
-                    ( PWCHAR ) Add2Ptr( usdest.Buffer, datasize - sizeof( WCHAR ) )
-                    );
-
-                RtlFreeUnicodeString( &usdest );
-            }
-        }
+    case FltOp_prefix:
+        status = CheckPrefix(
+            ( PWCHAR ) pCheck->m_Data,
+            FltTrimPrefix( ( PWCHAR ) pCheck->m_Data, pCheck->m_DataSize / sizeof( WCHAR ) ),
+            ( PWCHAR ) pData,
+            datasize / sizeof( WCHAR )
+            );
         break;
     
     default:
@@ -311,6 +782,34 @@ CheckContainer (
     return status;
 }
 
+ParamCost
+GetParameterCost (
+    __in ULONG ParameterId
+    )
+{
+    switch ( ParameterId )
+    {
+    case PARAMETER_FILE_NAME:
+    case PARAMETER_VOLUME_NAME:
+    case PARAMETER_SID:
+        return ParamCost_Expensive;
+
+    case PARAMETER_LUID:
+    case PARAMETER_DEVICE_ID:
+        return ParamCost_Context;
+
+    default:
+        break;
+    }
+
+    if ( ParameterId > PARAMETER_MAXIMUM )
+    {
+        return ParamCost_Expensive;
+    }
+
+    return ParamCost_Field;
+}
+
 __checkReturn
 NTSTATUS
 CheckEntry (
@@ -331,8 +830,9 @@ CheckEntry (
         break;
 
     default:
-        __debugbreak();
-        return STATUS_NOT_IMPLEMENTED;
+        // entries are typed when created
+        ASSERT( FALSE );
+        return STATUS_INVALID_PARAMETER;
     }
 
     switch ( status )
@@ -358,3 +858,33 @@ CheckEntry (
 
     return status;
 }
+
+__checkReturn
+NTSTATUS
+CheckEntryByResult (
+    __in ParamCheckEntry* Entry,
+    __in BOOLEAN Present,
+    __in BOOLEAN Found
+    )
+{
+    // the same status as CheckEntry gives for generic entry when parameter
+    // data was already compared by an index
+    ASSERT( CheckEntryGeneric == Entry->m_Type );
+
+    if ( !Present )
+    {
+        if ( FlagOn( Entry->m_Flags, FltFlags_BePresent ) )
+        {
+            return STATUS_NOT_FOUND;
+        }
+
+        Found = TRUE;
+    }
+
+    if ( FlagOn( Entry->m_Flags, FltFlags_Negation ) )
+    {
+        Found = !Found;
+    }
+
+    return Found ? STATUS_SUCCESS : STATUS_UNSUCCESSFUL;
+}
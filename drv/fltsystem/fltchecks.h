@@ -1,66 +1,207 @@
-#pragma once
-
-#include "../../inc/fltcommon.h"
-#include "../inc/fltevents.h"
-
-class FilterBox;
-
-typedef struct _FltCheckData
-{
-    ULONG               m_DataSize;
-    ULONG               m_Count;
-    UCHAR               m_Data[1];
-} FltCheckData, *PFltCheckData;
-
-#define PosListItemType  ULONG
-
-enum CheckEntryType
-{
-    CheckEntryInvalid   = 0,
-    CheckEntryGeneric   = 1,
-    CheckEntryBox       = 2
-};
-
-class ParamCheckEntry
-{
-private:
-    static ULONG m_AllocTag;
-public:
-    ParamCheckEntry();
-    ~ParamCheckEntry();
-
-    __checkReturn
-    NTSTATUS
-    Attach (
-        __in ULONG DataSize,
-        __in ULONG Count,
-        __in PUCHAR Data
-        );
-
-public:
-    LIST_ENTRY          m_List;
-    ULONG               m_Flags;    // _PARAM_ENTRY_FLAG_XXX
-    ULONG               m_PosCount;
-    PosListItemType*    m_FilterPosList;
-    
-    CheckEntryType      m_Type;
-    union
-    {
-        struct {
-            ULONG               m_Parameter;
-            FltOperation        m_Operation;
-            FltCheckData*       m_CheckData;
-        } Generic;
-
-        struct {
-            FilterBox*          m_Box;
-            PRTL_BITMAP         m_Affecting;
-        } Container;
-    };
-};
-
-NTSTATUS
-CheckEntry (
-    __in ParamCheckEntry* Entry,
-    __in EventData *Event
+#pragma once
+
+#include "../../inc/fltcommon.h"
+#include "../inc/fltevents.h"
+
+class FilterBox;
+
+typedef struct _FltCheckData
+{
+    ULONG               m_DataSize;
+    ULONG               m_Count;
+    UCHAR               m_Data[1];
+} FltCheckData, *PFltCheckData;
+
+#define PosListItemType  ULONG
+
+#define PARAM_TABLE_MIN_BUCKETS     64
+
+// cost of EventData::QueryParameter, cheaper parameters are checked first
+enum ParamCost
+{
+    ParamCost_Field     = 0,    // copied from callback data
+    ParamCost_Context   = 1,    // context lookup or token query
+    ParamCost_Expensive = 2     // name query or allocation
+};
+
+enum CheckEntryType
+{
+    CheckEntryInvalid   = 0,
+    CheckEntryGeneric   = 1,
+    CheckEntryBox       = 2
+};
+
+class ParamCheckEntry
+{
+private:
+    static ULONG m_AllocTag;
+public:
+    ParamCheckEntry();
+    ~ParamCheckEntry();
+
+    __checkReturn
+    NTSTATUS
+    Attach (
+        __in ULONG DataSize,
+        __in ULONG Count,
+        __in PUCHAR Data
+        );
+
+    // list grows geometrically - filters sharing the entry are appended
+    __checkReturn
+    NTSTATUS
+    AddPosition (
+        __in ULONG Position
+        );
+
+    // compacts in place, returns count of removed
+    ULONG
+    RemovePosition (
+        __in ULONG Position
+        );
+
+    BOOLEAN
+    IsEqual (
+        __in PFltParam Param
+        );
+
+public:
+    LIST_ENTRY          m_List;
+    ULONG               m_Flags;    // _PARAM_ENTRY_FLAG_XXX
+    ULONG               m_PosCount;
+    ULONG               m_PosCapacity;
+    PosListItemType*    m_FilterPosList;
+    ULONG               m_Hash;     // ParamCheckTable key of generic entry
+    ParamCheckEntry*    m_HashNext;
+    ULONG               m_CheckIdx; // number in compiled FilterDag
+    
+    CheckEntryType      m_Type;
+    union
+    {
+        struct {
+            ULONG               m_Parameter;
+            FltOperation        m_Operation;
+            FltCheckData*       m_CheckData;
+        } Generic;
+
+        struct {
+            FilterBox*          m_Box;
+            PRTL_BITMAP         m_Affecting;
+        } Container;
+    };
+};
+
+//!
+//    \description - generic entries of a Filters set by parameter, operation,
+//                   flags and data. Equal parameters of different filters
+//                   share one entry. Used by writer under exclusive lock.
+//!
+class ParamCheckTable
+{
+private:
+    static ULONG m_AllocTag;
+public:
+    ParamCheckTable();
+    ~ParamCheckTable();
+
+    static
+    ULONG
+    GetHash (
+        __in PFltParam Param
+        );
+
+    ParamCheckEntry*
+    Lookup (
+        __in PFltParam Param,
+        __in ULONG Hash
+        );
+
+    // no table when grow fails - chains get longer, lookups stay correct
+    void
+    Insert (
+        __in ParamCheckEntry* Entry
+        );
+
+    void
+    Remove (
+        __in ParamCheckEntry* Entry
+        );
+
+private:
+    void
+    Growp (
+        );
+
+private:
+    ParamCheckEntry**   m_Buckets;
+    ULONG               m_BucketsCount;     // power of 2
+    ULONG               m_Count;
+};
+
+// case folding of UTF-16 code units. Patterns are stored folded, strings
+// are folded while compared - ASCII without the upcase table
+FORCEINLINE
+WCHAR
+FltFoldChar (
+    __in WCHAR Char
+    )
+{
+    if ( Char < 0x80 )
+    {
+        return (WCHAR) ( Char - L'a' ) < 26 ? Char - ( L'a' - L'A' ) : Char;
+    }
+
+    return RtlUpcaseUnicodeChar( Char );
+}
+
+void
+FltFoldString (
+    __out_ecount(Length) PWCHAR Destination,
+    __in_ecount(Length) PWCHAR Source,
+    __in ULONG Length
+    );
+
+ParamCost
+GetParameterCost (
+    __in ULONG ParameterId
+    );
+
+NTSTATUS
+CheckEntry (
+    __in ParamCheckEntry* Entry,
+    __in EventData *Event
+    );
+
+__checkReturn
+NTSTATUS
+CheckEntryByResult (
+    __in ParamCheckEntry* Entry,
+    __in BOOLEAN Present,
+    __in BOOLEAN Found
+    );
+
+__checkReturn
+NTSTATUS
+CheckMask (
+    PWCHAR PatternStart,
+    PWCHAR PatternEnd,
+    PWCHAR StringStart,
+    PWCHAR StringEnd
+    );
+
+// trailing separators and zeros of FltOp_prefix value are not components
+ULONG
+FltTrimPrefix (
+    __in_ecount(Length) PWCHAR Prefix,
+    __in ULONG Length
+    );
+
+// Prefix is folded and trimmed, lengths in chars
+__checkReturn
+NTSTATUS
+CheckPrefix (
+    __in_ecount(PrefixLength) PWCHAR Prefix,
+    __in ULONG PrefixLength,
+    __in_ecount(Length) PWCHAR String,
+    __in ULONG Length
     );
\ No newline at end of file
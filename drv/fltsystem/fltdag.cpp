@@ -0,0 +1,1132 @@
+#include "../inc/commonkrnl.h"
+#include "../inc/memmgr.h"
+#include "fltdag.h"
+
+ULONG FilterDag::m_AllocTag = 'gdSA';
+
+//////////////////////////////////////////////////////////////////////////
+
+ULONG
+GetCheckRank (
+    __in ParamCheckEntry* Entry
+    )
+{
+    ULONG cost = 0;
+    ULONG fetch;
+
+    if ( CheckEntryBox == Entry->m_Type )
+    {
+        // box items may query any parameter
+        fetch = ParamCost_Expensive;
+        cost = 2;
+    }
+    else
+    {
+        fetch = GetParameterCost( Entry->Generic.m_Parameter );
+
+        switch ( Entry->Generic.m_Operation )
+        {
+        case FltOp_equ:
+            // indexed value set costs one probe
+            if (
+                !FilterEquIndex::IsIndexed( Entry )
+                &&
+                Entry->Generic.m_CheckData->m_Count > 1
+                )
+            {
+                cost = 1;
+            }
+            break;
+
+        case FltOp_pattern:
+            cost = 3;
+            break;
+
+        case FltOp_prefix:
+            // one descent, no verification
+            cost = 1;
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    // the same cost - check shared by more filters goes first, it makes
+    // common prefixes and prunes more on mismatch
+    ULONG shared = min( Entry->m_PosCount, 0xffffff );
+
+    // parameter fetch outweighs the compare - expensive parameter is
+    // queried only if cheap checks of some filter passed
+    return ( fetch << 28 ) | ( cost << 24 ) | ( 0xffffff - shared );
+}
+
+void
+SortChain (
+    __in ULONG ChecksCount,
+    __inout ParamCheckEntry** Checks
+    )
+{
+    // chains are short - insertion sort
+    for ( ULONG idx = 1; idx < ChecksCount; idx++ )
+    {
+        ParamCheckEntry* pEntry = Checks[ idx ];
+        ULONG rank = GetCheckRank( pEntry );
+
+        ULONG idx2 = idx;
+        while ( idx2 )
+        {
+            ParamCheckEntry* pPrev = Checks[ idx2 - 1 ];
+            ULONG rankprev = GetCheckRank( pPrev );
+
+            if (
+                rankprev < rank
+                ||
+                ( rankprev == rank && pPrev->m_CheckIdx <= pEntry->m_CheckIdx )
+                )
+            {
+                break;
+            }
+
+            Checks[ idx2 ] = pPrev;
+            idx2--;
+        }
+
+        Checks[ idx2 ] = pEntry;
+    }
+}
+
+ULONG
+GetDagSlot (
+    __in ULONG Node,
+    __in ULONG CheckIdx
+    )
+{
+    ULONG hash = Node * 0x9e3779b1 ^ CheckIdx * 0x85ebca6b;
+
+    return hash ^ ( hash >> 15 );
+}
+
+void
+DestroyLevelp (
+    __in PVOID Level
+    )
+{
+    DagLevel* pLevel = (DagLevel*) Level;
+
+    FREE_OBJECT( pLevel );
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+DagLevel::DagLevel (
+    )
+{
+    m_Checks = NULL;
+    m_ChecksCount = 0;
+    m_ChecksCapacity = 0;
+}
+
+DagLevel::~DagLevel (
+    )
+{
+    FREE_POOL( m_Checks );
+}
+
+BOOLEAN
+DagLevel::IsIndexed (
+    __in ParamCheckEntry* Entry
+    )
+{
+    return PatternIndex::IsIndexed( Entry )
+        || PrefixIndex::IsIndexed( Entry )
+        || FilterRangeIndex::IsIndexed( Entry );
+}
+
+__checkReturn
+NTSTATUS
+DagLevel::Add (
+    __in ParamCheckEntry* Entry
+    )
+{
+    ASSERT( IsIndexed( Entry ) );
+
+    NTSTATUS status = GrowArray(
+        (PVOID*) &m_Checks,
+        &m_ChecksCapacity,
+        m_ChecksCount,
+        sizeof( ParamCheckEntry* ),
+        FilterDag::m_AllocTag
+        );
+
+    if ( !NT_SUCCESS( status ) )
+    {
+        return status;
+    }
+
+    if ( PatternIndex::IsIndexed( Entry ) )
+    {
+        status = m_Patterns.Add( Entry, Entry->m_CheckIdx );
+    }
+    else if ( PrefixIndex::IsIndexed( Entry ) )
+    {
+        status = m_Prefixes.Add( Entry, Entry->m_CheckIdx );
+    }
+    else
+    {
+        status = m_Ranges.Add( Entry, Entry->m_CheckIdx );
+    }
+
+    if ( !NT_SUCCESS( status ) )
+    {
+        return status;
+    }
+
+    m_Checks[ m_ChecksCount++ ] = Entry;
+
+    return STATUS_SUCCESS;
+}
+
+__checkReturn
+NTSTATUS
+DagLevel::Build (
+    )
+{
+    NTSTATUS status = m_Patterns.Build();
+    if ( !NT_SUCCESS( status ) )
+    {
+        return status;
+    }
+
+    m_Ranges.Build();
+
+    return m_Prefixes.Build();
+}
+
+__checkReturn
+NTSTATUS
+DagLevel::Probe (
+    __in ULONG ParameterId,
+    __in PVOID Data,
+    __in ULONG DataSize,
+    __in FltHits* Found
+    )
+{
+    m_Ranges.Probe( ParameterId, Data, DataSize, Found );
+
+    if ( m_Prefixes.Contains( ParameterId ) )
+    {
+        NTSTATUS status = m_Prefixes.Match( ParameterId, Data, DataSize, Found );
+        if ( !NT_SUCCESS( status ) )
+        {
+            return status;
+        }
+    }
+
+    if ( m_Patterns.Contains( ParameterId ) )
+    {
+        return m_Patterns.Match( ParameterId, Data, DataSize, Found );
+    }
+
+    return STATUS_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+FilterDag::FilterDag (
+    )
+{
+    m_Image = NULL;
+    m_Levels = NULL;
+    m_Pending = NULL;
+
+    Invalidate();
+}
+
+FilterDag::~FilterDag (
+    )
+{
+    Invalidate();
+}
+
+void
+FilterDag::Invalidate (
+    )
+{
+    FREE_POOL( m_Image );
+
+    PDagLevels pLevels = m_Levels;
+    if ( pLevels )
+    {
+        for ( ULONG idx = 0; idx < pLevels->m_Count; idx++ )
+        {
+            DestroyLevelp( pLevels->m_Levels[ idx ] );
+        }
+
+        FREE_POOL( m_Levels );
+    }
+
+    FREE_POOL( m_Pending );
+    m_PendingCount = 0;
+    m_PendingCapacity = 0;
+
+    m_EquIndex.Reset();
+    m_ExpensiveParams = 0;
+
+    m_Valid = FALSE;
+    m_ChecksCount = 0;
+    m_IndexedChecks = 0;
+    m_CompiledFilters = 0;
+}
+
+__checkReturn
+NTSTATUS
+FilterDag::AllocateImage (
+    __in ULONG NodesCapacity,
+    __in ULONG FiltersCapacity
+    )
+{
+    ASSERT( !m_Image );
+    ASSERT( NodesCapacity );
+
+    // hash is at most half full - lookup always ends on an empty slot
+    ULONG slots = FLT_DAG_SPARE_NODES;
+    while ( slots < NodesCapacity * 2 )
+    {
+        slots *= 2;
+    }
+
+    SIZE_T nodes = FIELD_OFFSET( DagImage, m_Nodes ) + sizeof( DagNode ) * NodesCapacity;
+    SIZE_T size = nodes + sizeof( ULONG ) * ( FiltersCapacity + slots );
+
+    PDagImage pImage = (PDagImage) ExAllocatePoolWithTag(
+        PagedPool,
+        size,
+        m_AllocTag
+        );
+
+    if ( !pImage )
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    pImage->m_Size = size;
+    pImage->m_NodesCapacity = NodesCapacity;
+    pImage->m_NodesCount = 1;
+    pImage->m_FiltersCapacity = FiltersCapacity;
+    pImage->m_SlotsMask = slots - 1;
+    pImage->m_Next = (PULONG) Add2Ptr( pImage, nodes );
+    pImage->m_Slots = &pImage->m_Next[ FiltersCapacity ];
+
+    RtlFillMemory( pImage->m_Slots, sizeof( ULONG ) * slots, 0xff );
+
+    // root has no check
+    DagNode* pRoot = &pImage->m_Nodes[ FLT_DAG_ROOT ];
+    RtlZeroMemory( pRoot, sizeof( DagNode ) );
+    pRoot->m_Parent = FLT_DAG_NONE;
+    pRoot->m_Child = FLT_DAG_NONE;
+    pRoot->m_Dispatch = FLT_DAG_NONE;
+    pRoot->m_Sibling = FLT_DAG_NONE;
+    pRoot->m_FirstFilter = FLT_DAG_NONE;
+
+    m_Image = pImage;
+
+    return STATUS_SUCCESS;
+}
+
+ULONG
+FilterDag::AllocateNode (
+    __in ParamCheckEntry* Entry
+    )
+{
+    PDagImage pImage = m_Image;
+    if ( pImage->m_NodesCount == pImage->m_NodesCapacity )
+    {
+        return FLT_DAG_NONE;
+    }
+
+    ULONG node = pImage->m_NodesCount++;
+
+    DagNode* pNode = &pImage->m_Nodes[ node ];
+    pNode->m_Check = Entry;
+    pNode->m_Parent = FLT_DAG_NONE;
+    pNode->m_Child = FLT_DAG_NONE;
+    pNode->m_Dispatch = FLT_DAG_NONE;
+    pNode->m_Sibling = FLT_DAG_NONE;
+    pNode->m_FirstFilter = FLT_DAG_NONE;
+    pNode->m_CheckIdx = Entry->m_CheckIdx;
+    pNode->m_DispatchCount = 0;
+    pNode->m_DispatchParams = 0;
+    pNode->m_AbsentParams = 0;
+    pNode->m_Generic = ( CheckEntryGeneric == Entry->m_Type );
+    pNode->m_Parameter = pNode->m_Generic ? Entry->Generic.m_Parameter : 0;
+
+    // indexes don't change until next Compile. Negated check passes on
+    // values not found - it is checked one by one
+    pNode->m_Indexed = IsIndexedCheck( Entry );
+    pNode->m_Dispatched = pNode->m_Indexed
+        && !FlagOn( Entry->m_Flags, FltFlags_Negation );
+
+    return node;
+}
+
+__checkReturn
+NTSTATUS
+FilterDag::IndexCheck (
+    __in ParamCheckEntry* Entry
+    )
+{
+    Entry->m_CheckIdx = m_ChecksCount++;
+
+    if (
+        CheckEntryGeneric == Entry->m_Type
+        &&
+        ParamCost_Expensive == GetParameterCost( Entry->Generic.m_Parameter )
+        &&
+        Entry->Generic.m_Parameter <= PARAMETER_MAXIMUM
+        )
+    {
+        SetFlag( m_ExpensiveParams, Id2Bit( Entry->Generic.m_Parameter ) );
+    }
+
+    if ( FilterEquIndex::IsIndexed( Entry ) )
+    {
+        return m_EquIndex.AddEntry( Entry );
+    }
+
+    if ( DagLevel::IsIndexed( Entry ) )
+    {
+        // probes don't find it until Commit
+        NTSTATUS status = GrowArray(
+            (PVOID*) &m_Pending,
+            &m_PendingCapacity,
+            m_PendingCount,
+            sizeof( ParamCheckEntry* ),
+            m_AllocTag
+            );
+
+        if ( !NT_SUCCESS( status ) )
+        {
+            return status;
+        }
+
+        m_Pending[ m_PendingCount++ ] = Entry;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+BOOLEAN
+FilterDag::IsIndexedCheck (
+    __in ParamCheckEntry* Entry
+    )
+{
+    return FilterEquIndex::IsIndexed( Entry ) || DagLevel::IsIndexed( Entry );
+}
+
+ULONG
+FilterDag::FindChild (
+    __in ULONG Node,
+    __in ULONG CheckIdx
+    )
+{
+    PDagImage pImage = m_Image;
+    ULONG slot = GetDagSlot( Node, CheckIdx );
+
+    while ( TRUE )
+    {
+        slot &= pImage->m_SlotsMask;
+
+        ULONG child = pImage->m_Slots[ slot ];
+        if ( FLT_DAG_NONE == child )
+        {
+            return FLT_DAG_NONE;
+        }
+
+        if (
+            pImage->m_Nodes[ child ].m_Parent == Node
+            &&
+            pImage->m_Nodes[ child ].m_CheckIdx == CheckIdx
+            )
+        {
+            return child;
+        }
+
+        slot++;
+    }
+}
+
+__checkReturn
+NTSTATUS
+FilterDag::ProbeParameter (
+    __in EventData *Event,
+    __in ULONG ParameterId,
+    __inout PDagMatch Match
+    )
+{
+    if ( FlagOn( Match->m_Probed, Id2Bit( ParameterId ) ) )
+    {
+        return STATUS_SUCCESS;
+    }
+
+    SetFlag( Match->m_Probed, Id2Bit( ParameterId ) );
+
+    PVOID pData;
+    ULONG datasize;
+
+    NTSTATUS status = Event->GetParameter( ParameterId, &pData, &datasize );
+    if ( !NT_SUCCESS( status ) )
+    {
+        return STATUS_SUCCESS;
+    }
+
+    SetFlag( Match->m_Present, Id2Bit( ParameterId ) );
+
+    FltHits* pFound = &Match->m_Found;
+
+    m_EquIndex.Probe( ParameterId, pData, datasize, pFound );
+
+    PDagLevels pLevels = Match->m_Levels;
+    for ( ULONG idx = 0; pLevels && idx < pLevels->m_Count; idx++ )
+    {
+        status = pLevels->m_Levels[ idx ]->Probe( ParameterId, pData, datasize, pFound );
+        if ( !NT_SUCCESS( status ) )
+        {
+            return status;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+__checkReturn
+NTSTATUS
+FilterDag::CheckNode (
+    __in EventData *Event,
+    __in DagNode* Node,
+    __inout PDagMatch Match,
+    __out PBOOLEAN Passed
+    )
+{
+    ULONG checkidx = Node->m_CheckIdx;
+
+    *Passed = FALSE;
+
+    if ( checkidx >= Match->m_ChecksCount )
+    {
+        // added by Update after Match started
+        return STATUS_SUCCESS;
+    }
+
+    // waiting for Commit - probes don't find it yet
+    if ( Node->m_Indexed && checkidx < Match->m_IndexedChecks )
+    {
+        ULONG parameter = Node->m_Parameter;
+
+        NTSTATUS status = ProbeParameter( Event, parameter, Match );
+        if ( !NT_SUCCESS( status ) )
+        {
+            return status;
+        }
+
+        status = CheckEntryByResult(
+            Node->m_Check,
+            BooleanFlagOn( Match->m_Present, Id2Bit( parameter ) ),
+            Match->m_Found.Test( checkidx )
+            );
+
+        *Passed = NT_SUCCESS( status );
+
+        return STATUS_SUCCESS;
+    }
+
+    if ( !Match->m_Evaluated.Test( checkidx ) )
+    {
+        Match->m_Evaluated.Set( checkidx );
+
+        if ( Node->m_Generic && Node->m_Parameter <= PARAMETER_MAXIMUM )
+        {
+            SetFlag( Match->m_Fetched, Id2Bit( Node->m_Parameter ) );
+        }
+
+        if ( NT_SUCCESS( CheckEntry( Node->m_Check, Event ) ) )
+        {
+            Match->m_Passed.Set( checkidx );
+        }
+    }
+
+    *Passed = Match->m_Passed.Test( checkidx );
+
+    return STATUS_SUCCESS;
+}
+
+__checkReturn
+NTSTATUS
+FilterDag::InsertChain (
+    __in ULONG Position,
+    __in ULONG ChecksCount,
+    __in ParamCheckEntry** Checks
+    )
+{
+    ASSERT( Position < m_Image->m_FiltersCapacity );
+
+    DagNode* pNodes = m_Image->m_Nodes;
+    ULONG node = FLT_DAG_ROOT;
+
+    for ( ULONG idx = 0; idx < ChecksCount; idx++ )
+    {
+        ULONG child = FindChild( node, Checks[ idx ]->m_CheckIdx );
+
+        if ( FLT_DAG_NONE == child )
+        {
+            // no spare room - caller compiles a new image
+            child = AllocateNode( Checks[ idx ] );
+            if ( FLT_DAG_NONE == child )
+            {
+                return STATUS_BUFFER_TOO_SMALL;
+            }
+
+            DagNode* pParent = &pNodes[ node ];
+            DagNode* pChild = &pNodes[ child ];
+
+            pChild->m_Parent = node;
+            pChild->m_Sibling = pChild->m_Dispatched
+                ? pParent->m_Dispatch
+                : pParent->m_Child;
+
+            // publish filled node
+            KeMemoryBarrier();
+
+            if ( pChild->m_Dispatched )
+            {
+                PARAMS_MASK parameter = Id2Bit( pChild->m_Parameter );
+
+                SetFlag( pParent->m_DispatchParams, parameter );
+                if ( !FlagOn( Checks[ idx ]->m_Flags, FltFlags_BePresent ) )
+                {
+                    SetFlag( pParent->m_AbsentParams, parameter );
+                }
+
+                pParent->m_DispatchCount++;
+                pParent->m_Dispatch = child;
+            }
+            else
+            {
+                pParent->m_Child = child;
+            }
+
+            ULONG slot = GetDagSlot( node, pChild->m_CheckIdx );
+            while ( FLT_DAG_NONE != m_Image->m_Slots[ slot & m_Image->m_SlotsMask ] )
+            {
+                slot++;
+            }
+
+            m_Image->m_Slots[ slot & m_Image->m_SlotsMask ] = child;
+        }
+
+        ASSERT( pNodes[ child ].m_Check == Checks[ idx ] );
+
+        node = child;
+    }
+
+    m_Image->m_Next[ Position ] = pNodes[ node ].m_FirstFilter;
+
+    KeMemoryBarrier();
+    pNodes[ node ].m_FirstFilter = Position;
+
+    return STATUS_SUCCESS;
+}
+
+__checkReturn
+NTSTATUS
+FilterDag::Compile (
+    __in PLIST_ENTRY ParamsCheckList,
+    __in FltBitmap* ActiveFilters,
+    __in ULONG FiltersCount
+    )
+{
+    Invalidate();
+
+    PULONG pOffsets = NULL;
+    ParamCheckEntry** pChecks = NULL;
+
+    NTSTATUS status = STATUS_SUCCESS;
+
+    __try
+    {
+        pOffsets = (PULONG) ExAllocatePoolWithTag(
+            PagedPool,
+            sizeof( ULONG ) * ( FiltersCount + 1 ),
+            m_AllocTag
+            );
+
+        if ( !pOffsets )
+        {
+            status = STATUS_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+
+        RtlZeroMemory( pOffsets, sizeof( ULONG ) * ( FiltersCount + 1 ) );
+
+        // number checks and count them per filter
+        PLIST_ENTRY Flink = ParamsCheckList->Flink;
+        while ( Flink != ParamsCheckList )
+        {
+            ParamCheckEntry* pEntry = CONTAINING_RECORD(
+                Flink,
+                ParamCheckEntry,
+                m_List
+                );
+
+            Flink = Flink->Flink;
+
+            status = IndexCheck( pEntry );
+            if ( !NT_SUCCESS( status ) )
+            {
+                __leave;
+            }
+
+            for ( ULONG cou = 0; cou < pEntry->m_PosCount; cou++ )
+            {
+                ASSERT( pEntry->m_FilterPosList[ cou ] < FiltersCount );
+                pOffsets[ pEntry->m_FilterPosList[ cou ] + 1 ]++;
+            }
+        }
+
+        // not published yet - nothing to retire
+        status = Commit( NULL );
+        if ( !NT_SUCCESS( status ) )
+        {
+            __leave;
+        }
+
+
+        for ( ULONG idx = 0; idx < FiltersCount; idx++ )
+        {
+            pOffsets[ idx + 1 ] += pOffsets[ idx ];
+        }
+
+        // a node per check of a chain at most, spare room for Update.
+        // Links for the filters NeedsCompile lets Update add
+        ULONG chains = pOffsets[ FiltersCount ];
+
+        status = AllocateImage(
+            1 + chains + max( chains / 2, FLT_DAG_SPARE_NODES ),
+            FiltersCount + FiltersCount / FLT_DAG_DRIFT + 1
+            );
+
+        if ( !NT_SUCCESS( status ) )
+        {
+            __leave;
+        }
+
+        if ( pOffsets[ FiltersCount ] )
+        {
+            pChecks = (ParamCheckEntry**) ExAllocatePoolWithTag(
+                PagedPool,
+                sizeof( ParamCheckEntry* ) * pOffsets[ FiltersCount ],
+                m_AllocTag
+                );
+
+            if ( !pChecks )
+            {
+                status = STATUS_INSUFFICIENT_RESOURCES;
+                __leave;
+            }
+        }
+
+        // invert position lists - checks of each filter
+        Flink = ParamsCheckList->Flink;
+        while ( Flink != ParamsCheckList )
+        {
+            ParamCheckEntry* pEntry = CONTAINING_RECORD(
+                Flink,
+                ParamCheckEntry,
+                m_List
+                );
+
+            Flink = Flink->Flink;
+
+            for ( ULONG cou = 0; cou < pEntry->m_PosCount; cou++ )
+            {
+                pChecks[ pOffsets[ pEntry->m_FilterPosList[ cou ] ]++ ] = pEntry;
+            }
+        }
+
+        // offset of filter N is moved to the start of filter N + 1
+        ULONG start = 0;
+        for ( ULONG idx = 0; idx < FiltersCount; idx++ )
+        {
+            ULONG end = pOffsets[ idx ];
+
+            if ( ActiveFilters->Test( idx ) )
+            {
+                SortChain( end - start, &pChecks[ start ] );
+
+                status = InsertChain( idx, end - start, &pChecks[ start ] );
+                if ( !NT_SUCCESS( status ) )
+                {
+                    __leave;
+                }
+            }
+
+            start = end;
+        }
+
+        m_CompiledFilters = FiltersCount;
+        m_Valid = TRUE;
+    }
+    __finally
+    {
+        FREE_POOL( pChecks );
+        FREE_POOL( pOffsets );
+
+        if ( !NT_SUCCESS( status ) )
+        {
+            Invalidate();
+        }
+    }
+
+    return status;
+}
+
+__checkReturn
+NTSTATUS
+FilterDag::Update (
+    __in ULONG FiltersCount,
+    __in ULONG Position,
+    __in ULONG ChecksCount,
+    __in_ecount(ChecksCount) ParamCheckEntry** Checks
+    )
+{
+    ASSERT( m_Valid );
+
+    // on failure the object is dropped by the caller - readers may be
+    // walking it, nothing is freed here
+    if ( FiltersCount > m_Image->m_FiltersCapacity )
+    {
+        return STATUS_BUFFER_TOO_SMALL;
+    }
+
+    NTSTATUS status;
+
+    for ( ULONG idx = 0; idx < ChecksCount; idx++ )
+    {
+        if ( FLT_DAG_NONE == Checks[ idx ]->m_CheckIdx )
+        {
+            status = IndexCheck( Checks[ idx ] );
+            if ( !NT_SUCCESS( status ) )
+            {
+                return status;
+            }
+        }
+    }
+
+    SortChain( ChecksCount, Checks );
+
+    return InsertChain( Position, ChecksCount, Checks );
+}
+
+__checkReturn
+NTSTATUS
+FilterDag::BuildLevel (
+    __in_opt PDagLevels Levels,
+    __in ULONG First,
+    __deref_out DagLevel** Level
+    )
+{
+    DagLevel* pLevel = new ( PagedPool, m_AllocTag ) DagLevel;
+    if ( !pLevel )
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    NTSTATUS status = STATUS_SUCCESS;
+
+    for ( ULONG idx = First; Levels && idx < Levels->m_Count && NT_SUCCESS( status ); idx++ )
+    {
+        DagLevel* pMerged = Levels->m_Levels[ idx ];
+
+        for ( ULONG cou = 0; cou < pMerged->GetChecksCount() && NT_SUCCESS( status ); cou++ )
+        {
+            status = pLevel->Add( pMerged->GetCheck( cou ) );
+        }
+    }
+
+    for ( ULONG idx = 0; idx < m_PendingCount && NT_SUCCESS( status ); idx++ )
+    {
+        status = pLevel->Add( m_Pending[ idx ] );
+    }
+
+    if ( NT_SUCCESS( status ) )
+    {
+        status = pLevel->Build();
+    }
+
+    if ( !NT_SUCCESS( status ) )
+    {
+        FREE_OBJECT( pLevel );
+        return status;
+    }
+
+    *Level = pLevel;
+
+    return STATUS_SUCCESS;
+}
+
+__checkReturn
+NTSTATUS
+FilterDag::Commit (
+    __inout_opt PFltRetired Retired
+    )
+{
+    if ( !m_PendingCount )
+    {
+        // equ index has the checks added since
+        KeMemoryBarrier();
+        m_IndexedChecks = m_ChecksCount;
+
+        return STATUS_SUCCESS;
+    }
+
+    // each level stays bigger than twice the next one
+    PDagLevels pLevels = m_Levels;
+    ULONG count = pLevels ? pLevels->m_Count : 0;
+    ULONG first = count;
+    ULONG merged = m_PendingCount;
+
+    while ( first && pLevels->m_Levels[ first - 1 ]->GetChecksCount() <= merged * 2 )
+    {
+        first--;
+        merged += pLevels->m_Levels[ first ]->GetChecksCount();
+    }
+
+    ASSERT( first < FLT_DAG_LEVELS );
+
+    DagLevel* pLevel = NULL;
+    PDagLevels pNewLevels = NULL;
+
+    NTSTATUS status = STATUS_SUCCESS;
+
+    __try
+    {
+        status = BuildLevel( pLevels, first, &pLevel );
+        if ( !NT_SUCCESS( status ) )
+        {
+            __leave;
+        }
+
+        pNewLevels = (PDagLevels) ExAllocatePoolWithTag(
+            PagedPool,
+            sizeof( DagLevels ),
+            m_AllocTag
+            );
+
+        if ( !pNewLevels )
+        {
+            status = STATUS_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+
+        for ( ULONG idx = 0; idx < first; idx++ )
+        {
+            pNewLevels->m_Levels[ idx ] = pLevels->m_Levels[ idx ];
+        }
+
+        pNewLevels->m_Levels[ first ] = pLevel;
+        pNewLevels->m_Count = first + 1;
+
+        // merged levels and the old table
+        if ( Retired && pLevels )
+        {
+            status = FltRetiredReserve( Retired, count - first + 1 );
+            if ( !NT_SUCCESS( status ) )
+            {
+                __leave;
+            }
+        }
+
+        // checks are counted before they are indexed
+        KeMemoryBarrier();
+        m_Levels = pNewLevels;
+
+        for ( ULONG idx = first; idx < count; idx++ )
+        {
+            FltRetire( Retired, pLevels->m_Levels[ idx ], DestroyLevelp );
+        }
+
+        FltRetire( Retired, pLevels, NULL );
+
+        m_PendingCount = 0;
+
+        // probes find them once the levels are read
+        KeMemoryBarrier();
+        m_IndexedChecks = m_ChecksCount;
+    }
+    __finally
+    {
+        if ( !NT_SUCCESS( status ) )
+        {
+            FREE_OBJECT( pLevel );
+            FREE_POOL( pNewLevels );
+        }
+    }
+
+    return status;
+}
+
+__checkReturn
+NTSTATUS
+FilterDag::Match (
+    __in EventData *Event,
+    __in FltBitmap* Filtersbitmap,
+    __out PULONG Matched,
+    __out PPARAMS_MASK Fetched
+    )
+{
+    // check results for this event. Checks and filters added by
+    // concurrent Update after this point are skipped. Indexed count is
+    // read first, then levels that index at least the checks below it
+    DagMatch match;
+    match.m_IndexedChecks = m_IndexedChecks;
+
+    KeMemoryBarrier();
+    match.m_Levels = m_Levels;
+
+    KeMemoryBarrier();
+    match.m_ChecksCount = m_ChecksCount;
+    match.m_Probed = 0;
+    match.m_Present = 0;
+    match.m_Fetched = 0;
+
+    ULONG filterscount = Filtersbitmap->GetSize();
+
+    NTSTATUS status = match.m_Evaluated.Resize( match.m_ChecksCount );
+    if ( NT_SUCCESS( status ) )
+    {
+        status = match.m_Passed.Resize( match.m_ChecksCount );
+    }
+
+    if ( NT_SUCCESS( status ) )
+    {
+        status = match.m_Found.Resize( match.m_ChecksCount );
+    }
+
+    if ( !NT_SUCCESS( status ) )
+    {
+        return status;
+    }
+
+    ULONG matched = 0;
+    BOOLEAN bPassed;
+
+    // image is not replaced while the object is published
+    DagNode* pNodes = m_Image->m_Nodes;
+    PULONG pNext = m_Image->m_Next;
+
+    // passed nodes, children not visited yet
+    FltIdList pending;
+    status = pending.Append( FLT_DAG_ROOT );
+
+    while ( NT_SUCCESS( status ) && pending.GetCount() )
+    {
+        ULONG node = pending.Pop();
+        DagNode* pNode = &pNodes[ node ];
+
+        for (
+            ULONG position = pNode->m_FirstFilter;
+            position != FLT_DAG_NONE;
+            position = pNext[ position ]
+            )
+        {
+            if ( position < filterscount )
+            {
+                Filtersbitmap->Clear( position );
+                matched++;
+            }
+        }
+
+        for (
+            ULONG child = pNode->m_Child;
+            NT_SUCCESS( status ) && child != FLT_DAG_NONE;
+            child = pNodes[ child ].m_Sibling
+            )
+        {
+            status = CheckNode( Event, &pNodes[ child ], &match, &bPassed );
+            if ( NT_SUCCESS( status ) && bPassed )
+            {
+                status = pending.Append( child );
+            }
+        }
+
+        if ( !NT_SUCCESS( status ) || FLT_DAG_NONE == pNode->m_Dispatch )
+        {
+            continue;
+        }
+
+        PARAMS_MASK parameters = pNode->m_DispatchParams;
+        PARAMS_MASK absent = pNode->m_AbsentParams;
+
+        for ( ULONG64 bits = parameters; NT_SUCCESS( status ) && bits; bits &= bits - 1 )
+        {
+            status = ProbeParameter( Event, FltBitmapWordLowest( bits ), &match );
+        }
+
+        if ( !NT_SUCCESS( status ) )
+        {
+            continue;
+        }
+
+        // absent parameter passes checks without BePresent, more hits than
+        // children - cheaper to check the children one by one. Children
+        // waiting for Commit have no hits
+        ULONG hits = match.m_Found.GetCount();
+
+        if (
+            !match.m_Found.IsListed()
+            ||
+            FlagOn( absent, ~match.m_Present )
+            ||
+            hits >= pNode->m_DispatchCount
+            ||
+            match.m_IndexedChecks < match.m_ChecksCount
+            )
+        {
+            for (
+                ULONG child = pNode->m_Dispatch;
+                NT_SUCCESS( status ) && child != FLT_DAG_NONE;
+                child = pNodes[ child ].m_Sibling
+                )
+            {
+                status = CheckNode( Event, &pNodes[ child ], &match, &bPassed );
+                if ( NT_SUCCESS( status ) && bPassed )
+                {
+                    status = pending.Append( child );
+                }
+            }
+
+            continue;
+        }
+
+        // found value passes the check - only children of the hits
+        for ( ULONG idx = 0; NT_SUCCESS( status ) && idx < hits; idx++ )
+        {
+            ULONG child = FindChild( node, match.m_Found.GetHit( idx ) );
+            if ( FLT_DAG_NONE != child && pNodes[ child ].m_Dispatched )
+            {
+                status = pending.Append( child );
+            }
+        }
+    }
+
+    if ( !NT_SUCCESS( status ) )
+    {
+        // no memory - caller walks the list
+        return status;
+    }
+
+    *Matched = matched;
+    *Fetched = match.m_Fetched | match.m_Probed;
+
+    return STATUS_SUCCESS;
+}
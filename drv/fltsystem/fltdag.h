@@ -0,0 +1,314 @@
+#pragma once
+
+//!
+//    \description - compiled form of Filters parameters. Every filter is
+//                   a chain of its checks sorted cheap and widely shared
+//                   first, chains with common prefix share nodes. Failed
+//                   check prunes the whole subtree, each check is
+//                   evaluated once per event.
+//
+//                   Nodes and filter links live in one image, nodes are
+//                   linked by index. Match reads the check fields it needs
+//                   from the node, the entry is touched only to evaluate.
+//                   Children passed only by a found value are not walked:
+//                   Match looks up the child of every probe hit in the
+//                   image hash of ( parent, check ) pairs.
+//
+//                   Match runs without locks while Update appends filters
+//                   into spare room of the image: node is filled before it
+//                   is linked or hashed, filter position is linked after
+//                   its next link. Image is full - Update fails and the
+//                   caller compiles a new one. Compile and Invalidate are
+//                   for the object not visible to readers.
+//
+//                   Masks, prefixes and ordered checks are indexed in
+//                   levels. Checks added by Update
+//                   wait for Commit, it builds them into a new level and
+//                   merges smaller levels into it - a check is rebuilt
+//                   O(log N) times, a probe visits O(log N) levels. Built
+//                   level is not changed, the table of levels is replaced
+//                   as a whole. Until then probes don't find them - Match
+//                   evaluates checks above the indexed count one by one.
+//!
+
+#include "fltbitmap.h"
+#include "fltchecks.h"
+#include "fltepoch.h"
+#include "fltequ.h"
+#include "fltpattern.h"
+#include "fltprefix.h"
+#include "fltrange.h"
+
+#define FLT_DAG_NONE            ( (ULONG) -1 )
+#define FLT_DAG_ROOT            0
+#define FLT_DAG_SPARE_NODES     128
+#define FLT_DAG_LEVELS          32      // each is less than half of the previous
+#define FLT_DAG_DRIFT           8       // recompile after an eighth more filters
+
+// links are node indexes in the image
+struct DagNode
+{
+    ParamCheckEntry*    m_Check;
+    ULONG               m_Parent;
+    volatile ULONG      m_Child;            // children checked one by one
+    volatile ULONG      m_Dispatch;         // children found by hits
+    ULONG               m_Sibling;
+    volatile ULONG      m_FirstFilter;      // filters whose chain ends here
+    ULONG               m_CheckIdx;         // entry is renumbered by next Compile
+    ULONG               m_Parameter;        // generic check
+    volatile ULONG      m_DispatchCount;
+    volatile PARAMS_MASK m_DispatchParams;  // parameters of found children
+    volatile PARAMS_MASK m_AbsentParams;    // ... passed by absent parameter
+    BOOLEAN             m_Generic;
+    BOOLEAN             m_Indexed;          // found bit is set by a probe
+    BOOLEAN             m_Dispatched;       // indexed, passed only if found
+};
+
+typedef struct _DagImage
+{
+    SIZE_T              m_Size;             // bytes of the image
+    ULONG               m_NodesCapacity;
+    ULONG               m_NodesCount;
+    ULONG               m_FiltersCapacity;
+    ULONG               m_SlotsMask;
+    PULONG              m_Next;             // next filter of the same node
+    PULONG              m_Slots;            // child by parent and check
+    DagNode             m_Nodes[1];
+} DagImage, *PDagImage;
+
+// checks indexed together, built once
+class DagLevel
+{
+public:
+    DagLevel();
+    ~DagLevel();
+
+    static
+    BOOLEAN
+    IsIndexed (
+        __in ParamCheckEntry* Entry
+        );
+
+    __checkReturn
+    NTSTATUS
+    Add (
+        __in ParamCheckEntry* Entry
+        );
+
+    __checkReturn
+    NTSTATUS
+    Build();
+
+    __checkReturn
+    NTSTATUS
+    Probe (
+        __in ULONG ParameterId,
+        __in PVOID Data,
+        __in ULONG DataSize,
+        __in FltHits* Found
+        );
+
+    ULONG
+    GetChecksCount (
+        )
+    {
+        return m_ChecksCount;
+    }
+
+    ParamCheckEntry*
+    GetCheck (
+        __in ULONG Idx
+        )
+    {
+        ASSERT( Idx < m_ChecksCount );
+
+        return m_Checks[ Idx ];
+    }
+
+private:
+    PatternIndex        m_Patterns;
+    PrefixIndex         m_Prefixes;
+    FilterRangeIndex    m_Ranges;
+
+    ParamCheckEntry**   m_Checks;           // to merge into a bigger level
+    ULONG               m_ChecksCount;
+    ULONG               m_ChecksCapacity;
+};
+
+typedef struct _DagLevels
+{
+    ULONG               m_Count;
+    DagLevel*           m_Levels[ FLT_DAG_LEVELS ];
+} DagLevels, *PDagLevels;
+
+// results of one event, a check is evaluated or probed once
+typedef struct _DagMatch
+{
+    PDagLevels          m_Levels;
+    ULONG               m_IndexedChecks;    // below it found by probes
+    ULONG               m_ChecksCount;
+    FltBitmap           m_Evaluated;
+    FltBitmap           m_Passed;
+    FltHits             m_Found;            // set by index probes
+    PARAMS_MASK         m_Probed;
+    PARAMS_MASK         m_Present;
+    PARAMS_MASK         m_Fetched;
+} DagMatch, *PDagMatch;
+
+class FilterDag
+{
+public:
+    static ULONG        m_AllocTag;
+
+public:
+    FilterDag();
+    ~FilterDag();
+
+    BOOLEAN
+    IsValid (
+        )
+    {
+        return m_Valid;
+    }
+
+    void
+    Invalidate();
+
+    BOOLEAN
+    NeedsCompile (
+        __in ULONG FiltersCount
+        )
+    {
+        // Update ranks a chain by the shared counts of the moment. Fetch
+        // and cost classes don't change, stale is only the order inside
+        // one class - and only for filters added since last Compile
+        return !m_Valid
+            || FiltersCount > m_CompiledFilters + m_CompiledFilters / FLT_DAG_DRIFT;
+    }
+
+    __checkReturn
+    NTSTATUS
+    Compile (
+        __in PLIST_ENTRY ParamsCheckList,
+        __in FltBitmap* ActiveFilters,
+        __in ULONG FiltersCount
+        );
+
+    __checkReturn
+    NTSTATUS
+    Update (
+        __in ULONG FiltersCount,
+        __in ULONG Position,
+        __in ULONG ChecksCount,
+        __in_ecount(ChecksCount) ParamCheckEntry** Checks
+        );
+
+    // indexes checks added by Update, replaced levels are retired
+    __checkReturn
+    NTSTATUS
+    Commit (
+        __inout_opt PFltRetired Retired
+        );
+
+    __checkReturn
+    NTSTATUS
+    Match (
+        __in EventData *Event,
+        __in FltBitmap* Filtersbitmap,
+        __out PULONG Matched,
+        __out PPARAMS_MASK Fetched
+        );
+
+    PARAMS_MASK
+    GetExpensiveParams (
+        )
+    {
+        return m_ExpensiveParams;
+    }
+
+    SIZE_T
+    GetImageSize (
+        )
+    {
+        return m_Image ? m_Image->m_Size : 0;
+    }
+
+private:
+    __checkReturn
+    NTSTATUS
+    AllocateImage (
+        __in ULONG NodesCapacity,
+        __in ULONG FiltersCapacity
+        );
+
+    ULONG
+    AllocateNode (
+        __in ParamCheckEntry* Entry
+        );
+
+    __checkReturn
+    NTSTATUS
+    IndexCheck (
+        __in ParamCheckEntry* Entry
+        );
+
+    __checkReturn
+    NTSTATUS
+    BuildLevel (
+        __in_opt PDagLevels Levels,
+        __in ULONG First,
+        __deref_out DagLevel** Level
+        );
+
+    BOOLEAN
+    IsIndexedCheck (
+        __in ParamCheckEntry* Entry
+        );
+
+    ULONG
+    FindChild (
+        __in ULONG Node,
+        __in ULONG CheckIdx
+        );
+
+    __checkReturn
+    NTSTATUS
+    ProbeParameter (
+        __in EventData *Event,
+        __in ULONG ParameterId,
+        __inout PDagMatch Match
+        );
+
+    __checkReturn
+    NTSTATUS
+    CheckNode (
+        __in EventData *Event,
+        __in DagNode* Node,
+        __inout PDagMatch Match,
+        __out PBOOLEAN Passed
+        );
+
+    __checkReturn
+    NTSTATUS
+    InsertChain (
+        __in ULONG Position,
+        __in ULONG ChecksCount,
+        __in ParamCheckEntry** Checks
+        );
+
+private:
+    BOOLEAN             m_Valid;
+    volatile ULONG      m_ChecksCount;
+    volatile ULONG      m_IndexedChecks;    // checks in levels by last Commit
+    ULONG               m_CompiledFilters;
+
+    FilterEquIndex      m_EquIndex;
+
+    PDagLevels volatile m_Levels;
+    ParamCheckEntry**   m_Pending;          // added since last Commit
+    ULONG               m_PendingCount;
+    ULONG               m_PendingCapacity;
+    PARAMS_MASK         m_ExpensiveParams;  // expensive parameters used by checks
+
+    PDagImage           m_Image;
+};
@@ -0,0 +1,225 @@
+#include "../inc/commonkrnl.h"
+#include "fltepoch.h"
+
+static DECLSPEC_CACHEALIGN FltEpochSlot gEpochSlots[ FLT_EPOCH_SLOTS ];
+static volatile LONG gEpochIndex;
+static volatile LONG gEpochWriter;
+
+#define FLT_EPOCH_SPIN          4096
+#define FLT_RETIRED_TAG         'trSA'
+#define FLT_EPOCH_DELAY         ( -10 * 1000 )  // 1ms, relative
+
+void
+FltEpochEnter (
+    __out PFltEpochToken Token
+    )
+{
+    Token->m_Slot = &gEpochSlots[ KeGetCurrentProcessorNumber() % FLT_EPOCH_SLOTS ];
+    Token->m_Epoch = gEpochIndex & 1;
+
+    // interlocked is a full barrier - published pointers are read after
+    // the reader is counted
+    InterlockedIncrement( &Token->m_Slot->m_Entered[ Token->m_Epoch ] );
+}
+
+void
+FltEpochLeave (
+    __in PFltEpochToken Token
+    )
+{
+    InterlockedIncrement( &Token->m_Slot->m_Left[ Token->m_Epoch ] );
+}
+
+BOOLEAN
+FltEpochIsIdlep (
+    __in ULONG Epoch
+    )
+{
+    // Left first: reader counted in Left is counted in Entered as well,
+    // so equal sums mean no reader inside of the epoch
+    LONG left = 0;
+    for ( ULONG idx = 0; idx < FLT_EPOCH_SLOTS; idx++ )
+    {
+        left += gEpochSlots[ idx ].m_Left[ Epoch ];
+    }
+
+    KeMemoryBarrier();
+
+    LONG entered = 0;
+    for ( ULONG idx = 0; idx < FLT_EPOCH_SLOTS; idx++ )
+    {
+        entered += gEpochSlots[ idx ].m_Entered[ Epoch ];
+    }
+
+    return entered == left;
+}
+
+void
+FltEpochWaitp (
+    __in ULONG Epoch
+    )
+{
+    ULONG spin = 0;
+    while ( !FltEpochIsIdlep( Epoch ) )
+    {
+        if ( spin < FLT_EPOCH_SPIN )
+        {
+            spin++;
+            YieldProcessor();
+        }
+        else
+        {
+            LARGE_INTEGER interval;
+            interval.QuadPart = FLT_EPOCH_DELAY;
+            KeDelayExecutionThread( KernelMode, FALSE, &interval );
+        }
+    }
+}
+
+void
+FltEpochSynchronize (
+    )
+{
+    while ( InterlockedCompareExchange( &gEpochWriter, 1, 0 ) )
+    {
+        YieldProcessor();
+    }
+
+    // reader may sample the index just before the flip and be counted in
+    // the new epoch - two flips drain both counters
+    for ( ULONG pass = 0; pass < 2; pass++ )
+    {
+        LONG epoch = gEpochIndex & 1;
+        InterlockedExchange( &gEpochIndex, epoch ^ 1 );
+
+        FltEpochWaitp( epoch );
+    }
+
+    InterlockedExchange( &gEpochWriter, 0 );
+}
+
+void
+FltRetiredInit (
+    __out PFltRetired Retired
+    )
+{
+    Retired->m_Count = 0;
+    Retired->m_Capacity = FLT_RETIRED_BLOCKS;
+    Retired->m_Blocks = Retired->m_Inline;
+}
+
+__checkReturn
+NTSTATUS
+FltRetiredReserve (
+    __inout PFltRetired Retired,
+    __in ULONG Count
+    )
+{
+    if ( Retired->m_Capacity - Retired->m_Count >= Count )
+    {
+        return STATUS_SUCCESS;
+    }
+
+    ULONG capacity = Retired->m_Capacity * 2;
+    while ( capacity - Retired->m_Count < Count )
+    {
+        capacity *= 2;
+    }
+
+    PFltRetiredBlock pBlocks = (PFltRetiredBlock) ExAllocatePoolWithTag(
+        PagedPool,
+        sizeof( FltRetiredBlock ) * capacity,
+        FLT_RETIRED_TAG
+        );
+
+    if ( !pBlocks )
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlCopyMemory( pBlocks, Retired->m_Blocks, sizeof( FltRetiredBlock ) * Retired->m_Count );
+
+    if ( Retired->m_Blocks != Retired->m_Inline )
+    {
+        ExFreePool( Retired->m_Blocks );
+    }
+
+    Retired->m_Blocks = pBlocks;
+    Retired->m_Capacity = capacity;
+
+    return STATUS_SUCCESS;
+}
+
+void
+FltRetireFreep (
+    __in PFltRetiredBlock Block
+    )
+{
+    if ( Block->m_Routine )
+    {
+        Block->m_Routine( Block->m_Block );
+    }
+    else
+    {
+        ExFreePool( Block->m_Block );
+    }
+}
+
+void
+FltRetire (
+    __inout_opt PFltRetired Retired,
+    __in_opt PVOID Block,
+    __in_opt PFLT_RETIRE_ROUTINE Routine
+    )
+{
+    if ( !Block )
+    {
+        return;
+    }
+
+    FltRetiredBlock block;
+    block.m_Block = Block;
+    block.m_Routine = Routine;
+
+    if ( !Retired )
+    {
+        FltRetireFreep( &block );
+        return;
+    }
+
+    // no waiting here - the caller may hold a lock readers take on
+    // fallback. Room is reserved before the block was unpublished, the
+    // block is leaked if it was not and the pool is exhausted
+    NTSTATUS status = FltRetiredReserve( Retired, 1 );
+    if ( !NT_SUCCESS( status ) )
+    {
+        ASSERT( NT_SUCCESS( status ) );
+        return;
+    }
+
+    Retired->m_Blocks[ Retired->m_Count++ ] = block;
+}
+
+void
+FltRetiredRelease (
+    __inout PFltRetired Retired
+    )
+{
+    // reserved room may be left unused
+    if ( Retired->m_Count )
+    {
+        FltEpochSynchronize();
+    }
+
+    for ( ULONG idx = 0; idx < Retired->m_Count; idx++ )
+    {
+        FltRetireFreep( &Retired->m_Blocks[ idx ] );
+    }
+
+    if ( Retired->m_Blocks != Retired->m_Inline )
+    {
+        ExFreePool( Retired->m_Blocks );
+    }
+
+    FltRetiredInit( Retired );
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+//!
+//    \description - epoch based reclamation for the lock-free read path.
+//                   Readers bracket access to published structures with
+//                   FltEpochEnter/FltEpochLeave (two interlocked increments
+//                   on a per-processor slot, no shared cache line). Writer
+//                   unpublishes a block, collects it into FltRetired and
+//                   frees it after FltEpochSynchronize - when every reader
+//                   that could see the block has left.
+//
+//                   FltEpochSynchronize waits for readers: never call it
+//                   (or FltRetiredRelease) while holding a lock that reader
+//                   may take inside of the epoch section. FltRetire never
+//                   waits, FltRetired grows instead.
+//!
+
+#define FLT_EPOCH_SLOTS         64
+#define FLT_RETIRED_BLOCKS      8
+
+typedef struct _FltEpochSlot
+{
+    volatile LONG       m_Entered[2];
+    volatile LONG       m_Left[2];
+    UCHAR               m_Padding[ SYSTEM_CACHE_ALIGNMENT_SIZE - 4 * sizeof( LONG ) ];
+} FltEpochSlot, *PFltEpochSlot;
+
+typedef struct _FltEpochToken
+{
+    PFltEpochSlot       m_Slot;
+    ULONG               m_Epoch;
+} FltEpochToken, *PFltEpochToken;
+
+void
+FltEpochEnter (
+    __out PFltEpochToken Token
+    );
+
+void
+FltEpochLeave (
+    __in PFltEpochToken Token
+    );
+
+void
+FltEpochSynchronize (
+    );
+
+typedef void ( *PFLT_RETIRE_ROUTINE ) (
+    __in PVOID Block
+    );
+
+typedef struct _FltRetiredBlock
+{
+    PVOID                   m_Block;
+    PFLT_RETIRE_ROUTINE     m_Routine;      // NULL - pool block
+} FltRetiredBlock, *PFltRetiredBlock;
+
+// first FLT_RETIRED_BLOCKS blocks are kept inside, pool array above
+typedef struct _FltRetired
+{
+    ULONG                   m_Count;
+    ULONG                   m_Capacity;
+    PFltRetiredBlock        m_Blocks;
+    FltRetiredBlock         m_Inline[ FLT_RETIRED_BLOCKS ];
+} FltRetired, *PFltRetired;
+
+void
+FltRetiredInit (
+    __out PFltRetired Retired
+    );
+
+// room for Count more blocks. Writer reserves before it unpublishes
+// anything, so a failure leaves published state as it was
+__checkReturn
+NTSTATUS
+FltRetiredReserve (
+    __inout PFltRetired Retired,
+    __in ULONG Count
+    );
+
+// Retired == NULL - block was never published, freed immediately
+void
+FltRetire (
+    __inout_opt PFltRetired Retired,
+    __in_opt PVOID Block,
+    __in_opt PFLT_RETIRE_ROUTINE Routine
+    );
+
+// waits for grace period (only when something retired) and frees blocks
+void
+FltRetiredRelease (
+    __inout PFltRetired Retired
+    );
@@ -0,0 +1,228 @@
+#include "../inc/commonkrnl.h"
+#include "../inc/memmgr.h"
+#include "../../inc/accessch.h"
+#include "fltequ.h"
+
+ULONG FilterEquIndex::m_AllocTag = 'qeSA';
+
+FilterEquIndex::FilterEquIndex (
+    )
+{
+    m_Table = NULL;
+    m_ItemsCount = 0;
+}
+
+FilterEquIndex::~FilterEquIndex (
+    )
+{
+    Reset();
+}
+
+BOOLEAN
+FilterEquIndex::IsIndexed (
+    __in ParamCheckEntry* Entry
+    )
+{
+    if (
+        CheckEntryGeneric == Entry->m_Type
+        &&
+        FltOp_equ == Entry->Generic.m_Operation
+        &&
+        Entry->Generic.m_Parameter <= PARAMETER_MAXIMUM
+        )
+    {
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+ULONG
+FilterEquIndex::GetHash (
+    __in ULONG ParameterId,
+    __in PVOID Data,
+    __in ULONG DataSize
+    )
+{
+    // FNV-1a
+    ULONG hash = 2166136261 ^ ParameterId;
+    PUCHAR ptr = (PUCHAR) Data;
+
+    for ( ULONG idx = 0; idx < DataSize; idx++ )
+    {
+        hash ^= ptr[ idx ];
+        hash *= 16777619;
+    }
+
+    return hash;
+}
+
+void
+FilterEquIndex::Reset (
+    )
+{
+    PEquTable pTable = m_Table;
+    while ( pTable )
+    {
+        PEquTable pSuperseded = pTable->m_Superseded;
+        ExFreePool( pTable );
+        pTable = pSuperseded;
+    }
+
+    m_Table = NULL;
+    m_ItemsCount = 0;
+}
+
+__checkReturn
+NTSTATUS
+FilterEquIndex::Reserve (
+    __in ULONG ItemsCount
+    )
+{
+    PEquTable pTable = m_Table;
+    if ( pTable && ItemsCount <= pTable->m_ItemsCapacity )
+    {
+        return STATUS_SUCCESS;
+    }
+
+    ULONG capacity = pTable ? pTable->m_ItemsCapacity * 2 : 0;
+    capacity = max( ItemsCount, capacity );
+
+    // keep load factor under 1, buckets count is power of 2
+    ULONG bucketscount = FLT_EQU_MIN_BUCKETS;
+    while ( bucketscount < capacity )
+    {
+        bucketscount *= 2;
+    }
+
+    ULONG itemsoffset = (ULONG) ALIGN_UP_BY(
+        FIELD_OFFSET( EquTable, m_Buckets ) + sizeof( ULONG ) * bucketscount,
+        sizeof( PVOID )
+        );
+
+    PEquTable pNewTable = (PEquTable) ExAllocatePoolWithTag(
+        PagedPool,
+        itemsoffset + sizeof( EquItem ) * capacity,
+        m_AllocTag
+        );
+
+    if ( !pNewTable )
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    pNewTable->m_Superseded = pTable;
+    pNewTable->m_BucketsCount = bucketscount;
+    pNewTable->m_ItemsCapacity = capacity;
+    pNewTable->m_Items = (PEquItem) Add2Ptr( pNewTable, itemsoffset );
+
+    RtlFillMemory(
+        (PVOID) pNewTable->m_Buckets,
+        sizeof( ULONG ) * bucketscount,
+        0xff
+        );
+
+    // rehash into the new table, readers still walk the old one
+    for ( ULONG idx = 0; idx < m_ItemsCount; idx++ )
+    {
+        PEquItem pItem = &pNewTable->m_Items[ idx ];
+        *pItem = pTable->m_Items[ idx ];
+
+        ULONG bucket = pItem->m_Hash & ( bucketscount - 1 );
+
+        pItem->m_Next = pNewTable->m_Buckets[ bucket ];
+        pNewTable->m_Buckets[ bucket ] = idx;
+    }
+
+    KeMemoryBarrier();
+    m_Table = pNewTable;
+
+    return STATUS_SUCCESS;
+}
+
+__checkReturn
+NTSTATUS
+FilterEquIndex::AddEntry (
+    __in ParamCheckEntry* Entry
+    )
+{
+    ASSERT( IsIndexed( Entry ) );
+
+    FltCheckData* pCheck = Entry->Generic.m_CheckData;
+
+    ASSERT( pCheck->m_Count );
+    ULONG itemsize = pCheck->m_DataSize / pCheck->m_Count;
+
+    NTSTATUS status = Reserve( m_ItemsCount + pCheck->m_Count );
+    if ( !NT_SUCCESS( status ) )
+    {
+        return status;
+    }
+
+    PEquTable pTable = m_Table;
+    PUCHAR ptr = pCheck->m_Data;
+
+    for ( ULONG item = 0; item < pCheck->m_Count; item++ )
+    {
+        PEquItem pItem = &pTable->m_Items[ m_ItemsCount ];
+
+        pItem->m_Hash = GetHash( Entry->Generic.m_Parameter, ptr, itemsize );
+        pItem->m_ParameterId = Entry->Generic.m_Parameter;
+        pItem->m_Size = itemsize;
+        pItem->m_CheckIdx = Entry->m_CheckIdx;
+        pItem->m_Value = ptr;
+
+        ULONG bucket = pItem->m_Hash & ( pTable->m_BucketsCount - 1 );
+        pItem->m_Next = pTable->m_Buckets[ bucket ];
+
+        KeMemoryBarrier();
+        pTable->m_Buckets[ bucket ] = m_ItemsCount;
+
+        m_ItemsCount++;
+
+        ptr = (PUCHAR) Add2Ptr( ptr, itemsize );
+    }
+
+    return STATUS_SUCCESS;
+}
+
+void
+FilterEquIndex::Probe (
+    __in ULONG ParameterId,
+    __in PVOID Data,
+    __in ULONG DataSize,
+    __in FltHits* Found
+    )
+{
+    PEquTable pTable = m_Table;
+    if ( !pTable )
+    {
+        return;
+    }
+
+    ULONG hash = GetHash( ParameterId, Data, DataSize );
+
+    for (
+        ULONG idx = pTable->m_Buckets[ hash & ( pTable->m_BucketsCount - 1 ) ];
+        idx != FLT_EQU_NONE;
+        idx = pTable->m_Items[ idx ].m_Next
+        )
+    {
+        PEquItem pItem = &pTable->m_Items[ idx ];
+
+        if (
+            pItem->m_Hash == hash
+            &&
+            pItem->m_ParameterId == ParameterId
+            &&
+            pItem->m_Size == DataSize
+            &&
+            RtlEqualMemory( pItem->m_Value, Data, DataSize )
+            &&
+            pItem->m_CheckIdx < Found->GetSize()
+            )
+        {
+            Found->Set( pItem->m_CheckIdx );
+        }
+    }
+}
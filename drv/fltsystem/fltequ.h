@@ -0,0 +1,89 @@
+#pragma once
+
+//!
+//    \description - hash index of FltOp_equ checks. Maps parameter id and
+//                   value to the checks holding this value, so an equality
+//                   parameter is answered with one QueryParameter and one
+//                   probe for all filters.
+//
+//                   Probe runs without locks: table grows into a new
+//                   allocation (previous one stays until Reset), item is
+//                   filled before it is linked into a bucket.
+//!
+
+#include "fltbitmap.h"
+#include "fltchecks.h"
+
+#define FLT_EQU_NONE            ( (ULONG) -1 )
+#define FLT_EQU_MIN_BUCKETS     64
+
+typedef struct _EquItem
+{
+    ULONG               m_Next;
+    ULONG               m_Hash;
+    ULONG               m_ParameterId;
+    ULONG               m_Size;
+    ULONG               m_CheckIdx;
+    PUCHAR              m_Value;
+} EquItem, *PEquItem;
+
+typedef struct _EquTable
+{
+    struct _EquTable*   m_Superseded;
+    ULONG               m_BucketsCount;     // power of 2, not less than capacity
+    ULONG               m_ItemsCapacity;
+    PEquItem            m_Items;
+    volatile ULONG      m_Buckets[1];
+} EquTable, *PEquTable;
+
+class FilterEquIndex
+{
+public:
+    static ULONG        m_AllocTag;
+
+public:
+    FilterEquIndex();
+    ~FilterEquIndex();
+
+    static
+    BOOLEAN
+    IsIndexed (
+        __in ParamCheckEntry* Entry
+        );
+
+    void
+    Reset();
+
+    __checkReturn
+    NTSTATUS
+    AddEntry (
+        __in ParamCheckEntry* Entry
+        );
+
+    void
+    Probe (
+        __in ULONG ParameterId,
+        __in PVOID Data,
+        __in ULONG DataSize,
+        __in FltHits* Found
+        );
+
+private:
+    static
+    ULONG
+    GetHash (
+        __in ULONG ParameterId,
+        __in PVOID Data,
+        __in ULONG DataSize
+        );
+
+    __checkReturn
+    NTSTATUS
+    Reserve (
+        __in ULONG ItemsCount
+        );
+
+private:
+    PEquTable volatile  m_Table;
+    ULONG               m_ItemsCount;
+};
@@ -7,45 +7,157 @@
 
 ULONG Filters::m_AllocTag = 'ifSA';
 
-struct FilterEntry
+// what GetVerdict reads for a matched filter, 4 filters per cache line
+typedef struct _FilterVerdict
 {
-    ULONG               m_Flags;
     ULONG               m_FilterId;
-    UCHAR               m_GroupId;
     VERDICT             m_Verdict;
-    HANDLE              m_ProcessId;
     PARAMS_MASK         m_WishMask;
-    ULONG               m_RequestTimeout;
+} FilterVerdict, *PFilterVerdict;
+
+// filters by position in parallel arrays of one pool block. Cold
+// arrays are used by writers only
+struct FilterArrays
+{
+    ULONG               m_Capacity;
+    SIZE_T              m_Size;             // bytes of the block
+    PFilterVerdict      m_Verdicts;
+    PUCHAR              m_GroupIds;
+    HANDLE*             m_ProcessIds;
+    PULONG              m_RequestTimeouts;
+    PULONG              m_PolicyBytes;      // params of the filter as they came
 };
 
+#define FLT_ARRAY_ALIGN     64
+
+// blocks CommitChain retires: groups, dag and snapshot
+#define FLT_CHAIN_RETIRED   3
+
 //////////////////////////////////////////////////////////////////////////
 
-Filters::Filters (
+FilterArrays*
+AllocateFilterArraysp (
+    __in ULONG Capacity,
+    __in ULONG Tag
     )
 {
-    ExInitializeRundownProtection( &m_Ref );
-    FltInitializePushLock( &m_AccessLock );
-    
-    RtlInitializeBitMap(
-        &m_GroupsMap,
-        m_GroupsMapBuffer,
-        NumberOfBits
+    // every array starts on a cache line of the block
+    SIZE_T header = ALIGN_UP_BY( sizeof( FilterArrays ), FLT_ARRAY_ALIGN );
+    SIZE_T verdicts = ALIGN_UP_BY( sizeof( FilterVerdict ) * Capacity, FLT_ARRAY_ALIGN );
+    SIZE_T groupids = ALIGN_UP_BY( sizeof( UCHAR ) * Capacity, FLT_ARRAY_ALIGN );
+    SIZE_T processids = ALIGN_UP_BY( sizeof( HANDLE ) * Capacity, FLT_ARRAY_ALIGN );
+    SIZE_T timeouts = ALIGN_UP_BY( sizeof( ULONG ) * Capacity, FLT_ARRAY_ALIGN );
+    SIZE_T size = header + verdicts + groupids + processids + timeouts
+        + sizeof( ULONG ) * Capacity;
+
+    FilterArrays* pArrays = (FilterArrays*) ExAllocatePoolWithTag(
+        PagedPool,
+        size,
+        Tag
         );
 
-    RtlClearAllBits( &m_GroupsMap );
-    m_GroupCount = 0;
+    if ( !pArrays )
+    {
+        return NULL;
+    }
+
+    pArrays->m_Capacity = Capacity;
+    pArrays->m_Size = size;
+    pArrays->m_Verdicts = (PFilterVerdict) Add2Ptr( pArrays, header );
+    pArrays->m_GroupIds = (PUCHAR) Add2Ptr( pArrays->m_Verdicts, verdicts );
+    pArrays->m_ProcessIds = (HANDLE*) Add2Ptr( pArrays->m_GroupIds, groupids );
+    pArrays->m_RequestTimeouts = (PULONG) Add2Ptr( pArrays->m_ProcessIds, processids );
+    pArrays->m_PolicyBytes = (PULONG) Add2Ptr( pArrays->m_RequestTimeouts, timeouts );
 
-    RtlInitializeBitMap(
-        &m_ActiveFilters,
-        m_ActiveFiltersBuffer,
-        NumberOfBits
+    return pArrays;
+}
+
+void
+CopyFiltersp (
+    __in FilterArrays* To,
+    __in ULONG ToPosition,
+    __in FilterArrays* From,
+    __in ULONG FromPosition,
+    __in ULONG Count
+    )
+{
+    ASSERT( ToPosition + Count <= To->m_Capacity );
+    ASSERT( FromPosition + Count <= From->m_Capacity );
+
+    RtlCopyMemory(
+        &To->m_Verdicts[ ToPosition ],
+        &From->m_Verdicts[ FromPosition ],
+        sizeof( FilterVerdict ) * Count
         );
-    
-    RtlClearAllBits( &m_ActiveFilters );
+
+    RtlCopyMemory(
+        &To->m_GroupIds[ ToPosition ],
+        &From->m_GroupIds[ FromPosition ],
+        sizeof( UCHAR ) * Count
+        );
+
+    RtlCopyMemory(
+        &To->m_ProcessIds[ ToPosition ],
+        &From->m_ProcessIds[ FromPosition ],
+        sizeof( HANDLE ) * Count
+        );
+
+    RtlCopyMemory(
+        &To->m_RequestTimeouts[ ToPosition ],
+        &From->m_RequestTimeouts[ FromPosition ],
+        sizeof( ULONG ) * Count
+        );
+
+    RtlCopyMemory(
+        &To->m_PolicyBytes[ ToPosition ],
+        &From->m_PolicyBytes[ FromPosition ],
+        sizeof( ULONG ) * Count
+        );
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void
+DestroyDagp (
+    __in PVOID Dag
+    )
+{
+    FilterDag* pDag = (FilterDag*) Dag;
+
+    FREE_OBJECT( pDag );
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+Filters::Filters (
+    )
+{
+    ExInitializeRundownProtection( &m_Ref );
+    FltInitializePushLock( &m_AccessLock );
+
+    m_ExpensiveFetched = 0;
+    m_ExpensiveAvoided = 0;
 
     m_FiltersCount = 0;
+    m_FiltersCapacity = 0;
     m_FiltersArray = NULL;
+    m_PolicyBytes = 0;
     InitializeListHead( &m_ParamsCheckList );
+
+    m_Snapshot = NULL;
+
+    m_CacheParams = 0;
+    m_Uncacheable = FALSE;
+
+    m_ChainFirst = 0;
+    m_ChainSnapshot = NULL;
+    m_ChainCacheParams = 0;
+    m_ChainUncacheable = FALSE;
+    FltRetiredInit( &m_ChainRetired );
+
+    m_ChainChecks = NULL;
+    m_ChainChecksCount = 0;
+    m_ChainChecksCapacity = 0;
 }
 
 Filters::~Filters (
@@ -74,7 +186,20 @@ Filters::~Filters (
         }
     }
     
+    // readers are gone - storage unpublished the object and waited
+    if ( m_Snapshot )
+    {
+        DestroyDagp( m_Snapshot->m_Dag );
+        FREE_POOL( m_Snapshot->m_Groups );
+        FREE_POOL( m_Snapshot );
+    }
+
     FREE_POOL( m_FiltersArray );
+    FREE_POOL( m_ChainSnapshot );
+    FREE_POOL( m_ChainChecks );
+
+    // room reserved by a failed BeginChain
+    FltRetiredRelease( &m_ChainRetired );
 }
 
 __checkReturn
@@ -110,11 +235,27 @@ Filters::IsEmpty (
     return TRUE;
 }
 
+__checkReturn
+BOOLEAN
+Filters::GetCacheParams (
+    __out PPARAMS_MASK Params
+    )
+{
+    if ( m_Uncacheable )
+    {
+        return FALSE;
+    }
+
+    *Params = m_CacheParams;
+
+    return TRUE;
+}
+
 NTSTATUS
 Filters::CheckParamsList (
     __in EventData *Event,
     __in PULONG Unmatched,
-    __in PRTL_BITMAP Filtersbitmap
+    __in FltBitmap* Filtersbitmap
     )
 {
     // must - at least one filter is active
@@ -143,7 +284,7 @@ Filters::CheckParamsList (
         BOOLEAN bExistActiveFilter = FALSE;
         for ( ULONG cou = 0; cou < pEntry->m_PosCount; cou++ )
         {
-            if ( !RtlCheckBit ( Filtersbitmap, pEntry->m_FilterPosList[cou] ) )
+            if ( !Filtersbitmap->Test( pEntry->m_FilterPosList[cou] ) )
             {
                 bExistActiveFilter = TRUE;
                 break;
@@ -153,7 +294,6 @@ Filters::CheckParamsList (
         if ( !bExistActiveFilter )
         {
             // this parameter used in already unmatched filters
-            __debugbreak(); /// nct
             continue;
         }
 
@@ -168,12 +308,12 @@ Filters::CheckParamsList (
         // set unmatched filters bit
         for ( ULONG cou = 0; cou < pEntry->m_PosCount; cou++ )
         {
-            if ( RtlCheckBit( Filtersbitmap, pEntry->m_FilterPosList[cou] ) )
+            if ( Filtersbitmap->Test( pEntry->m_FilterPosList[cou] ) )
             {
                 continue;
             }
 
-            RtlSetBit( Filtersbitmap, pEntry->m_FilterPosList[cou] );
+            Filtersbitmap->Set( pEntry->m_FilterPosList[cou] );
 
             (*Unmatched)++;
             if ( *Unmatched == m_FiltersCount )
@@ -190,207 +330,306 @@ Filters::CheckParamsList (
 VERDICT
 Filters::GetVerdict (
     __in EventData *Event,
-    __out PARAMS_MASK *ParamsMask
+    __out PARAMS_MASK *ParamsMask,
+    __out PBOOLEAN Complete
     )
 {
-    if ( !m_FiltersCount )
+    *Complete = TRUE;
+
+    // no lock - snapshot and blocks it points to are freed after the
+    // caller leaves epoch section
+    FiltersSnapshot* pSnapshot = m_Snapshot;
+    if ( !pSnapshot )
     {
         return VERDICT_NOT_FILTERED;
     }
 
-    VERDICT verdict = VERDICT_NOT_FILTERED;
+    ULONG filterscount = pSnapshot->m_FiltersCount;
+    if ( !filterscount )
+    {
+        return VERDICT_NOT_FILTERED;
+    }
 
-    NTSTATUS status;
+    *Complete = FALSE;
 
-    RTL_BITMAP filtersbitmap;
-    ULONG mapbuffer[ BitMapBufferSizeInUlong ] = { 0 };
+    FilterArrays* pFiltersArray = pSnapshot->m_FiltersArray;
+    FilterDag* pDag = pSnapshot->m_Dag;
+    FilterGroups* pGroups = pSnapshot->m_Groups;
 
-    RtlInitializeBitMap(
-        &filtersbitmap,
-        mapbuffer,
-        NumberOfBits
-        );
+    VERDICT verdict = VERDICT_NOT_FILTERED;
 
-    RtlClearAllBits( &filtersbitmap );
+    NTSTATUS status = STATUS_UNSUCCESSFUL;
+    BOOLEAN bLocked = FALSE;
 
-    FltAcquirePushLockShared( &m_AccessLock );
+    // up to FLT_BITMAP_INLINE_BITS filters without allocation
+    FltBitmap filtersbitmap;
 
     __try
     {
-        ULONG unmatched = 0;
-
-        // set inactive filters
-        for ( ULONG cou = 0; cou < m_FiltersCount; cou++ )
+        if ( pDag )
         {
-            if ( !RtlCheckBit( &m_ActiveFilters, cou ) )
+            ULONG matched = 0;
+            PARAMS_MASK fetched = 0;
+
+            status = filtersbitmap.Resize( filterscount );
+            if ( NT_SUCCESS( status ) )
+            {
+                filtersbitmap.SetAll();
+
+                status = pDag->Match( Event, &filtersbitmap, &matched, &fetched );
+            }
+
+            if ( NT_SUCCESS( status ) )
             {
-                RtlSetBit( &filtersbitmap, cou );
+                CountFetchesp( pDag, fetched );
 
-                unmatched++;
-                if ( unmatched == m_FiltersCount )
+                if ( !matched )
                 {
+                    *Complete = TRUE;
                     __leave;
                 }
             }
         }
 
-        status = CheckParamsList( Event, &unmatched, &filtersbitmap );
         if ( !NT_SUCCESS( status ) )
         {
-            __leave;
-        }
+            // not compiled or no memory for check results - walk the list,
+            // position lists are changed by writers under the lock
+            FltAcquirePushLockShared( &m_AccessLock );
+            bLocked = TRUE;
 
-        // scan finished, lookup matched filters
-        // at least 1 filter matched and bit not set
-        *ParamsMask = 0;
+            filterscount = m_FiltersCount;
+            pFiltersArray = m_FiltersArray;
+            pGroups = m_Snapshot->m_Groups;
+
+            if ( !filterscount )
+            {
+                *Complete = TRUE;
+                __leave;
+            }
+
+            status = filtersbitmap.Resize( filterscount );
+            if ( !NT_SUCCESS( status ) )
+            {
+                __leave;
+            }
 
-        ULONG groupcount = m_GroupCount;
+            // set inactive filters
+            filtersbitmap.SetComplement( &m_ActiveFilters );
 
-        RTL_BITMAP groupsmap;
-        ULONG groupsmapbuffer[ BitMapBufferSizeInUlong ] = { 0 };
-        
-        RtlInitializeBitMap( &groupsmap, groupsmapbuffer, NumberOfBits );
-        RtlClearAllBits( &groupsmap );
+            ULONG unmatched = filtersbitmap.NumberOfSetBits();
+            if ( unmatched == filterscount )
+            {
+                *Complete = TRUE;
+                __leave;
+            }
 
-        ULONG position = -1;
+            status = CheckParamsList( Event, &unmatched, &filtersbitmap );
+            if ( !NT_SUCCESS( status ) )
+            {
+                // STATUS_NOT_FOUND - no filter matched
+                *Complete = ( STATUS_NOT_FOUND == status );
+                __leave;
+            }
+        }
 
-        status = Event->m_Aggregator.Allocate( groupcount );
+        // scan finished, at least 1 filter matched and bit not set.
+        // First matched filter of each group is left clear in winners
+        FltBitmap winners;
+        status = winners.Resize( filterscount );
         if ( !NT_SUCCESS( status ) )
         {
             __leave;
         }
 
-        while ( groupcount )
+        winners.SetAll();
+
+        ResolveGroupsp( pGroups, pFiltersArray, &filtersbitmap, &winners );
+
+        ULONG words = FltBitmapWords( filterscount );
+        ULONG survivors = 0;
+
+        for ( ULONG word = 0; word < words; word++ )
         {
-            groupcount--;
+            survivors += FltBitmapWordCount( winners.GetClearBits( word ) );
+        }
 
-            position = RtlFindClearBits( &filtersbitmap, 1, position + 1 );
+        status = Event->m_Aggregator.Allocate( survivors );
+        if ( !NT_SUCCESS( status ) )
+        {
+            __leave;
+        }
 
-            FilterEntry* pFilter = &m_FiltersArray[ position ];
-            
-            ASSERT( RtlCheckBit( &m_ActiveFilters, position ) );
+        // integrated verdict and wish mask, one record per winner
+        PFilterVerdict pVerdicts = pFiltersArray->m_Verdicts;
+        *ParamsMask = 0;
 
-            if ( RtlCheckBit( &groupsmap, pFilter->m_GroupId ) )
-            {
-                // already exist filter from this group
-                continue;
-            }
+        ULONG item = 0;
+        for ( ULONG word = 0; word < words; word++ )
+        {
+            ULONG64 bits = winners.GetClearBits( word );
 
-            status = Event->m_Aggregator.PlaceValue(
-                groupcount,
-                pFilter->m_FilterId,
-                pFilter->m_Verdict
-                );
-            
-            if ( !NT_SUCCESS( status ) )
+            while ( bits )
             {
-                // override existing verdict
-                verdict = VERDICT_NOT_FILTERED;
-                __leave;
-            }
+                ULONG position = word * FLT_BITMAP_WORD_BITS + FltBitmapWordLowest( bits );
+                bits &= bits - 1;
+
+                PFilterVerdict pFilter = &pVerdicts[ position ];
+
+                status = Event->m_Aggregator.PlaceValue(
+                    item++,
+                    pFilter->m_FilterId,
+                    pFilter->m_Verdict
+                    );
 
-            RtlSetBit( &groupsmap, pFilter->m_GroupId );
+                ASSERT( NT_SUCCESS( status ) );
 
-            // integrated verdict and wish mask
-            verdict |= pFilter->m_Verdict;
-            *ParamsMask |= pFilter->m_WishMask;
+                verdict |= pFilter->m_Verdict;
+                *ParamsMask |= pFilter->m_WishMask;
+            }
         }
 
         ASSERT( *ParamsMask );
+        *Complete = TRUE;
     }
     __finally
     {
+        if ( bLocked )
+        {
+            FltReleasePushLock( &m_AccessLock );
+        }
     }
 
-    FltReleasePushLock( &m_AccessLock );
-
     return verdict;
 }
 
-__checkReturn
-NTSTATUS
-Filters::TryToFindExisting (
-    __in PFltParam ParamEntry,
-    __in ULONG Position,
-    __deref_out_opt ParamCheckEntry** Entry
+void
+Filters::ResolveGroupsp (
+    __in_opt FilterGroups* Groups,
+    __in FilterArrays* FiltersArray,
+    __in FltBitmap* Filtersbitmap,
+    __inout FltBitmap* Winners
     )
 {
-    if ( IsListEmpty( &m_ParamsCheckList ) )
-    {
-        return STATUS_NOT_FOUND;
-    }
+    ULONG words = FltBitmapWords( Filtersbitmap->GetSize() );
 
-    NTSTATUS status = STATUS_NOT_FOUND;
-    __try
+    if ( !Groups )
     {
-        PLIST_ENTRY Flink = m_ParamsCheckList.Flink;
-        
-        while ( Flink != &m_ParamsCheckList )
-        {
-            ParamCheckEntry* pEntry = CONTAINING_RECORD(
-                Flink,
-                ParamCheckEntry,
-                m_List
-                );
+        // no masks - first filter of the group is found by position
+        ULONG64 seen[ FLT_GROUPS_COUNT / FLT_BITMAP_WORD_BITS ] = { 0 };
+        PUCHAR pGroupIds = FiltersArray->m_GroupIds;
 
-            Flink = Flink->Flink;
+        for ( ULONG word = 0; word < words; word++ )
+        {
+            ULONG64 bits = Filtersbitmap->GetClearBits( word );
 
-            if (
-                pEntry->Generic.m_Operation != ParamEntry->m_Operation
-                ||
-                pEntry->m_Flags != ParamEntry->m_Flags
-                ||
-                pEntry->Generic.m_CheckData->m_DataSize != ParamEntry->m_Data.m_Size
-                ||
-                pEntry->Generic.m_CheckData->m_DataSize != RtlCompareMemory(
-                    pEntry->Generic.m_CheckData->m_Data,
-                    ParamEntry->m_Data.m_Data,
-                    pEntry->Generic.m_CheckData->m_DataSize
-                    )
-                )
+            while ( bits )
             {
-                continue;
+                ULONG position = word * FLT_BITMAP_WORD_BITS + FltBitmapWordLowest( bits );
+                bits &= bits - 1;
+
+                UCHAR groupid = pGroupIds[ position ];
+                ULONG64 groupbit = 1ULL << ( groupid % FLT_BITMAP_WORD_BITS );
+
+                if ( !( seen[ groupid / FLT_BITMAP_WORD_BITS ] & groupbit ) )
+                {
+                    seen[ groupid / FLT_BITMAP_WORD_BITS ] |= groupbit;
+                    Winners->Clear( position );
+                }
             }
-            
-            // the same ParamEntry, attach to existing
+        }
 
-            PULONG pPostListTmp = pEntry->m_FilterPosList;
-            pEntry->m_FilterPosList = (PosListItemType*) ExAllocatePoolWithTag(
-                PagedPool,
-                sizeof( PosListItemType ) * ( pEntry->m_PosCount + 1 ),
-                m_AllocTag
-                );
+        return;
+    }
+
+    // masks may cover filters appended after the count was read. Walk
+    // is driven by matched words - words without matched filters are
+    // skipped for all groups at once
+    ULONG count = Groups->m_Count;
+    ULONG left = count;
+
+    ULONG64 pending[ FLT_GROUPS_COUNT / FLT_BITMAP_WORD_BITS ] = { 0 };
+    for ( ULONG idx = 0; idx < count; idx++ )
+    {
+        pending[ idx / FLT_BITMAP_WORD_BITS ] |= 1ULL << ( idx % FLT_BITMAP_WORD_BITS );
+    }
+
+    for ( ULONG word = 0; word < words && left; word++ )
+    {
+        ULONG64 bits = Filtersbitmap->GetClearBits( word );
+        if ( !bits )
+        {
+            continue;
+        }
+
+        for ( ULONG chunk = 0; chunk < FltBitmapWords( count ); chunk++ )
+        {
+            ULONG64 slots = pending[ chunk ];
 
-            if ( !pEntry->m_FilterPosList )
+            while ( slots )
             {
-                pEntry->m_FilterPosList = pPostListTmp;
+                ULONG idx = chunk * FLT_BITMAP_WORD_BITS + FltBitmapWordLowest( slots );
+                slots &= slots - 1;
 
-                status = STATUS_INSUFFICIENT_RESOURCES;
-                __leave;
-            }
+                PFilterGroup pGroup = &Groups->m_Groups[ idx ];
+                if ( word < pGroup->m_FirstWord )
+                {
+                    continue;
+                }
 
-            RtlCopyMemory(
-                pEntry->m_FilterPosList,
-                pPostListTmp,
-                pEntry->m_PosCount * sizeof( PosListItemType )
-                );
+                ULONG64 matched = 0;
+                ULONG offset = word - pGroup->m_FirstWord;
 
-            pEntry->m_FilterPosList[ pEntry->m_PosCount ] = Position;
-            pEntry->m_PosCount++;
+                if ( offset < pGroup->m_WordsCount )
+                {
+                    matched = bits & pGroup->m_Masks[ offset ];
+                    if ( !matched )
+                    {
+                        continue;
+                    }
 
-            FREE_POOL( pPostListTmp );
+                    Winners->Clear( word * FLT_BITMAP_WORD_BITS + FltBitmapWordLowest( matched ) );
+                }
 
-            *Entry = pEntry;
-             
-            status = STATUS_SUCCESS;
-            break;
+                // resolved or past the last word of the group
+                pending[ chunk ] &= ~( 1ULL << ( idx % FLT_BITMAP_WORD_BITS ) );
+                left--;
+            }
         }
     }
-    __finally
+}
+
+__checkReturn
+NTSTATUS
+Filters::TryToFindExisting (
+    __in PFltParam ParamEntry,
+    __in ULONG Hash,
+    __in ULONG Position,
+    __deref_out_opt ParamCheckEntry** Entry
+    )
+{
+    // box references are not shared
+    if ( !ParamEntry->m_ParameterId )
     {
+        return STATUS_NOT_FOUND;
     }
-    
-    return status;
+
+    ParamCheckEntry* pEntry = m_ParamsTable.Lookup( ParamEntry, Hash );
+    if ( !pEntry )
+    {
+        return STATUS_NOT_FOUND;
+    }
+
+    // the same ParamEntry, attach to existing
+    NTSTATUS status = pEntry->AddPosition( Position );
+    if ( !NT_SUCCESS( status ) )
+    {
+        return status;
+    }
+
+    *Entry = pEntry;
+
+    return STATUS_SUCCESS;
 }
 
 ParamCheckEntry*
@@ -403,7 +642,8 @@ Filters::AddParameterWithFilterPos (
     ParamCheckEntry* pEntry = NULL;
 
     // find existing
-    NTSTATUS status = TryToFindExisting( ParamEntry, Position, &pEntry );
+    ULONG hash = ParamCheckTable::GetHash( ParamEntry );
+    NTSTATUS status = TryToFindExisting( ParamEntry, hash, Position, &pEntry );
     if ( NT_SUCCESS( status ) )
     {
         return pEntry;
@@ -433,26 +673,17 @@ Filters::AddParameterWithFilterPos (
             __leave;
         }
 
-        pEntry->ParamCheckEntry::ParamCheckEntry();
+        new ( pEntry ) ParamCheckEntry;
 
         pEntry->m_Flags = ParamEntry->m_Flags;
-        pEntry->m_PosCount = 1;
-
-        pEntry->m_FilterPosList = (PosListItemType*) ExAllocatePoolWithTag(
-            PagedPool,
-            sizeof( PosListItemType ),
-            m_AllocTag
-            );
+        pEntry->m_Hash = hash;
 
-        if ( !pEntry->m_FilterPosList )
+        status = pEntry->AddPosition( Position );
+        if ( !NT_SUCCESS( status ) )
         {
-            status = STATUS_INSUFFICIENT_RESOURCES;
-
             __leave;
         }
 
-        pEntry->m_FilterPosList[0] = Position;
-
         // types of entry
         if ( !ParamEntry->m_ParameterId )
         {
@@ -525,6 +756,8 @@ Filters::AddParameterWithFilterPos (
             {
                 __leave;
             }
+
+            m_ParamsTable.Insert( pEntry );
         }
 
         InsertTailList( &m_ParamsCheckList, &pEntry->m_List );
@@ -545,7 +778,8 @@ Filters::AddParameterWithFilterPos (
 
 void
 Filters::DeleteParamsByFilterPosUnsafe (
-    __in_opt ULONG Position
+    __in_opt ULONG Position,
+    __inout_opt PLIST_ENTRY Deleted
     )
 {
     if ( IsListEmpty( &m_ParamsCheckList ) )
@@ -565,62 +799,34 @@ Filters::DeleteParamsByFilterPosUnsafe (
 
         Flink = Flink->Flink;
 
-        ULONG foundcount = 0;
-        for ( ULONG idx = 0; idx < pEntry->m_PosCount; idx++ )
+        if ( !pEntry->RemovePosition( Position ) )
         {
-            if ( pEntry->m_FilterPosList[ idx ] == Position )
-            {
-                foundcount++;
-            }
+            continue;
         }
 
-        if ( foundcount )
+        if ( pEntry->m_PosCount )
         {
-            if ( foundcount == pEntry->m_PosCount )
-            {
-                RemoveEntryList( &pEntry->m_List );
+            continue;
+        }
 
-                pEntry->ParamCheckEntry::~ParamCheckEntry();
-                FREE_POOL( pEntry );
+        RemoveEntryList( &pEntry->m_List );
 
-                continue;
-            }
-           
-            PosListItemType* pTmp = (PosListItemType*) ExAllocatePoolWithTag(
-                PagedPool,
-                sizeof( PosListItemType ) * pEntry->m_PosCount - foundcount,
-                m_AllocTag
-                );
+        if ( CheckEntryGeneric == pEntry->m_Type )
+        {
+            m_ParamsTable.Remove( pEntry );
+        }
 
-            ULONG idxto = 0;
+        if ( Deleted )
+        {
+            // published dag may refer to the entry - freed by caller
+            // after grace period
+            InsertTailList( Deleted, &pEntry->m_List );
 
-            if ( pTmp )
-            {
-                for ( ULONG idx = 0; idx < pEntry->m_PosCount; idx++ )
-                {
-                    if ( pEntry->m_FilterPosList[ idx ] != Position )
-                    {
-                        pTmp[ idxto++ ] = pEntry->m_FilterPosList[ idx ];
-                    }
-                }
-                
-                FREE_POOL( pEntry->m_FilterPosList );
-                pEntry->m_FilterPosList = pTmp;
-            }
-            else
-            {
-                pTmp = pEntry->m_FilterPosList;
-                for ( ULONG idx = 0; idx < pEntry->m_PosCount; idx++ )
-                {
-                    if ( pTmp[ idx ] != Position )
-                    {
-                        pTmp[ idxto++ ] = pTmp[ idx ];
-                    }
-                }
-            }
-            
-            pEntry->m_PosCount = pEntry->m_PosCount - foundcount;
+            continue;
         }
+
+        pEntry->ParamCheckEntry::~ParamCheckEntry();
+        FREE_POOL( pEntry );
     };
 }
 
@@ -669,6 +875,7 @@ Filters::AddParamsUnsafe (
     NTSTATUS status = STATUS_SUCCESS;
 
     PFltParam params = Params;
+    ULONG first = m_ChainChecksCount;
 
     for ( ULONG cou = 0; cou < ParamsCount; cou++ )
     {
@@ -683,7 +890,12 @@ Filters::AddParamsUnsafe (
         if ( !pEntry )
         {
             status = STATUS_INSUFFICIENT_RESOURCES;
-            DeleteParamsByFilterPosUnsafe( Position );
+            break;
+        }
+
+        status = AppendChainCheckp( pEntry );
+        if ( !NT_SUCCESS( status ) )
+        {
             break;
         }
 
@@ -692,49 +904,464 @@ Filters::AddParamsUnsafe (
             sizeof( FltParam ) + params->m_Data.m_Size
             );
     }
+
+    if ( NT_SUCCESS( status ) )
+    {
+        status = AppendChainCheckp( NULL );
+    }
+
+    if ( !NT_SUCCESS( status ) )
+    {
+        // new filter is not published yet
+        DeleteParamsByFilterPosUnsafe( Position, NULL );
+        m_ChainChecksCount = first;
+    }
     
     return status;
 }
 
 __checkReturn
 NTSTATUS
-Filters::GetFilterPosUnsafe (
-    PULONG Position
+Filters::AppendChainCheckp (
+    __in ParamCheckEntry* Entry
     )
 {
-    FilterEntry* pFiltersArray = (FilterEntry*) ExAllocatePoolWithTag(
-        PagedPool,
-        sizeof( FilterEntry ) * ( m_FiltersCount + 1 ),
-        m_AllocTag
-        );
+    // equal parameters of one filter share the entry - keep it once
+    for ( ULONG idx = m_ChainChecksCount; idx && Entry; idx-- )
+    {
+        if ( !m_ChainChecks[ idx - 1 ] )
+        {
+            break;
+        }
+
+        if ( m_ChainChecks[ idx - 1 ] == Entry )
+        {
+            return STATUS_SUCCESS;
+        }
+    }
+
+    if ( m_ChainChecksCount == m_ChainChecksCapacity )
+    {
+        ULONG capacity = m_ChainChecksCapacity ? m_ChainChecksCapacity * 2 : 64;
 
+        ParamCheckEntry** pChecks = (ParamCheckEntry**) ExAllocatePoolWithTag(
+            PagedPool,
+            sizeof( ParamCheckEntry* ) * capacity,
+            m_AllocTag
+            );
+
+        if ( !pChecks )
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        if ( m_ChainChecksCount )
+        {
+            RtlCopyMemory(
+                pChecks,
+                m_ChainChecks,
+                sizeof( ParamCheckEntry* ) * m_ChainChecksCount
+                );
+        }
+
+        FREE_POOL( m_ChainChecks );
+
+        m_ChainChecks = pChecks;
+        m_ChainChecksCapacity = capacity;
+    }
+
+    m_ChainChecks[ m_ChainChecksCount++ ] = Entry;
+
+    return STATUS_SUCCESS;
+}
+
+__checkReturn
+NTSTATUS
+Filters::ReserveFiltersUnsafe (
+    __in ULONG Capacity,
+    __inout PFltRetired Retired
+    )
+{
+    ASSERT( Capacity > m_FiltersCapacity );
+
+    NTSTATUS status = FltRetiredReserve( Retired, 1 );
+    if ( !NT_SUCCESS( status ) )
+    {
+        return status;
+    }
+
+    FilterArrays* pFiltersArray = AllocateFilterArraysp( Capacity, m_AllocTag );
     if ( !pFiltersArray )
     {   
         return STATUS_INSUFFICIENT_RESOURCES;
     }
-    
+
     if ( m_FiltersCount )
     {
-        RtlCopyMemory( 
-            pFiltersArray,
-            m_FiltersArray,
-            sizeof( FilterEntry ) * m_FiltersCount
+        CopyFiltersp( pFiltersArray, 0, m_FiltersArray, 0, m_FiltersCount );
+    }
+
+    // published snapshot keeps the old array until the next one is
+    // published, the block is freed after that
+    FltRetire( Retired, m_FiltersArray, NULL );
+
+    m_FiltersArray = pFiltersArray;
+    m_FiltersCapacity = Capacity;
+
+    return STATUS_SUCCESS;
+}
+
+__checkReturn
+NTSTATUS
+Filters::GetFilterPosUnsafe (
+    __out PULONG Position,
+    __inout PFltRetired Retired
+    )
+{
+    NTSTATUS status = m_ActiveFilters.Resize( m_FiltersCount + 1 );
+    if ( !NT_SUCCESS( status ) )
+    {
+        return status;
+    }
+
+    if ( m_FiltersCount == m_FiltersCapacity )
+    {
+        // grow twice - thousands of filters in one slot are expected
+        status = ReserveFiltersUnsafe(
+            m_FiltersCapacity ? m_FiltersCapacity * 2 : 8,
+            Retired
             );
 
-        FREE_POOL( m_FiltersArray );
+        if ( !NT_SUCCESS( status ) )
+        {
+            return status;
+        }
     }
 
-    m_FiltersArray = pFiltersArray;
+    RtlZeroMemory( &m_FiltersArray->m_Verdicts[ m_FiltersCount ], sizeof( FilterVerdict ) );
+    m_FiltersArray->m_GroupIds[ m_FiltersCount ] = 0;
+    m_FiltersArray->m_ProcessIds[ m_FiltersCount ] = NULL;
+    m_FiltersArray->m_RequestTimeouts[ m_FiltersCount ] = 0;
+    m_FiltersArray->m_PolicyBytes[ m_FiltersCount ] = 0;
 
-    RtlZeroMemory( &m_FiltersArray[ m_FiltersCount ], sizeof( FilterEntry ) );
     *Position = m_FiltersCount;
 
     return STATUS_SUCCESS;
 }
 
+FilterDag*
+Filters::CompileDagUnsafe (
+    )
+{
+    FilterDag* pDag = new ( PagedPool, FilterDag::m_AllocTag ) FilterDag;
+    if ( !pDag )
+    {
+        return NULL;
+    }
+
+    NTSTATUS status = pDag->Compile(
+        &m_ParamsCheckList,
+        &m_ActiveFilters,
+        m_FiltersCount
+        );
+
+    if ( !NT_SUCCESS( status ) )
+    {
+        FREE_OBJECT( pDag );
+    }
+
+    return pDag;
+}
+
+FilterGroups*
+Filters::CompileGroupsUnsafe (
+    )
+{
+    if ( !m_FiltersCount )
+    {
+        return NULL;
+    }
+
+    // first and last word of every group id, last is reused for index
+    PULONG pFirst = (PULONG) ExAllocatePoolWithTag(
+        PagedPool,
+        sizeof( ULONG ) * FLT_GROUPS_COUNT * 2,
+        m_AllocTag
+        );
+
+    if ( !pFirst )
+    {
+        return NULL;
+    }
+
+    PULONG pLast = &pFirst[ FLT_GROUPS_COUNT ];
+
+    RtlFillMemory( pFirst, sizeof( ULONG ) * FLT_GROUPS_COUNT, 0xff );
+    RtlZeroMemory( pLast, sizeof( ULONG ) * FLT_GROUPS_COUNT );
+
+    for ( ULONG position = 0; position < m_FiltersCount; position++ )
+    {
+        UCHAR groupid = m_FiltersArray->m_GroupIds[ position ];
+        ULONG word = position / FLT_BITMAP_WORD_BITS;
+
+        if ( FLT_BITMAP_NOT_FOUND == pFirst[ groupid ] )
+        {
+            pFirst[ groupid ] = word;
+        }
+
+        pLast[ groupid ] = word;
+    }
+
+    ULONG count = 0;
+    ULONG words = 0;
+    for ( ULONG groupid = 0; groupid < FLT_GROUPS_COUNT; groupid++ )
+    {
+        if ( FLT_BITMAP_NOT_FOUND != pFirst[ groupid ] )
+        {
+            count++;
+            words += pLast[ groupid ] - pFirst[ groupid ] + 1;
+        }
+    }
+
+    // twice the span of every group and slots for new groups - commits
+    // append in place until a group grows twice
+    ULONG capacity = min( max( count * 2, 4 ), FLT_GROUPS_COUNT );
+    ULONG wordscapacity = words * 2 + ( capacity - count ) * FLT_GROUP_SPARE_WORDS;
+
+    ULONG header = (ULONG) ALIGN_UP_BY(
+        sizeof( FilterGroups ) + sizeof( FilterGroup ) * ( capacity - 1 ),
+        sizeof( ULONG64 )
+        );
+
+    ULONG size = header + sizeof( ULONG64 ) * wordscapacity;
+
+    FilterGroups* pGroups = (FilterGroups*) ExAllocatePoolWithTag(
+        PagedPool,
+        size,
+        m_AllocTag
+        );
+
+    if ( pGroups )
+    {
+        RtlZeroMemory( pGroups, size );
+        pGroups->m_Size = size;
+        pGroups->m_Capacity = capacity;
+        pGroups->m_WordsCapacity = wordscapacity;
+        pGroups->m_Words = (ULONG64*) Add2Ptr( pGroups, header );
+
+        for ( ULONG groupid = 0; groupid < FLT_GROUPS_COUNT; groupid++ )
+        {
+            if ( FLT_BITMAP_NOT_FOUND == pFirst[ groupid ] )
+            {
+                continue;
+            }
+
+            PFilterGroup pGroup = &pGroups->m_Groups[ pGroups->m_Count ];
+            pGroup->m_FirstWord = pFirst[ groupid ];
+            pGroup->m_WordsCount = pLast[ groupid ] - pFirst[ groupid ] + 1;
+            pGroup->m_WordsCapacity = pGroup->m_WordsCount * 2;
+            pGroup->m_GroupId = (UCHAR) groupid;
+            pGroup->m_Masks = &pGroups->m_Words[ pGroups->m_FreeWord ];
+
+            pGroups->m_FreeWord += pGroup->m_WordsCapacity;
+            pLast[ groupid ] = pGroups->m_Count++;
+        }
+
+        for ( ULONG position = 0; position < m_FiltersCount; position++ )
+        {
+            PFilterGroup pGroup = &pGroups->m_Groups[
+                pLast[ m_FiltersArray->m_GroupIds[ position ] ]
+                ];
+
+            pGroup->m_Masks[ position / FLT_BITMAP_WORD_BITS - pGroup->m_FirstWord ] |=
+                1ULL << ( position % FLT_BITMAP_WORD_BITS );
+        }
+    }
+
+    FREE_POOL( pFirst );
+
+    return pGroups;
+}
+
+__checkReturn
+BOOLEAN
+Filters::AppendGroupsUnsafe (
+    __in FilterGroups* Groups
+    )
+{
+    // FALSE - no room, caller builds new masks. Bits set before are
+    // above the count of published snapshot
+    for ( ULONG position = m_ChainFirst; position < m_FiltersCount; position++ )
+    {
+        UCHAR groupid = m_FiltersArray->m_GroupIds[ position ];
+        ULONG word = position / FLT_BITMAP_WORD_BITS;
+
+        PFilterGroup pGroup = NULL;
+        for ( ULONG idx = 0; idx < Groups->m_Count; idx++ )
+        {
+            if ( Groups->m_Groups[ idx ].m_GroupId == groupid )
+            {
+                pGroup = &Groups->m_Groups[ idx ];
+                break;
+            }
+        }
+
+        if ( !pGroup )
+        {
+            if (
+                Groups->m_Count == Groups->m_Capacity
+                ||
+                Groups->m_FreeWord + FLT_GROUP_SPARE_WORDS > Groups->m_WordsCapacity
+                )
+            {
+                return FALSE;
+            }
+
+            pGroup = &Groups->m_Groups[ Groups->m_Count ];
+            pGroup->m_FirstWord = word;
+            pGroup->m_WordsCount = 0;
+            pGroup->m_WordsCapacity = FLT_GROUP_SPARE_WORDS;
+            pGroup->m_GroupId = groupid;
+            pGroup->m_Masks = &Groups->m_Words[ Groups->m_FreeWord ];
+
+            Groups->m_FreeWord += FLT_GROUP_SPARE_WORDS;
+
+            // slot is filled before readers count it
+            KeMemoryBarrier();
+            Groups->m_Count++;
+        }
+
+        // positions only grow - the word is never below the first one
+        ULONG offset = word - pGroup->m_FirstWord;
+        if ( offset >= pGroup->m_WordsCapacity )
+        {
+            return FALSE;
+        }
+
+        pGroup->m_Masks[ offset ] |= 1ULL << ( position % FLT_BITMAP_WORD_BITS );
+
+        if ( offset >= pGroup->m_WordsCount )
+        {
+            KeMemoryBarrier();
+            pGroup->m_WordsCount = offset + 1;
+        }
+    }
+
+    return TRUE;
+}
+
+__checkReturn
+FiltersSnapshot*
+Filters::AllocateSnapshotp (
+    )
+{
+    FiltersSnapshot* pSnapshot = (FiltersSnapshot*) ExAllocatePoolWithTag(
+        PagedPool,
+        sizeof( FiltersSnapshot ),
+        m_AllocTag
+        );
+
+    if ( pSnapshot )
+    {
+        RtlZeroMemory( pSnapshot, sizeof( FiltersSnapshot ) );
+    }
+
+    return pSnapshot;
+}
+
+void
+Filters::PublishSnapshotUnsafe (
+    __in FiltersSnapshot* Snapshot,
+    __inout PFltRetired Retired
+    )
+{
+    FiltersSnapshot* pOldSnapshot = m_Snapshot;
+
+    // everything the snapshot points to is written before the pointer
+    KeMemoryBarrier();
+    m_Snapshot = Snapshot;
+
+    if ( !pOldSnapshot )
+    {
+        return;
+    }
+
+    // dag and groups may be carried over to the new snapshot
+    if ( pOldSnapshot->m_Dag != Snapshot->m_Dag )
+    {
+        FltRetire( Retired, pOldSnapshot->m_Dag, DestroyDagp );
+    }
+
+    if ( pOldSnapshot->m_Groups != Snapshot->m_Groups )
+    {
+        FltRetire( Retired, pOldSnapshot->m_Groups, NULL );
+    }
+
+    FltRetire( Retired, pOldSnapshot, NULL );
+}
+
+__checkReturn
+NTSTATUS
+Filters::BeginChain (
+    __in ULONG Reserve
+    )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+
+    FltAcquirePushLockExclusive( &m_AccessLock );
+
+    __try
+    {
+        // commit and rollback publish it, they cannot fail
+        ASSERT( !m_ChainSnapshot );
+        m_ChainSnapshot = AllocateSnapshotp();
+        if ( !m_ChainSnapshot )
+        {
+            status = STATUS_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+
+        // commit retires groups, dag and snapshot
+        status = FltRetiredReserve( &m_ChainRetired, FLT_CHAIN_RETIRED );
+        if ( !NT_SUCCESS( status ) )
+        {
+            __leave;
+        }
+
+        // grow once and at least twice
+        if ( m_FiltersCount + Reserve > m_FiltersCapacity )
+        {
+            status = ReserveFiltersUnsafe(
+                max( m_FiltersCount + Reserve, m_FiltersCapacity * 2 ),
+                &m_ChainRetired
+                );
+
+            if ( !NT_SUCCESS( status ) )
+            {
+                __leave;
+            }
+        }
+
+        m_ChainFirst = m_FiltersCount;
+        m_ChainChecksCount = 0;
+        m_ChainCacheParams = 0;
+        m_ChainUncacheable = FALSE;
+    }
+    __finally
+    {
+        if ( !NT_SUCCESS( status ) )
+        {
+            FREE_POOL( m_ChainSnapshot );
+            FltReleasePushLock( &m_AccessLock );
+        }
+    }
+
+    return status;
+}
+
 __checkReturn
 NTSTATUS
-Filters::AddFilter (
+Filters::StageFilter (
     __in UCHAR GroupId,
     __in VERDICT Verdict,
     __in HANDLE ProcessId,
@@ -746,63 +1373,291 @@ Filters::AddFilter (
     __in ULONG FilterId
     )
 {
-    NTSTATUS status = STATUS_UNSUCCESSFUL;
-
     ASSERT( GroupId );
     ASSERT( Verdict );
     ASSERT( WishMask );
 
-    FltAcquirePushLockExclusive( &m_AccessLock );
+    ULONG position;
+    NTSTATUS status = GetFilterPosUnsafe( &position, &m_ChainRetired );
+    if ( !NT_SUCCESS( status ) )
+    {
+        return status;
+    }
 
-    __try
+    status = AddParamsUnsafe(
+        position,
+        ParamsCount,
+        Params,
+        BoxList
+        );
+
+    if ( !NT_SUCCESS( status ) )
     {
-        ULONG position;
-        status = GetFilterPosUnsafe( &position );
-        if ( !NT_SUCCESS( status ) )
+        return status;
+    }
+
+    PFltParam params = Params;
+    for ( ULONG cou = 0; cou < ParamsCount; cou++ )
+    {
+        if (
+            !params->m_ParameterId
+            ||
+            params->m_ParameterId > PARAMETER_MAXIMUM
+            )
         {
-            __leave;
+            m_ChainUncacheable = TRUE;
+        }
+        else
+        {
+            m_ChainCacheParams |= Id2Bit( params->m_ParameterId );
         }
 
-        FilterEntry* pEntry = &m_FiltersArray[ position ];
-
-        status = AddParamsUnsafe(
-            position,
-            ParamsCount,
-            Params,
-            BoxList
+        params = ( PFltParam ) Add2Ptr(
+            params,
+            sizeof( FltParam ) + params->m_Data.m_Size
             );
+    }
+    
+    PFilterVerdict pVerdict = &m_FiltersArray->m_Verdicts[ position ];
+    pVerdict->m_FilterId = FilterId;
+    pVerdict->m_Verdict = Verdict;
+    pVerdict->m_WishMask = WishMask;
 
-        if ( !NT_SUCCESS( status ) )
+    m_FiltersArray->m_GroupIds[ position ] = GroupId;
+    m_FiltersArray->m_ProcessIds[ position ] = ProcessId;
+    m_FiltersArray->m_RequestTimeouts[ position ] = RequestTimeout;
+    m_FiltersArray->m_PolicyBytes[ position ] = FltGetParamsSize( ParamsCount, Params );
+
+    m_PolicyBytes += m_FiltersArray->m_PolicyBytes[ position ];
+    
+    m_ActiveFilters.Set( position );
+
+    // snapshot count is not changed - readers don't see the filter
+    m_FiltersCount++;
+
+    return STATUS_SUCCESS;
+}
+
+void
+Filters::CommitChain (
+    )
+{
+    m_CacheParams |= m_ChainCacheParams;
+    if ( m_ChainUncacheable )
+    {
+        m_Uncacheable = TRUE;
+    }
+
+    FiltersSnapshot* pSnapshot = m_ChainSnapshot;
+    m_ChainSnapshot = NULL;
+
+    // array may be new even if nothing was staged
+    pSnapshot->m_FiltersCount = m_FiltersCount;
+    pSnapshot->m_FiltersArray = m_FiltersArray;
+
+    if ( m_Snapshot )
+    {
+        pSnapshot->m_Dag = m_Snapshot->m_Dag;
+        pSnapshot->m_Groups = m_Snapshot->m_Groups;
+    }
+
+    if ( m_FiltersCount != m_ChainFirst )
+    {
+        // masks grow in place, new ones are built when a group outgrows
+        // its words. NULL on failure - GetVerdict scans matched filters
+        if ( !pSnapshot->m_Groups || !AppendGroupsUnsafe( pSnapshot->m_Groups ) )
         {
-            __leave;
+            pSnapshot->m_Groups = CompileGroupsUnsafe();
         }
-        
-        pEntry->m_Verdict = Verdict;
-        pEntry->m_ProcessId = ProcessId;
-        pEntry->m_RequestTimeout = RequestTimeout;
-        pEntry->m_WishMask = WishMask;
-        pEntry->m_FilterId = FilterId;
-        pEntry->m_GroupId = GroupId;
-        
-        RtlSetBit( &m_ActiveFilters, position );
 
-        if ( !RtlCheckBit( &m_GroupsMap, GroupId ) )
+        FilterDag* pDag = pSnapshot->m_Dag;
+
+        // ranks drift while filters are added - recompile after an eighth
+        // more, fewer filters appended to a big set go to the published dag
+        BOOLEAN bCompile = !pDag || pDag->NeedsCompile( m_FiltersCount );
+
+        ULONG first = 0;
+
+        for ( ULONG position = m_ChainFirst; position < m_FiltersCount && !bCompile; position++ )
         {
-            RtlSetBit( &m_GroupsMap, GroupId );
-            m_GroupCount++;        
+            ULONG last = first;
+            while ( m_ChainChecks[ last ] )
+            {
+                last++;
+            }
+
+            NTSTATUS status = pDag->Update(
+                position + 1,
+                position,
+                last - first,
+                &m_ChainChecks[ first ]
+                );
+
+            bCompile = !NT_SUCCESS( status );
+            first = last + 1;
         }
 
-        m_FiltersCount++;
+        if ( !bCompile )
+        {
+            bCompile = !NT_SUCCESS( pDag->Commit( &m_ChainRetired ) );
+        }
 
-        status = STATUS_SUCCESS;
+        if ( bCompile )
+        {
+            // NULL on failure - GetVerdict walks the list until next compile
+            pSnapshot->m_Dag = CompileDagUnsafe();
+        }
     }
-    __finally
+    else if ( m_FiltersCount && !pSnapshot->m_Dag )
     {
+        // previous compile ran out of memory - any chain retries
+        pSnapshot->m_Dag = CompileDagUnsafe();
     }
 
+    // publish the whole chain
+    PublishSnapshotUnsafe( pSnapshot, &m_ChainRetired );
+
     FltReleasePushLock( &m_AccessLock );
+}
 
-    return status;
+void
+Filters::RollbackChain (
+    )
+{
+    // staged filters are at the tail and were never published
+    for ( ULONG position = m_ChainFirst; position < m_FiltersCount; position++ )
+    {
+        DeleteParamsByFilterPosUnsafe( position, NULL );
+        m_ActiveFilters.Clear( position );
+
+        m_PolicyBytes -= m_FiltersArray->m_PolicyBytes[ position ];
+    }
+
+    m_FiltersCount = m_ChainFirst;
+
+    FiltersSnapshot* pSnapshot = m_ChainSnapshot;
+    m_ChainSnapshot = NULL;
+
+    if ( m_Snapshot && m_Snapshot->m_FiltersArray == m_FiltersArray )
+    {
+        FREE_POOL( pSnapshot );
+    }
+    else
+    {
+        // array grew - published snapshot points to the retired one
+        pSnapshot->m_FiltersCount = m_FiltersCount;
+        pSnapshot->m_FiltersArray = m_FiltersArray;
+
+        if ( m_Snapshot )
+        {
+            pSnapshot->m_Dag = m_Snapshot->m_Dag;
+            pSnapshot->m_Groups = m_Snapshot->m_Groups;
+        }
+
+        PublishSnapshotUnsafe( pSnapshot, &m_ChainRetired );
+    }
+
+    FltReleasePushLock( &m_AccessLock );
+}
+
+void
+Filters::ReleaseChain (
+    )
+{
+    // readers may take the lock on fallback - wait for them after release
+    FltRetiredRelease( &m_ChainRetired );
+}
+
+void
+Filters::CountFetchesp (
+    __in FilterDag* Dag,
+    __in PARAMS_MASK Fetched
+    )
+{
+    ULONG64 expensive = (ULONG64) Dag->GetExpensiveParams();
+    if ( !expensive )
+    {
+        return;
+    }
+
+    ULONG fetched = FltBitmapWordCount( expensive & (ULONG64) Fetched );
+    ULONG avoided = FltBitmapWordCount( expensive & ~(ULONG64) Fetched );
+
+    if ( fetched )
+    {
+        InterlockedExchangeAdd64( &m_ExpensiveFetched, fetched );
+    }
+
+    if ( avoided )
+    {
+        InterlockedExchangeAdd64( &m_ExpensiveAvoided, avoided );
+    }
+}
+
+void
+Filters::AddFetchStatistics (
+    __inout PFltFetchStatistics Statistics
+    )
+{
+    Statistics->m_Fetched += m_ExpensiveFetched;
+    Statistics->m_Avoided += m_ExpensiveAvoided;
+}
+
+void
+Filters::AddUsage (
+    __inout PFltUsage Usage,
+    __in BOOLEAN Measure
+    )
+{
+    // writers are excluded by the storage lock
+    Usage->m_Filters += m_FiltersCount;
+    Usage->m_PolicyBytes += m_PolicyBytes;
+
+    if ( !Measure )
+    {
+        return;
+    }
+
+    Usage->m_Sets++;
+    Usage->m_FiltersBytes += sizeof( Filters ) + sizeof( FiltersSnapshot )
+        + FltBitmapWords( m_ActiveFilters.GetSize() ) * sizeof( ULONG64 );
+
+    if ( m_FiltersArray )
+    {
+        Usage->m_FiltersBytes += m_FiltersArray->m_Size;
+    }
+
+    PLIST_ENTRY Flink = m_ParamsCheckList.Flink;
+    while ( Flink != &m_ParamsCheckList )
+    {
+        ParamCheckEntry* pEntry = CONTAINING_RECORD(
+            Flink,
+            ParamCheckEntry,
+            m_List
+            );
+
+        Flink = Flink->Flink;
+
+        Usage->m_Params++;
+        Usage->m_ParamsBytes += sizeof( ParamCheckEntry );
+        Usage->m_PositionsBytes += sizeof( PosListItemType ) * pEntry->m_PosCapacity;
+
+        if ( CheckEntryGeneric == pEntry->m_Type && pEntry->Generic.m_CheckData )
+        {
+            Usage->m_ParamsBytes += FIELD_OFFSET( FltCheckData, m_Data )
+                + pEntry->Generic.m_CheckData->m_DataSize;
+        }
+    }
+
+    if ( m_Snapshot && m_Snapshot->m_Dag )
+    {
+        Usage->m_CompiledBytes += sizeof( FilterDag ) + m_Snapshot->m_Dag->GetImageSize();
+    }
+
+    if ( m_Snapshot && m_Snapshot->m_Groups )
+    {
+        Usage->m_CompiledBytes += m_Snapshot->m_Groups->m_Size;
+    }
 }
 
 ULONG
@@ -812,83 +1667,150 @@ Filters::CleanupByProcess (
 {
     ULONG removedcount = 0;
 
+    FltRetired retired;
+    FltRetiredInit( &retired );
+
+    LIST_ENTRY deleted;
+    InitializeListHead( &deleted );
+
     FltAcquirePushLockExclusive( &m_AccessLock );
 
-    ULONG idx = 0;
-    while ( TRUE )
+    __try
     {
-        if ( idx == m_FiltersCount )
+        // filters deactivated by previous cleanup are removed as well
+        for ( ULONG idx = 0; idx < m_FiltersCount; idx++ )
         {
-            break;
+            if (
+                m_FiltersArray->m_ProcessIds[ idx ] == ProcessId
+                ||
+                !m_ActiveFilters.Test( idx )
+                )
+            {
+                removedcount++;
+            }
         }
 
-        FilterEntry* pEntry = &m_FiltersArray[ idx ];
-
-        if ( pEntry->m_ProcessId != ProcessId )
+        if ( !removedcount )
         {
-            idx++;
-            continue;
+            __leave;
         }
 
-        removedcount++;
+        // positions are shifted - readers get new array and dag at once
+        ULONG filterscount = m_FiltersCount - removedcount;
 
-        RtlClearBit( &m_ActiveFilters, idx );
-        DeleteParamsByFilterPosUnsafe( idx );
+        FilterArrays* pFiltersArray = NULL;
+        FiltersSnapshot* pSnapshot = AllocateSnapshotp();
 
-        FilterEntry* pFiltersArrayNew = NULL;
-        
-        if ( m_FiltersCount > 1 )
+        if ( pSnapshot && filterscount )
         {
-            pFiltersArrayNew = ( FilterEntry* ) ExAllocatePoolWithTag(
-                PagedPool,
-                sizeof( FilterEntry ) * ( m_FiltersCount - 1 ),
-                m_AllocTag
-                );
+            // capacity is kept for next AddFilter
+            pFiltersArray = AllocateFilterArraysp( m_FiltersCapacity, m_AllocTag );
+        }
 
-            ULONG idxto = 0;
-            if ( !pFiltersArrayNew )
+        if ( !pSnapshot || ( filterscount && !pFiltersArray ) )
+        {
+            // no memory for new generation - deactivate filters in place,
+            // next cleanup removes them
+            for ( ULONG idx = 0; idx < m_FiltersCount; idx++ )
             {
-                pFiltersArrayNew = m_FiltersArray;
-                for ( ULONG idx2 = 0; idx2 < m_FiltersCount; idx2++ )
+                if ( m_FiltersArray->m_ProcessIds[ idx ] == ProcessId )
                 {
-                    if ( idx2 == idx )
-                    {
-                        continue;
-                    }
-
-                    pFiltersArrayNew[ idxto ] = m_FiltersArray[ idx2 ];
-                    MoveFilterPosInParams( idx2, idxto );
-                    idxto++;
+                    m_ActiveFilters.Clear( idx );
                 }
             }
-            else
+
+            if ( !pSnapshot )
             {
-                for ( ULONG idx2 = 0; idx2 < m_FiltersCount; idx2++ )
-                {
-                    if ( idx2 == idx )
-                    {
-                        continue;
-                    }
+                // readers match them until the next snapshot
+                __leave;
+            }
 
-                    pFiltersArrayNew[ idxto ] = m_FiltersArray[ idx2 ];
-                    MoveFilterPosInParams( idx2, idxto );
-                    idxto++;
-                }
+            // positions are kept, recompiled dag skips inactive filters
+            ASSERT( m_Snapshot );
+            pSnapshot->m_FiltersCount = m_FiltersCount;
+            pSnapshot->m_FiltersArray = m_FiltersArray;
+            pSnapshot->m_Dag = CompileDagUnsafe();
+            pSnapshot->m_Groups = m_Snapshot->m_Groups;
 
-                FREE_POOL( m_FiltersArray );
-                m_FiltersArray = pFiltersArrayNew;
+            PublishSnapshotUnsafe( pSnapshot, &retired );
+
+            __leave;
+        }
+
+        ULONG position = 0;
+        for ( ULONG idx = 0; idx < m_FiltersCount; idx++ )
+        {
+            if (
+                m_FiltersArray->m_ProcessIds[ idx ] == ProcessId
+                ||
+                !m_ActiveFilters.Test( idx )
+                )
+            {
+                DeleteParamsByFilterPosUnsafe( idx, &deleted );
+                m_PolicyBytes -= m_FiltersArray->m_PolicyBytes[ idx ];
+                continue;
             }
+
+            // positions below idx are already moved, no collision
+            CopyFiltersp( pFiltersArray, position, m_FiltersArray, idx, 1 );
+            if ( position != idx )
+            {
+                MoveFilterPosInParams( idx, position );
+            }
+
+            m_ActiveFilters.Set( position );
+            position++;
         }
 
-        m_FiltersCount--;
-    }
+        ASSERT( position == filterscount );
+
+        // shrinking - never fails
+        NTSTATUS status = m_ActiveFilters.Resize( filterscount );
+        ASSERT( NT_SUCCESS( status ) );
+        UNREFERENCED_PARAMETER( status );
+
+        if ( !filterscount )
+        {
+            ASSERT( IsListEmpty( &m_ParamsCheckList ) );
+        }
+
+        FltRetire( &retired, m_FiltersArray, NULL );
+
+        m_FiltersArray = pFiltersArray;
+        m_FiltersCount = filterscount;
+        if ( !pFiltersArray )
+        {
+            m_FiltersCapacity = 0;
+        }
 
-    if ( !m_FiltersCount)
+        pSnapshot->m_FiltersCount = filterscount;
+        pSnapshot->m_FiltersArray = pFiltersArray;
+        pSnapshot->m_Dag = filterscount ? CompileDagUnsafe() : NULL;
+        pSnapshot->m_Groups = CompileGroupsUnsafe();
+
+        ASSERT( m_Snapshot );
+        PublishSnapshotUnsafe( pSnapshot, &retired );
+    }
+    __finally
     {
-        ASSERT( IsListEmpty( &m_ParamsCheckList ) );
     }
 
     FltReleasePushLock( &m_AccessLock );
 
+    // old snapshot is retired whenever entries are deleted
+    ASSERT( IsListEmpty( &deleted ) || retired.m_Count );
+    FltRetiredRelease( &retired );
+
+    while ( !IsListEmpty( &deleted ) )
+    {
+        ParamCheckEntry* pEntry = CONTAINING_RECORD(
+            RemoveHeadList( &deleted ),
+            ParamCheckEntry,
+            m_List
+            );
+
+        FREE_OBJECT( pEntry );
+    }
+
     return removedcount;
 }
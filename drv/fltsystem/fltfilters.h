@@ -1,13 +1,56 @@
 #pragma once
 
 #include "../../inc/fltcommon.h"
+#include "../inc/fltstorage.h"
 #include "fltbox.h"
+#include "fltbitmap.h"
+#include "fltdag.h"
+#include "fltepoch.h"
 
-#define NumberOfBits 256
-#define BitMapBufferSizeInUlong (NumberOfBits / 32)
+// group id is UCHAR
+#define FLT_GROUPS_COUNT 256
+
+// words of a group that appears after the masks were built
+#define FLT_GROUP_SPARE_WORDS 4
 
 class ParamCheckEntry;
-struct FilterEntry;
+struct FilterArrays;
+
+// positions of the filters of one group, words outside of the range
+// have no bits of the group
+typedef struct _FilterGroup
+{
+    ULONG               m_FirstWord;
+    volatile ULONG      m_WordsCount;
+    ULONG               m_WordsCapacity;
+    UCHAR               m_GroupId;
+    ULONG64*            m_Masks;
+} FilterGroup, *PFilterGroup;
+
+// masks are built for all filters of the array, the first matched
+// position in a mask is the filter of the group. Commit appends bits of
+// new filters in place while slots and words have room, readers ignore
+// bits above their count
+typedef struct _FilterGroups
+{
+    ULONG               m_Size;         // bytes of the allocation
+    volatile ULONG      m_Count;
+    ULONG               m_Capacity;     // slots of groups
+    ULONG               m_FreeWord;     // first word not given to a group
+    ULONG               m_WordsCapacity;
+    ULONG64*            m_Words;
+    FilterGroup         m_Groups[1];
+} FilterGroups, *PFilterGroups;
+
+// what GetVerdict sees without the lock. Never changed once published -
+// writers fill a new one and swap the pointer, old one is retired
+struct FiltersSnapshot
+{
+    ULONG               m_FiltersCount;
+    FilterArrays*       m_FiltersArray;
+    FilterDag*          m_Dag;          // NULL - walk the list under the lock
+    FilterGroups*       m_Groups;       // NULL - matched filters are scanned
+};
 
 class Filters
 {
@@ -30,16 +73,37 @@ public:
     BOOLEAN
     IsEmpty();
 
+    // caller is inside of epoch section (FltEpochEnter). Complete is
+    // FALSE when evaluation was cut short by resource failure
     __checkReturn
     VERDICT
     GetVerdict (
         __in EventData *Event,
-        __out PARAMS_MASK *ParamsMask
+        __out PARAMS_MASK *ParamsMask,
+        __out PBOOLEAN Complete
+        );
+
+    // parameters verdict depends on. FALSE - set has box checks, verdict
+    // depends on box contents
+    __checkReturn
+    BOOLEAN
+    GetCacheParams (
+        __out PPARAMS_MASK Params
         );
     
+    // chain of filters. BeginChain locks the set until CommitChain or
+    // RollbackChain, staged filters are published by commit at once.
+    // ReleaseChain frees retired blocks - call it when no set of the
+    // chain is locked, readers may wait for the lock on fallback
+    __checkReturn
+    NTSTATUS
+    BeginChain (
+        __in ULONG Reserve
+        );
+
     __checkReturn
     NTSTATUS
-    AddFilter (
+    StageFilter (
         __in UCHAR GroupId,
         __in VERDICT Verdict,
         __in HANDLE ProcessId,
@@ -51,11 +115,35 @@ public:
         __in ULONG FilterId
         );
 
+    void
+    CommitChain (
+        );
+
+    void
+    RollbackChain (
+        );
+
+    void
+    ReleaseChain (
+        );
+
     ULONG
     CleanupByProcess (
         __in HANDLE ProcessId
         );
 
+    void
+    AddFetchStatistics (
+        __inout PFltFetchStatistics Statistics
+        );
+
+    // caller holds storage lock. Measure - memory of the set as well
+    void
+    AddUsage (
+        __inout PFltUsage Usage,
+        __in BOOLEAN Measure
+        );
+
 private:
     __checkReturn
     NTSTATUS
@@ -66,16 +154,58 @@ private:
         __in PFilterBoxList BoxList
         );
 
+    __checkReturn
+    NTSTATUS
+    ReserveFiltersUnsafe (
+        __in ULONG Capacity,
+        __inout PFltRetired Retired
+        );
+
     __checkReturn
     NTSTATUS
     GetFilterPosUnsafe (
-    PULONG Position
+        __out PULONG Position,
+        __inout PFltRetired Retired
+        );
+
+    FilterDag*
+    CompileDagUnsafe (
+        );
+
+    FilterGroups*
+    CompileGroupsUnsafe (
+        );
+
+    __checkReturn
+    BOOLEAN
+    AppendGroupsUnsafe (
+        __in FilterGroups* Groups
+        );
+
+    __checkReturn
+    FiltersSnapshot*
+    AllocateSnapshotp (
+        );
+
+    void
+    PublishSnapshotUnsafe (
+        __in FiltersSnapshot* Snapshot,
+        __inout PFltRetired Retired
+        );
+
+    void
+    ResolveGroupsp (
+        __in_opt FilterGroups* Groups,
+        __in FilterArrays* FiltersArray,
+        __in FltBitmap* Filtersbitmap,
+        __inout FltBitmap* Winners
         );
 
     __checkReturn
     NTSTATUS
     TryToFindExisting (
         __in PFltParam ParamEntry,
+        __in ULONG Hash,
         __in ULONG Position,
         __deref_out_opt ParamCheckEntry** Entry
         );
@@ -87,9 +217,16 @@ private:
         __in PFilterBoxList BoxList
         );
 
+    __checkReturn
+    NTSTATUS
+    AppendChainCheckp (
+        __in ParamCheckEntry* Entry
+        );
+
     void
     DeleteParamsByFilterPosUnsafe (
-        __in_opt ULONG Position
+        __in_opt ULONG Position,
+        __inout_opt PLIST_ENTRY Deleted
         );
 
     void
@@ -98,24 +235,47 @@ private:
         ULONG IdxTo
         );
 
+    void
+    CountFetchesp (
+        __in FilterDag* Dag,
+        __in PARAMS_MASK Fetched
+        );
+
     NTSTATUS
     CheckParamsList (
         __in EventData *Event,
         __in PULONG Unmatched,
-        __in PRTL_BITMAP Filtersbitmap
+        __in FltBitmap* Filtersbitmap
         );
 
 private:
     EX_RUNDOWN_REF      m_Ref;
     EX_PUSH_LOCK        m_AccessLock;
 
-    RTL_BITMAP          m_GroupsMap;
-    ULONG               m_GroupsMapBuffer[ BitMapBufferSizeInUlong ];
-    ULONG               m_GroupCount;
-
-    RTL_BITMAP          m_ActiveFilters;
-    ULONG               m_ActiveFiltersBuffer[ BitMapBufferSizeInUlong ];
+    FltBitmap           m_ActiveFilters;
     ULONG               m_FiltersCount;
-    FilterEntry*        m_FiltersArray;
+    ULONG               m_FiltersCapacity;
+    FilterArrays*       m_FiltersArray;
+    LONG64              m_PolicyBytes;
     LIST_ENTRY          m_ParamsCheckList;
+    ParamCheckTable     m_ParamsTable;
+
+    FiltersSnapshot* volatile m_Snapshot;
+
+    volatile LONG64     m_ExpensiveFetched;
+    volatile LONG64     m_ExpensiveAvoided;
+
+    // only grows - extra parameter in cache key costs hits, not verdicts
+    volatile PARAMS_MASK m_CacheParams;
+    volatile BOOLEAN    m_Uncacheable;
+
+    // chain in progress
+    ULONG               m_ChainFirst;       // first staged position
+    FiltersSnapshot*    m_ChainSnapshot;    // published by commit or rollback
+    PARAMS_MASK         m_ChainCacheParams;
+    BOOLEAN             m_ChainUncacheable;
+    FltRetired          m_ChainRetired;
+    ParamCheckEntry**   m_ChainChecks;          // per staged filter, NULL ends
+    ULONG               m_ChainChecksCount;
+    ULONG               m_ChainChecksCapacity;
 };
@@ -0,0 +1,600 @@
+#include "../inc/commonkrnl.h"
+#include "../inc/memmgr.h"
+#include "fltpattern.h"
+
+ULONG PatternAutomaton::m_AllocTag = 'caSA';
+ULONG PatternIndex::m_AllocTag = 'ipSA';
+
+__checkReturn
+NTSTATUS
+GrowArray (
+    __inout PVOID* Array,
+    __inout PULONG Capacity,
+    __in ULONG Count,
+    __in ULONG ItemSize,
+    __in ULONG Tag
+    )
+{
+    if ( Count < *Capacity )
+    {
+        return STATUS_SUCCESS;
+    }
+
+    ULONG capacity = *Capacity ? *Capacity * 2 : 16;
+
+    PVOID pArray = ExAllocatePoolWithTag( PagedPool, ItemSize * capacity, Tag );
+    if ( !pArray )
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    if ( Count )
+    {
+        RtlCopyMemory( pArray, *Array, ItemSize * Count );
+    }
+
+    FREE_POOL( *Array );
+
+    *Array = pArray;
+    *Capacity = capacity;
+
+    return STATUS_SUCCESS;
+}
+
+void
+GetLongestLiteral (
+    __in PWCHAR Pattern,
+    __in ULONG Length,
+    __out PULONG Start,
+    __out PULONG Size
+    )
+{
+    // mask matches only if every literal run between wildcards is found
+    // in the string, the longest run is the most selective key
+    *Start = 0;
+    *Size = 0;
+
+    ULONG runstart = 0;
+    for ( ULONG idx = 0; idx <= Length; idx++ )
+    {
+        if ( idx < Length && '*' != Pattern[ idx ] && '?' != Pattern[ idx ] )
+        {
+            continue;
+        }
+
+        if ( idx - runstart > *Size )
+        {
+            *Start = runstart;
+            *Size = idx - runstart;
+        }
+
+        runstart = idx + 1;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+PatternAutomaton::PatternAutomaton (
+    )
+{
+    m_Nodes = NULL;
+    m_NodesCount = 0;
+    m_NodesCapacity = 0;
+
+    m_Patterns = NULL;
+    m_PatternsCount = 0;
+    m_PatternsCapacity = 0;
+
+    m_Wild = FLT_PATTERN_NONE;
+
+    RtlFillMemory( m_RootNext, sizeof( m_RootNext ), 0xff );
+}
+
+PatternAutomaton::~PatternAutomaton (
+    )
+{
+    FREE_POOL( m_Nodes );
+    FREE_POOL( m_Patterns );
+}
+
+ULONG
+PatternAutomaton::GetChild (
+    __in ULONG Node,
+    __in WCHAR Char
+    )
+{
+    if ( !Node && Char < FLT_PATTERN_ROOT_CHARS )
+    {
+        return m_RootNext[ Char ];
+    }
+
+    for (
+        ULONG child = m_Nodes[ Node ].m_Child;
+        child != FLT_PATTERN_NONE;
+        child = m_Nodes[ child ].m_Sibling
+        )
+    {
+        if ( m_Nodes[ child ].m_Char == Char )
+        {
+            return child;
+        }
+    }
+
+    return FLT_PATTERN_NONE;
+}
+
+__checkReturn
+NTSTATUS
+PatternAutomaton::AddChild (
+    __in ULONG Node,
+    __in WCHAR Char,
+    __out PULONG Child
+    )
+{
+    NTSTATUS status = GrowArray(
+        (PVOID*) &m_Nodes,
+        &m_NodesCapacity,
+        m_NodesCount,
+        sizeof( AcNode ),
+        m_AllocTag
+        );
+
+    if ( !NT_SUCCESS( status ) )
+    {
+        return status;
+    }
+
+    ULONG child = m_NodesCount++;
+    PAcNode pChild = &m_Nodes[ child ];
+
+    pChild->m_Child = FLT_PATTERN_NONE;
+    pChild->m_Fail = 0;
+    pChild->m_Dict = FLT_PATTERN_NONE;
+    pChild->m_Patterns = FLT_PATTERN_NONE;
+    pChild->m_Char = Char;
+
+    if ( child )
+    {
+        pChild->m_Sibling = m_Nodes[ Node ].m_Child;
+        m_Nodes[ Node ].m_Child = child;
+
+        if ( !Node && Char < FLT_PATTERN_ROOT_CHARS )
+        {
+            m_RootNext[ Char ] = child;
+        }
+    }
+    else
+    {
+        // root
+        pChild->m_Sibling = FLT_PATTERN_NONE;
+    }
+
+    *Child = child;
+
+    return STATUS_SUCCESS;
+}
+
+__checkReturn
+NTSTATUS
+PatternAutomaton::Add (
+    __in ParamCheckEntry* Entry,
+    __in ULONG Id
+    )
+{
+    ULONG node;
+    NTSTATUS status;
+
+    if ( !m_NodesCount )
+    {
+        status = AddChild( 0, 0, &node );
+        if ( !NT_SUCCESS( status ) )
+        {
+            return status;
+        }
+    }
+
+    status = GrowArray(
+        (PVOID*) &m_Patterns,
+        &m_PatternsCapacity,
+        m_PatternsCount,
+        sizeof( AcPattern ),
+        m_AllocTag
+        );
+
+    if ( !NT_SUCCESS( status ) )
+    {
+        return status;
+    }
+
+    FltCheckData* pCheck = Entry->Generic.m_CheckData;
+    PWCHAR pattern = (PWCHAR) pCheck->m_Data;
+
+    ULONG start;
+    ULONG size;
+    GetLongestLiteral( pattern, pCheck->m_DataSize / sizeof( WCHAR ), &start, &size );
+
+    PAcPattern pPattern = &m_Patterns[ m_PatternsCount ];
+    pPattern->m_Id = Id;
+    pPattern->m_Entry = Entry;
+
+    if ( !size )
+    {
+        pPattern->m_Next = m_Wild;
+        m_Wild = m_PatternsCount++;
+
+        return STATUS_SUCCESS;
+    }
+
+    node = 0;
+    for ( ULONG idx = start; idx < start + size; idx++ )
+    {
+        ULONG child = GetChild( node, pattern[ idx ] );
+        if ( FLT_PATTERN_NONE == child )
+        {
+            status = AddChild( node, pattern[ idx ], &child );
+            if ( !NT_SUCCESS( status ) )
+            {
+                return status;
+            }
+        }
+
+        node = child;
+    }
+
+    pPattern->m_Next = m_Nodes[ node ].m_Patterns;
+    m_Nodes[ node ].m_Patterns = m_PatternsCount++;
+
+    return STATUS_SUCCESS;
+}
+
+__checkReturn
+NTSTATUS
+PatternAutomaton::Build (
+    )
+{
+    if ( !m_NodesCount )
+    {
+        return STATUS_SUCCESS;
+    }
+
+    PULONG pQueue = (PULONG) ExAllocatePoolWithTag(
+        PagedPool,
+        sizeof( ULONG ) * m_NodesCount,
+        m_AllocTag
+        );
+
+    if ( !pQueue )
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    // breadth first - fail node is always shallower
+    ULONG head = 0;
+    ULONG tail = 0;
+
+    pQueue[ tail++ ] = 0;
+
+    while ( head < tail )
+    {
+        ULONG node = pQueue[ head++ ];
+
+        for (
+            ULONG child = m_Nodes[ node ].m_Child;
+            child != FLT_PATTERN_NONE;
+            child = m_Nodes[ child ].m_Sibling
+            )
+        {
+            PAcNode pChild = &m_Nodes[ child ];
+
+            ULONG fail = 0;
+            if ( node )
+            {
+                ULONG state = m_Nodes[ node ].m_Fail;
+                while ( TRUE )
+                {
+                    fail = GetChild( state, pChild->m_Char );
+                    if ( FLT_PATTERN_NONE != fail || !state )
+                    {
+                        break;
+                    }
+
+                    state = m_Nodes[ state ].m_Fail;
+                }
+
+                if ( FLT_PATTERN_NONE == fail )
+                {
+                    fail = 0;
+                }
+            }
+
+            pChild->m_Fail = fail;
+            pChild->m_Dict = FLT_PATTERN_NONE != m_Nodes[ fail ].m_Patterns
+                ? fail
+                : m_Nodes[ fail ].m_Dict;
+
+            pQueue[ tail++ ] = child;
+        }
+    }
+
+    FREE_POOL( pQueue );
+
+    return STATUS_SUCCESS;
+}
+
+void
+PatternAutomaton::Verify (
+    __in ULONG Pattern,
+    __in PWCHAR String,
+    __in ULONG Length,
+    __in FltHits* Found
+    )
+{
+    PAcPattern pPattern = &m_Patterns[ Pattern ];
+    FltCheckData* pCheck = pPattern->m_Entry->Generic.m_CheckData;
+
+    if ( Found->Test( pPattern->m_Id ) )
+    {
+        return;
+    }
+
+    NTSTATUS status = CheckMask(
+        ( PWCHAR ) pCheck->m_Data,
+        ( PWCHAR ) Add2Ptr( pCheck->m_Data, pCheck->m_DataSize - sizeof( WCHAR ) ),
+        String,
+        String + Length - 1
+        );
+
+    if ( NT_SUCCESS( status ) )
+    {
+        Found->Set( pPattern->m_Id );
+    }
+}
+
+void
+PatternAutomaton::Hitp (
+    __in ULONG Pattern,
+    __in_opt FltBitmap* Candidates,
+    __in PWCHAR String,
+    __in ULONG Length,
+    __in FltHits* Found
+    )
+{
+    if ( Candidates )
+    {
+        Candidates->Set( Pattern );
+    }
+    else
+    {
+        Verify( Pattern, String, Length, Found );
+    }
+}
+
+__checkReturn
+NTSTATUS
+PatternAutomaton::Match (
+    __in PWCHAR String,
+    __in ULONG Length,
+    __in FltHits* Found
+    )
+{
+    // candidates are collected while the bitmap is inline, bigger
+    // automata verify every hit - nothing is allocated per event
+    FltBitmap candidates;
+    FltBitmap* pCandidates = NULL;
+
+    if ( m_PatternsCount <= FLT_BITMAP_INLINE_BITS )
+    {
+        NTSTATUS status = candidates.Resize( m_PatternsCount );
+        ASSERT( NT_SUCCESS( status ) );
+        UNREFERENCED_PARAMETER( status );
+
+        pCandidates = &candidates;
+    }
+
+    for (
+        ULONG pattern = m_Wild;
+        pattern != FLT_PATTERN_NONE;
+        pattern = m_Patterns[ pattern ].m_Next
+        )
+    {
+        Hitp( pattern, pCandidates, String, Length, Found );
+    }
+
+    if ( m_NodesCount )
+    {
+        WCHAR folded[ FLT_PATTERN_STACK_CHARS ];
+        ULONG state = 0;
+
+        for ( ULONG chunk = 0; chunk < Length; chunk += FLT_PATTERN_STACK_CHARS )
+        {
+            ULONG count = min( Length - chunk, FLT_PATTERN_STACK_CHARS );
+            FltFoldString( folded, &String[ chunk ], count );
+
+            for ( ULONG idx = 0; idx < count; idx++ )
+            {
+                ULONG next;
+                while ( TRUE )
+                {
+                    next = GetChild( state, folded[ idx ] );
+                    if ( FLT_PATTERN_NONE != next || !state )
+                    {
+                        break;
+                    }
+
+                    state = m_Nodes[ state ].m_Fail;
+                }
+
+                state = FLT_PATTERN_NONE == next ? 0 : next;
+
+                ULONG output = FLT_PATTERN_NONE != m_Nodes[ state ].m_Patterns
+                    ? state
+                    : m_Nodes[ state ].m_Dict;
+
+                while ( FLT_PATTERN_NONE != output )
+                {
+                    for (
+                        ULONG pattern = m_Nodes[ output ].m_Patterns;
+                        pattern != FLT_PATTERN_NONE;
+                        pattern = m_Patterns[ pattern ].m_Next
+                        )
+                    {
+                        Hitp( pattern, pCandidates, String, Length, Found );
+                    }
+
+                    output = m_Nodes[ output ].m_Dict;
+                }
+            }
+        }
+    }
+
+    if ( !pCandidates )
+    {
+        return STATUS_SUCCESS;
+    }
+
+    for (
+        ULONG pattern = candidates.FindSet( 0 );
+        pattern != FLT_BITMAP_NOT_FOUND;
+        pattern = candidates.FindSet( pattern + 1 )
+        )
+    {
+        Verify( pattern, String, Length, Found );
+    }
+
+    return STATUS_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+PatternIndex::PatternIndex (
+    )
+{
+    m_Built = FALSE;
+    RtlZeroMemory( m_Automata, sizeof( m_Automata ) );
+}
+
+PatternIndex::~PatternIndex (
+    )
+{
+    Reset();
+}
+
+BOOLEAN
+PatternIndex::IsIndexed (
+    __in ParamCheckEntry* Entry
+    )
+{
+    if (
+        CheckEntryGeneric == Entry->m_Type
+        &&
+        FltOp_pattern == Entry->Generic.m_Operation
+        &&
+        Entry->Generic.m_Parameter <= PARAMETER_MAXIMUM
+        &&
+        Entry->Generic.m_CheckData->m_DataSize >= sizeof( WCHAR )
+        )
+    {
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+void
+PatternIndex::Reset (
+    )
+{
+    for ( ULONG idx = 0; idx <= PARAMETER_MAXIMUM; idx++ )
+    {
+        FREE_OBJECT( m_Automata[ idx ] );
+    }
+
+    m_Built = FALSE;
+}
+
+__checkReturn
+NTSTATUS
+PatternIndex::Add (
+    __in ParamCheckEntry* Entry,
+    __in ULONG Id
+    )
+{
+    ASSERT( IsIndexed( Entry ) );
+
+    m_Built = FALSE;
+
+    ULONG parameter = Entry->Generic.m_Parameter;
+
+    if ( !m_Automata[ parameter ] )
+    {
+        m_Automata[ parameter ] = new (
+            PagedPool,
+            PatternAutomaton::m_AllocTag
+            ) PatternAutomaton;
+
+        if ( !m_Automata[ parameter ] )
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+    }
+
+    return m_Automata[ parameter ]->Add( Entry, Id );
+}
+
+__checkReturn
+NTSTATUS
+PatternIndex::Build (
+    )
+{
+    for ( ULONG idx = 0; idx <= PARAMETER_MAXIMUM; idx++ )
+    {
+        if ( !m_Automata[ idx ] )
+        {
+            continue;
+        }
+
+        NTSTATUS status = m_Automata[ idx ]->Build();
+        if ( !NT_SUCCESS( status ) )
+        {
+            return status;
+        }
+    }
+
+    m_Built = TRUE;
+
+    return STATUS_SUCCESS;
+}
+
+BOOLEAN
+PatternIndex::Contains (
+    __in ULONG ParameterId
+    )
+{
+    if ( ParameterId > PARAMETER_MAXIMUM || !m_Automata[ ParameterId ] )
+    {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+__checkReturn
+NTSTATUS
+PatternIndex::Match (
+    __in ULONG ParameterId,
+    __in PVOID Data,
+    __in ULONG DataSize,
+    __in FltHits* Found
+    )
+{
+    ASSERT( m_Built );
+    ASSERT( Contains( ParameterId ) );
+
+    NTSTATUS status = m_Automata[ ParameterId ]->Match(
+        (PWCHAR) Data,
+        DataSize / sizeof( WCHAR ),
+        Found
+        );
+
+    return status;
+}
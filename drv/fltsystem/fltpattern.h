@@ -0,0 +1,175 @@
+#pragma once
+
+//!
+//    \description - multi-pattern index of FltOp_pattern checks. Longest
+//                   literal segment of every mask is a key of Aho-Corasick
+//                   automaton (one per parameter), one pass over the string
+//                   gives candidate masks, CheckMask verifies them.
+//                   Masks are stored folded, the string is folded by
+//                   chunks on the stack while it is scanned.
+//!
+
+#include "../../inc/accessch.h"
+#include "fltbitmap.h"
+#include "fltchecks.h"
+
+#define FLT_PATTERN_NONE        ( (ULONG) -1 )
+#define FLT_PATTERN_ROOT_CHARS  128
+#define FLT_PATTERN_STACK_CHARS 256
+
+// doubles pool array when Count reaches Capacity, used by indexes
+__checkReturn
+NTSTATUS
+GrowArray (
+    __inout PVOID* Array,
+    __inout PULONG Capacity,
+    __in ULONG Count,
+    __in ULONG ItemSize,
+    __in ULONG Tag
+    );
+
+typedef struct _AcNode
+{
+    ULONG               m_Child;
+    ULONG               m_Sibling;
+    ULONG               m_Fail;
+    ULONG               m_Dict;         // nearest node on fail chain with patterns
+    ULONG               m_Patterns;     // patterns with key ending here
+    WCHAR               m_Char;
+} AcNode, *PAcNode;
+
+typedef struct _AcPattern
+{
+    ULONG               m_Next;
+    ULONG               m_Id;
+    ParamCheckEntry*    m_Entry;
+} AcPattern, *PAcPattern;
+
+class PatternAutomaton
+{
+public:
+    static ULONG        m_AllocTag;
+
+public:
+    PatternAutomaton();
+    ~PatternAutomaton();
+
+    __checkReturn
+    NTSTATUS
+    Add (
+        __in ParamCheckEntry* Entry,
+        __in ULONG Id
+        );
+
+    __checkReturn
+    NTSTATUS
+    Build();
+
+    // String is not folded
+    __checkReturn
+    NTSTATUS
+    Match (
+        __in PWCHAR String,
+        __in ULONG Length,
+        __in FltHits* Found
+        );
+
+private:
+    void
+    Hitp (
+        __in ULONG Pattern,
+        __in_opt FltBitmap* Candidates,
+        __in PWCHAR String,
+        __in ULONG Length,
+        __in FltHits* Found
+        );
+
+    ULONG
+    GetChild (
+        __in ULONG Node,
+        __in WCHAR Char
+        );
+
+    __checkReturn
+    NTSTATUS
+    AddChild (
+        __in ULONG Node,
+        __in WCHAR Char,
+        __out PULONG Child
+        );
+
+    void
+    Verify (
+        __in ULONG Pattern,
+        __in PWCHAR String,
+        __in ULONG Length,
+        __in FltHits* Found
+        );
+
+private:
+    PAcNode             m_Nodes;
+    ULONG               m_NodesCount;
+    ULONG               m_NodesCapacity;
+
+    PAcPattern          m_Patterns;
+    ULONG               m_PatternsCount;
+    ULONG               m_PatternsCapacity;
+
+    ULONG               m_Wild;         // patterns without literals
+    ULONG               m_RootNext[ FLT_PATTERN_ROOT_CHARS ];
+};
+
+class PatternIndex
+{
+public:
+    static ULONG        m_AllocTag;
+
+public:
+    PatternIndex();
+    ~PatternIndex();
+
+    static
+    BOOLEAN
+    IsIndexed (
+        __in ParamCheckEntry* Entry
+        );
+
+    void
+    Reset();
+
+    __checkReturn
+    NTSTATUS
+    Add (
+        __in ParamCheckEntry* Entry,
+        __in ULONG Id
+        );
+
+    __checkReturn
+    NTSTATUS
+    Build();
+
+    BOOLEAN
+    IsBuilt (
+        )
+    {
+        return m_Built;
+    }
+
+    BOOLEAN
+    Contains (
+        __in ULONG ParameterId
+        );
+
+    __checkReturn
+    NTSTATUS
+    Match (
+        __in ULONG ParameterId,
+        __in PVOID Data,
+        __in ULONG DataSize,
+        __in FltHits* Found
+        );
+
+private:
+    BOOLEAN             m_Built;
+    PatternAutomaton*   m_Automata[ PARAMETER_MAXIMUM + 1 ];
+};
@@ -0,0 +1,789 @@
+#include "../inc/commonkrnl.h"
+#include "../inc/memmgr.h"
+#include "fltprefix.h"
+#include "fltpattern.h"
+
+ULONG PrefixTrie::m_AllocTag = 'rtSA';
+ULONG PrefixIndex::m_AllocTag = 'xpSA';
+
+typedef struct _PrefixStackItem
+{
+    ULONG               m_Node;
+    ULONG               m_Position;     // component of the path after the node
+} PrefixStackItem, *PPrefixStackItem;
+
+LONG
+ComparePrefixKeys (
+    __in PPrefixNode Node1,
+    __in PPrefixNode Node2
+    )
+{
+    ULONG length = min( Node1->m_KeyLength, Node2->m_KeyLength );
+
+    for ( ULONG idx = 0; idx < length; idx++ )
+    {
+        if ( Node1->m_Label[ idx ] != Node2->m_Label[ idx ] )
+        {
+            return Node1->m_Label[ idx ] < Node2->m_Label[ idx ] ? -1 : 1;
+        }
+    }
+
+    return (LONG) Node1->m_KeyLength - (LONG) Node2->m_KeyLength;
+}
+
+void
+SiftDownLinksp (
+    __in PPrefixNode Nodes,
+    __inout PULONG Links,
+    __in ULONG Root,
+    __in ULONG Count
+    )
+{
+    for ( ; ; )
+    {
+        ULONG child = Root * 2 + 1;
+        if ( child >= Count )
+        {
+            break;
+        }
+
+        if (
+            child + 1 < Count
+            &&
+            ComparePrefixKeys( &Nodes[ Links[ child ] ], &Nodes[ Links[ child + 1 ] ] ) < 0
+            )
+        {
+            child++;
+        }
+
+        if ( ComparePrefixKeys( &Nodes[ Links[ Root ] ], &Nodes[ Links[ child ] ] ) >= 0 )
+        {
+            break;
+        }
+
+        ULONG tmp = Links[ Root ];
+        Links[ Root ] = Links[ child ];
+        Links[ child ] = tmp;
+
+        Root = child;
+    }
+}
+
+ULONG
+GetPrefixHash (
+    __in ULONG Parent,
+    __in_ecount(Length) PWCHAR Component,
+    __in ULONG Length
+    )
+{
+    // FNV-1a
+    ULONG hash = 2166136261 ^ Parent;
+
+    for ( ULONG idx = 0; idx < Length; idx++ )
+    {
+        hash ^= Component[ idx ];
+        hash *= 16777619;
+    }
+
+    return hash;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+PrefixTrie::PrefixTrie (
+    )
+{
+    m_Built = FALSE;
+
+    m_Nodes = NULL;
+    m_NodesCount = 0;
+    m_NodesCapacity = 0;
+
+    m_Links = NULL;
+    m_LinksCount = 0;
+    m_LinksCapacity = 0;
+
+    m_Items = NULL;
+    m_ItemsCount = 0;
+    m_ItemsCapacity = 0;
+
+    m_Hash = NULL;
+    m_HashCapacity = 0;
+}
+
+PrefixTrie::~PrefixTrie (
+    )
+{
+    FREE_POOL( m_Nodes );
+    FREE_POOL( m_Links );
+    FREE_POOL( m_Items );
+    FREE_POOL( m_Hash );
+}
+
+ULONG
+PrefixTrie::FindAddedp (
+    __in ULONG Parent,
+    __in_ecount(Length) PWCHAR Component,
+    __in ULONG Length
+    )
+{
+    if ( !m_HashCapacity )
+    {
+        return FLT_PREFIX_NONE;
+    }
+
+    ULONG slot = GetPrefixHash( Parent, Component, Length );
+
+    for ( ; ; slot++ )
+    {
+        ULONG node = m_Hash[ slot & ( m_HashCapacity - 1 ) ];
+        if ( FLT_PREFIX_NONE == node )
+        {
+            return FLT_PREFIX_NONE;
+        }
+
+        PPrefixNode pNode = &m_Nodes[ node ];
+        if (
+            pNode->m_Parent == Parent
+            &&
+            pNode->m_Length == Length
+            &&
+            Length * sizeof( WCHAR ) == RtlCompareMemory(
+                pNode->m_Label,
+                Component,
+                Length * sizeof( WCHAR )
+                )
+            )
+        {
+            return node;
+        }
+    }
+}
+
+__checkReturn
+NTSTATUS
+PrefixTrie::GrowHashp (
+    )
+{
+    // at most half full, every node but the root is hashed again
+    ULONG capacity = m_HashCapacity ? m_HashCapacity * 2 : 64;
+
+    PULONG pHash = (PULONG) ExAllocatePoolWithTag(
+        PagedPool,
+        sizeof( ULONG ) * capacity,
+        m_AllocTag
+        );
+
+    if ( !pHash )
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlFillMemory( pHash, sizeof( ULONG ) * capacity, 0xff );
+
+    for ( ULONG node = 1; node < m_NodesCount; node++ )
+    {
+        PPrefixNode pNode = &m_Nodes[ node ];
+        ULONG slot = GetPrefixHash( pNode->m_Parent, pNode->m_Label, pNode->m_Length );
+
+        while ( FLT_PREFIX_NONE != pHash[ slot & ( capacity - 1 ) ] )
+        {
+            slot++;
+        }
+
+        pHash[ slot & ( capacity - 1 ) ] = node;
+    }
+
+    FREE_POOL( m_Hash );
+
+    m_Hash = pHash;
+    m_HashCapacity = capacity;
+
+    return STATUS_SUCCESS;
+}
+
+__checkReturn
+NTSTATUS
+PrefixTrie::AddNodep (
+    __in ULONG Parent,
+    __in PWCHAR Label,
+    __in ULONG Length,
+    __out PULONG Node
+    )
+{
+    NTSTATUS status = GrowArray(
+        (PVOID*) &m_Nodes,
+        &m_NodesCapacity,
+        m_NodesCount,
+        sizeof( PrefixNode ),
+        m_AllocTag
+        );
+
+    if ( !NT_SUCCESS( status ) )
+    {
+        return status;
+    }
+
+    if ( ( m_NodesCount + 1 ) * 2 > m_HashCapacity )
+    {
+        status = GrowHashp();
+        if ( !NT_SUCCESS( status ) )
+        {
+            return status;
+        }
+    }
+
+    ULONG node = m_NodesCount++;
+    PPrefixNode pNode = &m_Nodes[ node ];
+
+    pNode->m_Label = Label;
+    pNode->m_Length = Length;
+    pNode->m_KeyLength = Length;
+    pNode->m_Wild = ( 1 == Length && L'*' == Label[ 0 ] );
+    pNode->m_Child = FLT_PREFIX_NONE;
+    pNode->m_ChildCount = 0;
+    pNode->m_Sibling = FLT_PREFIX_NONE;
+    pNode->m_Parent = Parent;
+    pNode->m_WildChild = FLT_PREFIX_NONE;
+    pNode->m_Prefixes = FLT_PREFIX_NONE;
+
+    if ( FLT_PREFIX_NONE != Parent )
+    {
+        pNode->m_Sibling = m_Nodes[ Parent ].m_Child;
+        m_Nodes[ Parent ].m_Child = node;
+
+        ULONG slot = GetPrefixHash( Parent, Label, Length );
+        while ( FLT_PREFIX_NONE != m_Hash[ slot & ( m_HashCapacity - 1 ) ] )
+        {
+            slot++;
+        }
+
+        m_Hash[ slot & ( m_HashCapacity - 1 ) ] = node;
+    }
+
+    *Node = node;
+
+    return STATUS_SUCCESS;
+}
+
+__checkReturn
+NTSTATUS
+PrefixTrie::Add (
+    __in ParamCheckEntry* Entry,
+    __in ULONG Id
+    )
+{
+    ASSERT( !m_Built );
+
+    ULONG node;
+    NTSTATUS status;
+
+    if ( !m_NodesCount )
+    {
+        status = AddNodep( FLT_PREFIX_NONE, NULL, 0, &node );
+        if ( !NT_SUCCESS( status ) )
+        {
+            return status;
+        }
+    }
+
+    status = GrowArray(
+        (PVOID*) &m_Items,
+        &m_ItemsCapacity,
+        m_ItemsCount,
+        sizeof( PrefixItem ),
+        m_AllocTag
+        );
+
+    if ( !NT_SUCCESS( status ) )
+    {
+        return status;
+    }
+
+    FltCheckData* pCheck = Entry->Generic.m_CheckData;
+    PWCHAR prefix = (PWCHAR) pCheck->m_Data;
+    ULONG length = FltTrimPrefix( prefix, pCheck->m_DataSize / sizeof( WCHAR ) );
+
+    node = 0;
+    ULONG position = 0;
+
+    for ( ; ; )
+    {
+        ULONG end = position;
+        while ( end < length && L'\\' != prefix[ end ] )
+        {
+            end++;
+        }
+
+        // wide nodes - siblings are not scanned
+        ULONG child = FindAddedp( node, &prefix[ position ], end - position );
+
+        if ( FLT_PREFIX_NONE == child )
+        {
+            status = AddNodep( node, &prefix[ position ], end - position, &child );
+            if ( !NT_SUCCESS( status ) )
+            {
+                return status;
+            }
+        }
+
+        node = child;
+
+        if ( end >= length )
+        {
+            break;
+        }
+
+        position = end + 1;
+    }
+
+    PPrefixItem pItem = &m_Items[ m_ItemsCount ];
+    pItem->m_Id = Id;
+    pItem->m_Next = m_Nodes[ node ].m_Prefixes;
+    m_Nodes[ node ].m_Prefixes = m_ItemsCount++;
+
+    return STATUS_SUCCESS;
+}
+
+void
+PrefixTrie::Mergep (
+    __in ULONG Node
+    )
+{
+    PPrefixNode pNode = &m_Nodes[ Node ];
+
+    // label of the child is preceded by the node components in check
+    // data of the child
+    while (
+        !pNode->m_Wild
+        &&
+        FLT_PREFIX_NONE == pNode->m_Prefixes
+        &&
+        FLT_PREFIX_NONE != pNode->m_Child
+        &&
+        FLT_PREFIX_NONE == m_Nodes[ pNode->m_Child ].m_Sibling
+        &&
+        !m_Nodes[ pNode->m_Child ].m_Wild
+        )
+    {
+        PPrefixNode pChild = &m_Nodes[ pNode->m_Child ];
+
+        pNode->m_Label = pChild->m_Label - ( pNode->m_Length + 1 );
+        pNode->m_Length += pChild->m_Length + 1;
+        pNode->m_Prefixes = pChild->m_Prefixes;
+        pNode->m_Child = pChild->m_Child;
+    }
+}
+
+__checkReturn
+NTSTATUS
+PrefixTrie::Linkp (
+    __in ULONG Node
+    )
+{
+    ULONG first = m_LinksCount;
+
+    for (
+        ULONG child = m_Nodes[ Node ].m_Child;
+        child != FLT_PREFIX_NONE;
+        child = m_Nodes[ child ].m_Sibling
+        )
+    {
+        if ( m_Nodes[ child ].m_Wild )
+        {
+            m_Nodes[ Node ].m_WildChild = child;
+            continue;
+        }
+
+        NTSTATUS status = GrowArray(
+            (PVOID*) &m_Links,
+            &m_LinksCapacity,
+            m_LinksCount,
+            sizeof( ULONG ),
+            m_AllocTag
+            );
+
+        if ( !NT_SUCCESS( status ) )
+        {
+            return status;
+        }
+
+        m_Links[ m_LinksCount++ ] = child;
+    }
+
+    // heap sort of children by first component
+    PULONG pLinks = &m_Links[ first ];
+    ULONG count = m_LinksCount - first;
+
+    for ( ULONG root = count / 2; root-- > 0; )
+    {
+        SiftDownLinksp( m_Nodes, pLinks, root, count );
+    }
+
+    for ( ULONG last = count; last-- > 1; )
+    {
+        ULONG tmp = pLinks[ 0 ];
+        pLinks[ 0 ] = pLinks[ last ];
+        pLinks[ last ] = tmp;
+
+        SiftDownLinksp( m_Nodes, pLinks, 0, last );
+    }
+
+    m_Nodes[ Node ].m_Child = first;
+    m_Nodes[ Node ].m_ChildCount = count;
+
+    return STATUS_SUCCESS;
+}
+
+__checkReturn
+NTSTATUS
+PrefixTrie::Build (
+    )
+{
+    if ( m_Built || !m_NodesCount )
+    {
+        m_Built = TRUE;
+
+        return STATUS_SUCCESS;
+    }
+
+    // nodes are visited once, merged ones are not reached
+    PULONG pPending = (PULONG) ExAllocatePoolWithTag(
+        PagedPool,
+        sizeof( ULONG ) * m_NodesCount,
+        m_AllocTag
+        );
+
+    if ( !pPending )
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    NTSTATUS status = STATUS_SUCCESS;
+    ULONG pending = 0;
+
+    pPending[ pending++ ] = 0;
+
+    while ( pending )
+    {
+        ULONG node = pPending[ --pending ];
+
+        if ( node )
+        {
+            Mergep( node );
+        }
+
+        status = Linkp( node );
+        if ( !NT_SUCCESS( status ) )
+        {
+            break;
+        }
+
+        PPrefixNode pNode = &m_Nodes[ node ];
+        for ( ULONG idx = 0; idx < pNode->m_ChildCount; idx++ )
+        {
+            pPending[ pending++ ] = m_Links[ pNode->m_Child + idx ];
+        }
+
+        if ( FLT_PREFIX_NONE != pNode->m_WildChild )
+        {
+            pPending[ pending++ ] = pNode->m_WildChild;
+        }
+    }
+
+    ExFreePool( pPending );
+
+    if ( NT_SUCCESS( status ) )
+    {
+        FREE_POOL( m_Hash );
+        m_HashCapacity = 0;
+
+        m_Built = TRUE;
+    }
+
+    return status;
+}
+
+ULONG
+PrefixTrie::FindChildp (
+    __in PPrefixNode Node,
+    __in_ecount(Length) PWCHAR Component,
+    __in ULONG Length
+    )
+{
+    ULONG low = 0;
+    ULONG high = Node->m_ChildCount;
+
+    while ( low < high )
+    {
+        ULONG middle = low + ( high - low ) / 2;
+        ULONG child = m_Links[ Node->m_Child + middle ];
+        PPrefixNode pChild = &m_Nodes[ child ];
+
+        ULONG length = min( pChild->m_KeyLength, Length );
+        LONG compare = 0;
+
+        for ( ULONG idx = 0; idx < length && !compare; idx++ )
+        {
+            WCHAR folded = FltFoldChar( Component[ idx ] );
+            if ( pChild->m_Label[ idx ] != folded )
+            {
+                compare = pChild->m_Label[ idx ] < folded ? -1 : 1;
+            }
+        }
+
+        if ( !compare )
+        {
+            compare = (LONG) pChild->m_KeyLength - (LONG) Length;
+        }
+
+        if ( !compare )
+        {
+            return child;
+        }
+
+        if ( compare < 0 )
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return FLT_PREFIX_NONE;
+}
+
+__checkReturn
+NTSTATUS
+PrefixTrie::Match (
+    __in_ecount(Length) PWCHAR String,
+    __in ULONG Length,
+    __in FltHits* Found
+    )
+{
+    ASSERT( m_Built );
+
+    if ( !m_NodesCount )
+    {
+        return STATUS_SUCCESS;
+    }
+
+    PrefixStackItem stack[ FLT_PREFIX_STACK ];
+    ULONG depth = 0;
+
+    stack[ depth ].m_Node = 0;
+    stack[ depth ].m_Position = 0;
+    depth++;
+
+    while ( depth )
+    {
+        depth--;
+
+        PPrefixNode pNode = &m_Nodes[ stack[ depth ].m_Node ];
+        ULONG position = stack[ depth ].m_Position;
+
+        ULONG end = position;
+        while ( end < Length && L'\\' != String[ end ] )
+        {
+            end++;
+        }
+
+        // wild edge takes the component, literal one its key and the rest
+        // of merged components
+        ULONG reached[ 2 ];
+        ULONG stop[ 2 ];
+        ULONG count = 0;
+
+        if ( FLT_PREFIX_NONE != pNode->m_WildChild )
+        {
+            reached[ count ] = pNode->m_WildChild;
+            stop[ count ] = end;
+            count++;
+        }
+
+        ULONG child = FindChildp( pNode, &String[ position ], end - position );
+        if ( FLT_PREFIX_NONE != child )
+        {
+            PPrefixNode pChild = &m_Nodes[ child ];
+            ULONG last = position + pChild->m_Length;
+
+            BOOLEAN bMatched = last <= Length && ( last == Length || L'\\' == String[ last ] );
+            for ( ULONG idx = pChild->m_KeyLength; bMatched && idx < pChild->m_Length; idx++ )
+            {
+                bMatched = FltFoldChar( String[ position + idx ] ) == pChild->m_Label[ idx ];
+            }
+
+            if ( bMatched )
+            {
+                reached[ count ] = child;
+                stop[ count ] = last;
+                count++;
+            }
+        }
+
+        for ( ULONG idx = 0; idx < count; idx++ )
+        {
+            PPrefixNode pReached = &m_Nodes[ reached[ idx ] ];
+
+            for (
+                ULONG item = pReached->m_Prefixes;
+                item != FLT_PREFIX_NONE;
+                item = m_Items[ item ].m_Next
+                )
+            {
+                Found->Set( m_Items[ item ].m_Id );
+            }
+
+            if (
+                stop[ idx ] >= Length
+                ||
+                ( !pReached->m_ChildCount && FLT_PREFIX_NONE == pReached->m_WildChild )
+                )
+            {
+                continue;
+            }
+
+            if ( FLT_PREFIX_STACK == depth )
+            {
+                // caller checks the entries one by one
+                return STATUS_INSUFFICIENT_RESOURCES;
+            }
+
+            stack[ depth ].m_Node = reached[ idx ];
+            stack[ depth ].m_Position = stop[ idx ] + 1;
+            depth++;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+PrefixIndex::PrefixIndex (
+    )
+{
+    m_Built = FALSE;
+    RtlZeroMemory( m_Tries, sizeof( m_Tries ) );
+}
+
+PrefixIndex::~PrefixIndex (
+    )
+{
+    Reset();
+}
+
+BOOLEAN
+PrefixIndex::IsIndexed (
+    __in ParamCheckEntry* Entry
+    )
+{
+    if (
+        CheckEntryGeneric == Entry->m_Type
+        &&
+        FltOp_prefix == Entry->Generic.m_Operation
+        &&
+        Entry->Generic.m_Parameter <= PARAMETER_MAXIMUM
+        )
+    {
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+void
+PrefixIndex::Reset (
+    )
+{
+    for ( ULONG idx = 0; idx <= PARAMETER_MAXIMUM; idx++ )
+    {
+        FREE_OBJECT( m_Tries[ idx ] );
+    }
+
+    m_Built = FALSE;
+}
+
+__checkReturn
+NTSTATUS
+PrefixIndex::Add (
+    __in ParamCheckEntry* Entry,
+    __in ULONG Id
+    )
+{
+    ASSERT( IsIndexed( Entry ) );
+
+    m_Built = FALSE;
+
+    ULONG parameter = Entry->Generic.m_Parameter;
+
+    if ( !m_Tries[ parameter ] )
+    {
+        m_Tries[ parameter ] = new ( PagedPool, PrefixTrie::m_AllocTag ) PrefixTrie;
+
+        if ( !m_Tries[ parameter ] )
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+    }
+
+    return m_Tries[ parameter ]->Add( Entry, Id );
+}
+
+__checkReturn
+NTSTATUS
+PrefixIndex::Build (
+    )
+{
+    for ( ULONG idx = 0; idx <= PARAMETER_MAXIMUM; idx++ )
+    {
+        if ( !m_Tries[ idx ] )
+        {
+            continue;
+        }
+
+        NTSTATUS status = m_Tries[ idx ]->Build();
+        if ( !NT_SUCCESS( status ) )
+        {
+            return status;
+        }
+    }
+
+    m_Built = TRUE;
+
+    return STATUS_SUCCESS;
+}
+
+BOOLEAN
+PrefixIndex::Contains (
+    __in ULONG ParameterId
+    )
+{
+    if ( ParameterId > PARAMETER_MAXIMUM || !m_Tries[ ParameterId ] )
+    {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+__checkReturn
+NTSTATUS
+PrefixIndex::Match (
+    __in ULONG ParameterId,
+    __in PVOID Data,
+    __in ULONG DataSize,
+    __in FltHits* Found
+    )
+{
+    ASSERT( m_Built );
+    ASSERT( Contains( ParameterId ) );
+
+    return m_Tries[ ParameterId ]->Match(
+        (PWCHAR) Data,
+        DataSize / sizeof( WCHAR ),
+        Found
+        );
+}
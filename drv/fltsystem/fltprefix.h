@@ -0,0 +1,182 @@
+#pragma once
+
+//!
+//    \description - index of FltOp_prefix checks. Prefixes of a parameter
+//                   make a radix trie over path components: edge holds
+//                   whole components, chains without branches are merged
+//                   into one edge when the trie is built, "*" component is
+//                   a separate edge. One descent over the path sets found
+//                   bit of every prefix it passes.
+//
+//                   Edge labels point into folded check data, the trie is
+//                   rebuilt with the entries it refers to.
+//!
+
+#include "../../inc/accessch.h"
+#include "fltbitmap.h"
+#include "fltchecks.h"
+
+#define FLT_PREFIX_NONE         ( (ULONG) -1 )
+#define FLT_PREFIX_STACK        64      // deeper tries are checked one by one
+
+typedef struct _PrefixNode
+{
+    PWCHAR              m_Label;        // folded, merged components keep separators
+    ULONG               m_Length;       // chars
+    ULONG               m_KeyLength;    // first component, distinct among siblings
+    BOOLEAN             m_Wild;
+    ULONG               m_Child;        // built - first of m_ChildCount links
+    ULONG               m_ChildCount;
+    ULONG               m_Sibling;      // while adding
+    ULONG               m_Parent;       // while adding
+    ULONG               m_WildChild;
+    ULONG               m_Prefixes;     // prefixes ending here
+} PrefixNode, *PPrefixNode;
+
+typedef struct _PrefixItem
+{
+    ULONG               m_Next;
+    ULONG               m_Id;
+} PrefixItem, *PPrefixItem;
+
+class PrefixTrie
+{
+public:
+    static ULONG        m_AllocTag;
+
+public:
+    PrefixTrie();
+    ~PrefixTrie();
+
+    __checkReturn
+    NTSTATUS
+    Add (
+        __in ParamCheckEntry* Entry,
+        __in ULONG Id
+        );
+
+    __checkReturn
+    NTSTATUS
+    Build();
+
+    // String is not folded
+    __checkReturn
+    NTSTATUS
+    Match (
+        __in_ecount(Length) PWCHAR String,
+        __in ULONG Length,
+        __in FltHits* Found
+        );
+
+private:
+    __checkReturn
+    NTSTATUS
+    AddNodep (
+        __in ULONG Parent,
+        __in PWCHAR Label,
+        __in ULONG Length,
+        __out PULONG Node
+        );
+
+    void
+    Mergep (
+        __in ULONG Node
+        );
+
+    __checkReturn
+    NTSTATUS
+    Linkp (
+        __in ULONG Node
+        );
+
+    ULONG
+    FindChildp (
+        __in PPrefixNode Node,
+        __in_ecount(Length) PWCHAR Component,
+        __in ULONG Length
+        );
+
+    ULONG
+    FindAddedp (
+        __in ULONG Parent,
+        __in_ecount(Length) PWCHAR Component,
+        __in ULONG Length
+        );
+
+    __checkReturn
+    NTSTATUS
+    GrowHashp();
+
+private:
+    BOOLEAN             m_Built;
+
+    PPrefixNode         m_Nodes;
+    ULONG               m_NodesCount;
+    ULONG               m_NodesCapacity;
+
+    PULONG              m_Links;        // literal children sorted by key
+    ULONG               m_LinksCount;
+    ULONG               m_LinksCapacity;
+
+    PPrefixItem         m_Items;
+    ULONG               m_ItemsCount;
+    ULONG               m_ItemsCapacity;
+
+    PULONG              m_Hash;         // nodes by parent and label, while adding
+    ULONG               m_HashCapacity;
+};
+
+class PrefixIndex
+{
+public:
+    static ULONG        m_AllocTag;
+
+public:
+    PrefixIndex();
+    ~PrefixIndex();
+
+    static
+    BOOLEAN
+    IsIndexed (
+        __in ParamCheckEntry* Entry
+        );
+
+    void
+    Reset();
+
+    __checkReturn
+    NTSTATUS
+    Add (
+        __in ParamCheckEntry* Entry,
+        __in ULONG Id
+        );
+
+    __checkReturn
+    NTSTATUS
+    Build();
+
+    BOOLEAN
+    IsBuilt (
+        )
+    {
+        return m_Built;
+    }
+
+    BOOLEAN
+    Contains (
+        __in ULONG ParameterId
+        );
+
+    __checkReturn
+    NTSTATUS
+    Match (
+        __in ULONG ParameterId,
+        __in PVOID Data,
+        __in ULONG DataSize,
+        __in FltHits* Found
+        );
+
+private:
+    BOOLEAN             m_Built;
+    PrefixTrie*         m_Tries[ PARAMETER_MAXIMUM + 1 ];
+};
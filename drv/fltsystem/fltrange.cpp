@@ -0,0 +1,306 @@
+#include "../inc/commonkrnl.h"
+#include "../inc/memmgr.h"
+#include "fltrange.h"
+#include "fltpattern.h"
+#include "fltvalues.h"
+
+ULONG FilterRangeIndex::m_AllocTag = 'grSA';
+
+ULONG64
+GetWidthMaximum (
+    __in ULONG Size
+    )
+{
+    if ( Size >= sizeof( ULONG64 ) )
+    {
+        return (ULONG64) -1;
+    }
+
+    return ( 1ULL << ( Size * 8 ) ) - 1;
+}
+
+BOOLEAN
+IsRangeItemBelow (
+    __in PRangeItem Item1,
+    __in PRangeItem Item2
+    )
+{
+    if ( Item1->m_ParameterId != Item2->m_ParameterId )
+    {
+        return Item1->m_ParameterId < Item2->m_ParameterId;
+    }
+
+    return Item1->m_Low < Item2->m_Low;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+FilterRangeIndex::FilterRangeIndex (
+    )
+{
+    m_Built = FALSE;
+    m_Items = NULL;
+    m_ItemsCount = 0;
+    m_ItemsCapacity = 0;
+
+    RtlZeroMemory( m_First, sizeof( m_First ) );
+    RtlZeroMemory( m_Count, sizeof( m_Count ) );
+}
+
+FilterRangeIndex::~FilterRangeIndex (
+    )
+{
+    Reset();
+}
+
+BOOLEAN
+FilterRangeIndex::IsIndexed (
+    __in ParamCheckEntry* Entry
+    )
+{
+    if (
+        CheckEntryGeneric != Entry->m_Type
+        ||
+        Entry->Generic.m_Parameter > PARAMETER_MAXIMUM
+        )
+    {
+        return FALSE;
+    }
+
+    switch ( Entry->Generic.m_Operation )
+    {
+    case FltOp_less:
+    case FltOp_greater:
+    case FltOp_range:
+        break;
+
+    default:
+        return FALSE;
+    }
+
+    // widths are validated when filter is added
+    ASSERT( Entry->Generic.m_CheckData->m_Count );
+    ASSERT(
+        FltIsOrderedWidth(
+            Entry->Generic.m_CheckData->m_DataSize / Entry->Generic.m_CheckData->m_Count
+            )
+        );
+
+    return TRUE;
+}
+
+void
+FilterRangeIndex::Reset (
+    )
+{
+    FREE_POOL( m_Items );
+
+    m_ItemsCount = 0;
+    m_ItemsCapacity = 0;
+    m_Built = FALSE;
+
+    RtlZeroMemory( m_First, sizeof( m_First ) );
+    RtlZeroMemory( m_Count, sizeof( m_Count ) );
+}
+
+__checkReturn
+NTSTATUS
+FilterRangeIndex::AddItemp (
+    __in ULONG ParameterId,
+    __in ULONG Size,
+    __in ULONG Id,
+    __in ULONG64 Low,
+    __in ULONG64 High
+    )
+{
+    NTSTATUS status = GrowArray(
+        (PVOID*) &m_Items,
+        &m_ItemsCapacity,
+        m_ItemsCount,
+        sizeof( RangeItem ),
+        m_AllocTag
+        );
+
+    if ( !NT_SUCCESS( status ) )
+    {
+        return status;
+    }
+
+    PRangeItem pItem = &m_Items[ m_ItemsCount++ ];
+    pItem->m_Low = Low;
+    pItem->m_High = High;
+    pItem->m_ParameterId = ParameterId;
+    pItem->m_Size = Size;
+    pItem->m_CheckIdx = Id;
+
+    return STATUS_SUCCESS;
+}
+
+__checkReturn
+NTSTATUS
+FilterRangeIndex::Add (
+    __in ParamCheckEntry* Entry,
+    __in ULONG Id
+    )
+{
+    ASSERT( IsIndexed( Entry ) );
+
+    m_Built = FALSE;
+
+    FltCheckData* pCheck = Entry->Generic.m_CheckData;
+    ULONG size = pCheck->m_DataSize / pCheck->m_Count;
+    ULONG64 maximum = GetWidthMaximum( size );
+
+    NTSTATUS status = STATUS_SUCCESS;
+
+    // empty intervals (less than 0, greater than maximum) never match
+    for ( ULONG item = 0; item < pCheck->m_Count && NT_SUCCESS( status ); item++ )
+    {
+        ULONG64 value = FltLoadUnsigned( pCheck->m_Data + item * size, size );
+
+        switch ( Entry->Generic.m_Operation )
+        {
+        case FltOp_less:
+            if ( value )
+            {
+                status = AddItemp( Entry->Generic.m_Parameter, size, Id, 0, value - 1 );
+            }
+            break;
+
+        case FltOp_greater:
+            if ( value < maximum )
+            {
+                status = AddItemp( Entry->Generic.m_Parameter, size, Id, value + 1, maximum );
+            }
+            break;
+
+        case FltOp_range:
+            {
+                ULONG64 high = FltLoadUnsigned( pCheck->m_Data + ++item * size, size );
+                if ( value <= high )
+                {
+                    status = AddItemp( Entry->Generic.m_Parameter, size, Id, value, high );
+                }
+            }
+            break;
+
+        default:
+            ASSERT( FALSE );
+            break;
+        }
+    }
+
+    return status;
+}
+
+void
+FilterRangeIndex::SiftDownp (
+    __in ULONG Root,
+    __in ULONG Count
+    )
+{
+    for ( ; ; )
+    {
+        ULONG child = Root * 2 + 1;
+        if ( child >= Count )
+        {
+            break;
+        }
+
+        if (
+            child + 1 < Count
+            &&
+            IsRangeItemBelow( &m_Items[ child ], &m_Items[ child + 1 ] )
+            )
+        {
+            child++;
+        }
+
+        if ( !IsRangeItemBelow( &m_Items[ Root ], &m_Items[ child ] ) )
+        {
+            break;
+        }
+
+        RangeItem tmp = m_Items[ Root ];
+        m_Items[ Root ] = m_Items[ child ];
+        m_Items[ child ] = tmp;
+
+        Root = child;
+    }
+}
+
+void
+FilterRangeIndex::Build (
+    )
+{
+    // heap sort by parameter and low bound
+    for ( ULONG root = m_ItemsCount / 2; root-- > 0; )
+    {
+        SiftDownp( root, m_ItemsCount );
+    }
+
+    for ( ULONG last = m_ItemsCount; last-- > 1; )
+    {
+        RangeItem tmp = m_Items[ 0 ];
+        m_Items[ 0 ] = m_Items[ last ];
+        m_Items[ last ] = tmp;
+
+        SiftDownp( 0, last );
+    }
+
+    RtlZeroMemory( m_First, sizeof( m_First ) );
+    RtlZeroMemory( m_Count, sizeof( m_Count ) );
+
+    for ( ULONG idx = m_ItemsCount; idx-- > 0; )
+    {
+        m_First[ m_Items[ idx ].m_ParameterId ] = idx;
+        m_Count[ m_Items[ idx ].m_ParameterId ]++;
+    }
+
+    m_Built = TRUE;
+}
+
+void
+FilterRangeIndex::Probe (
+    __in ULONG ParameterId,
+    __in PVOID Data,
+    __in ULONG DataSize,
+    __in FltHits* Found
+    )
+{
+    ASSERT( m_Built );
+
+    if (
+        ParameterId > PARAMETER_MAXIMUM
+        ||
+        !m_Count[ ParameterId ]
+        ||
+        !FltIsOrderedWidth( DataSize )
+        )
+    {
+        return;
+    }
+
+    ULONG64 value = FltLoadUnsigned( (PUCHAR) Data, DataSize );
+    PRangeItem pItems = &m_Items[ m_First[ ParameterId ] ];
+
+    // base is the last interval starting not above value
+    PRangeItem pBase = pItems;
+    ULONG count = m_Count[ ParameterId ];
+    while ( count > 1 )
+    {
+        ULONG half = count / 2;
+        pBase = ( pBase[ half ].m_Low <= value ) ? &pBase[ half ] : pBase;
+        count -= half;
+    }
+
+    ULONG candidates = (ULONG) ( pBase - pItems ) + ( pBase->m_Low <= value );
+
+    for ( ULONG idx = 0; idx < candidates; idx++ )
+    {
+        if ( pItems[ idx ].m_High >= value && pItems[ idx ].m_Size == DataSize )
+        {
+            Found->Set( pItems[ idx ].m_CheckIdx );
+        }
+    }
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+//!
+//    \description - index of ordered checks (FltOp_less, FltOp_greater,
+//                   FltOp_range). Every check is turned into intervals of
+//                   unsigned values, intervals of a parameter are sorted by
+//                   low bound. Probe finds intervals starting not above the
+//                   value by binary search and tests their high bounds, so
+//                   all ordered checks of a parameter cost one probe.
+//
+//                   Built by Compile, checks added later are evaluated one
+//                   by one.
+//!
+
+#include "../../inc/accessch.h"
+#include "fltbitmap.h"
+#include "fltchecks.h"
+
+typedef struct _RangeItem
+{
+    ULONG64             m_Low;          // inclusive
+    ULONG64             m_High;         // inclusive
+    ULONG               m_ParameterId;
+    ULONG               m_Size;
+    ULONG               m_CheckIdx;
+} RangeItem, *PRangeItem;
+
+class FilterRangeIndex
+{
+public:
+    static ULONG        m_AllocTag;
+
+public:
+    FilterRangeIndex();
+    ~FilterRangeIndex();
+
+    static
+    BOOLEAN
+    IsIndexed (
+        __in ParamCheckEntry* Entry
+        );
+
+    void
+    Reset();
+
+    __checkReturn
+    NTSTATUS
+    Add (
+        __in ParamCheckEntry* Entry,
+        __in ULONG Id
+        );
+
+    void
+    Build();
+
+    BOOLEAN
+    IsBuilt (
+        )
+    {
+        return m_Built;
+    }
+
+    void
+    Probe (
+        __in ULONG ParameterId,
+        __in PVOID Data,
+        __in ULONG DataSize,
+        __in FltHits* Found
+        );
+
+private:
+    __checkReturn
+    NTSTATUS
+    AddItemp (
+        __in ULONG ParameterId,
+        __in ULONG Size,
+        __in ULONG Id,
+        __in ULONG64 Low,
+        __in ULONG64 High
+        );
+
+    void
+    SiftDownp (
+        __in ULONG Root,
+        __in ULONG Count
+        );
+
+private:
+    BOOLEAN             m_Built;
+    PRangeItem          m_Items;
+    ULONG               m_ItemsCount;
+    ULONG               m_ItemsCapacity;
+    ULONG               m_First[ PARAMETER_MAXIMUM + 1 ];
+    ULONG               m_Count[ PARAMETER_MAXIMUM + 1 ];
+};
@@ -1,7 +1,10 @@
 #include "../inc/commonkrnl.h"
 #include "../inc/memmgr.h"
 #include "../inc/fltstorage.h"
+#include "../inc/fltsystem.h"
 #include "fltfilters.h"
+#include "fltcache.h"
+#include "fltbox.h"
 
 #include "fltstorage.tmh"
 
@@ -20,6 +23,204 @@ typedef struct _FiltersItem
     Filters*    m_Filters;
 } FiltersItem, *PFiltersItem;
 
+// set touched by a chain
+typedef struct _FltChainSet
+{
+    Filters*        m_Filters;
+    PFltChainItem   m_Item;         // first item of the set, tree key
+    ULONG           m_Reserve;      // filters of the chain in the set
+    BOOLEAN         m_Created;      // not published yet
+    BOOLEAN         m_Locked;
+} FltChainSet, *PFltChainSet;
+
+typedef struct _FiltersIndex
+{
+    // first - index is larger than a page, allocation is page aligned.
+    // Minors of an operation share cache lines
+    Filters*    m_Dispatch[ FLT_DISPATCH_SLOTS ];
+    ULONG       m_Count;
+    FiltersItem m_Items[1];     // keys out of dispatch range, tree order
+} FiltersIndex, *PFiltersIndex;
+
+ULONG
+FltGetDispatchSlot (
+    __in ULONG Interceptor,
+    __in ULONG Operation,
+    __in ULONG Minor,
+    __in ULONG OperationType
+    )
+{
+    if (
+        Interceptor >= FLT_DISPATCH_INTERCEPTORS
+        ||
+        Operation >= FLT_DISPATCH_OPERATIONS
+        ||
+        OperationType >= FLT_DISPATCH_POINTS
+        ||
+        Minor >= FLT_DISPATCH_MINORS
+        )
+    {
+        return FLT_DISPATCH_NONE;
+    }
+
+    ULONG slot = Interceptor;
+    slot = slot * FLT_DISPATCH_OPERATIONS + Operation;
+    slot = slot * FLT_DISPATCH_POINTS + OperationType;
+    slot = slot * FLT_DISPATCH_MINORS + Minor;
+
+    return slot;
+}
+
+ULONG
+FltGetParamsSize (
+    __in ULONG ParamsCount,
+    __in_opt PFltParam Params
+    )
+{
+    ULONG size = 0;
+
+    PFltParam params = Params;
+    for ( ULONG cou = 0; cou < ParamsCount; cou++ )
+    {
+        size += sizeof( FltParam ) + params->m_Data.m_Size;
+
+        params = (PFltParam) Add2Ptr(
+            params,
+            sizeof( FltParam ) + params->m_Data.m_Size
+            );
+    }
+
+    return size;
+}
+
+__checkReturn
+NTSTATUS
+ValidateParamOperationp (
+    __in PFltParam Param
+    )
+{
+    ULONG count = Param->m_Data.m_Count;
+
+    switch ( Param->m_Operation )
+    {
+    case FltOp_pattern:
+    case FltOp_prefix:
+        // one string, box items may come without count
+        if (
+            count > 1
+            ||
+            Param->m_Data.m_Size % sizeof( WCHAR )
+            )
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        // CheckMask takes the last character, a pattern is never empty
+        if (
+            FltOp_pattern == Param->m_Operation
+            &&
+            Param->m_Data.m_Size < sizeof( WCHAR )
+            )
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        return STATUS_SUCCESS;
+
+    case FltOp_equ:
+    case FltOp_and:
+    case FltOp_less:
+    case FltOp_greater:
+    case FltOp_range:
+        break;
+
+    default:
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    // values of one width
+    if (
+        !count
+        ||
+        !Param->m_Data.m_Size
+        ||
+        Param->m_Data.m_Size % count
+        )
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (
+        FltOp_equ == Param->m_Operation
+        ||
+        FltOp_and == Param->m_Operation
+        )
+    {
+        return STATUS_SUCCESS;
+    }
+
+    switch ( Param->m_Data.m_Size / count )
+    {
+    case sizeof( UCHAR ):
+    case sizeof( USHORT ):
+    case sizeof( ULONG ):
+    case sizeof( ULONG64 ):
+        break;
+
+    default:
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if ( FltOp_range == Param->m_Operation && count % 2 )
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+__checkReturn
+NTSTATUS
+FltValidateParam (
+    __in PFltParam Param,
+    __in BOOLEAN BoxItem
+    )
+{
+    NTSTATUS status = ValidateParamOperationp( Param );
+    if ( !NT_SUCCESS( status ) || BoxItem )
+    {
+        return status;
+    }
+
+    if ( !Param->m_Data.m_Count )
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    // box reference: mask of m_BitCount bits
+    if ( PARAMETER_EXT_BOX_FILTERS == Param->m_ParameterId )
+    {
+        if ( Param->m_Data.m_Size < FIELD_OFFSET( FltBoxControl, m_BitMask ) )
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        ULONG bitcount = Param->m_Data.m_Box->m_BitCount;
+        if (
+            !bitcount
+            ||
+            bitcount % 32
+            ||
+            bitcount / 8 > Param->m_Data.m_Size - FIELD_OFFSET( FltBoxControl, m_BitMask )
+            )
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
 //////////////////////////////////////////////////////////////////////////
 
 FiltersStorage::FiltersStorage (
@@ -42,6 +243,23 @@ FiltersStorage::FiltersStorage (
     m_Flags = _FT_FLAGS_PAUSED;
     m_FilterIdCounter = 0;
     m_BoxList = NULL;
+    m_Index = NULL;
+
+    m_Interest = NULL;
+    RtlZeroMemory( m_Interested, sizeof( m_Interested ) );
+
+    RtlZeroMemory( &m_RetiredStatistics, sizeof( m_RetiredStatistics ) );
+
+    m_Generation = 0;
+    m_Cache = NULL;
+    m_CacheDisabled = FALSE;
+
+    RtlZeroMemory( &m_QuotaLimits, sizeof( m_QuotaLimits ) );
+    RtlZeroMemory( &m_Quotas, sizeof( m_Quotas ) );
+    m_Rejected = 0;
+    m_StagedBytes = 0;
+    m_ChargedFilters = 0;
+    m_ChargedBytes = 0;
 
     m_ProcessHelper->RegisterExitProcessCb( ExitProcessCb, this );
 }
@@ -54,6 +272,7 @@ FiltersStorage::~FiltersStorage (
 
     DeleteAllFilters();
     delete m_BoxList;
+    delete m_Cache;
     FltDeletePushLock( &m_AccessLock );
 }
 
@@ -77,8 +296,6 @@ FiltersStorage::Compare (
 {
     UNREFERENCED_PARAMETER( Table );
 
-    RTL_GENERIC_COMPARE_RESULTS result;
-
     PFiltersItem struct1 = (PFiltersItem) FirstStruct;
     PFiltersItem struct2 = (PFiltersItem) SecondStruct;
 
@@ -118,11 +335,8 @@ FiltersStorage::Allocate (
 {
     UNREFERENCED_PARAMETER( Table );
 
-    PVOID ptr = ExAllocatePoolWithTag(
-        PagedPool,
-        ByteSize,
-        m_AllocTag
-        );
+    // FiltersItem nodes
+    PVOID ptr = MemSlabAllocate( ByteSize, m_AllocTag );
 
     return ptr;
 }
@@ -136,7 +350,7 @@ FiltersStorage::Free (
 {
     UNREFERENCED_PARAMETER( Table );
 
-    FREE_POOL( Buffer );
+    FREE_SLAB( Buffer );
 }
 
 void
@@ -171,45 +385,264 @@ FiltersStorage::AddFilterUnsafe (
     )
 {
     ASSERT( FilterId );
-    NTSTATUS status = CreateBoxControlp();
 
+    FltChainItem item;
+    item.m_Interceptor = Interceptor;
+    item.m_OperationId = OperationId;
+    item.m_FunctionMi = FunctionMi;
+    item.m_OperationType = OperationType;
+    item.m_GroupId = GroupId;
+    item.m_Verdict = Verdict;
+    item.m_ProcessId = ProcessId;
+    item.m_RequestTimeout = RequestTimeout;
+    item.m_WishMask = WishMask;
+    item.m_ParamsCount = ParamsCount;
+    item.m_Params = Params;
+    item.m_FilterId = 0;
+
+    NTSTATUS status = AddFiltersUnsafe( 1, &item );
+
+    if ( NT_SUCCESS( status ) )
+    {
+        *FilterId = item.m_FilterId;
+    }
+
+    return status;
+}
+
+__checkReturn
+NTSTATUS
+FiltersStorage::AddFiltersUnsafe (
+    __in ULONG Count,
+    __inout_ecount(Count) PFltChainItem Items
+    )
+{
+    ASSERT( Count );
+    ASSERT( Items );
+
+    LONG64 policybytes = 0;
+    for ( ULONG idx = 0; idx < Count; idx++ )
+    {
+        PFltChainItem pItem = &Items[ idx ];
+
+        if (
+            !pItem->m_GroupId
+            ||
+            !pItem->m_Verdict
+            ||
+            !pItem->m_WishMask
+            )
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        // checks trust what is accepted here
+        PFltParam params = pItem->m_Params;
+        for ( ULONG cou = 0; cou < pItem->m_ParamsCount; cou++ )
+        {
+            NTSTATUS status = FltValidateParam( params, FALSE );
+            if ( !NT_SUCCESS( status ) )
+            {
+                return status;
+            }
+
+            params = (PFltParam) Add2Ptr(
+                params,
+                sizeof( FltParam ) + params->m_Data.m_Size
+                );
+        }
+
+        policybytes += FltGetParamsSize( pItem->m_ParamsCount, pItem->m_Params );
+    }
+
+    NTSTATUS status = CheckQuotasUnsafep( Count, 0, policybytes );
     if ( !NT_SUCCESS( status ) )
     {
         return status;
     }
 
-    Filters* pFilters = GetOrCreateFiltersByUnsafep (
-        Interceptor,
-        OperationId,
-        FunctionMi,
-        OperationType
-        );
+    status = CreateBoxControlp();
+    if ( !NT_SUCCESS( status ) )
+    {
+        return status;
+    }
+
+    CreateCachep();
 
-    if ( !pFilters )
+    // distinct sets of the chain and set index of each item
+    PFltChainSet pSets = NULL;
+    PULONG pItemSet = NULL;
+    ULONG setscount = 0;
+    BOOLEAN bCreated = FALSE;
+
+    __try
     {
-        return STATUS_INSUFFICIENT_RESOURCES;
+        pSets = (PFltChainSet) ExAllocatePoolWithTag(
+            PagedPool,
+            ( sizeof( FltChainSet ) + sizeof( ULONG ) ) * Count,
+            m_AllocTag
+            );
+
+        if ( !pSets )
+        {
+            status = STATUS_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+
+        pItemSet = (PULONG) Add2Ptr( pSets, sizeof( FltChainSet ) * Count );
+
+        for ( ULONG idx = 0; idx < Count; idx++ )
+        {
+            PFltChainItem pItem = &Items[ idx ];
+            BOOLEAN bNew = FALSE;
+
+            Filters* pFilters = GetOrCreateFiltersByUnsafep (
+                pItem->m_Interceptor,
+                pItem->m_OperationId,
+                pItem->m_FunctionMi,
+                pItem->m_OperationType,
+                &bNew
+                );
+
+            if ( !pFilters )
+            {
+                status = STATUS_INSUFFICIENT_RESOURCES;
+                __leave;
+            }
+
+            // chains target a few sets
+            ULONG set = 0;
+            while ( set < setscount && pSets[ set ].m_Filters != pFilters )
+            {
+                set++;
+            }
+
+            if ( set == setscount )
+            {
+                pSets[ set ].m_Filters = pFilters;
+                pSets[ set ].m_Item = pItem;
+                pSets[ set ].m_Reserve = 0;
+                pSets[ set ].m_Created = bNew;
+                pSets[ set ].m_Locked = FALSE;
+
+                setscount++;
+
+                if ( bNew )
+                {
+                    bCreated = TRUE;
+                }
+            }
+            else
+            {
+                pFilters->Release();
+            }
+
+            pSets[ set ].m_Reserve++;
+            pItemSet[ idx ] = set;
+        }
+
+        // new sets are empty - publish them before any set is locked,
+        // publishing waits for readers
+        if ( bCreated )
+        {
+            status = PublishIndexUnsafep( FALSE );
+            if ( !NT_SUCCESS( status ) )
+            {
+                __leave;
+            }
+
+            for ( ULONG set = 0; set < setscount; set++ )
+            {
+                pSets[ set ].m_Created = FALSE;
+            }
+        }
+
+        for ( ULONG set = 0; set < setscount; set++ )
+        {
+            status = pSets[ set ].m_Filters->BeginChain( pSets[ set ].m_Reserve );
+            if ( !NT_SUCCESS( status ) )
+            {
+                __leave;
+            }
+
+            pSets[ set ].m_Locked = TRUE;
+        }
+
+        for ( ULONG idx = 0; idx < Count; idx++ )
+        {
+            PFltChainItem pItem = &Items[ idx ];
+            ULONG filterId = GetNextFilterid();
+
+            status = pSets[ pItemSet[ idx ] ].m_Filters->StageFilter(
+                pItem->m_GroupId,
+                pItem->m_Verdict,
+                pItem->m_ProcessId,
+                pItem->m_RequestTimeout,
+                pItem->m_WishMask,
+                pItem->m_ParamsCount,
+                pItem->m_Params,
+                m_BoxList,
+                filterId
+                );
+
+            if ( !NT_SUCCESS( status ) )
+            {
+                __leave;
+            }
+
+            pItem->m_FilterId = filterId;
+        }
+
+        status = STATUS_SUCCESS;
     }
+    __finally
+    {
+        for ( ULONG set = 0; set < setscount; set++ )
+        {
+            if ( !pSets[ set ].m_Locked )
+            {
+                continue;
+            }
+
+            if ( NT_SUCCESS( status ) )
+            {
+                pSets[ set ].m_Filters->CommitChain();
+            }
+            else
+            {
+                pSets[ set ].m_Filters->RollbackChain();
+            }
+        }
 
-    ULONG filterId = GetNextFilterid();
+        // every set is unlocked
+        for ( ULONG set = 0; set < setscount; set++ )
+        {
+            if ( pSets[ set ].m_Locked )
+            {
+                pSets[ set ].m_Filters->ReleaseChain();
+            }
 
-    status = pFilters->AddFilter(
-        GroupId,
-        Verdict,
-        ProcessId,
-        RequestTimeout,
-        WishMask,
-        ParamsCount,
-        Params,
-        m_BoxList,
-        filterId
-        );
+            pSets[ set ].m_Filters->Release();
+
+            if ( pSets[ set ].m_Created )
+            {
+                DeleteUnpublishedUnsafep( pSets[ set ].m_Item );
+            }
+        }
+
+        if ( pSets )
+        {
+            ExFreePool( pSets );
+        }
+    }
 
     if ( NT_SUCCESS( status ) )
     {
-        *FilterId = filterId;
+        m_ChargedFilters += Count;
+        m_ChargedBytes += policybytes;
     }
 
-    pFilters->Release();
+    BumpGenerationp();
 
     return status;
 }
@@ -223,46 +656,177 @@ FiltersStorage::CreateBoxUnsafe (
     __out PULONG FilterId
     )
 {
-    ASSERT( Guid );
     ASSERT( FilterId );
 
+    FltBoxStage stage;
+
+    NTSTATUS status = StageBoxUnsafe( Guid, ParamsCount, Params, &stage );
+    if ( !NT_SUCCESS( status ) )
+    {
+        return status;
+    }
+
+    ApplyBoxUnsafe( &stage, FilterId );
+
+    return status;
+}
+
+__checkReturn
+NTSTATUS
+FiltersStorage::ReleaseBoxUnsafe (
+    __in LPGUID Guid
+    )
+{
+    FltBoxStage stage;
+    ULONG position;
+
+    NTSTATUS status = StageBoxReleaseUnsafe( Guid, &stage );
+    if ( !NT_SUCCESS( status ) )
+    {
+        return status;
+    }
+
+    ApplyBoxUnsafe( &stage, &position );
+
+    return status;
+}
+
+__checkReturn
+NTSTATUS
+FiltersStorage::StageBoxUnsafe (
+    __in LPGUID Guid,
+    __in ULONG ParamsCount,
+    __in_opt PFltParam Params,
+    __out PFltBoxStage Stage
+    )
+{
+    ASSERT( Guid );
+    ASSERT( Stage );
+
+    PFltParam params = Params;
+    for ( ULONG cou = 0; cou < ParamsCount; cou++ )
+    {
+        NTSTATUS status = FltValidateParam( params, TRUE );
+        if ( !NT_SUCCESS( status ) )
+        {
+            return status;
+        }
+
+        params = (PFltParam) Add2Ptr(
+            params,
+            sizeof( FltParam ) + params->m_Data.m_Size
+            );
+    }
+
     NTSTATUS status = CreateBoxControlp();
     if ( !NT_SUCCESS( status ) )
     {
         return status;
     }
 
-    PFilterBox pBox = NULL;
-    status = m_BoxList->GetOrCreateBox( Guid, &pBox );
+    // items of an existing box are charged as bytes only
+    PFilterBox pBox = m_BoxList->LookupBox( Guid );
+    if ( pBox )
+    {
+        pBox->Release();
+    }
+
+    LONG64 policybytes = FltGetParamsSize( ParamsCount, Params );
 
+    status = CheckQuotasUnsafep( 0, pBox ? 0 : 1, policybytes );
     if ( !NT_SUCCESS( status ) )
     {
         return status;
     }
 
-    status = pBox->AddParams( ParamsCount, Params, FilterId );
+    status = FilterBox::PrepareParams( ParamsCount, Params, &Stage->m_Item );
+    if ( !NT_SUCCESS( status ) )
+    {
+        return status;
+    }
 
+    status = m_BoxList->GetOrCreateBox( Guid, &Stage->m_Box, &Stage->m_Listed );
     if ( !NT_SUCCESS( status ) )
     {
+        FilterBox::FreeParams( Stage->m_Item );
+
         return status;
     }
 
-    pBox->Release();
+    Stage->m_PolicyBytes = policybytes;
+    m_StagedBytes += policybytes;
 
     return status;
 }
 
 __checkReturn
 NTSTATUS
-FiltersStorage::ReleaseBoxUnsafe (
-    __in LPGUID Guid
+FiltersStorage::StageBoxReleaseUnsafe (
+    __in LPGUID Guid,
+    __out PFltBoxStage Stage
     )
 {
     ASSERT( Guid );
+    ASSERT( Stage );
+
+    if ( !m_BoxList )
+    {
+        return STATUS_NOT_FOUND;
+    }
 
-    NTSTATUS status = m_BoxList->ReleaseBox( Guid );
+    Stage->m_Item = NULL;
+    Stage->m_Listed = FALSE;
+    Stage->m_PolicyBytes = 0;
 
-    return status;
+    return m_BoxList->DetachBox( Guid, &Stage->m_Box );
+}
+
+void
+FiltersStorage::ApplyBoxUnsafe (
+    __in PFltBoxStage Stage,
+    __out PULONG FilterId
+    )
+{
+    *FilterId = 0;
+
+    if ( Stage->m_Item )
+    {
+        *FilterId = m_BoxList->InsertParams( Stage->m_Box, Stage->m_Item );
+        m_StagedBytes -= Stage->m_PolicyBytes;
+    }
+
+    m_BoxList->DropBox( Stage->m_Box );
+
+    BumpGenerationp();
+}
+
+void
+FiltersStorage::CancelBoxUnsafe (
+    __in PFltBoxStage Stage
+    )
+{
+    if ( !Stage->m_Item )
+    {
+        m_BoxList->AttachBox( Stage->m_Box );
+
+        return;
+    }
+
+    FilterBox::FreeParams( Stage->m_Item );
+    m_StagedBytes -= Stage->m_PolicyBytes;
+
+    // reference of the list taken by the stage is dropped as well
+    if ( Stage->m_Listed )
+    {
+        PFilterBox pBox = NULL;
+        if ( NT_SUCCESS( m_BoxList->DetachBox( &Stage->m_Box->m_Guid, &pBox ) ) )
+        {
+            ASSERT( pBox == Stage->m_Box );
+            m_BoxList->DropBox( pBox );
+        }
+    }
+
+    m_BoxList->DropBox( Stage->m_Box );
 }
 
 void
@@ -273,6 +837,18 @@ FiltersStorage::DeleteAllFilters (
 
     FltAcquirePushLockExclusive( &m_AccessLock );
 
+    // readers never take storage lock - wait for them right here
+    PFiltersIndex pIndex = m_Index;
+    m_Index = NULL;
+
+    UpdateInterestUnsafep( NULL );
+
+    if ( pIndex )
+    {
+        FltEpochSynchronize();
+        ExFreePool( pIndex );
+    }
+
     do
     {
         pItem = (PFiltersItem) RtlEnumerateGenericTableAvl(
@@ -283,13 +859,17 @@ FiltersStorage::DeleteAllFilters (
         if ( pItem )
         {
             ASSERT( pItem->m_Filters );
-            FREE_OBJECT( pItem->m_Filters );
+            RetireFiltersp( pItem->m_Filters );
 
             RtlDeleteElementGenericTableAvl( &m_Tree, pItem );
         }
     } while ( pItem );
 
     m_FilterIdCounter = 0;
+    m_ChargedFilters = 0;
+    m_ChargedBytes = 0;
+
+    BumpGenerationp();
 
     FltReleasePushLock( &m_AccessLock );
 }
@@ -314,49 +894,366 @@ FiltersStorage::CreateBoxControlp (
 }
 
 void
-FiltersStorage::CleanupFiltersByPidp (
-    __in HANDLE ProcessId
+FiltersStorage::CreateCachep (
     )
 {
-    UNREFERENCED_PARAMETER( ProcessId );
+    if ( m_Cache || m_CacheDisabled )
+    {
+        return;
+    }
 
-    PFiltersItem pItem;
+    // no memory - events are evaluated every time
+    FltVerdictCache* pCache = new ( PagedPool, m_AllocTag ) FltVerdictCache;
 
-    FltAcquirePushLockExclusive( &m_AccessLock );
+    KeMemoryBarrier();
+    m_Cache = pCache;
+}
 
-    pItem = (PFiltersItem) RtlEnumerateGenericTableAvl(
-        &m_Tree,
-        TRUE
+void
+FiltersStorage::BumpGenerationp (
+    )
+{
+    // after the change is published: verdict computed from old state
+    // carries old generation
+    InterlockedIncrement( &m_Generation );
+}
+
+void
+FiltersStorage::RetireFiltersp (
+    __in Filters* FiltersObj
+    )
+{
+    // keep counters of deleted set, access lock is held exclusive
+    FiltersObj->AddFetchStatistics( &m_RetiredStatistics );
+
+    FREE_OBJECT( FiltersObj );
+}
+
+__checkReturn
+NTSTATUS
+FiltersStorage::PublishIndexUnsafep (
+    __in BOOLEAN SkipEmpty
+    )
+{
+    ULONG count = 0;
+    ULONG outside = 0;
+
+    PFiltersItem pItem = (PFiltersItem) RtlEnumerateGenericTableAvl(
+        &m_Tree,
+        TRUE
         );
 
     while ( pItem )
     {
-        ASSERT( pItem->m_Filters );
-        ULONG removed = pItem->m_Filters->CleanupByProcess( ProcessId );
-
-        if ( pItem->m_Filters->IsEmpty() )
+        if ( !SkipEmpty || !pItem->m_Filters->IsEmpty() )
         {
-            FREE_OBJECT( pItem->m_Filters );
+            count++;
+
+            if ( FLT_DISPATCH_NONE == FltGetDispatchSlot(
+                pItem->m_Interceptor,
+                pItem->m_Operation,
+                pItem->m_Minor,
+                pItem->m_OperationType
+                ) )
+            {
+                outside++;
+            }
+        }
 
-            RtlDeleteElementGenericTableAvl( &m_Tree, pItem );
+        pItem = (PFiltersItem) RtlEnumerateGenericTableAvl(
+            &m_Tree,
+            FALSE
+            );
+    }
 
-            pItem = (PFiltersItem) RtlEnumerateGenericTableAvl(
-                &m_Tree,
-                TRUE
-                );
+    PFiltersIndex pIndex = NULL;
+
+    if ( count )
+    {
+        pIndex = (PFiltersIndex) ExAllocatePoolWithTag(
+            PagedPool,
+            FIELD_OFFSET( FiltersIndex, m_Items ) + sizeof( FiltersItem ) * outside,
+            m_AllocTag
+            );
+
+        if ( !pIndex )
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
         }
-        else
+
+        RtlZeroMemory( pIndex->m_Dispatch, sizeof( pIndex->m_Dispatch ) );
+        pIndex->m_Count = 0;
+
+        pItem = (PFiltersItem) RtlEnumerateGenericTableAvl(
+            &m_Tree,
+            TRUE
+            );
+
+        while ( pItem )
         {
+            if ( !SkipEmpty || !pItem->m_Filters->IsEmpty() )
+            {
+                ULONG slot = FltGetDispatchSlot(
+                    pItem->m_Interceptor,
+                    pItem->m_Operation,
+                    pItem->m_Minor,
+                    pItem->m_OperationType
+                    );
+
+                if ( FLT_DISPATCH_NONE != slot )
+                {
+                    pIndex->m_Dispatch[ slot ] = pItem->m_Filters;
+                }
+                else
+                {
+                    pIndex->m_Items[ pIndex->m_Count++ ] = *pItem;
+                }
+            }
+
             pItem = (PFiltersItem) RtlEnumerateGenericTableAvl(
                 &m_Tree,
                 FALSE
                 );
         }
-    };
+    }
+
+    PFiltersIndex pOldIndex = m_Index;
+
+    KeMemoryBarrier();
+    m_Index = pIndex;
+
+    UpdateInterestUnsafep( pIndex );
+
+    if ( pOldIndex )
+    {
+        // readers never take storage lock - wait for them right here
+        FltEpochSynchronize();
+        ExFreePool( pOldIndex );
+    }
+
+    return STATUS_SUCCESS;
+}
+
+void
+FiltersStorage::UpdateInterestUnsafep (
+    __in_opt PFiltersIndex Index
+    )
+{
+    if ( !m_Interest )
+    {
+        return;
+    }
+
+    for ( ULONG word = 0; word < FLT_DISPATCH_SLOTS / 32; word++ )
+    {
+        ULONG bits = 0;
+        if ( Index )
+        {
+            for ( ULONG bit = 0; bit < 32; bit++ )
+            {
+                if ( Index->m_Dispatch[ word * 32 + bit ] )
+                {
+                    bits |= 1 << bit;
+                }
+            }
+        }
+
+        ULONG changed = bits ^ m_Interested[ word ];
+        for ( ULONG bit = 0; changed; bit++, changed >>= 1 )
+        {
+            if ( !( changed & 1 ) )
+            {
+                continue;
+            }
+
+            if ( FlagOn( bits, 1 << bit ) )
+            {
+                m_Interest->Add( word * 32 + bit );
+            }
+            else
+            {
+                m_Interest->Remove( word * 32 + bit );
+            }
+        }
+
+        m_Interested[ word ] = bits;
+    }
+}
+
+void
+FiltersStorage::CleanupFiltersByPidp (
+    __in HANDLE ProcessId
+    )
+{
+    PFiltersItem pItem;
+    BOOLEAN bEmpty = FALSE;
+
+    FltAcquirePushLockExclusive( &m_AccessLock );
+
+    pItem = (PFiltersItem) RtlEnumerateGenericTableAvl(
+        &m_Tree,
+        TRUE
+        );
+
+    while ( pItem )
+    {
+        ASSERT( pItem->m_Filters );
+
+        ChargeFiltersp( pItem->m_Filters, -1 );
+        pItem->m_Filters->CleanupByProcess( ProcessId );
+        ChargeFiltersp( pItem->m_Filters, 1 );
+
+        if ( pItem->m_Filters->IsEmpty() )
+        {
+            bEmpty = TRUE;
+        }
+
+        pItem = (PFiltersItem) RtlEnumerateGenericTableAvl(
+            &m_Tree,
+            FALSE
+            );
+    }
+
+    // empty sets are deleted once readers can't find them. No memory for
+    // new index - they stay until next cleanup
+    if ( bEmpty && NT_SUCCESS( PublishIndexUnsafep( TRUE ) ) )
+    {
+        pItem = (PFiltersItem) RtlEnumerateGenericTableAvl(
+            &m_Tree,
+            TRUE
+            );
+
+        while ( pItem )
+        {
+            if ( pItem->m_Filters->IsEmpty() )
+            {
+                RetireFiltersp( pItem->m_Filters );
+
+                RtlDeleteElementGenericTableAvl( &m_Tree, pItem );
+
+                pItem = (PFiltersItem) RtlEnumerateGenericTableAvl(
+                    &m_Tree,
+                    TRUE
+                    );
+            }
+            else
+            {
+                pItem = (PFiltersItem) RtlEnumerateGenericTableAvl(
+                    &m_Tree,
+                    FALSE
+                    );
+            }
+        }
+    }
+
+    BumpGenerationp();
 
     FltReleasePushLock( &m_AccessLock );
 }
 
+void
+FiltersStorage::ChargeFiltersp (
+    __in Filters* FiltersObj,
+    __in LONG Sign
+    )
+{
+    FltUsage usage;
+    RtlZeroMemory( &usage, sizeof( usage ) );
+
+    FiltersObj->AddUsage( &usage, FALSE );
+
+    m_ChargedFilters += Sign * (LONG) usage.m_Filters;
+    m_ChargedBytes += Sign * usage.m_PolicyBytes;
+}
+
+void
+FiltersStorage::QueryUsageUnsafep (
+    __out PFltUsage Usage
+    )
+{
+    RtlZeroMemory( Usage, sizeof( FltUsage ) );
+
+    Usage->m_Rejected = m_Rejected;
+
+    // sets do not change under the shared lock, table is walked without
+    // moving its restart key
+    PVOID restartkey = NULL;
+    PFiltersItem pItem;
+
+    while ( NULL != ( pItem = (PFiltersItem) RtlEnumerateGenericTableWithoutSplayingAvl(
+        &m_Tree,
+        &restartkey
+        ) ) )
+    {
+        pItem->m_Filters->AddUsage( Usage, TRUE );
+    }
+
+    ASSERT( Usage->m_Filters == m_ChargedFilters );
+    ASSERT( Usage->m_PolicyBytes == m_ChargedBytes );
+
+    if ( m_BoxList )
+    {
+        LONG64 policybytes;
+
+        m_BoxList->QueryCharge( &Usage->m_Boxes, &policybytes );
+        m_BoxList->QueryMemory( &Usage->m_BoxesBytes );
+
+        Usage->m_PolicyBytes += policybytes;
+    }
+
+    if ( m_Cache )
+    {
+        Usage->m_CacheBytes = sizeof( FltVerdictCache );
+    }
+}
+
+__checkReturn
+NTSTATUS
+FiltersStorage::CheckQuotasUnsafep (
+    __in ULONG Filters,
+    __in ULONG Boxes,
+    __in LONG64 PolicyBytes
+    )
+{
+    if (
+        !m_Quotas.m_Filters
+        &&
+        !m_Quotas.m_Boxes
+        &&
+        !m_Quotas.m_PolicyBytes
+        )
+    {
+        return STATUS_SUCCESS;
+    }
+
+    ULONG boxes = 0;
+    LONG64 boxbytes = 0;
+
+    if ( m_BoxList )
+    {
+        m_BoxList->QueryCharge( &boxes, &boxbytes );
+    }
+
+    if (
+        ( m_Quotas.m_Filters && (LONG64) m_ChargedFilters + Filters > m_Quotas.m_Filters )
+        ||
+        ( m_Quotas.m_Boxes && (LONG64) boxes + Boxes > m_Quotas.m_Boxes )
+        ||
+        (
+            m_Quotas.m_PolicyBytes
+            &&
+            m_ChargedBytes + boxbytes + m_StagedBytes + PolicyBytes > m_Quotas.m_PolicyBytes
+        )
+        )
+    {
+        m_Rejected++;
+
+        return STATUS_QUOTA_EXCEEDED;
+    }
+
+    return STATUS_SUCCESS;
+}
+
 LONG
 FiltersStorage::GetNextFilterid (
     )
@@ -404,6 +1301,16 @@ FiltersStorage::FilterEvent (
     __in PPARAMS_MASK ParamsMask
     )
 {
+    NTSTATUS status = STATUS_NOT_FOUND;
+
+    // before any published state is read
+    LONG generation = m_Generation;
+
+    // Filters object and everything it publishes are freed after
+    // grace period - no lock and no reference on this path
+    FltEpochToken token;
+    FltEpochEnter( &token );
+
     Filters* pFilters = GetFiltersByp(
         Event->GetInterceptorId(),
         Event->GetOperationId(),
@@ -411,19 +1318,205 @@ FiltersStorage::FilterEvent (
         Event->GetOperationType()
         );
 
-    if ( !pFilters )
+    if ( pFilters )
     {
-        return STATUS_NOT_FOUND;
+        FltVerdictCache* pCache = m_CacheDisabled ? NULL : m_Cache;
+        FltCacheKey key;
+        PARAMS_MASK params;
+        BOOLEAN bCacheable = FALSE;
+        BOOLEAN bCached = FALSE;
+
+        if ( pCache )
+        {
+            bCacheable = pFilters->GetCacheParams( &params )
+                && FltVerdictCache::BuildKey( Event, params, &key );
+
+            if ( bCacheable )
+            {
+                bCached = pCache->Lookup( &key, generation, Event, Verdict, ParamsMask );
+            }
+            else
+            {
+                pCache->CountBypass();
+            }
+        }
+
+        if ( !bCached )
+        {
+            BOOLEAN bComplete = FALSE;
+
+            *Verdict = pFilters->GetVerdict(
+                Event,
+                ParamsMask,
+                &bComplete
+                );
+
+            // no result of failed evaluation, nothing computed from
+            // state changed meanwhile
+            if ( bCacheable && bComplete && generation == m_Generation )
+            {
+                pCache->Insert( &key, generation, Event, *Verdict, *ParamsMask );
+            }
+        }
+
+        status = STATUS_SUCCESS;
     }
 
-    *Verdict = pFilters->GetVerdict(
-        Event,
-        ParamsMask
+    FltEpochLeave( &token );
+
+    return status;
+}
+
+void
+FiltersStorage::QueryFetchStatistics (
+    __out PFltFetchStatistics Statistics
+    )
+{
+    // enumeration keeps restart key in the table
+    FltAcquirePushLockExclusive( &m_AccessLock );
+
+    *Statistics = m_RetiredStatistics;
+
+    PFiltersItem pItem = (PFiltersItem) RtlEnumerateGenericTableAvl(
+        &m_Tree,
+        TRUE
         );
 
-    pFilters->Release();
+    while ( pItem )
+    {
+        pItem->m_Filters->AddFetchStatistics( Statistics );
 
-    return STATUS_SUCCESS;
+        pItem = (PFiltersItem) RtlEnumerateGenericTableAvl(
+            &m_Tree,
+            FALSE
+            );
+    }
+
+    FltReleasePushLock( &m_AccessLock );
+}
+
+void
+FiltersStorage::QueryCacheStatistics (
+    __out PFltCacheStatistics Statistics
+    )
+{
+    FltVerdictCache* pCache = m_Cache;
+    if ( pCache )
+    {
+        pCache->QueryStatistics( Statistics );
+    }
+    else
+    {
+        RtlZeroMemory( Statistics, sizeof( FltCacheStatistics ) );
+    }
+}
+
+LONG64
+LowerQuotap (
+    __in LONG64 Quota,
+    __in LONG64 Limit
+    )
+{
+    if ( !Limit || ( Quota && Quota < Limit ) )
+    {
+        return Quota;
+    }
+
+    return Limit;
+}
+
+void
+FiltersStorage::SetQuotaLimits (
+    __in PFltQuotas Limits
+    )
+{
+    FltAcquirePushLockExclusive( &m_AccessLock );
+
+    m_QuotaLimits = *Limits;
+    m_Quotas = *Limits;
+
+    FltReleasePushLock( &m_AccessLock );
+}
+
+void
+FiltersStorage::SetQuotas (
+    __in PFltQuotas Quotas
+    )
+{
+    // filters over new limits stay, next additions fail
+    FltAcquirePushLockExclusive( &m_AccessLock );
+
+    m_Quotas.m_Filters = (ULONG) LowerQuotap(
+        Quotas->m_Filters,
+        m_QuotaLimits.m_Filters
+        );
+
+    m_Quotas.m_Boxes = (ULONG) LowerQuotap(
+        Quotas->m_Boxes,
+        m_QuotaLimits.m_Boxes
+        );
+
+    m_Quotas.m_PolicyBytes = LowerQuotap(
+        Quotas->m_PolicyBytes,
+        m_QuotaLimits.m_PolicyBytes
+        );
+
+    FltReleasePushLock( &m_AccessLock );
+}
+
+void
+FiltersStorage::QueryQuotas (
+    __out PFltQuotas Quotas
+    )
+{
+    FltAcquirePushLockShared( &m_AccessLock );
+
+    *Quotas = m_Quotas;
+
+    FltReleasePushLock( &m_AccessLock );
+}
+
+void
+FiltersStorage::QueryUsage (
+    __out PFltUsage Usage
+    )
+{
+    // writers only are excluded
+    FltAcquirePushLockShared( &m_AccessLock );
+
+    QueryUsageUnsafep( Usage );
+
+    FltReleasePushLock( &m_AccessLock );
+}
+
+void
+FiltersStorage::ChangeCacheState (
+    __in BOOLEAN Enable
+    )
+{
+    FltAcquirePushLockExclusive( &m_AccessLock );
+
+    m_CacheDisabled = !Enable;
+    CreateCachep();
+
+    // generation is bumped while disabled as well, entries stay valid
+    FltReleasePushLock( &m_AccessLock );
+}
+
+void
+FiltersStorage::SetInterest (
+    __in_opt FltInterest* Interest
+    )
+{
+    FltAcquirePushLockExclusive( &m_AccessLock );
+
+    // withdraw everything reported before
+    UpdateInterestUnsafep( NULL );
+
+    m_Interest = Interest;
+    UpdateInterestUnsafep( m_Index );
+
+    FltReleasePushLock( &m_AccessLock );
 }
 
 __checkReturn
@@ -435,35 +1528,54 @@ FiltersStorage::GetFiltersByp (
     __in ULONG OperationType
     )
 {
-    Filters* pFilters = NULL;
+    PFiltersIndex pIndex = m_Index;
+    if ( !pIndex )
+    {
+        return NULL;
+    }
+
+    ULONG slot = FltGetDispatchSlot( Interceptor, Operation, Minor, OperationType );
+    if ( FLT_DISPATCH_NONE != slot )
+    {
+        return pIndex->m_Dispatch[ slot ];
+    }
 
+    // rare keys - binary search
     FiltersItem item;
     item.m_Interceptor = Interceptor;
     item.m_Operation = Operation;
     item.m_Minor = Minor;
     item.m_OperationType = OperationType;
 
-    FltAcquirePushLockShared( &m_AccessLock );
-
-    PFiltersItem pItem = (PFiltersItem) RtlLookupElementGenericTableAvl(
-        &m_Tree,
-        &item
-        );
+    ULONG low = 0;
+    ULONG high = pIndex->m_Count;
 
-    if ( pItem)
+    while ( low < high )
     {
-        pFilters = pItem->m_Filters;
+        ULONG mid = ( low + high ) / 2;
 
-        NTSTATUS status = pFilters->AddRef();
-        if ( !NT_SUCCESS( status ) )
+        RTL_GENERIC_COMPARE_RESULTS result = Compare(
+            NULL,
+            &item,
+            &pIndex->m_Items[ mid ]
+            );
+
+        if ( GenericEqual == result )
         {
-            pFilters = NULL;
+            return pIndex->m_Items[ mid ].m_Filters;
         }
-    }
 
-    FltReleasePushLock( &m_AccessLock );
+        if ( GenericLessThan == result )
+        {
+            high = mid;
+        }
+        else
+        {
+            low = mid + 1;
+        }
+    }
 
-    return pFilters;
+    return NULL;
 }
 
 __checkReturn
@@ -472,7 +1584,8 @@ FiltersStorage::GetOrCreateFiltersByUnsafep (
     __in ULONG Interceptor,
     __in ULONG Operation,
     __in_opt ULONG Minor,
-    __in ULONG OperationType
+    __in ULONG OperationType,
+    __out PBOOLEAN Created
     )
 {
     FiltersItem item;
@@ -482,6 +1595,7 @@ FiltersStorage::GetOrCreateFiltersByUnsafep (
     item.m_OperationType = OperationType;
 
     BOOLEAN newElement = FALSE;
+    *Created = FALSE;
 
     PFiltersItem pItem = (PFiltersItem) RtlInsertElementGenericTableAvl(
         &m_Tree,
@@ -502,6 +1616,10 @@ FiltersStorage::GetOrCreateFiltersByUnsafep (
 
             pItem = NULL;
         }
+        else
+        {
+            *Created = TRUE;
+        }
     }
 
     if ( pItem )
@@ -514,4 +1632,28 @@ FiltersStorage::GetOrCreateFiltersByUnsafep (
     }
 
     return NULL;
-}
\ No newline at end of file
+}
+
+void
+FiltersStorage::DeleteUnpublishedUnsafep (
+    __in PFltChainItem Item
+    )
+{
+    FiltersItem item;
+    item.m_Interceptor = Item->m_Interceptor;
+    item.m_Operation = Item->m_OperationId;
+    item.m_Minor = Item->m_FunctionMi;
+    item.m_OperationType = Item->m_OperationType;
+
+    PFiltersItem pItem = (PFiltersItem) RtlLookupElementGenericTableAvl(
+        &m_Tree,
+        &item
+        );
+
+    if ( pItem )
+    {
+        // never visible to readers
+        FREE_OBJECT( pItem->m_Filters );
+        RtlDeleteElementGenericTableAvl( &m_Tree, &item );
+    }
+}
@@ -0,0 +1,433 @@
+#include "../inc/commonkrnl.h"
+#include "../../inc/fltcommon.h"
+#include "fltvalues.h"
+
+// x64 kernel code may use SSE2 without saving floating point state
+#if defined (_M_AMD64) || defined (__x86_64__)
+#include <emmintrin.h>
+#define FLT_VALUES_SSE2
+#endif
+
+LONG
+FltCompareValuep (
+    __in PUCHAR Value1,
+    __in PUCHAR Value2,
+    __in ULONG ItemSize
+    )
+{
+    switch ( ItemSize )
+    {
+    case sizeof( ULONG ):
+        {
+            ULONG value1 = *(PULONG) Value1;
+            ULONG value2 = *(PULONG) Value2;
+
+            return value1 < value2 ? -1 : ( value1 > value2 ? 1 : 0 );
+        }
+
+    case sizeof( ULONG64 ):
+        {
+            ULONG64 value1 = *(PULONG64) Value1;
+            ULONG64 value2 = *(PULONG64) Value2;
+
+            return value1 < value2 ? -1 : ( value1 > value2 ? 1 : 0 );
+        }
+
+    default:
+        break;
+    }
+
+    return memcmp( Value1, Value2, ItemSize );
+}
+
+void
+FltSwapValuesp (
+    __inout PUCHAR Value1,
+    __inout PUCHAR Value2,
+    __in ULONG ItemSize
+    )
+{
+    for ( ULONG idx = 0; idx < ItemSize; idx++ )
+    {
+        UCHAR tmp = Value1[ idx ];
+        Value1[ idx ] = Value2[ idx ];
+        Value2[ idx ] = tmp;
+    }
+}
+
+void
+FltSiftDownp (
+    __inout PUCHAR Values,
+    __in ULONG ItemSize,
+    __in ULONG Root,
+    __in ULONG Count
+    )
+{
+    for ( ; ; )
+    {
+        ULONG child = Root * 2 + 1;
+        if ( child >= Count )
+        {
+            break;
+        }
+
+        if (
+            child + 1 < Count
+            &&
+            FltCompareValuep(
+                Values + child * ItemSize,
+                Values + ( child + 1 ) * ItemSize,
+                ItemSize
+                ) < 0
+            )
+        {
+            child++;
+        }
+
+        if ( FltCompareValuep(
+            Values + Root * ItemSize,
+            Values + child * ItemSize,
+            ItemSize
+            ) >= 0 )
+        {
+            break;
+        }
+
+        FltSwapValuesp(
+            Values + Root * ItemSize,
+            Values + child * ItemSize,
+            ItemSize
+            );
+
+        Root = child;
+    }
+}
+
+void
+FltSortValues (
+    __inout_bcount(ItemSize * Count) PUCHAR Values,
+    __in ULONG ItemSize,
+    __in ULONG Count
+    )
+{
+    // heap sort - in place and without recursion
+    if ( Count < 2 || !ItemSize )
+    {
+        return;
+    }
+
+    for ( ULONG root = Count / 2; root-- > 0; )
+    {
+        FltSiftDownp( Values, ItemSize, root, Count );
+    }
+
+    for ( ULONG last = Count - 1; last > 0; last-- )
+    {
+        FltSwapValuesp( Values, Values + last * ItemSize, ItemSize );
+        FltSiftDownp( Values, ItemSize, 0, last );
+    }
+}
+
+BOOLEAN
+FltFindUlongp (
+    __in_ecount(Count) PULONG Values,
+    __in ULONG Count,
+    __in ULONG Value
+    )
+{
+    ULONG idx = 0;
+
+    if ( Count <= FLT_VALUES_SCAN )
+    {
+#if defined (FLT_VALUES_SSE2)
+        const __m128i key = _mm_set1_epi32( (int) Value );
+
+        for ( ; idx + 4 <= Count; idx += 4 )
+        {
+            __m128i values = _mm_loadu_si128( (__m128i*) &Values[ idx ] );
+            if ( _mm_movemask_epi8( _mm_cmpeq_epi32( values, key ) ) )
+            {
+                return TRUE;
+            }
+        }
+#endif // FLT_VALUES_SSE2
+
+        for ( ; idx < Count; idx++ )
+        {
+            if ( Values[ idx ] == Value )
+            {
+                return TRUE;
+            }
+        }
+
+        return FALSE;
+    }
+
+    // base is the last value not greater than Value
+    PULONG pBase = Values;
+    while ( Count > 1 )
+    {
+        ULONG half = Count / 2;
+        pBase = ( pBase[ half ] <= Value ) ? &pBase[ half ] : pBase;
+        Count -= half;
+    }
+
+    return *pBase == Value;
+}
+
+BOOLEAN
+FltFindUlong64p (
+    __in_ecount(Count) PULONG64 Values,
+    __in ULONG Count,
+    __in ULONG64 Value
+    )
+{
+    ULONG idx = 0;
+
+    if ( Count <= FLT_VALUES_SCAN )
+    {
+#if defined (FLT_VALUES_SSE2)
+        // SSE2 compares 32 bit halves, value matches when both do
+        const __m128i key = _mm_set1_epi64x( (LONG64) Value );
+
+        for ( ; idx + 2 <= Count; idx += 2 )
+        {
+            __m128i values = _mm_loadu_si128( (__m128i*) &Values[ idx ] );
+            __m128i equal = _mm_cmpeq_epi32( values, key );
+
+            equal = _mm_and_si128(
+                equal,
+                _mm_shuffle_epi32( equal, _MM_SHUFFLE( 2, 3, 0, 1 ) )
+                );
+
+            if ( _mm_movemask_epi8( equal ) )
+            {
+                return TRUE;
+            }
+        }
+#endif // FLT_VALUES_SSE2
+
+        for ( ; idx < Count; idx++ )
+        {
+            if ( Values[ idx ] == Value )
+            {
+                return TRUE;
+            }
+        }
+
+        return FALSE;
+    }
+
+    PULONG64 pBase = Values;
+    while ( Count > 1 )
+    {
+        ULONG half = Count / 2;
+        pBase = ( pBase[ half ] <= Value ) ? &pBase[ half ] : pBase;
+        Count -= half;
+    }
+
+    return *pBase == Value;
+}
+
+BOOLEAN
+FltFindValue (
+    __in_bcount(ItemSize * Count) PUCHAR Values,
+    __in ULONG ItemSize,
+    __in ULONG Count,
+    __in PVOID Value
+    )
+{
+    if ( !Count )
+    {
+        return FALSE;
+    }
+
+    switch ( ItemSize )
+    {
+    case sizeof( ULONG ):
+        return FltFindUlongp( (PULONG) Values, Count, *(ULONG UNALIGNED*) Value );
+
+    case sizeof( ULONG64 ):
+        return FltFindUlong64p( (PULONG64) Values, Count, *(ULONG64 UNALIGNED*) Value );
+
+    default:
+        break;
+    }
+
+    if ( Count <= FLT_VALUES_SCAN )
+    {
+        for ( ULONG idx = 0; idx < Count; idx++ )
+        {
+            if ( ItemSize == RtlCompareMemory( Values + idx * ItemSize, Value, ItemSize ) )
+            {
+                return TRUE;
+            }
+        }
+
+        return FALSE;
+    }
+
+    ULONG low = 0;
+    ULONG high = Count;
+    while ( low < high )
+    {
+        ULONG middle = low + ( high - low ) / 2;
+        LONG compare = FltCompareValuep( Values + middle * ItemSize, (PUCHAR) Value, ItemSize );
+
+        if ( !compare )
+        {
+            return TRUE;
+        }
+
+        if ( compare < 0 )
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return FALSE;
+}
+
+BOOLEAN
+FltTestMasks (
+    __in_bcount(ItemSize * Count) PUCHAR Masks,
+    __in ULONG ItemSize,
+    __in ULONG Count,
+    __in PVOID Value
+    )
+{
+    ULONG64 hit = 0;
+
+    switch ( ItemSize )
+    {
+    case sizeof( ULONG ):
+        {
+            ULONG value = *(ULONG UNALIGNED*) Value;
+            for ( ULONG item = 0; item < Count; item++ )
+            {
+                hit |= ( (PULONG) Masks )[ item ] & value;
+            }
+        }
+        break;
+
+    case sizeof( ULONG64 ):
+        {
+            ULONG64 value = *(ULONG64 UNALIGNED*) Value;
+            for ( ULONG item = 0; item < Count; item++ )
+            {
+                hit |= ( (PULONG64) Masks )[ item ] & value;
+            }
+        }
+        break;
+
+    default:
+        {
+            PUCHAR pValue = (PUCHAR) Value;
+            for ( ULONG idx = 0; idx < ItemSize * Count; idx++ )
+            {
+                hit |= Masks[ idx ] & pValue[ idx % ItemSize ];
+            }
+        }
+        break;
+    }
+
+    return hit ? TRUE : FALSE;
+}
+
+BOOLEAN
+FltIsOrderedWidth (
+    __in ULONG ItemSize
+    )
+{
+    switch ( ItemSize )
+    {
+    case sizeof( UCHAR ):
+    case sizeof( USHORT ):
+    case sizeof( ULONG ):
+    case sizeof( ULONG64 ):
+        return TRUE;
+
+    default:
+        break;
+    }
+
+    return FALSE;
+}
+
+ULONG64
+FltLoadUnsigned (
+    __in PUCHAR Value,
+    __in ULONG ItemSize
+    )
+{
+    switch ( ItemSize )
+    {
+    case sizeof( UCHAR ):
+        return *Value;
+
+    case sizeof( USHORT ):
+        return *(USHORT UNALIGNED*) Value;
+
+    case sizeof( ULONG ):
+        return *(ULONG UNALIGNED*) Value;
+
+    default:
+        break;
+    }
+
+    return *(ULONG64 UNALIGNED*) Value;
+}
+
+BOOLEAN
+FltTestOrdered (
+    __in FltOperation Operation,
+    __in_bcount(ItemSize * Count) PUCHAR Bounds,
+    __in ULONG ItemSize,
+    __in ULONG Count,
+    __in PVOID Value
+    )
+{
+    ASSERT( FltIsOrderedWidth( ItemSize ) );
+
+    ULONG64 value = FltLoadUnsigned( (PUCHAR) Value, ItemSize );
+    ULONG hit = 0;
+
+    switch ( Operation )
+    {
+    case FltOp_less:
+        for ( ULONG item = 0; item < Count; item++ )
+        {
+            hit |= value < FltLoadUnsigned( Bounds + item * ItemSize, ItemSize );
+        }
+        break;
+
+    case FltOp_greater:
+        for ( ULONG item = 0; item < Count; item++ )
+        {
+            hit |= value > FltLoadUnsigned( Bounds + item * ItemSize, ItemSize );
+        }
+        break;
+
+    case FltOp_range:
+        ASSERT( !( Count % 2 ) );
+
+        for ( ULONG item = 0; item + 1 < Count; item += 2 )
+        {
+            ULONG64 low = FltLoadUnsigned( Bounds + item * ItemSize, ItemSize );
+            ULONG64 high = FltLoadUnsigned( Bounds + ( item + 1 ) * ItemSize, ItemSize );
+
+            hit |= ( value >= low ) & ( value <= high );
+        }
+        break;
+
+    default:
+        ASSERT( FALSE );
+        break;
+    }
+
+    return hit ? TRUE : FALSE;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+//!
+//    \description - value sets of FltOp_equ checks. Values of one check have
+//                   the same width, they are sorted once when the check is
+//                   attached. Few values are compared all (SIMD for 4 and 8
+//                   byte values), many are found by branchless binary search.
+//
+//                   Order is of integers for 4 and 8 byte values, of bytes
+//                   for other widths - sort and search agree on it.
+//
+//                   Masks and ordered operations are evaluated without
+//                   branches on data: every value is tested, results are
+//                   or-ed.
+//!
+
+#define FLT_VALUES_SCAN         32      // more values are searched
+
+void
+FltSortValues (
+    __inout_bcount(ItemSize * Count) PUCHAR Values,
+    __in ULONG ItemSize,
+    __in ULONG Count
+    );
+
+// Values are sorted by FltSortValues
+BOOLEAN
+FltFindValue (
+    __in_bcount(ItemSize * Count) PUCHAR Values,
+    __in ULONG ItemSize,
+    __in ULONG Count,
+    __in PVOID Value
+    );
+
+// FltOp_and - any bit of any mask is set in Value, any width
+BOOLEAN
+FltTestMasks (
+    __in_bcount(ItemSize * Count) PUCHAR Masks,
+    __in ULONG ItemSize,
+    __in ULONG Count,
+    __in PVOID Value
+    );
+
+// widths of FltOp_less, FltOp_greater and FltOp_range
+BOOLEAN
+FltIsOrderedWidth (
+    __in ULONG ItemSize
+    );
+
+// ItemSize is ordered width
+ULONG64
+FltLoadUnsigned (
+    __in PUCHAR Value,
+    __in ULONG ItemSize
+    );
+
+// FltOp_range takes pairs, Count is even
+BOOLEAN
+FltTestOrdered (
+    __in FltOperation Operation,
+    __in_bcount(ItemSize * Count) PUCHAR Bounds,
+    __in ULONG ItemSize,
+    __in ULONG Count,
+    __in PVOID Value
+    );
@@ -4,11 +4,13 @@
 #include "../inc/fltsystem.h"
 #include "../inc/processhelper.h"
 
+// QuotaLimits - limits of every client, a client may lower them only
 __checkReturn
 NTSTATUS
 ChannelInitPort (
     __in ProcessHelper* ProcessHlp,
-    __in FilteringSystem* FltSystem
+    __in FilteringSystem* FltSystem,
+    __in PFltQuotas QuotaLimits
     );
 
 void
@@ -1,17 +1,17 @@
-#pragma once
-
-void
-RegisterInvisibleProcess (
-    HANDLE Process
-    );
-
-void
-UnregisterInvisibleProcess (
-    HANDLE Process
-    );
-
-__checkReturn
-BOOLEAN
-IsInvisibleProcess (
-    HANDLE Process
+#pragma once
+
+void
+RegisterInvisibleProcess (
+    HANDLE Process
+    );
+
+void
+UnregisterInvisibleProcess (
+    HANDLE Process
+    );
+
+__checkReturn
+BOOLEAN
+IsInvisibleProcess (
+    HANDLE Process
     );
\ No newline at end of file
@@ -1,101 +1,198 @@
-#pragma once
-
-#include "../../inc/fltcommon.h"
-
-typedef struct _AggregationItem
-{
-    ULONG       m_FilterId;
-    VERDICT     m_Verdict;
-} AggregationItem, *PAggregationItem;
-
-class Aggregation
-{
-private:
-    static ULONG        m_AllocTag;
-
-public:
-    Aggregation();
-    ~Aggregation();
-
-    ULONG
-    GetCount();
-
-    ULONG
-    GetFilterId (
-        __in_opt ULONG Position
-        );
-
-    VERDICT
-    GetVerdict (
-        __in_opt ULONG Position
-        );
-
-    __checkReturn
-    NTSTATUS
-    Allocate (
-        __in ULONG ItemsCount
-        );
-
-    __checkReturn
-    NTSTATUS
-    PlaceValue (
-        __in ULONG Position,
-        __in ULONG FilterId,
-        __in_opt VERDICT Verdict
-        );
-
-private:
-    ULONG               m_Count;
-    PAggregationItem    m_Items;
-};
-
-class EventData
-{
-public:
-    Aggregation m_Aggregator;
-
-    EventData (
-        __in ULONG InterceptorId,
-        __in ULONG Major,
-        __in ULONG Minor,
-        __in ULONG OperationType
-        );
-
-    ~EventData();
-
-    ULONG
-    GetInterceptorId();
-
-    ULONG
-    GetOperationId();
-
-    ULONG
-    GetMinor();
-
-    ULONG
-    GetOperationType();
-
-    __checkReturn
-    virtual
-    NTSTATUS
-    QueryParameter (
-        __in_opt ULONG ParameterId,
-        __drv_when(return==0, __deref_out_opt __drv_valueIs(!=0)) PVOID* Data,
-        __deref_out_opt PULONG DataSize
-        );
-
-    __checkReturn
-    virtual
-    NTSTATUS
-    ObjectRequest (
-        __in ULONG Command,
-        __out_opt PVOID OutputBuffer,
-        __inout_opt PULONG OutputBufferSize
-        );
-
-protected:
-    ULONG   m_InterceptorId;
-    ULONG   m_Major;
-    ULONG   m_Minor;
-    ULONG   m_OperationType;
-};
+#pragma once
+
+#include "../../inc/fltcommon.h"
+
+typedef struct _AggregationItem
+{
+    ULONG       m_FilterId;
+    VERDICT     m_Verdict;
+} AggregationItem, *PAggregationItem;
+
+// most events match a few groups - items above this count go to pool
+#define AGGREGATION_INLINE_ITEMS    4
+
+class Aggregation
+{
+private:
+    static ULONG        m_AllocTag;
+
+public:
+    Aggregation();
+    ~Aggregation();
+
+    ULONG
+    GetCount (
+        )
+    {
+        return m_Count;
+    }
+
+    ULONG
+    GetFilterId (
+        __in_opt ULONG Position
+        )
+    {
+        ASSERT( Position < m_Count );
+
+        return m_Items[ Position ].m_FilterId;
+    }
+
+    VERDICT
+    GetVerdict (
+        __in_opt ULONG Position
+        )
+    {
+        ASSERT( Position < m_Count );
+
+        return m_Items[ Position ].m_Verdict;
+    }
+
+    __checkReturn
+    NTSTATUS
+    Allocate (
+        __in ULONG ItemsCount
+        );
+
+    __checkReturn
+    NTSTATUS
+    PlaceValue (
+        __in ULONG Position,
+        __in ULONG FilterId,
+        __in_opt VERDICT Verdict
+        )
+    {
+        ASSERT( Position < m_Count );
+
+        if ( Position >= m_Count )
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        m_Items[ Position ].m_FilterId = FilterId;
+        m_Items[ Position ].m_Verdict = Verdict;
+
+        return STATUS_SUCCESS;
+    }
+
+private:
+    ULONG               m_Count;
+    PAggregationItem    m_Items;        // m_Inline or pool
+    AggregationItem     m_Inline[ AGGREGATION_INLINE_ITEMS ];
+};
+
+//!
+//    \description - parameters are read by every check, box item and by the
+//                   message builder. Result of QueryParameter is memoized per
+//                   event - data must stay valid and unchanged while the
+//                   event exists. Failures are memoized too.
+//!
+
+#define EVENT_MEMO_SLOTS        16      // distinct parameters memoized
+#define EVENT_MEMO_NONE         0xff
+
+typedef struct _EventMemoSlot
+{
+    PVOID       m_Data;
+    ULONG       m_Size;
+    NTSTATUS    m_Status;
+} EventMemoSlot, *PEventMemoSlot;
+
+class EventData
+{
+public:
+    Aggregation m_Aggregator;
+
+    EventData (
+        __in ULONG InterceptorId,
+        __in ULONG Major,
+        __in ULONG Minor,
+        __in ULONG OperationType
+        );
+
+    ~EventData();
+
+    ULONG
+    GetInterceptorId();
+
+    ULONG
+    GetOperationId();
+
+    ULONG
+    GetMinor();
+
+    ULONG
+    GetOperationType();
+
+    __checkReturn
+    virtual
+    NTSTATUS
+    QueryParameter (
+        __in_opt ULONG ParameterId,
+        __drv_when(return==0, __deref_out_opt __drv_valueIs(!=0)) PVOID* Data,
+        __deref_out_opt PULONG DataSize
+        );
+
+    // memoized QueryParameter, filtering and channel use it
+    __checkReturn
+    NTSTATUS
+    GetParameter (
+        __in_opt ULONG ParameterId,
+        __drv_when(return==0, __deref_out_opt __drv_valueIs(!=0)) PVOID* Data,
+        __deref_out_opt PULONG DataSize
+        )
+    {
+        m_Queries++;
+
+        if ( ParameterId < _PARAMS_COUNT && EVENT_MEMO_NONE != m_MemoIndex[ ParameterId ] )
+        {
+            PEventMemoSlot pSlot = &m_Memo[ m_MemoIndex[ ParameterId ] ];
+            if ( NT_SUCCESS( pSlot->m_Status ) )
+            {
+                *Data = pSlot->m_Data;
+                *DataSize = pSlot->m_Size;
+            }
+
+            return pSlot->m_Status;
+        }
+
+        return MemoizeParameterp( ParameterId, Data, DataSize );
+    }
+
+    // Queries - GetParameter calls, Computed - QueryParameter calls
+    void
+    QueryMemoStatistics (
+        __out PULONG Queries,
+        __out PULONG Computed
+        );
+
+    __checkReturn
+    virtual
+    NTSTATUS
+    ObjectRequest (
+        __in ULONG Command,
+        __out_opt PVOID OutputBuffer,
+        __inout_opt PULONG OutputBufferSize
+        );
+
+protected:
+    ULONG   m_InterceptorId;
+    ULONG   m_Major;
+    ULONG   m_Minor;
+    ULONG   m_OperationType;
+
+private:
+    __checkReturn
+    NTSTATUS
+    MemoizeParameterp (
+        __in_opt ULONG ParameterId,
+        __drv_when(return==0, __deref_out_opt __drv_valueIs(!=0)) PVOID* Data,
+        __deref_out_opt PULONG DataSize
+        );
+
+private:
+    ULONG           m_Queries;
+    ULONG           m_Computed;
+    ULONG           m_MemoCount;
+    UCHAR           m_MemoIndex[ _PARAMS_COUNT ];
+    EventMemoSlot   m_Memo[ EVENT_MEMO_SLOTS ];
+};
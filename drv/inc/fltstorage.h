@@ -4,7 +4,119 @@
 #include "../inc/processhelper.h"
 
 class Filters;
+class FilterBox;
 class FilterBoxList;
+class FltVerdictCache;
+class FltInterest;
+struct _FiltersIndex;
+
+// interceptor, operation and point are small enums, minor functions of
+// IRP are below 32 - such keys are dispatched by index
+#define FLT_DISPATCH_INTERCEPTORS   4
+#define FLT_DISPATCH_OPERATIONS     4
+#define FLT_DISPATCH_POINTS         4
+#define FLT_DISPATCH_MINORS         32
+
+#define FLT_DISPATCH_SLOTS          ( FLT_DISPATCH_INTERCEPTORS * FLT_DISPATCH_OPERATIONS \
+                                    * FLT_DISPATCH_POINTS * FLT_DISPATCH_MINORS )
+
+#define FLT_DISPATCH_NONE           ( (ULONG) -1 )
+
+ULONG
+FltGetDispatchSlot (
+    __in ULONG Interceptor,
+    __in ULONG Operation,
+    __in ULONG Minor,
+    __in ULONG OperationType
+    );
+
+// bytes of params as they come from the client
+ULONG
+FltGetParamsSize (
+    __in ULONG ParamsCount,
+    __in_opt PFltParam Params
+    );
+
+// known operation and values of one width, data of the param is in
+// memory. BoxItem - item of a box, it may come without count
+__checkReturn
+NTSTATUS
+FltValidateParam (
+    __in PFltParam Param,
+    __in BOOLEAN BoxItem
+    );
+
+// expensive parameters (file name, sid...) per event
+typedef struct _FltFetchStatistics
+{
+    LONG64          m_Fetched;      // queried by checks
+    LONG64          m_Avoided;      // used by filters, but other checks failed first
+} FltFetchStatistics, *PFltFetchStatistics;
+
+// verdict cache, events of sets without box checks
+typedef struct _FltCacheStatistics
+{
+    LONG64          m_Hits;
+    LONG64          m_Misses;
+    LONG64          m_Evictions;    // valid entry replaced
+    LONG64          m_Bypassed;     // key or aggregation does not fit entry
+} FltCacheStatistics, *PFltCacheStatistics;
+
+// limits of a storage, 0 - not limited. AddFiltersUnsafe and
+// CreateBoxUnsafe over a limit fail with STATUS_QUOTA_EXCEEDED.
+// Limits of the driver bound quotas the client sets
+typedef struct _FltQuotas
+{
+    ULONG           m_Filters;
+    ULONG           m_Boxes;
+    LONG64          m_PolicyBytes;
+} FltQuotas, *PFltQuotas;
+
+typedef struct _FltUsage
+{
+    // charged against quotas
+    ULONG           m_Filters;
+    ULONG           m_Boxes;
+    LONG64          m_PolicyBytes;      // params of filters and box items
+    LONG64          m_Rejected;         // requests over a quota
+
+    // memory held, estimated from object sizes
+    ULONG           m_Sets;
+    ULONG           m_Params;           // check entries of sets
+    LONG64          m_FiltersBytes;     // filter arrays
+    LONG64          m_ParamsBytes;      // check entries with their values
+    LONG64          m_PositionsBytes;   // position lists of check entries
+    LONG64          m_CompiledBytes;    // dag images and group masks
+    LONG64          m_BoxesBytes;       // boxes with items
+    LONG64          m_CacheBytes;       // verdict cache
+} FltUsage, *PFltUsage;
+
+// filter of a chain, AddFiltersUnsafe
+typedef struct _FltChainItem
+{
+    ULONG           m_Interceptor;
+    ULONG           m_OperationId;
+    ULONG           m_FunctionMi;
+    ULONG           m_OperationType;
+    UCHAR           m_GroupId;
+    VERDICT         m_Verdict;
+    HANDLE          m_ProcessId;
+    ULONG           m_RequestTimeout;
+    PARAMS_MASK     m_WishMask;
+    ULONG           m_ParamsCount;
+    PFltParam       m_Params;
+    ULONG           m_FilterId;     // out
+} FltChainItem, *PFltChainItem;
+
+// box entry of a chain. Entries are staged before filters of the chain
+// and applied after them, cancelled ones leave the box as it was
+typedef struct _FltBoxStage
+{
+    FilterBox*              m_Box;          // referenced
+    struct _BoxFilterItem*  m_Item;         // create, NULL - release
+    BOOLEAN                 m_Listed;       // create listed the box
+    LONG64                  m_PolicyBytes;  // charged while staged
+} FltBoxStage, *PFltBoxStage;
 
 class FiltersStorage
 {
@@ -52,6 +164,14 @@ public:
         __out PULONG FilterId
         );
 
+    // all filters are published at once, none on failure
+    __checkReturn
+    NTSTATUS
+    AddFiltersUnsafe (
+        __in ULONG Count,
+        __inout_ecount(Count) PFltChainItem Items
+        );
+
     __checkReturn
     NTSTATUS
     CreateBoxUnsafe (
@@ -67,6 +187,36 @@ public:
         __in LPGUID Guid
         );
 
+    // item is built and the box is listed, readers see nothing yet
+    __checkReturn
+    NTSTATUS
+    StageBoxUnsafe (
+        __in LPGUID Guid,
+        __in ULONG ParamsCount,
+        __in_opt PFltParam Params,
+        __out PFltBoxStage Stage
+        );
+
+    __checkReturn
+    NTSTATUS
+    StageBoxReleaseUnsafe (
+        __in LPGUID Guid,
+        __out PFltBoxStage Stage
+        );
+
+    // FilterId - position of the created item, 0 for release
+    void
+    ApplyBoxUnsafe (
+        __in PFltBoxStage Stage,
+        __out PULONG FilterId
+        );
+
+    // stages of a chain are cancelled in the reverse order
+    void
+    CancelBoxUnsafe (
+        __in PFltBoxStage Stage
+        );
+
     void
     DeleteAllFilters (
         );
@@ -87,6 +237,50 @@ public:
         __in PVERDICT Verdict,
         __in PPARAMS_MASK ParamsMask
         );
+
+    void
+    QueryFetchStatistics (
+        __out PFltFetchStatistics Statistics
+        );
+
+    void
+    QueryCacheStatistics (
+        __out PFltCacheStatistics Statistics
+        );
+
+    // cache is enabled by default
+    void
+    ChangeCacheState (
+        __in BOOLEAN Enable
+        );
+
+    // quotas are set to the limits, SetQuotas never raises them above
+    void
+    SetQuotaLimits (
+        __in PFltQuotas Limits
+        );
+
+    // 0 or a value over the limit - the limit
+    void
+    SetQuotas (
+        __in PFltQuotas Quotas
+        );
+
+    void
+    QueryQuotas (
+        __out PFltQuotas Quotas
+        );
+
+    void
+    QueryUsage (
+        __out PFltUsage Usage
+        );
+
+    // published sets are reported to Interest, NULL - withdraw them
+    void
+    SetInterest (
+        __in_opt FltInterest* Interest
+        );
   
 private:
     LONG
@@ -97,11 +291,59 @@ private:
     CreateBoxControlp (
         );
 
+    void
+    CreateCachep (
+        );
+
+    // cached verdicts computed before are stale
+    void
+    BumpGenerationp (
+        );
+
+    void
+    RetireFiltersp (
+        __in Filters* FiltersObj
+        );
+
+    // filters of a set against quotas, Sign is 1 or -1
+    void
+    ChargeFiltersp (
+        __in Filters* FiltersObj,
+        __in LONG Sign
+        );
+
+    __checkReturn
+    NTSTATUS
+    PublishIndexUnsafep (
+        __in BOOLEAN SkipEmpty
+        );
+
+    // Index - published one, NULL withdraws all reported slots
+    void
+    UpdateInterestUnsafep (
+        __in_opt struct _FiltersIndex* Index
+        );
+
+    // walks sets for memory they hold, lock is taken at least shared
+    void
+    QueryUsageUnsafep (
+        __out PFltUsage Usage
+        );
+
+    __checkReturn
+    NTSTATUS
+    CheckQuotasUnsafep (
+        __in ULONG Filters,
+        __in ULONG Boxes,
+        __in LONG64 PolicyBytes
+        );
+
     void
     CleanupFiltersByPidp (
         __in HANDLE ProcessId
         );
 
+    // caller is inside of epoch section, no reference taken
     __checkReturn
     Filters*
     GetFiltersByp (
@@ -111,13 +353,20 @@ private:
         __in ULONG OperationType
         );
     
+    // new set is not published - PublishIndexUnsafep
     __checkReturn
     Filters*
     GetOrCreateFiltersByUnsafep (
         __in ULONG Interceptor,
         __in ULONG Operation,
         __in_opt ULONG Minor,
-        __in ULONG OperationType
+        __in ULONG OperationType,
+        __out PBOOLEAN Created
+        );
+
+    void
+    DeleteUnpublishedUnsafep (
+        __in PFltChainItem Item
         );
 
 private:
@@ -127,4 +376,28 @@ private:
     LONG            m_FilterIdCounter;
     LONG            m_Flags;
     FilterBoxList*  m_BoxList;
+
+    // dispatch array and sorted rest of the tree for lock-free lookup,
+    // replaced by writers
+    struct _FiltersIndex* volatile m_Index;
+
+    FltInterest*    m_Interest;
+    ULONG           m_Interested[ FLT_DISPATCH_SLOTS / 32 ];  // reported slots
+
+    // counters of deleted Filters
+    FltFetchStatistics m_RetiredStatistics;
+
+    // bumped after every change readers can see
+    volatile LONG   m_Generation;
+    FltVerdictCache* volatile m_Cache;
+    BOOLEAN         m_CacheDisabled;
+
+    FltQuotas       m_QuotaLimits;
+    FltQuotas       m_Quotas;
+    LONG64          m_Rejected;
+    LONG64          m_StagedBytes;      // box items not inserted yet
+
+    // filters of all sets, quotas are checked without walking them
+    ULONG           m_ChargedFilters;
+    LONG64          m_ChargedBytes;
 };
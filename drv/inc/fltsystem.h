@@ -1,51 +1,99 @@
-#pragma once
-#include  "../../inc/fltcommon.h"
-#include  "../inc/fltevents.h"
-#include  "../inc/fltstorage.h"
-
-class FilteringSystem
-{
-public:
-    static ULONG        m_AllocTag;
-
-public:
-    FilteringSystem();
-    ~FilteringSystem();
-
-    __checkReturn
-    NTSTATUS
-    AddRef (
-        );
-
-    void
-    Release (
-        );
-
-    __checkReturn
-    NTSTATUS
-    Attach (
-        __in FiltersStorage* FltStorage
-        );
-
-    void
-    Detach (
-        __in FiltersStorage* FltStorage
-        );
-
-    BOOLEAN
-    IsFiltersExist (
-        );
-
-    __checkReturn
-    NTSTATUS
-    FilterEvent (
-        __in EventData* Event,
-        __in PVERDICT Verdict,
-        __in PPARAMS_MASK ParamsMask
-        );
-
-private:
-    EX_PUSH_LOCK        m_AccessLock;
-    LIST_ENTRY          m_List;
-    LONG                m_RefCount;
-};
+#pragma once
+#include  "../../inc/fltcommon.h"
+#include  "../inc/fltevents.h"
+#include  "../inc/fltstorage.h"
+
+//!
+//    \description - keys of events attached storages filter. Slot of
+//                   (interceptor, operation, minor, point) is set while any
+//                   storage publishes a set for it, so interceptors skip
+//                   building events nobody filters. Keys out of dispatch
+//                   range are always interesting.
+//!
+
+class FltInterest
+{
+public:
+    FltInterest();
+    ~FltInterest();
+
+    BOOLEAN
+    IsInterested (
+        __in ULONG Interceptor,
+        __in ULONG Operation,
+        __in ULONG Minor,
+        __in ULONG OperationType
+        );
+
+    void
+    Add (
+        __in ULONG Slot
+        );
+
+    void
+    Remove (
+        __in ULONG Slot
+        );
+
+private:
+    EX_PUSH_LOCK        m_AccessLock;       // writers only
+    ULONG               m_Counts[ FLT_DISPATCH_SLOTS ];
+    volatile LONG       m_Bits[ FLT_DISPATCH_SLOTS / 32 ];
+};
+
+class FilteringSystem
+{
+public:
+    static ULONG        m_AllocTag;
+
+public:
+    FilteringSystem();
+    ~FilteringSystem();
+
+    __checkReturn
+    NTSTATUS
+    AddRef (
+        );
+
+    void
+    Release (
+        );
+
+    __checkReturn
+    NTSTATUS
+    Attach (
+        __in FiltersStorage* FltStorage
+        );
+
+    void
+    Detach (
+        __in FiltersStorage* FltStorage
+        );
+
+    BOOLEAN
+    IsFiltersExist (
+        );
+
+    // no lock, event is not built when FALSE
+    BOOLEAN
+    IsInterested (
+        __in ULONG Interceptor,
+        __in ULONG Operation,
+        __in ULONG Minor,
+        __in ULONG OperationType
+        );
+
+    __checkReturn
+    NTSTATUS
+    FilterEvent (
+        __in EventData* Event,
+        __in PVERDICT Verdict,
+        __in PPARAMS_MASK ParamsMask
+        );
+
+private:
+    EX_PUSH_LOCK        m_AccessLock;
+    LIST_ENTRY          m_List;
+    LONG                m_RefCount;
+    FltInterest         m_Interest;
+};
@@ -1,43 +1,131 @@
-#pragma once
-
-#pragma message(" ----- memmgr")
-
-#ifndef FREE_POOL
-#define FREE_POOL( _PoolPtr ) \
-    if ( _PoolPtr ) \
-    { \
-        ExFreePool( _PoolPtr ); \
-        _PoolPtr = NULL; \
-    }
-#endif // FREE_POOL
-
-void* _cdecl operator new (
-    size_t size,
-    POOL_TYPE PoolType,
-    ULONG Tag
-    );
- 
-void _cdecl operator delete (
-    void *p
-    );
- 
-void* _cdecl operator new[] (
-    size_t size,
-    POOL_TYPE PoolType,
-    ULONG Tag
-    );
-
-void _cdecl operator delete[] (
-    void *p
-    );
-
-
-#ifndef FREE_OBJECT
-#define FREE_OBJECT( _ObjPtr ) \
-    if ( _ObjPtr ) \
-    { \
-        delete _ObjPtr; \
-        _ObjPtr = NULL; \
-    }
-
-#endif // FREE_POOL
+#pragma once
+
+#pragma message(" ----- memmgr")
+
+#ifndef FREE_POOL
+#define FREE_POOL( _PoolPtr ) \
+    if ( _PoolPtr ) \
+    { \
+        ExFreePool( _PoolPtr ); \
+        _PoolPtr = NULL; \
+    }
+#endif // FREE_POOL
+
+//!
+//    \description - slab allocator for objects allocated and freed on
+//                   every event. Size classes are served by lookaside
+//                   lists of the current processor, a block header keeps
+//                   class and tag. Blocks above the largest class and
+//                   blocks allocated without initialized slab are taken
+//                   from pool. Live counts are kept per processor and
+//                   tag, peak is exact up to MEM_SLAB_BATCH blocks per
+//                   processor.
+//!
+
+#define MEM_SLAB_CLASSES        8       // 32 .. 4096 bytes
+#define MEM_SLAB_MIN_SHIFT      5
+#define MEM_SLAB_TAGS           32
+#define MEM_SLAB_BATCH          64      // live blocks a processor counts alone
+
+typedef struct _MemSlabStatistics
+{
+    ULONG               m_Tag;
+    LONG                m_Live;
+    LONG                m_Peak;
+    LONG64              m_PoolAllocations;  // served by pool
+} MemSlabStatistics, *PMemSlabStatistics;
+
+__checkReturn
+NTSTATUS
+MemSlabInitialize (
+    );
+
+// blocks freed after this go to pool
+void
+MemSlabDestroy (
+    );
+
+__checkReturn
+PVOID
+MemSlabAllocate (
+    __in SIZE_T Size,
+    __in ULONG Tag
+    );
+
+void
+MemSlabFree (
+    __in PVOID Block
+    );
+
+// returns number of tags, fills up to Count of them
+ULONG
+MemSlabQueryStatistics (
+    __out_ecount_opt(Count) PMemSlabStatistics Statistics,
+    __in ULONG Count
+    );
+
+#ifndef FREE_SLAB
+#define FREE_SLAB( _SlabPtr ) \
+    if ( _SlabPtr ) \
+    { \
+        MemSlabFree( _SlabPtr ); \
+        _SlabPtr = NULL; \
+    }
+#endif // FREE_SLAB
+
+void* _cdecl operator new (
+    size_t size,
+    POOL_TYPE PoolType,
+    ULONG Tag
+    );
+ 
+void _cdecl operator delete (
+    void *p
+    );
+ 
+void* _cdecl operator new[] (
+    size_t size,
+    POOL_TYPE PoolType,
+    ULONG Tag
+    );
+
+void _cdecl operator delete[] (
+    void *p
+    );
+
+
+#if !defined( __PLACEMENT_NEW_INLINE ) && !defined( _NEW )
+#define __PLACEMENT_NEW_INLINE
+
+inline
+void* _cdecl operator new (
+    size_t size,
+    void* p
+    )
+{
+    UNREFERENCED_PARAMETER( size );
+
+    return p;
+}
+
+inline
+void _cdecl operator delete (
+    void* p,
+    void* place
+    )
+{
+    UNREFERENCED_PARAMETER( p );
+    UNREFERENCED_PARAMETER( place );
+}
+
+#endif // __PLACEMENT_NEW_INLINE
+
+#ifndef FREE_OBJECT
+#define FREE_OBJECT( _ObjPtr ) \
+    if ( _ObjPtr ) \
+    { \
+        delete _ObjPtr; \
+        _ObjPtr = NULL; \
+    }
+
+#endif // FREE_POOL
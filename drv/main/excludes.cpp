@@ -1,41 +1,41 @@
-#include "../inc/commonkrnl.h"
-#include "../inc/excludes.h"
-
-HANDLE gAttachedProcess = NULL;
-
-void
-RegisterInvisibleProcess (
-    HANDLE Process
-    )
-{
-    ASSERT( ARGUMENT_PRESENT( Process ) );
-
-    ASSERT( !gAttachedProcess );
-    
-    gAttachedProcess = Process;
-}
-
-void
-UnregisterInvisibleProcess (
-    HANDLE Process
-    )
-{
-    UNREFERENCED_PARAMETER( Process );
-    ASSERT( gAttachedProcess );
-
-    gAttachedProcess = NULL;
-}
-
-__checkReturn
-BOOLEAN
-IsInvisibleProcess (
-    HANDLE Process
-    )
-{
-    if ( gAttachedProcess == Process )
-    {
-        return TRUE;
-    }
-
-    return FALSE;
+#include "../inc/commonkrnl.h"
+#include "../inc/excludes.h"
+
+HANDLE gAttachedProcess = NULL;
+
+void
+RegisterInvisibleProcess (
+    HANDLE Process
+    )
+{
+    ASSERT( ARGUMENT_PRESENT( Process ) );
+
+    ASSERT( !gAttachedProcess );
+    
+    gAttachedProcess = Process;
+}
+
+void
+UnregisterInvisibleProcess (
+    HANDLE Process
+    )
+{
+    UNREFERENCED_PARAMETER( Process );
+    ASSERT( gAttachedProcess );
+
+    gAttachedProcess = NULL;
+}
+
+__checkReturn
+BOOLEAN
+IsInvisibleProcess (
+    HANDLE Process
+    )
+{
+    if ( gAttachedProcess == Process )
+    {
+        return TRUE;
+    }
+
+    return FALSE;
 }
\ No newline at end of file
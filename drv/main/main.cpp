@@ -26,6 +26,12 @@ typedef struct _Globals
 
 Globals GlobalData;
 
+// limits of every client, values of Parameters key of the service
+// replace them, 0 - not limited
+#define QUOTA_FILTERS_DEFAULT       0x100000
+#define QUOTA_BOXES_DEFAULT         0x10000
+#define QUOTA_POLICY_BYTES_DEFAULT  0x10000000
+
 extern "C"
 {
     NTSTATUS
@@ -49,11 +55,95 @@ DriverUnload (
     FREE_OBJECT( GlobalData.m_FilteringSystem );
     FREE_OBJECT( GlobalData.m_ProcessHelper );
 
+    MemSlabDestroy();
+
     DoTraceEx( TRACE_LEVEL_CRITICAL, TB_CORE, "DriverUnload complete" );
 
     WPP_CLEANUP( GlobalData.m_FilterDriverObject->DeviceObject );
 }
 
+void
+QueryQuotaLimits (
+    __in PUNICODE_STRING RegistryPath,
+    __out PFltQuotas QuotaLimits
+    )
+{
+    ULONG filters = QUOTA_FILTERS_DEFAULT;
+    ULONG boxes = QUOTA_BOXES_DEFAULT;
+    ULONG policybytes = QUOTA_POLICY_BYTES_DEFAULT;
+
+    // absent value keeps the default, other type fails the query
+    RTL_QUERY_REGISTRY_TABLE table[5];
+    RtlZeroMemory( table, sizeof( table ) );
+
+    table[0].Flags = RTL_QUERY_REGISTRY_SUBKEY;
+    table[0].Name = L"Parameters";
+
+    table[1].Flags = RTL_QUERY_REGISTRY_DIRECT | RTL_QUERY_REGISTRY_TYPECHECK;
+    table[1].Name = L"QuotaFilters";
+    table[1].EntryContext = &filters;
+    table[1].DefaultType = ( REG_DWORD << RTL_QUERY_REGISTRY_TYPECHECK_SHIFT ) | REG_NONE;
+
+    table[2].Flags = RTL_QUERY_REGISTRY_DIRECT | RTL_QUERY_REGISTRY_TYPECHECK;
+    table[2].Name = L"QuotaBoxes";
+    table[2].EntryContext = &boxes;
+    table[2].DefaultType = ( REG_DWORD << RTL_QUERY_REGISTRY_TYPECHECK_SHIFT ) | REG_NONE;
+
+    table[3].Flags = RTL_QUERY_REGISTRY_DIRECT | RTL_QUERY_REGISTRY_TYPECHECK;
+    table[3].Name = L"QuotaPolicyBytes";
+    table[3].EntryContext = &policybytes;
+    table[3].DefaultType = ( REG_DWORD << RTL_QUERY_REGISTRY_TYPECHECK_SHIFT ) | REG_NONE;
+
+    // RegistryPath is counted, not terminated - open it by handle
+    HANDLE hKey = NULL;
+    OBJECT_ATTRIBUTES oa;
+
+    InitializeObjectAttributes(
+        &oa,
+        RegistryPath,
+        OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE,
+        NULL,
+        NULL
+        );
+
+    NTSTATUS status = ZwOpenKey( &hKey, KEY_READ, &oa );
+    if ( NT_SUCCESS( status ) )
+    {
+        status = RtlQueryRegistryValues(
+            RTL_REGISTRY_HANDLE,
+            (PCWSTR) hKey,
+            table,
+            NULL,
+            NULL
+            );
+
+        ZwClose( hKey );
+    }
+
+    if ( !NT_SUCCESS( status ) )
+    {
+        // no key - defaults
+        DoTraceEx( TRACE_LEVEL_WARNING, TB_CORE, "quota limits query %!STATUS!", status );
+
+        filters = QUOTA_FILTERS_DEFAULT;
+        boxes = QUOTA_BOXES_DEFAULT;
+        policybytes = QUOTA_POLICY_BYTES_DEFAULT;
+    }
+
+    QuotaLimits->m_Filters = filters;
+    QuotaLimits->m_Boxes = boxes;
+    QuotaLimits->m_PolicyBytes = policybytes;
+
+    DoTraceEx(
+        TRACE_LEVEL_INFORMATION,
+        TB_CORE,
+        "quota limits: filters %u boxes %u policy bytes %I64d",
+        QuotaLimits->m_Filters,
+        QuotaLimits->m_Boxes,
+        QuotaLimits->m_PolicyBytes
+        );
+}
+
 NTSTATUS
 DriverEntry (
     __in PDRIVER_OBJECT DriverObject,
@@ -62,7 +152,6 @@ DriverEntry (
 {
     NTSTATUS status = STATUS_UNSUCCESSFUL;
 
-    UNREFERENCED_PARAMETER( RegistryPath );
     WPP_INIT_TRACING( DriverObject, RegistryPath );
 
     DoTraceEx( TRACE_LEVEL_CRITICAL, TB_CORE, "DriverEntry..." );
@@ -79,6 +168,12 @@ DriverEntry (
             __leave;
         }
 
+        status = MemSlabInitialize();
+        if ( !NT_SUCCESS( status ) )
+        {
+            __leave;
+        }
+
         GlobalData.m_ProcessHelper = new (
             PagedPool,
             ProcessHelper::m_AllocTag
@@ -112,9 +207,13 @@ DriverEntry (
             __leave;
         }
 
+        FltQuotas quotalimits;
+        QueryQuotaLimits( RegistryPath, &quotalimits );
+
         status = ChannelInitPort(
             GlobalData.m_ProcessHelper,
-            GlobalData.m_FilteringSystem
+            GlobalData.m_FilteringSystem,
+            &quotalimits
             );
 
         if ( !NT_SUCCESS( status ) )
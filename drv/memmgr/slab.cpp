@@ -0,0 +1,357 @@
+#include "../inc/commonkrnl.h"
+#include "../inc/memmgr.h"
+
+#define MEM_SLAB_TAG            'sbSA'
+#define MEM_SLAB_POOL           MEM_SLAB_CLASSES    // class of blocks from pool
+#define MEM_SLAB_CPUS           64
+
+// payload stays 16 byte aligned
+typedef struct _MemSlabHeader
+{
+    ULONG               m_Tag;
+    ULONG               m_Class;
+    ULONG64             m_Reserved;
+} MemSlabHeader, *PMemSlabHeader;
+
+// counters by tag slot are touched by one processor mostly, a thread
+// moved to another processor meanwhile still counts right
+typedef struct DECLSPEC_CACHEALIGN _MemSlabCpu
+{
+    PAGED_LOOKASIDE_LIST m_Lists[ MEM_SLAB_CLASSES ];
+    volatile LONG       m_Live[ MEM_SLAB_TAGS ];    // not folded into the tag yet
+    volatile LONG64     m_PoolAllocations[ MEM_SLAB_TAGS ];
+} MemSlabCpu, *PMemSlabCpu;
+
+// processors fold live counts by MEM_SLAB_BATCH, peak is raised on fold
+typedef struct DECLSPEC_CACHEALIGN _MemSlabTag
+{
+    volatile LONG       m_Tag;
+    volatile LONG       m_Live;
+    volatile LONG       m_Peak;
+    volatile LONG64     m_PoolAllocations;      // without initialized slab
+} MemSlabTag, *PMemSlabTag;
+
+PMemSlabCpu gSlabCpus = NULL;
+ULONG gSlabCpusCount = 0;
+MemSlabTag gSlabTags[ MEM_SLAB_TAGS ];
+
+ULONG
+MemSlabGetClassp (
+    __in SIZE_T Size
+    )
+{
+    ULONG slabclass = 0;
+    while (
+        slabclass < MEM_SLAB_CLASSES
+        &&
+        ( (SIZE_T) 1 << ( slabclass + MEM_SLAB_MIN_SHIFT ) ) < Size
+        )
+    {
+        slabclass++;
+    }
+
+    return slabclass;
+}
+
+PMemSlabTag
+MemSlabGetTagp (
+    __in ULONG Tag
+    )
+{
+    // tags differ in high bytes ('xxSA')
+    ULONG slot = ( Tag * 0x9e3779b1 ) >> 16;
+
+    for ( ULONG probe = 0; probe < MEM_SLAB_TAGS; probe++ )
+    {
+        PMemSlabTag pTag = &gSlabTags[ ( slot + probe ) % MEM_SLAB_TAGS ];
+
+        if ( !pTag->m_Tag )
+        {
+            InterlockedCompareExchange( &pTag->m_Tag, (LONG) Tag, 0 );
+        }
+
+        if ( (LONG) Tag == pTag->m_Tag )
+        {
+            return pTag;
+        }
+    }
+
+    // table is full - tag is not counted
+    return NULL;
+}
+
+void
+MemSlabRaisePeakp (
+    __in PMemSlabTag Tag,
+    __in LONG Live
+    )
+{
+    LONG peak = Tag->m_Peak;
+
+    while ( Live > peak )
+    {
+        LONG previous = InterlockedCompareExchange( &Tag->m_Peak, Live, peak );
+        if ( previous == peak )
+        {
+            break;
+        }
+
+        peak = previous;
+    }
+}
+
+void
+MemSlabCountp (
+    __in_opt PMemSlabCpu Cpu,
+    __in PMemSlabTag Tag,
+    __in LONG Blocks
+    )
+{
+    if ( !Cpu )
+    {
+        MemSlabRaisePeakp( Tag, InterlockedExchangeAdd( &Tag->m_Live, Blocks ) + Blocks );
+
+        return;
+    }
+
+    volatile LONG* pLive = &Cpu->m_Live[ Tag - gSlabTags ];
+    LONG delta = InterlockedExchangeAdd( pLive, Blocks ) + Blocks;
+
+    if ( delta < MEM_SLAB_BATCH && delta > -MEM_SLAB_BATCH )
+    {
+        // shared lines are only read until the peak grows
+        if ( Blocks > 0 && Tag->m_Live + delta > Tag->m_Peak )
+        {
+            MemSlabRaisePeakp( Tag, Tag->m_Live + delta );
+        }
+
+        return;
+    }
+
+    // one of racing threads folds the batch
+    if ( delta != InterlockedCompareExchange( pLive, 0, delta ) )
+    {
+        return;
+    }
+
+    LONG live = InterlockedExchangeAdd( &Tag->m_Live, delta ) + delta;
+    if ( delta > 0 )
+    {
+        MemSlabRaisePeakp( Tag, live );
+    }
+}
+
+__checkReturn
+NTSTATUS
+MemSlabInitialize (
+    )
+{
+    ASSERT( !gSlabCpus );
+
+    ULONG count = min( KeQueryActiveProcessorCount( NULL ), MEM_SLAB_CPUS );
+
+    // lookaside lists live in nonpaged memory
+    PMemSlabCpu pCpus = (PMemSlabCpu) ExAllocatePoolWithTag(
+        NonPagedPool,
+        sizeof( MemSlabCpu ) * count,
+        MEM_SLAB_TAG
+        );
+
+    if ( !pCpus )
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    for ( ULONG cpu = 0; cpu < count; cpu++ )
+    {
+        for ( ULONG slabclass = 0; slabclass < MEM_SLAB_CLASSES; slabclass++ )
+        {
+            ExInitializePagedLookasideList(
+                &pCpus[ cpu ].m_Lists[ slabclass ],
+                NULL,
+                NULL,
+                0,
+                sizeof( MemSlabHeader ) + ( (SIZE_T) 1 << ( slabclass + MEM_SLAB_MIN_SHIFT ) ),
+                MEM_SLAB_TAG,
+                0
+                );
+        }
+    }
+
+    gSlabCpusCount = count;
+
+    KeMemoryBarrier();
+    gSlabCpus = pCpus;
+
+    return STATUS_SUCCESS;
+}
+
+void
+MemSlabDestroy (
+    )
+{
+    // no allocations in flight - called on unload
+    PMemSlabCpu pCpus = gSlabCpus;
+    if ( !pCpus )
+    {
+        return;
+    }
+
+    gSlabCpus = NULL;
+    KeMemoryBarrier();
+
+    for ( ULONG cpu = 0; cpu < gSlabCpusCount; cpu++ )
+    {
+        // counts stay with the tags
+        for ( ULONG slot = 0; slot < MEM_SLAB_TAGS; slot++ )
+        {
+            gSlabTags[ slot ].m_Live += pCpus[ cpu ].m_Live[ slot ];
+            gSlabTags[ slot ].m_PoolAllocations += pCpus[ cpu ].m_PoolAllocations[ slot ];
+        }
+
+        for ( ULONG slabclass = 0; slabclass < MEM_SLAB_CLASSES; slabclass++ )
+        {
+            ExDeletePagedLookasideList( &pCpus[ cpu ].m_Lists[ slabclass ] );
+        }
+    }
+
+    gSlabCpusCount = 0;
+
+    FREE_POOL( pCpus );
+}
+
+__checkReturn
+PVOID
+MemSlabAllocate (
+    __in SIZE_T Size,
+    __in ULONG Tag
+    )
+{
+    ULONG slabclass = MemSlabGetClassp( Size );
+    PMemSlabCpu pCpus = gSlabCpus;
+    PMemSlabCpu pCpu = NULL;
+    PMemSlabHeader pHeader = NULL;
+
+    if ( pCpus )
+    {
+        pCpu = &pCpus[ KeGetCurrentProcessorNumber() % gSlabCpusCount ];
+    }
+
+    if ( MEM_SLAB_POOL != slabclass && pCpu )
+    {
+        pHeader = (PMemSlabHeader) ExAllocateFromPagedLookasideList(
+            &pCpu->m_Lists[ slabclass ]
+            );
+    }
+    else
+    {
+        slabclass = MEM_SLAB_POOL;
+
+        pHeader = (PMemSlabHeader) ExAllocatePoolWithTag(
+            PagedPool,
+            sizeof( MemSlabHeader ) + Size,
+            Tag
+            );
+    }
+
+    if ( !pHeader )
+    {
+        return NULL;
+    }
+
+    pHeader->m_Tag = Tag;
+    pHeader->m_Class = slabclass;
+
+    // counters of the current processor, shared ones once a batch
+    PMemSlabTag pTag = MemSlabGetTagp( Tag );
+    if ( pTag )
+    {
+        MemSlabCountp( pCpu, pTag, 1 );
+
+        if ( MEM_SLAB_POOL == slabclass )
+        {
+            InterlockedExchangeAdd64(
+                pCpu ? &pCpu->m_PoolAllocations[ pTag - gSlabTags ] : &pTag->m_PoolAllocations,
+                1
+                );
+        }
+    }
+
+    return pHeader + 1;
+}
+
+void
+MemSlabFree (
+    __in PVOID Block
+    )
+{
+    PMemSlabHeader pHeader = (PMemSlabHeader) Block - 1;
+
+    PMemSlabCpu pCpus = gSlabCpus;
+    PMemSlabCpu pCpu = NULL;
+
+    if ( pCpus )
+    {
+        pCpu = &pCpus[ KeGetCurrentProcessorNumber() % gSlabCpusCount ];
+    }
+
+    PMemSlabTag pTag = MemSlabGetTagp( pHeader->m_Tag );
+    if ( pTag )
+    {
+        MemSlabCountp( pCpu, pTag, -1 );
+    }
+
+    // lookaside lists allocate from pool - blocks outlive the slab
+    if ( MEM_SLAB_POOL == pHeader->m_Class || !pCpu )
+    {
+        ExFreePool( pHeader );
+
+        return;
+    }
+
+    ASSERT( pHeader->m_Class < MEM_SLAB_CLASSES );
+
+    ExFreeToPagedLookasideList( &pCpu->m_Lists[ pHeader->m_Class ], pHeader );
+}
+
+ULONG
+MemSlabQueryStatistics (
+    __out_ecount_opt(Count) PMemSlabStatistics Statistics,
+    __in ULONG Count
+    )
+{
+    ULONG tags = 0;
+    PMemSlabCpu pCpus = gSlabCpus;
+
+    for ( ULONG slot = 0; slot < MEM_SLAB_TAGS; slot++ )
+    {
+        PMemSlabTag pTag = &gSlabTags[ slot ];
+        if ( !pTag->m_Tag )
+        {
+            continue;
+        }
+
+        if ( Statistics && tags < Count )
+        {
+            PMemSlabStatistics pStatistics = &Statistics[ tags ];
+
+            pStatistics->m_Tag = (ULONG) pTag->m_Tag;
+            pStatistics->m_Live = pTag->m_Live;
+            pStatistics->m_PoolAllocations = pTag->m_PoolAllocations;
+
+            // sum is exact when no blocks are allocated meanwhile
+            for ( ULONG cpu = 0; pCpus && cpu < gSlabCpusCount; cpu++ )
+            {
+                pStatistics->m_Live += pCpus[ cpu ].m_Live[ slot ];
+                pStatistics->m_PoolAllocations += pCpus[ cpu ].m_PoolAllocations[ slot ];
+            }
+
+            MemSlabRaisePeakp( pTag, pStatistics->m_Live );
+            pStatistics->m_Peak = pTag->m_Peak;
+        }
+
+        tags++;
+    }
+
+    return tags;
+}
@@ -0,0 +1,3394 @@
+//!
+//    \description - verdict benchmark for the portable engine build.
+//                   Builds synthetic filter sets in a FiltersStorage and
+//                   measures verdicts/sec and p50/p99 latency of FilterEvent.
+//                   threads mode runs FilterEvent from 1..64 threads, with
+//                   optional writer adding and cleaning filters meanwhile.
+//                   Events repeat from a ring of 1024 - verdict cache hit
+//                   rate is reported, -m 0 measures evaluation alone.
+//                   load mode compares filter by filter loading with one
+//                   chain of all filters. groups mode measures picking
+//                   the filter of each group when every filter matches,
+//                   with cache misses per event where the processor
+//                   counters are available.
+//                   slab mode compares the slab with pool on allocations
+//                   an event makes.
+//                   verify mode checks verdicts of random sets against
+//                   the list walk, exits with 1 on a mismatch.
+//!
+
+// standard headers go first - see __try in umode/inc/fltKernel.h
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "../inc/commonkrnl.h"
+#include "../inc/memmgr.h"
+#include "../../inc/accessch.h"
+#include "../inc/fltstorage.h"
+#include "../fltsystem/fltbitmap.h"
+#include "../fltsystem/fltchecks.h"
+#include "../fltsystem/fltdag.h"
+#include "umhost.h"
+
+typedef std::chrono::steady_clock BenchClock;
+
+#define BENCH_NAME_MAX          128
+#define BENCH_EVENT_RING        1024
+#define BENCH_PID_BASE          1000
+#define BENCH_OWNER_PID         4
+#define BENCH_CHURN_PID         8
+#define BENCH_CHURN_FILTERS     16
+#define BENCH_THREADS_MAX       64
+#define BENCH_CACHE_DEFAULT     ( (ULONG) -1 )
+#define BENCH_VALUES_MAX        100000
+#define BENCH_BOX_MAX           65536
+#define BENCH_GROUPS_FILTERS    1024
+#define BENCH_SLAB_WINDOW       16      // events in flight per thread
+#define BENCH_SLAB_BLOCKS       4
+#define BENCH_GROW_PART         16      // grow - share of filters added one by one
+#define BENCH_VERIFY_SETS       8       // verify - random sets of a run
+#define BENCH_VERIFY_ROUNDS     48      // changes of a set
+#define BENCH_VERIFY_OWNERS     4       // processes owning filters of a set
+#define BENCH_VERIFY_VALUES     16      // process ids of filters and events
+#define BENCH_VERIFY_EVENTS     256     // distinct events of a set
+#define BENCH_VERIFY_STORAGES   2       // cache on, cache off
+#define BENCH_VERIFY_REPORTED   8       // mismatches printed per set
+#define BENCH_VERIFY_TAG        'vbSA'
+#define BENCH_VERIFY_ORDERED    4       // verify - kinds of random params
+#define BENCH_VERIFY_PATTERN    5
+#define BENCH_VERIFY_PREFIX     6
+#define BENCH_VERIFY_ANY        7
+#define BENCH_VERIFY_SIBLINGS   8       // dispatched checks besides the cases
+#define BENCH_PENDING_FILTERS   256     // verify - filters of a dag, added by Update
+#define BENCH_PENDING_FIRST     32      // ... after these are compiled
+#define BENCH_PENDING_EVENTS    8       // per Update and per Commit
+#define BENCH_VERIFY_CASE_EVENTS ( 6 * 4 * 3 * 3 )  // process, access, options, name
+
+enum BenchKind
+{
+    BenchKind_Equ       = 0,
+    BenchKind_And       = 1,
+    BenchKind_Pattern   = 2,
+    BenchKind_Mixed     = 3,
+    BenchKind_Range     = 4,
+    BenchKind_Prefix    = 5,
+    BenchKind_Max       = 6
+};
+
+static const char* gKindNames[ BenchKind_Max ] = { "equ", "and", "pattern", "mixed", "range", "prefix" };
+
+enum BenchMode
+{
+    BenchMode_Verdict   = 0,
+    BenchMode_Scale     = 1,
+    BenchMode_Threads   = 2,
+    BenchMode_Load      = 3,
+    BenchMode_Values    = 4,
+    BenchMode_Box       = 5,
+    BenchMode_Groups    = 6,
+    BenchMode_Slab      = 7,
+    BenchMode_Grow      = 8,
+    BenchMode_Verify    = 9,
+    BenchMode_Max       = 10
+};
+
+static const char* gModeNames[ BenchMode_Max ] = {
+    "verdict", "scale", "threads", "load", "values", "box", "groups", "slab", "grow", "verify"
+    };
+
+typedef struct _BenchOptions
+{
+    ULONG       m_Mode;
+    ULONG       m_Kind;             // BenchKind_Max - all kinds
+    ULONG       m_FiltersCount;     // 0 - default sweep
+    ULONG       m_GroupsCount;
+    ULONG       m_EventsCount;
+    ULONG       m_Seed;
+    ULONG       m_ThreadsCount;     // upper bound of threads sweep
+    BOOLEAN     m_Churn;            // writer thread in threads mode
+    ULONG       m_Cache;            // verdict cache, BENCH_CACHE_DEFAULT - by mode
+} BenchOptions, *PBenchOptions;
+
+typedef struct _BenchEventParams
+{
+    HANDLE      m_ProcessId;
+    ACCESS_MASK m_DesiredAccess;
+    ULONG       m_FileNameSize;
+    WCHAR       m_FileName[ BENCH_NAME_MAX ];
+} BenchEventParams, *PBenchEventParams;
+
+typedef struct _BenchResult
+{
+    double      m_VerdictsPerSec;
+    double      m_P50;
+    double      m_P99;
+    double      m_MatchedRatio;
+    double      m_AvoidedRatio;     // expensive fetches avoided, < 0 - none used
+    double      m_CachedRatio;      // verdicts from cache, < 0 - cache is off
+    double      m_MemoRatio;        // parameter queries served by event memo
+    LONG64      m_Evictions;
+    double      m_CacheMisses;      // per event, < 0 - no counters
+    double      m_L1Misses;         // L1 data read misses per event
+} BenchResult, *PBenchResult;
+
+typedef struct _BenchWorker
+{
+    FiltersStorage*     m_Storage;
+    PBenchEventParams   m_Events;
+    ULONG               m_First;
+    ULONG               m_EventsCount;
+    ULONG               m_Matched;
+} BenchWorker, *PBenchWorker;
+
+typedef struct _BenchSlabWorker
+{
+    BOOLEAN             m_Slab;
+    ULONG               m_EventsCount;
+    ULONG               m_Seed;
+    ULONG               m_Failed;
+} BenchSlabWorker, *PBenchSlabWorker;
+
+typedef struct _BenchChurn
+{
+    FiltersStorage*     m_Storage;
+    ULONG               m_Kind;
+    ULONG               m_FirstIndex;
+    ULONG               m_GroupsCount;
+    volatile LONG       m_Stop;
+    ULONG               m_Cycles;
+    NTSTATUS            m_Status;
+} BenchChurn, *PBenchChurn;
+
+typedef struct _BenchVerifyEventParams
+{
+    PARAMS_MASK m_Absent;           // Id2Bit of parameters the event has not
+    HANDLE      m_ProcessId;
+    ACCESS_MASK m_DesiredAccess;
+    ULONG       m_CreateOptions;
+    ULONG       m_FileNameSize;
+    WCHAR       m_FileName[ BENCH_NAME_MAX ];
+} BenchVerifyEventParams, *PBenchVerifyEventParams;
+
+typedef struct _BenchVerifyFilter
+{
+    std::vector<UCHAR>              m_Params;
+    ULONG                           m_ParamsCount;
+    UCHAR                           m_GroupId;
+    VERDICT                         m_Verdict;
+    PARAMS_MASK                     m_WishMask;
+    HANDLE                          m_ProcessId;
+    ULONG                           m_FilterId[ BENCH_VERIFY_STORAGES ];
+    std::vector<ParamCheckEntry*>   m_Checks;       // list walk reference
+} BenchVerifyFilter, *PBenchVerifyFilter;
+
+// param of a fixed case, process ids are numbers of BENCH_PID_BASE steps
+typedef struct _BenchVerifyCase
+{
+    ULONG           m_ParameterId;
+    FltOperation    m_Operation;
+    FltFlags        m_Flags;
+    ULONG           m_Count;
+    ULONG           m_Values[ 2 ];
+    const char*     m_Name;             // pattern or prefix
+} BenchVerifyCase, *PBenchVerifyCase;
+
+//////////////////////////////////////////////////////////////////////////
+
+class BenchEvent : public EventData
+{
+public:
+    BenchEvent (
+        __in PBenchEventParams Params
+        ) :
+        EventData( FILE_MINIFILTER, OP_FILE_CREATE, 0, PostProcessing ),
+        m_Params( Params )
+    {
+    }
+
+    __checkReturn
+    virtual
+    NTSTATUS
+    QueryParameter (
+        __in_opt ULONG ParameterId,
+        __drv_when(return==0, __deref_out_opt __drv_valueIs(!=0)) PVOID* Data,
+        __deref_out_opt PULONG DataSize
+        )
+    {
+        switch ( ParameterId )
+        {
+        case PARAMETER_FILE_NAME:
+            *Data = m_Params->m_FileName;
+            *DataSize = m_Params->m_FileNameSize;
+            break;
+
+        case PARAMETER_REQUESTOR_PROCESS_ID:
+            *Data = &m_Params->m_ProcessId;
+            *DataSize = sizeof( m_Params->m_ProcessId );
+            break;
+
+        case PARAMETER_DESIRED_ACCESS:
+            *Data = &m_Params->m_DesiredAccess;
+            *DataSize = sizeof( m_Params->m_DesiredAccess );
+            break;
+
+        default:
+            return STATUS_NOT_FOUND;
+        }
+
+        return STATUS_SUCCESS;
+    }
+
+private:
+    PBenchEventParams m_Params;
+};
+
+//////////////////////////////////////////////////////////////////////////
+
+ULONG
+BenchRandom (
+    __inout PULONG Seed
+    )
+{
+    *Seed = *Seed * 1103515245 + 12345;
+
+    return ( *Seed >> 8 ) & 0xffffff;
+}
+
+ULONG
+BenchFormatName (
+    __out PWCHAR Buffer,
+    __in const char* Format,
+    __in ULONG Value1,
+    __in ULONG Value2
+    )
+{
+    char name[ BENCH_NAME_MAX ];
+    int length = snprintf( name, sizeof( name ), Format, Value1, Value2 );
+
+    for ( int idx = 0; idx < length; idx++ )
+    {
+        Buffer[ idx ] = (WCHAR) name[ idx ];
+    }
+
+    return length * sizeof( WCHAR );
+}
+
+void
+BenchAppendParam (
+    __inout std::vector<UCHAR>& Buffer,
+    __in ULONG ParameterId,
+    __in FltOperation Operation,
+    __in FltFlags Flags,
+    __in ULONG Count,
+    __in const void* Data,
+    __in ULONG Size
+    )
+{
+    size_t offset = Buffer.size();
+    Buffer.resize( offset + sizeof( FltParam ) + Size );
+
+    PFltParam pParam = (PFltParam) &Buffer[ offset ];
+    pParam->m_ParameterId = ParameterId;
+    pParam->m_Operation = Operation;
+    pParam->m_Flags = Flags;
+    pParam->m_Data.m_Size = Size;
+    pParam->m_Data.m_Count = Count;
+
+    RtlCopyMemory( pParam->m_Data.m_Data, Data, Size );
+}
+
+ULONG
+BenchBuildParams (
+    __in ULONG Kind,
+    __in ULONG Index,
+    __out std::vector<UCHAR>& Params
+    )
+{
+    ULONG paramscount = 0;
+
+    // distinct value per filter - probe finds a few of many checks
+    HANDLE pid = UlongToHandle( BENCH_PID_BASE + Index * 4 );
+    ACCESS_MASK access = 1 << ( Index % 20 );
+
+    WCHAR pattern[ BENCH_NAME_MAX ];
+    ULONG patternsize = BenchFormatName(
+        pattern,
+        "*\\DIR%u\\*.EX%u",
+        Index,
+        Index % 7
+        );
+
+    if ( BenchKind_Equ == Kind || BenchKind_Mixed == Kind )
+    {
+        BenchAppendParam(
+            Params,
+            PARAMETER_REQUESTOR_PROCESS_ID,
+            FltOp_equ,
+            FltFlags_None,
+            1,
+            &pid,
+            sizeof( pid )
+            );
+
+        paramscount++;
+    }
+
+    if ( BenchKind_And == Kind || BenchKind_Mixed == Kind )
+    {
+        BenchAppendParam(
+            Params,
+            PARAMETER_DESIRED_ACCESS,
+            FltOp_and,
+            FltFlags_None,
+            1,
+            &access,
+            sizeof( access )
+            );
+
+        paramscount++;
+    }
+
+    if ( BenchKind_Range == Kind )
+    {
+        // eight process ids, access below the bit of the filter
+        HANDLE range[ 2 ] = { pid, UlongToHandle( HandleToUlong( pid ) + 7 * 4 ) };
+
+        BenchAppendParam(
+            Params,
+            PARAMETER_REQUESTOR_PROCESS_ID,
+            FltOp_range,
+            FltFlags_None,
+            2,
+            range,
+            sizeof( range )
+            );
+
+        BenchAppendParam(
+            Params,
+            PARAMETER_DESIRED_ACCESS,
+            FltOp_less,
+            FltFlags_None,
+            1,
+            &access,
+            sizeof( access )
+            );
+
+        paramscount += 2;
+    }
+
+    if ( BenchKind_Prefix == Kind )
+    {
+        // the directory of the pattern, any volume
+        WCHAR prefix[ BENCH_NAME_MAX ];
+        ULONG prefixsize = BenchFormatName(
+            prefix,
+            "\\Device\\*\\Users\\dir%u",
+            Index,
+            0
+            );
+
+        BenchAppendParam(
+            Params,
+            PARAMETER_FILE_NAME,
+            FltOp_prefix,
+            FltFlags_None,
+            1,
+            prefix,
+            prefixsize
+            );
+
+        paramscount++;
+    }
+
+    if ( BenchKind_Pattern == Kind || BenchKind_Mixed == Kind )
+    {
+        BenchAppendParam(
+            Params,
+            PARAMETER_FILE_NAME,
+            FltOp_pattern,
+            FltFlags_None,
+            1,
+            pattern,
+            patternsize
+            );
+
+        paramscount++;
+    }
+
+    return paramscount;
+}
+
+void
+BenchBuildItem (
+    __in ULONG Kind,
+    __in ULONG Index,
+    __in ULONG GroupsCount,
+    __out std::vector<UCHAR>& Params,
+    __out PFltChainItem Item
+    )
+{
+    Item->m_Interceptor = FILE_MINIFILTER;
+    Item->m_OperationId = OP_FILE_CREATE;
+    Item->m_FunctionMi = 0;
+    Item->m_OperationType = PostProcessing;
+    Item->m_GroupId = (UCHAR) ( 1 + Index % GroupsCount );
+    Item->m_Verdict = VERDICT_ASK;
+    Item->m_ProcessId = UlongToHandle( BENCH_OWNER_PID );
+    Item->m_RequestTimeout = 0;
+    Item->m_WishMask = Id2Bit( PARAMETER_FILE_NAME ) | Id2Bit( PARAMETER_REQUESTOR_PROCESS_ID );
+    Item->m_ParamsCount = BenchBuildParams( Kind, Index, Params );
+    Item->m_Params = (PFltParam) &Params[0];
+    Item->m_FilterId = 0;
+}
+
+__checkReturn
+NTSTATUS
+BenchAddFilter (
+    __in FiltersStorage* Storage,
+    __in ULONG Kind,
+    __in ULONG Index,
+    __in ULONG GroupsCount,
+    __in HANDLE OwnerId
+    )
+{
+    std::vector<UCHAR> params;
+    ULONG paramscount = BenchBuildParams( Kind, Index, params );
+
+    ULONG filterId;
+
+    Storage->Lock();
+
+    NTSTATUS status = Storage->AddFilterUnsafe(
+        FILE_MINIFILTER,
+        OP_FILE_CREATE,
+        0,
+        PostProcessing,
+        (UCHAR) ( 1 + Index % GroupsCount ),
+        VERDICT_ASK,
+        OwnerId,
+        0,
+        Id2Bit( PARAMETER_FILE_NAME ) | Id2Bit( PARAMETER_REQUESTOR_PROCESS_ID ),
+        paramscount,
+        (PFltParam) &params[0],
+        &filterId
+        );
+
+    Storage->UnLock();
+
+    return status;
+}
+
+void
+BenchGenerateEvents (
+    __out PBenchEventParams Events,
+    __in ULONG Count,
+    __in ULONG FiltersCount,
+    __in ULONG Seed
+    )
+{
+    for ( ULONG idx = 0; idx < Count; idx++ )
+    {
+        PBenchEventParams pEvent = &Events[ idx ];
+
+        // about a half of events hit a filter by each parameter
+        pEvent->m_ProcessId = UlongToHandle(
+            BENCH_PID_BASE + ( BenchRandom( &Seed ) % ( FiltersCount * 2 ) ) * 4
+            );
+
+        pEvent->m_DesiredAccess = 1 << ( BenchRandom( &Seed ) % 32 );
+
+        ULONG dir = BenchRandom( &Seed ) % ( FiltersCount * 2 );
+        pEvent->m_FileNameSize = BenchFormatName(
+            pEvent->m_FileName,
+            "\\Device\\HarddiskVolume1\\Users\\dir%u\\file.ex%u",
+            dir,
+            BenchRandom( &Seed ) % 7
+            );
+    }
+}
+
+int
+BenchCounterOpen (
+    __in ULONG Type,
+    __in ULONG64 Config
+    )
+{
+    // calling thread, user mode only. -1 when there is no PMU (virtual
+    // machines) or perf_event_paranoid forbids it
+    struct perf_event_attr attr;
+    memset( &attr, 0, sizeof( attr ) );
+
+    attr.size = sizeof( attr );
+    attr.type = Type;
+    attr.config = Config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return (int) syscall( SYS_perf_event_open, &attr, 0, -1, -1, 0 );
+}
+
+double
+BenchCounterClose (
+    __in int Counter,
+    __in ULONG EventsCount
+    )
+{
+    if ( Counter < 0 )
+    {
+        return -1;
+    }
+
+    LONG64 value = 0;
+    ioctl( Counter, PERF_EVENT_IOC_DISABLE, 0 );
+    if ( read( Counter, &value, sizeof( value ) ) != sizeof( value ) )
+    {
+        value = -1;
+    }
+
+    close( Counter );
+
+    return value < 0 ? -1 : (double) value / EventsCount;
+}
+
+void
+BenchPrintCount (
+    __in double Count
+    )
+{
+    if ( Count < 0 )
+    {
+        printf( " %10s", "n/a" );
+    }
+    else
+    {
+        printf( " %10.1f", Count );
+    }
+}
+
+void
+BenchCacheRatio (
+    __in FiltersStorage* Storage,
+    __in PBenchOptions Options,
+    __out double* CachedRatio,
+    __out PLONG64 Evictions
+    )
+{
+    FltCacheStatistics statistics;
+    Storage->QueryCacheStatistics( &statistics );
+
+    LONG64 lookups = statistics.m_Hits + statistics.m_Misses + statistics.m_Bypassed;
+
+    *CachedRatio = Options->m_Cache && lookups ? (double) statistics.m_Hits / lookups : -1;
+    *Evictions = statistics.m_Evictions;
+}
+
+void
+BenchRunEvents (
+    __in FiltersStorage* Storage,
+    __in PBenchEventParams Events,
+    __in PBenchOptions Options,
+    __out PBenchResult Result
+    )
+{
+    NTSTATUS status;
+    ULONG matched = 0;
+    LONG64 queries = 0;
+    LONG64 computed = 0;
+
+    int cachemisses = BenchCounterOpen( PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES );
+    int l1misses = BenchCounterOpen(
+        PERF_TYPE_HW_CACHE,
+        PERF_COUNT_HW_CACHE_L1D
+            | ( PERF_COUNT_HW_CACHE_OP_READ << 8 )
+            | ( PERF_COUNT_HW_CACHE_RESULT_MISS << 16 )
+        );
+
+    // throughput
+    if ( cachemisses >= 0 )
+    {
+        ioctl( cachemisses, PERF_EVENT_IOC_ENABLE, 0 );
+    }
+
+    if ( l1misses >= 0 )
+    {
+        ioctl( l1misses, PERF_EVENT_IOC_ENABLE, 0 );
+    }
+
+    BenchClock::time_point start = BenchClock::now();
+
+    for ( ULONG idx = 0; idx < Options->m_EventsCount; idx++ )
+    {
+        BenchEvent event( &Events[ idx % BENCH_EVENT_RING ] );
+
+        VERDICT verdict = VERDICT_NOT_FILTERED;
+        PARAMS_MASK mask = 0;
+
+        status = Storage->FilterEvent( &event, &verdict, &mask );
+        if ( NT_SUCCESS( status ) && verdict )
+        {
+            matched++;
+        }
+
+        ULONG eventqueries;
+        ULONG eventcomputed;
+        event.QueryMemoStatistics( &eventqueries, &eventcomputed );
+
+        queries += eventqueries;
+        computed += eventcomputed;
+    }
+
+    double elapsed = std::chrono::duration<double>( BenchClock::now() - start ).count();
+
+    Result->m_CacheMisses = BenchCounterClose( cachemisses, Options->m_EventsCount );
+    Result->m_L1Misses = BenchCounterClose( l1misses, Options->m_EventsCount );
+
+    // latency
+    std::vector<double> samples( Options->m_EventsCount );
+
+    for ( ULONG idx = 0; idx < Options->m_EventsCount; idx++ )
+    {
+        BenchClock::time_point begin = BenchClock::now();
+
+        BenchEvent event( &Events[ idx % BENCH_EVENT_RING ] );
+
+        VERDICT verdict = VERDICT_NOT_FILTERED;
+        PARAMS_MASK mask = 0;
+
+        status = Storage->FilterEvent( &event, &verdict, &mask );
+
+        samples[ idx ] = std::chrono::duration<double, std::nano>(
+            BenchClock::now() - begin
+            ).count();
+    }
+
+    std::sort( samples.begin(), samples.end() );
+
+    Result->m_VerdictsPerSec = elapsed > 0 ? Options->m_EventsCount / elapsed : 0;
+    Result->m_P50 = samples[ samples.size() / 2 ];
+    Result->m_P99 = samples[ ( samples.size() * 99 ) / 100 ];
+    Result->m_MatchedRatio = (double) matched / Options->m_EventsCount;
+    Result->m_MemoRatio = queries ? (double) ( queries - computed ) / queries : -1;
+}
+
+__checkReturn
+NTSTATUS
+BenchVerdict (
+    __in ULONG Kind,
+    __in ULONG FiltersCount,
+    __in ULONG Chained,
+    __in PBenchOptions Options,
+    __out PBenchResult Result
+    )
+{
+    NTSTATUS status = UmHostGetProcessHelper()->AddRef();
+    if ( !NT_SUCCESS( status ) )
+    {
+        return status;
+    }
+
+    FiltersStorage* pStorage = new FiltersStorage( UmHostGetProcessHelper() );
+    pStorage->ChangeCacheState( Options->m_Cache ? TRUE : FALSE );
+
+    // first filters compiled at once, the rest goes to the compiled set
+    if ( Chained )
+    {
+        std::vector< std::vector<UCHAR> > params( Chained );
+        std::vector<FltChainItem> items( Chained );
+
+        for ( ULONG idx = 0; idx < Chained; idx++ )
+        {
+            BenchBuildItem( Kind, idx, Options->m_GroupsCount, params[ idx ], &items[ idx ] );
+        }
+
+        pStorage->Lock();
+        status = pStorage->AddFiltersUnsafe( Chained, &items[0] );
+        pStorage->UnLock();
+
+        if ( !NT_SUCCESS( status ) )
+        {
+            fprintf( stderr, "add chain failed 0x%x\n", status );
+            delete pStorage;
+
+            return status;
+        }
+    }
+
+    for ( ULONG idx = Chained; idx < FiltersCount; idx++ )
+    {
+        status = BenchAddFilter(
+            pStorage,
+            Kind,
+            idx,
+            Options->m_GroupsCount,
+            UlongToHandle( BENCH_OWNER_PID )
+            );
+
+        if ( !NT_SUCCESS( status ) )
+        {
+            fprintf( stderr, "add filter %u failed 0x%x\n", idx, status );
+            delete pStorage;
+
+            return status;
+        }
+    }
+
+    std::vector<BenchEventParams> events( BENCH_EVENT_RING );
+    BenchGenerateEvents( &events[0], BENCH_EVENT_RING, FiltersCount, Options->m_Seed );
+
+    BenchRunEvents( pStorage, &events[0], Options, Result );
+
+    FltFetchStatistics statistics;
+    pStorage->QueryFetchStatistics( &statistics );
+
+    LONG64 needed = statistics.m_Fetched + statistics.m_Avoided;
+    Result->m_AvoidedRatio = needed ? (double) statistics.m_Avoided / needed : -1;
+
+    BenchCacheRatio( pStorage, Options, &Result->m_CachedRatio, &Result->m_Evictions );
+
+    delete pStorage;
+
+    return STATUS_SUCCESS;
+}
+
+void
+BenchPrintRatio (
+    __in double Ratio
+    )
+{
+    if ( Ratio < 0 )
+    {
+        printf( " %8s", "-" );
+    }
+    else
+    {
+        printf( " %7.1f%%", Ratio * 100 );
+    }
+}
+
+int
+RunVerdict (
+    __in PBenchOptions Options
+    )
+{
+    static const ULONG sweep[] = { 16, 64, 256 };
+
+    printf(
+        "%-8s %8s %6s %14s %10s %10s %8s %8s %8s %8s %8s\n",
+        "kind",
+        "filters",
+        "groups",
+        "verdicts/sec",
+        "p50 ns",
+        "p99 ns",
+        "matched",
+        "avoided",
+        "cached",
+        "memo",
+        "evicted"
+        );
+
+    for ( ULONG kind = 0; kind < BenchKind_Max; kind++ )
+    {
+        if ( Options->m_Kind != BenchKind_Max && Options->m_Kind != kind )
+        {
+            continue;
+        }
+
+        for ( ULONG cou = 0; cou < sizeof( sweep ) / sizeof( sweep[0] ); cou++ )
+        {
+            ULONG filters = Options->m_FiltersCount ? Options->m_FiltersCount : sweep[ cou ];
+
+            BenchResult result;
+            NTSTATUS status = BenchVerdict( kind, filters, 0, Options, &result );
+            if ( !NT_SUCCESS( status ) )
+            {
+                return 1;
+            }
+
+            printf(
+                "%-8s %8u %6u %14.0f %10.0f %10.0f %7.1f%%",
+                gKindNames[ kind ],
+                filters,
+                Options->m_GroupsCount,
+                result.m_VerdictsPerSec,
+                result.m_P50,
+                result.m_P99,
+                result.m_MatchedRatio * 100
+                );
+
+            // share of expensive parameter fetches skipped by cheap checks
+            BenchPrintRatio( result.m_AvoidedRatio );
+            BenchPrintRatio( result.m_CachedRatio );
+            // repeated parameter queries answered without QueryParameter
+            BenchPrintRatio( result.m_MemoRatio );
+            printf( " %8lld\n", result.m_Evictions );
+
+            if ( Options->m_FiltersCount )
+            {
+                break;
+            }
+        }
+    }
+
+    return 0;
+}
+
+int
+RunScale (
+    __in PBenchOptions Options
+    )
+{
+    // pattern and mixed sets cost a full scan per event - opt in with -k
+    static const ULONG sweep[] = { 256, 1024, 4096, 16384, 65536 };
+
+    printf(
+        "%-8s %8s %14s %10s %10s %10s %8s %8s %8s\n",
+        "kind",
+        "filters",
+        "verdicts/sec",
+        "p50 ns",
+        "p99 ns",
+        "ns/filter",
+        "x256",
+        "avoided",
+        "cached"
+        );
+
+    for ( ULONG kind = 0; kind < BenchKind_Max; kind++ )
+    {
+        if ( Options->m_Kind == BenchKind_Max )
+        {
+            if ( BenchKind_Pattern == kind || BenchKind_Mixed == kind )
+            {
+                continue;
+            }
+        }
+        else if ( Options->m_Kind != kind )
+        {
+            continue;
+        }
+
+        double base = 0;
+
+        for ( ULONG cou = 0; cou < sizeof( sweep ) / sizeof( sweep[0] ); cou++ )
+        {
+            if ( Options->m_FiltersCount && sweep[ cou ] > Options->m_FiltersCount )
+            {
+                break;
+            }
+
+            // grow - the last part added filter by filter after compile
+            ULONG chained = 0;
+            if ( BenchMode_Grow == Options->m_Mode )
+            {
+                chained = sweep[ cou ] - sweep[ cou ] / BENCH_GROW_PART;
+            }
+
+            BenchResult result;
+            NTSTATUS status = BenchVerdict( kind, sweep[ cou ], chained, Options, &result );
+            if ( !NT_SUCCESS( status ) )
+            {
+                return 1;
+            }
+
+            if ( !base )
+            {
+                base = result.m_P50;
+            }
+
+            printf(
+                "%-8s %8u %14.0f %10.0f %10.0f %10.2f %8.1f",
+                gKindNames[ kind ],
+                sweep[ cou ],
+                result.m_VerdictsPerSec,
+                result.m_P50,
+                result.m_P99,
+                result.m_P50 / sweep[ cou ],
+                result.m_P50 / base
+                );
+
+            BenchPrintRatio( result.m_AvoidedRatio );
+            BenchPrintRatio( result.m_CachedRatio );
+            printf( "\n" );
+        }
+    }
+
+    return 0;
+}
+
+void
+BenchWorkerRun (
+    __inout PBenchWorker Worker
+    )
+{
+    for ( ULONG idx = 0; idx < Worker->m_EventsCount; idx++ )
+    {
+        BenchEvent event( &Worker->m_Events[ ( Worker->m_First + idx ) % BENCH_EVENT_RING ] );
+
+        VERDICT verdict = VERDICT_NOT_FILTERED;
+        PARAMS_MASK mask = 0;
+
+        NTSTATUS status = Worker->m_Storage->FilterEvent( &event, &verdict, &mask );
+        if ( NT_SUCCESS( status ) && verdict )
+        {
+            Worker->m_Matched++;
+        }
+    }
+}
+
+void
+BenchChurnRun (
+    __inout PBenchChurn Churn
+    )
+{
+    // filters of a short living client: added one by one, removed at once
+    // by process exit. Readers see new snapshots and retired blocks
+    while ( !Churn->m_Stop )
+    {
+        for ( ULONG idx = 0; idx < BENCH_CHURN_FILTERS; idx++ )
+        {
+            NTSTATUS status = BenchAddFilter(
+                Churn->m_Storage,
+                Churn->m_Kind,
+                Churn->m_FirstIndex + idx,
+                Churn->m_GroupsCount,
+                UlongToHandle( BENCH_CHURN_PID )
+                );
+
+            if ( !NT_SUCCESS( status ) )
+            {
+                Churn->m_Status = status;
+                return;
+            }
+        }
+
+        FiltersStorage::ExitProcessCb( UlongToHandle( BENCH_CHURN_PID ), Churn->m_Storage );
+        Churn->m_Cycles++;
+    }
+}
+
+__checkReturn
+NTSTATUS
+BenchThreads (
+    __in ULONG Kind,
+    __in ULONG FiltersCount,
+    __in ULONG ThreadsCount,
+    __in PBenchOptions Options,
+    __out double* VerdictsPerSec,
+    __out double* MatchedRatio,
+    __out double* CachedRatio,
+    __out PULONG ChurnCycles
+    )
+{
+    NTSTATUS status = UmHostGetProcessHelper()->AddRef();
+    if ( !NT_SUCCESS( status ) )
+    {
+        return status;
+    }
+
+    FiltersStorage* pStorage = new FiltersStorage( UmHostGetProcessHelper() );
+    pStorage->ChangeCacheState( Options->m_Cache ? TRUE : FALSE );
+
+    for ( ULONG idx = 0; idx < FiltersCount; idx++ )
+    {
+        status = BenchAddFilter(
+            pStorage,
+            Kind,
+            idx,
+            Options->m_GroupsCount,
+            UlongToHandle( BENCH_OWNER_PID )
+            );
+
+        if ( !NT_SUCCESS( status ) )
+        {
+            fprintf( stderr, "add filter %u failed 0x%x\n", idx, status );
+            delete pStorage;
+
+            return status;
+        }
+    }
+
+    std::vector<BenchEventParams> events( BENCH_EVENT_RING );
+    BenchGenerateEvents( &events[0], BENCH_EVENT_RING, FiltersCount, Options->m_Seed );
+
+    // the same total work split between threads
+    std::vector<BenchWorker> workers( ThreadsCount );
+    for ( ULONG idx = 0; idx < ThreadsCount; idx++ )
+    {
+        workers[ idx ].m_Storage = pStorage;
+        workers[ idx ].m_Events = &events[0];
+        workers[ idx ].m_First = idx * ( BENCH_EVENT_RING / ThreadsCount );
+        workers[ idx ].m_EventsCount = Options->m_EventsCount / ThreadsCount;
+        workers[ idx ].m_Matched = 0;
+    }
+
+    BenchChurn churn;
+    churn.m_Storage = pStorage;
+    churn.m_Kind = Kind;
+    churn.m_FirstIndex = FiltersCount;
+    churn.m_GroupsCount = Options->m_GroupsCount;
+    churn.m_Stop = 0;
+    churn.m_Cycles = 0;
+    churn.m_Status = STATUS_SUCCESS;
+
+    std::thread writer;
+    if ( Options->m_Churn )
+    {
+        writer = std::thread( BenchChurnRun, &churn );
+    }
+
+    BenchClock::time_point start = BenchClock::now();
+
+    std::vector<std::thread> threads;
+    for ( ULONG idx = 0; idx < ThreadsCount; idx++ )
+    {
+        threads.push_back( std::thread( BenchWorkerRun, &workers[ idx ] ) );
+    }
+
+    ULONG total = 0;
+    ULONG matched = 0;
+    for ( ULONG idx = 0; idx < ThreadsCount; idx++ )
+    {
+        threads[ idx ].join();
+
+        total += workers[ idx ].m_EventsCount;
+        matched += workers[ idx ].m_Matched;
+    }
+
+    double elapsed = std::chrono::duration<double>( BenchClock::now() - start ).count();
+
+    if ( Options->m_Churn )
+    {
+        InterlockedExchange( &churn.m_Stop, 1 );
+        writer.join();
+    }
+
+    LONG64 evictions;
+    BenchCacheRatio( pStorage, Options, CachedRatio, &evictions );
+
+    delete pStorage;
+
+    if ( !NT_SUCCESS( churn.m_Status ) )
+    {
+        fprintf( stderr, "churn failed 0x%x\n", churn.m_Status );
+
+        return churn.m_Status;
+    }
+
+    *VerdictsPerSec = elapsed > 0 ? total / elapsed : 0;
+    *MatchedRatio = total ? (double) matched / total : 0;
+    *ChurnCycles = churn.m_Cycles;
+
+    return STATUS_SUCCESS;
+}
+
+int
+RunThreads (
+    __in PBenchOptions Options
+    )
+{
+    ULONG kind = BenchKind_Max == Options->m_Kind ? BenchKind_Mixed : Options->m_Kind;
+    ULONG filters = Options->m_FiltersCount ? Options->m_FiltersCount : 256;
+
+    printf(
+        "%-8s %8s %8s %14s %8s %8s %8s %8s\n",
+        "kind",
+        "filters",
+        "threads",
+        "verdicts/sec",
+        "x1",
+        "matched",
+        "cached",
+        "churn"
+        );
+
+    double base = 0;
+
+    for ( ULONG threads = 1; threads <= Options->m_ThreadsCount; threads *= 2 )
+    {
+        double rate;
+        double matched;
+        double cached;
+        ULONG cycles;
+
+        NTSTATUS status = BenchThreads(
+            kind,
+            filters,
+            threads,
+            Options,
+            &rate,
+            &matched,
+            &cached,
+            &cycles
+            );
+
+        if ( !NT_SUCCESS( status ) )
+        {
+            return 1;
+        }
+
+        if ( !base )
+        {
+            base = rate;
+        }
+
+        printf(
+            "%-8s %8u %8u %14.0f %8.2f %7.1f%%",
+            gKindNames[ kind ],
+            filters,
+            threads,
+            rate,
+            base ? rate / base : 0,
+            matched * 100
+            );
+
+        BenchPrintRatio( cached );
+
+        if ( Options->m_Churn )
+        {
+            printf( " %8u\n", cycles );
+        }
+        else
+        {
+            printf( " %8s\n", "-" );
+        }
+    }
+
+    return 0;
+}
+
+__checkReturn
+NTSTATUS
+BenchLoad (
+    __in ULONG Kind,
+    __in ULONG FiltersCount,
+    __in PBenchOptions Options,
+    __in BOOLEAN Chain,
+    __out double* Seconds
+    )
+{
+    NTSTATUS status = UmHostGetProcessHelper()->AddRef();
+    if ( !NT_SUCCESS( status ) )
+    {
+        return status;
+    }
+
+    FiltersStorage* pStorage = new FiltersStorage( UmHostGetProcessHelper() );
+
+    // parameters are prepared before timing - measures storage only
+    std::vector< std::vector<UCHAR> > params( FiltersCount );
+    std::vector<FltChainItem> items( FiltersCount );
+
+    for ( ULONG idx = 0; idx < FiltersCount; idx++ )
+    {
+        BenchBuildItem( Kind, idx, Options->m_GroupsCount, params[ idx ], &items[ idx ] );
+    }
+
+    BenchClock::time_point start = BenchClock::now();
+
+    if ( Chain )
+    {
+        pStorage->Lock();
+        status = pStorage->AddFiltersUnsafe( FiltersCount, &items[0] );
+        pStorage->UnLock();
+    }
+    else
+    {
+        // as many requests as filters - lock is taken per filter
+        for ( ULONG idx = 0; idx < FiltersCount && NT_SUCCESS( status ); idx++ )
+        {
+            pStorage->Lock();
+            status = pStorage->AddFiltersUnsafe( 1, &items[ idx ] );
+            pStorage->UnLock();
+        }
+    }
+
+    *Seconds = std::chrono::duration<double>( BenchClock::now() - start ).count();
+
+    delete pStorage;
+
+    return status;
+}
+
+int
+RunLoad (
+    __in PBenchOptions Options
+    )
+{
+    static const ULONG sweep[] = { 1000, 10000, 30000, 100000 };
+
+    printf(
+        "%-8s %8s %12s %12s %8s\n",
+        "kind",
+        "filters",
+        "single ms",
+        "chain ms",
+        "speedup"
+        );
+
+    for ( ULONG kind = 0; kind < BenchKind_Max; kind++ )
+    {
+        if ( Options->m_Kind != BenchKind_Max && Options->m_Kind != kind )
+        {
+            continue;
+        }
+
+        for ( ULONG cou = 0; cou < sizeof( sweep ) / sizeof( sweep[0] ); cou++ )
+        {
+            if ( Options->m_FiltersCount && sweep[ cou ] > Options->m_FiltersCount )
+            {
+                break;
+            }
+
+            double single;
+            double chain;
+
+            NTSTATUS status = BenchLoad( kind, sweep[ cou ], Options, FALSE, &single );
+            if ( NT_SUCCESS( status ) )
+            {
+                status = BenchLoad( kind, sweep[ cou ], Options, TRUE, &chain );
+            }
+
+            if ( !NT_SUCCESS( status ) )
+            {
+                fprintf( stderr, "load failed 0x%x\n", status );
+                return 1;
+            }
+
+            printf(
+                "%-8s %8u %12.2f %12.2f %8.1f\n",
+                gKindNames[ kind ],
+                sweep[ cou ],
+                single * 1000,
+                chain * 1000,
+                chain > 0 ? single / chain : 0
+                );
+        }
+    }
+
+    return 0;
+}
+
+__checkReturn
+NTSTATUS
+BenchValues (
+    __in ULONG ValuesCount,
+    __in BOOLEAN Box,
+    __in PBenchOptions Options,
+    __out PBenchResult Result
+    )
+{
+    NTSTATUS status = UmHostGetProcessHelper()->AddRef();
+    if ( !NT_SUCCESS( status ) )
+    {
+        return status;
+    }
+
+    FiltersStorage* pStorage = new FiltersStorage( UmHostGetProcessHelper() );
+    pStorage->ChangeCacheState( Options->m_Cache ? TRUE : FALSE );
+
+    // allow-list of process ids in random order
+    ULONG seed = Options->m_Seed;
+    std::vector<HANDLE> values( ValuesCount );
+
+    for ( ULONG idx = 0; idx < ValuesCount; idx++ )
+    {
+        values[ idx ] = UlongToHandle( BENCH_PID_BASE + idx * 4 );
+    }
+
+    for ( ULONG idx = ValuesCount - 1; idx > 0; idx-- )
+    {
+        std::swap( values[ idx ], values[ BenchRandom( &seed ) % ( idx + 1 ) ] );
+    }
+
+    std::vector<UCHAR> params;
+    BenchAppendParam(
+        params,
+        PARAMETER_REQUESTOR_PROCESS_ID,
+        FltOp_equ,
+        FltFlags_None,
+        ValuesCount,
+        &values[0],
+        ValuesCount * sizeof( HANDLE )
+        );
+
+    GUID guid = { 0x62656e63, 0, 0, { 0 } };
+
+    pStorage->Lock();
+
+    if ( Box )
+    {
+        // box item is checked by FltFindValue, filters share equ index
+        ULONG position;
+
+        status = pStorage->CreateBoxUnsafe( &guid, 1, (PFltParam) &params[0], &position );
+        if ( NT_SUCCESS( status ) )
+        {
+            ULONG bitmask = 1 << position;
+
+            params.clear();
+            BenchAppendParam(
+                params,
+                PARAMETER_EXT_BOX_FILTERS,
+                FltOp_equ,
+                FltFlags_None,
+                1,
+                &guid,
+                sizeof( guid )
+                );
+
+            params.resize( params.size() + 2 * sizeof( ULONG ) );
+
+            PFltParam pParam = (PFltParam) &params[0];
+            pParam->m_Data.m_Size = sizeof( FltBoxControl );
+            pParam->m_Data.m_Box->m_BitCount = 32;
+            pParam->m_Data.m_Box->m_BitMask[0] = bitmask;
+        }
+    }
+
+    ULONG filterId;
+    if ( NT_SUCCESS( status ) )
+    {
+        status = pStorage->AddFilterUnsafe(
+            FILE_MINIFILTER,
+            OP_FILE_CREATE,
+            0,
+            PostProcessing,
+            1,
+            VERDICT_ASK,
+            UlongToHandle( BENCH_OWNER_PID ),
+            0,
+            Id2Bit( PARAMETER_REQUESTOR_PROCESS_ID ),
+            1,
+            (PFltParam) &params[0],
+            &filterId
+            );
+    }
+
+    pStorage->UnLock();
+
+    if ( !NT_SUCCESS( status ) )
+    {
+        fprintf( stderr, "add filter failed 0x%x\n", status );
+        delete pStorage;
+
+        return status;
+    }
+
+    // a half of events are in the list
+    std::vector<BenchEventParams> events( BENCH_EVENT_RING );
+    BenchGenerateEvents( &events[0], BENCH_EVENT_RING, 1, Options->m_Seed );
+
+    for ( ULONG idx = 0; idx < BENCH_EVENT_RING; idx++ )
+    {
+        events[ idx ].m_ProcessId = UlongToHandle(
+            BENCH_PID_BASE + ( BenchRandom( &seed ) % ( ValuesCount * 2 ) ) * 4
+            );
+    }
+
+    BenchRunEvents( pStorage, &events[0], Options, Result );
+
+    if ( Box )
+    {
+        pStorage->Lock();
+        status = pStorage->ReleaseBoxUnsafe( &guid );
+        pStorage->UnLock();
+    }
+
+    delete pStorage;
+
+    return status;
+}
+
+int
+RunValues (
+    __in PBenchOptions Options
+    )
+{
+    static const ULONG sweep[] = { 1, 4, 16, 64, 256, 1024, 4096, 16384, BENCH_VALUES_MAX };
+
+    printf(
+        "%8s %14s %10s %14s %10s %8s\n",
+        "values",
+        "box v/sec",
+        "box p50",
+        "filter v/sec",
+        "filter p50",
+        "matched"
+        );
+
+    for ( ULONG cou = 0; cou < sizeof( sweep ) / sizeof( sweep[0] ); cou++ )
+    {
+        ULONG values = Options->m_FiltersCount ? Options->m_FiltersCount : sweep[ cou ];
+        if ( values > BENCH_VALUES_MAX )
+        {
+            fprintf( stderr, "values count is limited by %u\n", BENCH_VALUES_MAX );
+            return 1;
+        }
+
+        BenchResult box;
+        BenchResult filter;
+
+        NTSTATUS status = BenchValues( values, TRUE, Options, &box );
+        if ( NT_SUCCESS( status ) )
+        {
+            status = BenchValues( values, FALSE, Options, &filter );
+        }
+
+        if ( !NT_SUCCESS( status ) )
+        {
+            return 1;
+        }
+
+        printf(
+            "%8u %14.0f %10.0f %14.0f %10.0f %7.1f%%\n",
+            values,
+            box.m_VerdictsPerSec,
+            box.m_P50,
+            filter.m_VerdictsPerSec,
+            filter.m_P50,
+            box.m_MatchedRatio * 100
+            );
+
+        if ( Options->m_FiltersCount )
+        {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+__checkReturn
+NTSTATUS
+BenchBox (
+    __in ULONG MasksCount,
+    __in PBenchOptions Options,
+    __out PBenchResult Result
+    )
+{
+    NTSTATUS status = UmHostGetProcessHelper()->AddRef();
+    if ( !NT_SUCCESS( status ) )
+    {
+        return status;
+    }
+
+    FiltersStorage* pStorage = new FiltersStorage( UmHostGetProcessHelper() );
+    pStorage->ChangeCacheState( Options->m_Cache ? TRUE : FALSE );
+
+    GUID guid = { 0x62656e64, 0, 0, { 0 } };
+    std::vector<ULONG> bitmask( ( MasksCount + 31 ) / 32 );
+
+    pStorage->Lock();
+
+    // extensions of events are ex0..ex6, first masks hit them
+    for ( ULONG idx = 0; idx < MasksCount && NT_SUCCESS( status ); idx++ )
+    {
+        WCHAR mask[ BENCH_NAME_MAX ];
+        ULONG masksize = BenchFormatName( mask, "*\\FILE.EX%u", idx + 3, 0 );
+
+        std::vector<UCHAR> params;
+        BenchAppendParam(
+            params,
+            PARAMETER_FILE_NAME,
+            FltOp_pattern,
+            FltFlags_None,
+            1,
+            mask,
+            masksize
+            );
+
+        ULONG position;
+        status = pStorage->CreateBoxUnsafe( &guid, 1, (PFltParam) &params[0], &position );
+        if ( NT_SUCCESS( status ) )
+        {
+            bitmask[ position / 32 ] |= 1 << ( position % 32 );
+        }
+    }
+
+    std::vector<UCHAR> params;
+    BenchAppendParam(
+        params,
+        PARAMETER_EXT_BOX_FILTERS,
+        FltOp_equ,
+        FltFlags_None,
+        1,
+        &guid,
+        sizeof( guid )
+        );
+
+    params.resize( params.size() + bitmask.size() * sizeof( ULONG ) + sizeof( ULONG ) );
+
+    PFltParam pParam = (PFltParam) &params[0];
+    pParam->m_Data.m_Size = (ULONG) ( FIELD_OFFSET( FltBoxControl, m_BitMask ) + bitmask.size() * sizeof( ULONG ) );
+    pParam->m_Data.m_Box->m_BitCount = (ULONG) bitmask.size() * 32;
+    RtlCopyMemory( pParam->m_Data.m_Box->m_BitMask, &bitmask[0], bitmask.size() * sizeof( ULONG ) );
+
+    ULONG filterId;
+    if ( NT_SUCCESS( status ) )
+    {
+        status = pStorage->AddFilterUnsafe(
+            FILE_MINIFILTER,
+            OP_FILE_CREATE,
+            0,
+            PostProcessing,
+            1,
+            VERDICT_ASK,
+            UlongToHandle( BENCH_OWNER_PID ),
+            0,
+            Id2Bit( PARAMETER_FILE_NAME ),
+            1,
+            (PFltParam) &params[0],
+            &filterId
+            );
+    }
+
+    pStorage->UnLock();
+
+    if ( NT_SUCCESS( status ) )
+    {
+        std::vector<BenchEventParams> events( BENCH_EVENT_RING );
+        BenchGenerateEvents( &events[0], BENCH_EVENT_RING, 1, Options->m_Seed );
+
+        BenchRunEvents( pStorage, &events[0], Options, Result );
+    }
+    else
+    {
+        fprintf( stderr, "add box failed 0x%x\n", status );
+    }
+
+    pStorage->Lock();
+    NTSTATUS statusRelease = pStorage->ReleaseBoxUnsafe( &guid );
+    pStorage->UnLock();
+
+    if ( NT_SUCCESS( status ) )
+    {
+        status = statusRelease;
+    }
+
+    delete pStorage;
+
+    return status;
+}
+
+int
+RunBox (
+    __in PBenchOptions Options
+    )
+{
+    static const ULONG sweep[] = { 16, 256, 1024, 5000 };
+
+    printf( "%8s %14s %10s %10s %8s\n", "masks", "verdicts/sec", "p50 ns", "p99 ns", "matched" );
+
+    for ( ULONG cou = 0; cou < sizeof( sweep ) / sizeof( sweep[0] ); cou++ )
+    {
+        ULONG masks = Options->m_FiltersCount ? Options->m_FiltersCount : sweep[ cou ];
+        if ( masks > BENCH_BOX_MAX )
+        {
+            fprintf( stderr, "masks count is limited by %u\n", BENCH_BOX_MAX );
+            return 1;
+        }
+
+        BenchResult result;
+        if ( !NT_SUCCESS( BenchBox( masks, Options, &result ) ) )
+        {
+            return 1;
+        }
+
+        printf(
+            "%8u %14.0f %10.0f %10.0f %7.1f%%\n",
+            masks,
+            result.m_VerdictsPerSec,
+            result.m_P50,
+            result.m_P99,
+            result.m_MatchedRatio * 100
+            );
+
+        if ( Options->m_FiltersCount )
+        {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+__checkReturn
+NTSTATUS
+BenchGroups (
+    __in ULONG FiltersCount,
+    __in ULONG GroupsCount,
+    __in PBenchOptions Options,
+    __out PBenchResult Result
+    )
+{
+    NTSTATUS status = UmHostGetProcessHelper()->AddRef();
+    if ( !NT_SUCCESS( status ) )
+    {
+        return status;
+    }
+
+    FiltersStorage* pStorage = new FiltersStorage( UmHostGetProcessHelper() );
+    pStorage->ChangeCacheState( Options->m_Cache ? TRUE : FALSE );
+
+    // one shared check matches every event, groups interleave by position
+    WCHAR mask[ BENCH_NAME_MAX ];
+    ULONG masksize = BenchFormatName( mask, "*", 0, 0 );
+
+    std::vector<UCHAR> params;
+    BenchAppendParam(
+        params,
+        PARAMETER_FILE_NAME,
+        FltOp_pattern,
+        FltFlags_None,
+        1,
+        mask,
+        masksize
+        );
+
+    std::vector<FltChainItem> items( FiltersCount );
+
+    for ( ULONG idx = 0; idx < FiltersCount; idx++ )
+    {
+        PFltChainItem pItem = &items[ idx ];
+
+        pItem->m_Interceptor = FILE_MINIFILTER;
+        pItem->m_OperationId = OP_FILE_CREATE;
+        pItem->m_FunctionMi = 0;
+        pItem->m_OperationType = PostProcessing;
+        pItem->m_GroupId = (UCHAR) ( 1 + idx % GroupsCount );
+        pItem->m_Verdict = VERDICT_ASK;
+        pItem->m_ProcessId = UlongToHandle( BENCH_OWNER_PID );
+        pItem->m_RequestTimeout = 0;
+        pItem->m_WishMask = Id2Bit( PARAMETER_FILE_NAME );
+        pItem->m_ParamsCount = 1;
+        pItem->m_Params = (PFltParam) &params[0];
+        pItem->m_FilterId = 0;
+    }
+
+    pStorage->Lock();
+    status = pStorage->AddFiltersUnsafe( FiltersCount, &items[0] );
+    pStorage->UnLock();
+
+    if ( NT_SUCCESS( status ) )
+    {
+        std::vector<BenchEventParams> events( BENCH_EVENT_RING );
+        BenchGenerateEvents( &events[0], BENCH_EVENT_RING, FiltersCount, Options->m_Seed );
+
+        BenchRunEvents( pStorage, &events[0], Options, Result );
+    }
+    else
+    {
+        fprintf( stderr, "add filters failed 0x%x\n", status );
+    }
+
+    delete pStorage;
+
+    return status;
+}
+
+int
+RunGroups (
+    __in PBenchOptions Options
+    )
+{
+    // group id is UCHAR and not 0 - 255 is the most a set can have
+    static const ULONG sweep[] = { 1, 16, 255 };
+
+    ULONG filters = Options->m_FiltersCount ? Options->m_FiltersCount : BENCH_GROUPS_FILTERS;
+
+    printf(
+        "%8s %6s %14s %10s %10s %8s %10s %10s\n",
+        "filters",
+        "groups",
+        "verdicts/sec",
+        "p50 ns",
+        "p99 ns",
+        "matched",
+        "misses/ev",
+        "l1d/ev"
+        );
+
+    for ( ULONG cou = 0; cou < sizeof( sweep ) / sizeof( sweep[0] ); cou++ )
+    {
+        BenchResult result;
+        if ( !NT_SUCCESS( BenchGroups( filters, sweep[ cou ], Options, &result ) ) )
+        {
+            return 1;
+        }
+
+        printf(
+            "%8u %6u %14.0f %10.0f %10.0f %7.1f%%",
+            filters,
+            sweep[ cou ],
+            result.m_VerdictsPerSec,
+            result.m_P50,
+            result.m_P99,
+            result.m_MatchedRatio * 100
+            );
+
+        BenchPrintCount( result.m_CacheMisses );
+        BenchPrintCount( result.m_L1Misses );
+        printf( "\n" );
+    }
+
+    return 0;
+}
+
+// blocks of an event: queued item, message, aggregation items, bitmap
+static const ULONG gSlabTags[ BENCH_SLAB_BLOCKS ] = { 'iqSA', 'gmSA', 'gaSA', 'mbSA' };
+
+ULONG
+BenchSlabSize (
+    __in ULONG Block,
+    __inout PULONG Seed
+    )
+{
+    switch ( Block )
+    {
+    case 0:
+        // QueuedItem, channel is not in portable build
+        return 64;
+
+    case 1:
+        return 256 + BenchRandom( Seed ) % ( DRV_EVENT_CONTENT_SIZE - 256 );
+
+    case 2:
+        return sizeof( AggregationItem ) * ( AGGREGATION_INLINE_ITEMS + 1 + BenchRandom( Seed ) % 12 );
+
+    default:
+        break;
+    }
+
+    return sizeof( ULONG64 ) * ( FLT_BITMAP_INLINE_WORDS + 1 + BenchRandom( Seed ) % 60 );
+}
+
+void
+BenchSlabRun (
+    __inout PBenchSlabWorker Worker
+    )
+{
+    PVOID window[ BENCH_SLAB_WINDOW ][ BENCH_SLAB_BLOCKS ];
+    RtlZeroMemory( window, sizeof( window ) );
+
+    for ( ULONG idx = 0; idx < Worker->m_EventsCount + BENCH_SLAB_WINDOW; idx++ )
+    {
+        PVOID* pBlocks = window[ idx % BENCH_SLAB_WINDOW ];
+
+        // the oldest event in flight completes
+        for ( ULONG block = 0; block < BENCH_SLAB_BLOCKS; block++ )
+        {
+            if ( !pBlocks[ block ] )
+            {
+                continue;
+            }
+
+            if ( Worker->m_Slab )
+            {
+                MemSlabFree( pBlocks[ block ] );
+            }
+            else
+            {
+                ExFreePool( pBlocks[ block ] );
+            }
+
+            pBlocks[ block ] = NULL;
+        }
+
+        if ( idx >= Worker->m_EventsCount )
+        {
+            continue;
+        }
+
+        for ( ULONG block = 0; block < BENCH_SLAB_BLOCKS; block++ )
+        {
+            ULONG size = BenchSlabSize( block, &Worker->m_Seed );
+
+            pBlocks[ block ] = Worker->m_Slab
+                ? MemSlabAllocate( size, gSlabTags[ block ] )
+                : ExAllocatePoolWithTag( PagedPool, size, gSlabTags[ block ] );
+
+            if ( !pBlocks[ block ] )
+            {
+                Worker->m_Failed++;
+            }
+        }
+    }
+}
+
+double
+BenchSlab (
+    __in BOOLEAN Slab,
+    __in ULONG ThreadsCount,
+    __in PBenchOptions Options
+    )
+{
+    // the same total work split between threads
+    std::vector<BenchSlabWorker> workers( ThreadsCount );
+    for ( ULONG idx = 0; idx < ThreadsCount; idx++ )
+    {
+        workers[ idx ].m_Slab = Slab;
+        workers[ idx ].m_EventsCount = Options->m_EventsCount / ThreadsCount;
+        workers[ idx ].m_Seed = Options->m_Seed + idx;
+        workers[ idx ].m_Failed = 0;
+    }
+
+    BenchClock::time_point start = BenchClock::now();
+
+    std::vector<std::thread> threads;
+    for ( ULONG idx = 0; idx < ThreadsCount; idx++ )
+    {
+        threads.push_back( std::thread( BenchSlabRun, &workers[ idx ] ) );
+    }
+
+    ULONG total = 0;
+    for ( ULONG idx = 0; idx < ThreadsCount; idx++ )
+    {
+        threads[ idx ].join();
+
+        total += workers[ idx ].m_EventsCount;
+
+        if ( workers[ idx ].m_Failed )
+        {
+            fprintf( stderr, "%u allocations failed\n", workers[ idx ].m_Failed );
+        }
+    }
+
+    double elapsed = std::chrono::duration<double>( BenchClock::now() - start ).count();
+
+    return elapsed > 0 ? total / elapsed : 0;
+}
+
+int
+RunSlab (
+    __in PBenchOptions Options
+    )
+{
+    printf( "%8s %14s %14s %8s\n", "threads", "pool events/s", "slab events/s", "x pool" );
+
+    for ( ULONG threads = 1; threads <= Options->m_ThreadsCount; threads *= 2 )
+    {
+        double pool = BenchSlab( FALSE, threads, Options );
+        double slab = BenchSlab( TRUE, threads, Options );
+
+        printf( "%8u %14.0f %14.0f %8.2f\n", threads, pool, slab, pool > 0 ? slab / pool : 0 );
+    }
+
+    MemSlabStatistics statistics[ MEM_SLAB_TAGS ];
+    ULONG tags = min( MemSlabQueryStatistics( statistics, MEM_SLAB_TAGS ), MEM_SLAB_TAGS );
+
+    printf( "\n%-6s %8s %8s %14s\n", "tag", "live", "peak", "from pool" );
+
+    for ( ULONG idx = 0; idx < tags; idx++ )
+    {
+        PMemSlabStatistics pStatistics = &statistics[ idx ];
+
+        // bytes in memory order, as pool tag tools show them
+        ULONG tag = pStatistics->m_Tag;
+
+        printf(
+            "%c%c%c%c   %8d %8d %14lld\n",
+            (char) tag,
+            (char) ( tag >> 8 ),
+            (char) ( tag >> 16 ),
+            (char) ( tag >> 24 ),
+            pStatistics->m_Live,
+            pStatistics->m_Peak,
+            pStatistics->m_PoolAllocations
+            );
+    }
+
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// verify - FilterEvent of storages with cache on and off against the list
+// walk: filter matches when CheckEntry passes for each of its params
+
+class BenchVerifyEvent : public EventData
+{
+public:
+    BenchVerifyEvent (
+        __in PBenchVerifyEventParams Params
+        ) :
+        EventData( FILE_MINIFILTER, OP_FILE_CREATE, 0, PostProcessing ),
+        m_Params( Params )
+    {
+    }
+
+    __checkReturn
+    virtual
+    NTSTATUS
+    QueryParameter (
+        __in_opt ULONG ParameterId,
+        __drv_when(return==0, __deref_out_opt __drv_valueIs(!=0)) PVOID* Data,
+        __deref_out_opt PULONG DataSize
+        )
+    {
+        if ( ParameterId > PARAMETER_MAXIMUM || FlagOn( m_Params->m_Absent, Id2Bit( ParameterId ) ) )
+        {
+            return STATUS_NOT_FOUND;
+        }
+
+        switch ( ParameterId )
+        {
+        case PARAMETER_FILE_NAME:
+            *Data = m_Params->m_FileName;
+            *DataSize = m_Params->m_FileNameSize;
+            break;
+
+        case PARAMETER_REQUESTOR_PROCESS_ID:
+            *Data = &m_Params->m_ProcessId;
+            *DataSize = sizeof( m_Params->m_ProcessId );
+            break;
+
+        case PARAMETER_DESIRED_ACCESS:
+            *Data = &m_Params->m_DesiredAccess;
+            *DataSize = sizeof( m_Params->m_DesiredAccess );
+            break;
+
+        case PARAMETER_CREATE_OPTIONS:
+            *Data = &m_Params->m_CreateOptions;
+            *DataSize = sizeof( m_Params->m_CreateOptions );
+            break;
+
+        default:
+            return STATUS_NOT_FOUND;
+        }
+
+        return STATUS_SUCCESS;
+    }
+
+private:
+    PBenchVerifyEventParams m_Params;
+};
+
+void
+BenchVerifyValues (
+    __inout PULONG Seed,
+    __in FltOperation Operation,
+    __in ULONG Width,
+    __in ULONG Domain,
+    __out std::vector<ULONG64>& Values
+    )
+{
+    ULONG count = 1 + BenchRandom( Seed ) % 3;
+    if ( FltOp_less == Operation || FltOp_greater == Operation )
+    {
+        count = 1;
+    }
+
+    for ( ULONG idx = 0; idx < count; idx++ )
+    {
+        ULONG64 value = BenchRandom( Seed ) % Domain;
+        if ( sizeof( HANDLE ) == Width )
+        {
+            value = BENCH_PID_BASE + value * 4;
+        }
+
+        if ( FltOp_range != Operation )
+        {
+            Values.push_back( value );
+            continue;
+        }
+
+        // pair of bounds, low one first
+        ULONG64 high = value + ( BenchRandom( Seed ) % 3 ) * ( sizeof( HANDLE ) == Width ? 4 : 1 );
+        Values.push_back( value );
+        Values.push_back( high );
+    }
+}
+
+void
+BenchVerifyAppendValues (
+    __inout std::vector<UCHAR>& Buffer,
+    __in ULONG ParameterId,
+    __in FltOperation Operation,
+    __in FltFlags Flags,
+    __in ULONG Width,
+    __in std::vector<ULONG64>& Values
+    )
+{
+    std::vector<UCHAR> data( Values.size() * Width );
+
+    for ( size_t idx = 0; idx < Values.size(); idx++ )
+    {
+        // little endian - low bytes of the value
+        RtlCopyMemory( &data[ idx * Width ], &Values[ idx ], Width );
+    }
+
+    BenchAppendParam(
+        Buffer,
+        ParameterId,
+        Operation,
+        Flags,
+        (ULONG) Values.size(),
+        &data[0],
+        (ULONG) data.size()
+        );
+}
+
+void
+BenchVerifyBuildParam (
+    __inout PULONG Seed,
+    __in ULONG Kind,
+    __inout std::vector<UCHAR>& Params
+    )
+{
+    static const FltOperation ordered[] = { FltOp_equ, FltOp_less, FltOp_greater, FltOp_range };
+
+    FltFlags flags = FltFlags_None;
+    if ( !( BenchRandom( Seed ) % 4 ) )
+    {
+        flags |= FltFlags_Negation;
+    }
+
+    if ( !( BenchRandom( Seed ) % 4 ) )
+    {
+        flags |= FltFlags_BePresent;
+    }
+
+    std::vector<ULONG64> values;
+    WCHAR name[ BENCH_NAME_MAX ];
+    ULONG namesize;
+
+    ULONG dir = BenchRandom( Seed ) % 8;
+    ULONG ext = BenchRandom( Seed ) % 4;
+
+    switch ( BENCH_VERIFY_ANY == Kind ? BenchRandom( Seed ) % BENCH_VERIFY_ANY : Kind )
+    {
+    case 0:
+    case 1:
+        {
+            FltOperation operation = ordered[ BenchRandom( Seed ) % 4 ];
+            BenchVerifyValues( Seed, operation, sizeof( HANDLE ), BENCH_VERIFY_VALUES, values );
+            BenchVerifyAppendValues(
+                Params,
+                PARAMETER_REQUESTOR_PROCESS_ID,
+                operation,
+                flags,
+                sizeof( HANDLE ),
+                values
+                );
+        }
+        break;
+
+    case 2:
+        {
+            // masks of a few bits
+            ULONG count = 1 + BenchRandom( Seed ) % 2;
+            for ( ULONG idx = 0; idx < count; idx++ )
+            {
+                values.push_back( 1 << ( BenchRandom( Seed ) % 8 ) );
+            }
+
+            BenchVerifyAppendValues(
+                Params,
+                PARAMETER_DESIRED_ACCESS,
+                FltOp_and,
+                flags,
+                sizeof( ACCESS_MASK ),
+                values
+                );
+        }
+        break;
+
+    case 3:
+        {
+            FltOperation operation = ordered[ BenchRandom( Seed ) % 4 ];
+            BenchVerifyValues( Seed, operation, sizeof( ACCESS_MASK ), 256, values );
+            BenchVerifyAppendValues(
+                Params,
+                PARAMETER_DESIRED_ACCESS,
+                operation,
+                flags,
+                sizeof( ACCESS_MASK ),
+                values
+                );
+        }
+        break;
+
+    case BENCH_VERIFY_ORDERED:
+        {
+            // absent from a half of events
+            FltOperation operation = ordered[ BenchRandom( Seed ) % 4 ];
+            BenchVerifyValues( Seed, operation, sizeof( ULONG ), 8, values );
+            BenchVerifyAppendValues(
+                Params,
+                PARAMETER_CREATE_OPTIONS,
+                operation,
+                flags,
+                sizeof( ULONG ),
+                values
+                );
+        }
+        break;
+
+    case BENCH_VERIFY_PATTERN:
+        {
+            switch ( BenchRandom( Seed ) % 4 )
+            {
+            case 0:
+                namesize = BenchFormatName( name, "*\\DIR%u\\*.EX%u", dir, ext );
+                break;
+
+            case 1:
+                namesize = BenchFormatName( name, "*\\users\\dir%u\\*", dir, 0 );
+                break;
+
+            case 2:
+                namesize = BenchFormatName( name, "*.ex%u", ext, 0 );
+                break;
+
+            default:
+                namesize = BenchFormatName( name, "*", 0, 0 );
+                break;
+            }
+
+            BenchAppendParam( Params, PARAMETER_FILE_NAME, FltOp_pattern, flags, 1, name, namesize );
+        }
+        break;
+
+    default:
+        {
+            static const char* prefixes[] = {
+                "\\Device\\*\\Users\\dir%u",
+                "\\DEVICE\\HarddiskVolume1\\users\\DIR%u\\",
+                "\\Device\\HarddiskVolume%u\\Users",
+                "\\Device\\*\\Users\\dir%u\\file.ex%u"
+                };
+
+            namesize = BenchFormatName( name, prefixes[ BenchRandom( Seed ) % 4 ], dir % 3, ext );
+            BenchAppendParam( Params, PARAMETER_FILE_NAME, FltOp_prefix, flags, 1, name, namesize );
+        }
+        break;
+    }
+}
+
+void
+BenchVerifyDeleteFilter (
+    __in PBenchVerifyFilter Filter
+    )
+{
+    for ( size_t idx = 0; idx < Filter->m_Checks.size(); idx++ )
+    {
+        delete Filter->m_Checks[ idx ];
+    }
+
+    delete Filter;
+}
+
+// reference entries are built as the set builds its own
+__checkReturn
+NTSTATUS
+BenchVerifyBuildChecks (
+    __inout PBenchVerifyFilter Filter
+    )
+{
+    PFltParam pParam = (PFltParam) &Filter->m_Params[0];
+
+    for ( ULONG idx = 0; idx < Filter->m_ParamsCount; idx++ )
+    {
+        ParamCheckEntry* pEntry = new ( PagedPool, BENCH_VERIFY_TAG ) ParamCheckEntry;
+        if ( !pEntry )
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        Filter->m_Checks.push_back( pEntry );
+
+        pEntry->m_Flags = pParam->m_Flags;
+        pEntry->m_Type = CheckEntryGeneric;
+        pEntry->Generic.m_Operation = pParam->m_Operation;
+        pEntry->Generic.m_Parameter = pParam->m_ParameterId;
+        pEntry->Generic.m_CheckData = NULL;
+
+        NTSTATUS status = pEntry->Attach(
+            pParam->m_Data.m_Size,
+            pParam->m_Data.m_Count,
+            pParam->m_Data.m_Data
+            );
+
+        if ( !NT_SUCCESS( status ) )
+        {
+            return status;
+        }
+
+        pParam = (PFltParam) Add2Ptr( pParam, sizeof( FltParam ) + pParam->m_Data.m_Size );
+    }
+
+    return STATUS_SUCCESS;
+}
+
+__checkReturn
+NTSTATUS
+BenchVerifyBuildFilter (
+    __inout PULONG Seed,
+    __in ULONG GroupsCount,
+    __deref_out PBenchVerifyFilter* Filter
+    )
+{
+    static const VERDICT verdicts[] = { VERDICT_DENY, VERDICT_ASK, VERDICT_DENY | VERDICT_ASK };
+    static const ULONG wishes[] = {
+        PARAMETER_FILE_NAME,
+        PARAMETER_REQUESTOR_PROCESS_ID,
+        PARAMETER_DESIRED_ACCESS,
+        PARAMETER_CREATE_OPTIONS
+        };
+
+    PBenchVerifyFilter pFilter = new BenchVerifyFilter;
+
+    pFilter->m_ParamsCount = 1 + BenchRandom( Seed ) % 3;
+    pFilter->m_GroupId = (UCHAR) ( 1 + BenchRandom( Seed ) % GroupsCount );
+    pFilter->m_Verdict = verdicts[ BenchRandom( Seed ) % 3 ];
+    pFilter->m_WishMask = Id2Bit( wishes[ BenchRandom( Seed ) % 4 ] );
+    pFilter->m_ProcessId = UlongToHandle( BENCH_OWNER_PID + BenchRandom( Seed ) % BENCH_VERIFY_OWNERS );
+    pFilter->m_FilterId[ 0 ] = 0;
+    pFilter->m_FilterId[ 1 ] = 0;
+
+    for ( ULONG idx = 0; idx < pFilter->m_ParamsCount; idx++ )
+    {
+        BenchVerifyBuildParam( Seed, BENCH_VERIFY_ANY, pFilter->m_Params );
+    }
+
+    NTSTATUS status = BenchVerifyBuildChecks( pFilter );
+    if ( !NT_SUCCESS( status ) )
+    {
+        BenchVerifyDeleteFilter( pFilter );
+
+        return status;
+    }
+
+    *Filter = pFilter;
+
+    return STATUS_SUCCESS;
+}
+
+void
+BenchVerifyGenerateEvent (
+    __inout PULONG Seed,
+    __out PBenchVerifyEventParams Event
+    )
+{
+    Event->m_Absent = 0;
+
+    // parameters are absent from some events, create options from a half
+    if ( !( BenchRandom( Seed ) % 16 ) )
+    {
+        Event->m_Absent |= Id2Bit( PARAMETER_REQUESTOR_PROCESS_ID );
+    }
+
+    if ( !( BenchRandom( Seed ) % 8 ) )
+    {
+        Event->m_Absent |= Id2Bit( PARAMETER_DESIRED_ACCESS );
+    }
+
+    if ( !( BenchRandom( Seed ) % 8 ) )
+    {
+        Event->m_Absent |= Id2Bit( PARAMETER_FILE_NAME );
+    }
+
+    if ( BenchRandom( Seed ) % 2 )
+    {
+        Event->m_Absent |= Id2Bit( PARAMETER_CREATE_OPTIONS );
+    }
+
+    Event->m_ProcessId = UlongToHandle( BENCH_PID_BASE + ( BenchRandom( Seed ) % BENCH_VERIFY_VALUES ) * 4 );
+    Event->m_DesiredAccess = BenchRandom( Seed ) % 256;
+    Event->m_CreateOptions = BenchRandom( Seed ) % 8;
+    Event->m_FileNameSize = BenchFormatName(
+        Event->m_FileName,
+        "\\Device\\HarddiskVolume1\\Users\\dir%u\\file.ex%u",
+        BenchRandom( Seed ) % 8,
+        BenchRandom( Seed ) % 4
+        );
+}
+
+BOOLEAN
+BenchVerifyMatch (
+    __in PBenchVerifyFilter Filter,
+    __in EventData* Event
+    )
+{
+    for ( size_t idx = 0; idx < Filter->m_Checks.size(); idx++ )
+    {
+        if ( STATUS_SUCCESS != CheckEntry( Filter->m_Checks[ idx ], Event ) )
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+// FiltersStorage per cache state, both are changed the same way
+__checkReturn
+NTSTATUS
+BenchVerifyAdd (
+    __in FiltersStorage** Storages,
+    __in std::vector<PBenchVerifyFilter>& Added,
+    __in BOOLEAN Chained
+    )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+
+    for ( ULONG storage = 0; storage < BENCH_VERIFY_STORAGES && NT_SUCCESS( status ); storage++ )
+    {
+        FiltersStorage* pStorage = Storages[ storage ];
+
+        pStorage->Lock();
+
+        if ( Chained )
+        {
+            std::vector<FltChainItem> items( Added.size() );
+
+            for ( size_t idx = 0; idx < Added.size(); idx++ )
+            {
+                PBenchVerifyFilter pFilter = Added[ idx ];
+                PFltChainItem pItem = &items[ idx ];
+
+                pItem->m_Interceptor = FILE_MINIFILTER;
+                pItem->m_OperationId = OP_FILE_CREATE;
+                pItem->m_FunctionMi = 0;
+                pItem->m_OperationType = PostProcessing;
+                pItem->m_GroupId = pFilter->m_GroupId;
+                pItem->m_Verdict = pFilter->m_Verdict;
+                pItem->m_ProcessId = pFilter->m_ProcessId;
+                pItem->m_RequestTimeout = 0;
+                pItem->m_WishMask = pFilter->m_WishMask;
+                pItem->m_ParamsCount = pFilter->m_ParamsCount;
+                pItem->m_Params = (PFltParam) &pFilter->m_Params[0];
+                pItem->m_FilterId = 0;
+            }
+
+            status = pStorage->AddFiltersUnsafe( (ULONG) items.size(), &items[0] );
+
+            for ( size_t idx = 0; idx < Added.size() && NT_SUCCESS( status ); idx++ )
+            {
+                Added[ idx ]->m_FilterId[ storage ] = items[ idx ].m_FilterId;
+            }
+        }
+        else
+        {
+            for ( size_t idx = 0; idx < Added.size() && NT_SUCCESS( status ); idx++ )
+            {
+                PBenchVerifyFilter pFilter = Added[ idx ];
+
+                status = pStorage->AddFilterUnsafe(
+                    FILE_MINIFILTER,
+                    OP_FILE_CREATE,
+                    0,
+                    PostProcessing,
+                    pFilter->m_GroupId,
+                    pFilter->m_Verdict,
+                    pFilter->m_ProcessId,
+                    0,
+                    pFilter->m_WishMask,
+                    pFilter->m_ParamsCount,
+                    (PFltParam) &pFilter->m_Params[0],
+                    &pFilter->m_FilterId[ storage ]
+                    );
+            }
+        }
+
+        pStorage->UnLock();
+    }
+
+    return status;
+}
+
+BOOLEAN
+BenchVerifyCompare (
+    __in FiltersStorage** Storages,
+    __in std::vector<PBenchVerifyFilter>& Filters,
+    __in PBenchVerifyEventParams Params
+    )
+{
+    // list walk - first matched filter of each group in position order
+    BenchVerifyEvent reference( Params );
+
+    VERDICT verdict = VERDICT_NOT_FILTERED;
+    PARAMS_MASK mask = 0;
+    std::vector<PBenchVerifyFilter> winners;
+    BOOLEAN seen[ 256 ] = { FALSE };
+
+    for ( size_t idx = 0; idx < Filters.size(); idx++ )
+    {
+        PBenchVerifyFilter pFilter = Filters[ idx ];
+        if ( seen[ pFilter->m_GroupId ] || !BenchVerifyMatch( pFilter, &reference ) )
+        {
+            continue;
+        }
+
+        seen[ pFilter->m_GroupId ] = TRUE;
+        winners.push_back( pFilter );
+
+        verdict |= pFilter->m_Verdict;
+        mask |= pFilter->m_WishMask;
+    }
+
+    BOOLEAN bEqual = TRUE;
+
+    for ( ULONG storage = 0; storage < BENCH_VERIFY_STORAGES; storage++ )
+    {
+        BenchVerifyEvent event( Params );
+
+        VERDICT storageverdict = VERDICT_NOT_FILTERED;
+        PARAMS_MASK storagemask = 0;
+
+        // STATUS_NOT_FOUND - no set of the operation, cleanup deleted it
+        NTSTATUS status = Storages[ storage ]->FilterEvent( &event, &storageverdict, &storagemask );
+        if ( !NT_SUCCESS( status ) && STATUS_NOT_FOUND != status )
+        {
+            fprintf( stderr, "storage %u: FilterEvent failed 0x%x\n", storage, status );
+            return FALSE;
+        }
+
+        std::vector<ULONG> expected;
+        for ( size_t idx = 0; idx < winners.size(); idx++ )
+        {
+            expected.push_back( winners[ idx ]->m_FilterId[ storage ] );
+        }
+
+        std::vector<ULONG> aggregated;
+        for ( ULONG idx = 0; idx < event.m_Aggregator.GetCount(); idx++ )
+        {
+            aggregated.push_back( event.m_Aggregator.GetFilterId( idx ) );
+        }
+
+        std::sort( expected.begin(), expected.end() );
+        std::sort( aggregated.begin(), aggregated.end() );
+
+        if ( storageverdict == verdict && storagemask == mask && aggregated == expected )
+        {
+            continue;
+        }
+
+        bEqual = FALSE;
+
+        fprintf(
+            stderr,
+            "storage %u (cache %s): verdict 0x%x mask 0x%llx, list walk 0x%x mask 0x%llx\n",
+            storage,
+            storage ? "off" : "on",
+            storageverdict,
+            (unsigned long long) storagemask,
+            verdict,
+            (unsigned long long) mask
+            );
+
+        char name[ BENCH_NAME_MAX ];
+        ULONG length = Params->m_FileNameSize / sizeof( WCHAR );
+        for ( ULONG idx = 0; idx < length; idx++ )
+        {
+            name[ idx ] = (char) Params->m_FileName[ idx ];
+        }
+
+        name[ length ] = 0;
+
+        fprintf(
+            stderr,
+            "  event pid %u access 0x%x options %u absent 0x%llx name %s\n",
+            HandleToUlong( Params->m_ProcessId ),
+            Params->m_DesiredAccess,
+            Params->m_CreateOptions,
+            (unsigned long long) Params->m_Absent,
+            name
+            );
+
+        fprintf( stderr, "  filters:" );
+        for ( size_t idx = 0; idx < aggregated.size(); idx++ )
+        {
+            fprintf( stderr, " %u", aggregated[ idx ] );
+        }
+
+        fprintf( stderr, ", list walk:" );
+        for ( size_t idx = 0; idx < expected.size(); idx++ )
+        {
+            fprintf( stderr, " %u", expected[ idx ] );
+        }
+
+        fprintf( stderr, "\n" );
+    }
+
+    return bEqual;
+}
+
+__checkReturn
+NTSTATUS
+BenchVerifyCreateStorages (
+    __out_ecount(BENCH_VERIFY_STORAGES) FiltersStorage** Storages
+    )
+{
+    for ( ULONG storage = 0; storage < BENCH_VERIFY_STORAGES; storage++ )
+    {
+        NTSTATUS status = UmHostGetProcessHelper()->AddRef();
+        if ( !NT_SUCCESS( status ) )
+        {
+            return status;
+        }
+
+        Storages[ storage ] = new FiltersStorage( UmHostGetProcessHelper() );
+        Storages[ storage ]->ChangeCacheState( storage ? FALSE : TRUE );
+    }
+
+    return STATUS_SUCCESS;
+}
+
+__checkReturn
+NTSTATUS
+BenchVerifySet (
+    __in ULONG Seed,
+    __in PBenchOptions Options,
+    __out PULONG Mismatches
+    )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    FiltersStorage* storages[ BENCH_VERIFY_STORAGES ] = { NULL };
+
+    std::vector<PBenchVerifyFilter> filters;
+    std::vector<BenchVerifyEventParams> events( BENCH_VERIFY_EVENTS );
+
+    ULONG seed = Seed;
+    ULONG groupscount = 1 + BenchRandom( &seed ) % Options->m_GroupsCount;
+
+    *Mismatches = 0;
+
+    status = BenchVerifyCreateStorages( storages );
+
+    // events repeat - cached verdicts are reused between changes
+    for ( ULONG idx = 0; idx < BENCH_VERIFY_EVENTS; idx++ )
+    {
+        BenchVerifyGenerateEvent( &seed, &events[ idx ] );
+    }
+
+    ULONG eventsperround = Options->m_EventsCount / BENCH_VERIFY_ROUNDS + 1;
+
+    for (
+        ULONG round = 0;
+        round < BENCH_VERIFY_ROUNDS && NT_SUCCESS( status ) && *Mismatches < BENCH_VERIFY_REPORTED;
+        round++
+        )
+    {
+        std::vector<PBenchVerifyFilter> added;
+
+        // first round compiles a chain, then filters are appended to the
+        // compiled set one by one or as chains, an eighth more recompiles
+        ULONG change = round ? BenchRandom( &seed ) % 8 : 0;
+        ULONG count = 0;
+
+        if ( !change )
+        {
+            count = round ? 1 + BenchRandom( &seed ) % 32 : Options->m_FiltersCount;
+        }
+        else if ( change < 6 )
+        {
+            count = 1 + BenchRandom( &seed ) % 3;
+        }
+        else
+        {
+            HANDLE owner = UlongToHandle( BENCH_OWNER_PID + BenchRandom( &seed ) % BENCH_VERIFY_OWNERS );
+
+            for ( ULONG storage = 0; storage < BENCH_VERIFY_STORAGES; storage++ )
+            {
+                FiltersStorage::ExitProcessCb( owner, storages[ storage ] );
+            }
+
+            size_t kept = 0;
+            for ( size_t idx = 0; idx < filters.size(); idx++ )
+            {
+                if ( filters[ idx ]->m_ProcessId == owner )
+                {
+                    BenchVerifyDeleteFilter( filters[ idx ] );
+                    continue;
+                }
+
+                filters[ kept++ ] = filters[ idx ];
+            }
+
+            filters.resize( kept );
+        }
+
+        for ( ULONG idx = 0; idx < count && NT_SUCCESS( status ); idx++ )
+        {
+            PBenchVerifyFilter pFilter;
+            status = BenchVerifyBuildFilter( &seed, groupscount, &pFilter );
+            if ( NT_SUCCESS( status ) )
+            {
+                added.push_back( pFilter );
+            }
+        }
+
+        if ( NT_SUCCESS( status ) && !added.empty() )
+        {
+            status = BenchVerifyAdd( storages, added, !change || change % 2 );
+        }
+
+        filters.insert( filters.end(), added.begin(), added.end() );
+
+        if ( !NT_SUCCESS( status ) )
+        {
+            fprintf( stderr, "seed %u round %u: add failed 0x%x\n", Seed, round, status );
+            break;
+        }
+
+        for ( ULONG idx = 0; idx < eventsperround && *Mismatches < BENCH_VERIFY_REPORTED; idx++ )
+        {
+            if ( !BenchVerifyCompare( storages, filters, &events[ BenchRandom( &seed ) % BENCH_VERIFY_EVENTS ] ) )
+            {
+                fprintf( stderr, "seed %u round %u: %u filters\n", Seed, round, (ULONG) filters.size() );
+                (*Mismatches)++;
+            }
+        }
+    }
+
+    for ( ULONG storage = 0; storage < BENCH_VERIFY_STORAGES; storage++ )
+    {
+        delete storages[ storage ];
+    }
+
+    for ( size_t idx = 0; idx < filters.size(); idx++ )
+    {
+        BenchVerifyDeleteFilter( filters[ idx ] );
+    }
+
+    return status;
+}
+
+// indexed checks of one parent - negated ones are checked one by one,
+// the rest is dispatched by probe hits. Absent and not found values
+// pass or fail them differently
+static const BenchVerifyCase gDispatchCases[][ 2 ] = {
+    { { PARAMETER_REQUESTOR_PROCESS_ID, FltOp_equ, FltFlags_None, 1, { 0 } } },
+    { { PARAMETER_REQUESTOR_PROCESS_ID, FltOp_equ, FltFlags_None, 1, { 1 } } },
+    { { PARAMETER_REQUESTOR_PROCESS_ID, FltOp_equ, FltFlags_Negation, 1, { 0 } } },
+    { { PARAMETER_REQUESTOR_PROCESS_ID, FltOp_equ, FltFlags_Negation | FltFlags_BePresent, 2, { 0, 1 } } },
+    { { PARAMETER_REQUESTOR_PROCESS_ID, FltOp_equ, FltFlags_BePresent, 1, { 2 } } },
+    {
+        { PARAMETER_REQUESTOR_PROCESS_ID, FltOp_equ, FltFlags_None, 1, { 0 } },
+        { PARAMETER_DESIRED_ACCESS, FltOp_and, FltFlags_None, 1, { 1 } }
+    },
+    {
+        { PARAMETER_REQUESTOR_PROCESS_ID, FltOp_equ, FltFlags_Negation, 1, { 0 } },
+        { PARAMETER_DESIRED_ACCESS, FltOp_equ, FltFlags_Negation, 1, { 3 } }
+    },
+    { { PARAMETER_FILE_NAME, FltOp_prefix, FltFlags_Negation, 0, { 0 }, "\\Device\\*\\Users\\dir1" } },
+    {
+        { PARAMETER_FILE_NAME, FltOp_pattern, FltFlags_Negation, 0, { 0 }, "*.EX1" },
+        { PARAMETER_REQUESTOR_PROCESS_ID, FltOp_equ, FltFlags_None, 1, { 1 } }
+    },
+    { { PARAMETER_REQUESTOR_PROCESS_ID, FltOp_range, FltFlags_Negation, 2, { 0, 1 } } },
+    {
+        { PARAMETER_CREATE_OPTIONS, FltOp_equ, FltFlags_None, 1, { 1 } },
+        { PARAMETER_REQUESTOR_PROCESS_ID, FltOp_equ, FltFlags_None, 1, { 0 } }
+    },
+    { { PARAMETER_CREATE_OPTIONS, FltOp_equ, FltFlags_Negation, 1, { 2 } } },
+    { { PARAMETER_CREATE_OPTIONS, FltOp_equ, FltFlags_Negation | FltFlags_BePresent, 1, { 2 } } },
+    {
+        { PARAMETER_FILE_NAME, FltOp_prefix, FltFlags_None, 0, { 0 }, "\\Device\\*\\Users\\dir2" },
+        { PARAMETER_REQUESTOR_PROCESS_ID, FltOp_equ, FltFlags_Negation, 1, { 3 } }
+    },
+    {
+        { PARAMETER_DESIRED_ACCESS, FltOp_and, FltFlags_Negation, 1, { 2 } },
+        { PARAMETER_REQUESTOR_PROCESS_ID, FltOp_equ, FltFlags_None, 1, { 3 } }
+    }
+};
+
+__checkReturn
+NTSTATUS
+BenchVerifyCaseFilter (
+    __in_ecount(2) const BenchVerifyCase* Case,
+    __in UCHAR GroupId,
+    __deref_out PBenchVerifyFilter* Filter
+    )
+{
+    PBenchVerifyFilter pFilter = new BenchVerifyFilter;
+
+    pFilter->m_ParamsCount = 0;
+    pFilter->m_GroupId = GroupId;
+    pFilter->m_Verdict = VERDICT_DENY;
+    pFilter->m_WishMask = Id2Bit( PARAMETER_REQUESTOR_PROCESS_ID );
+    pFilter->m_ProcessId = UlongToHandle( BENCH_OWNER_PID );
+    pFilter->m_FilterId[ 0 ] = 0;
+    pFilter->m_FilterId[ 1 ] = 0;
+
+    // PARAMETER_EXT_BOX_FILTERS ends the params
+    for ( ULONG idx = 0; idx < 2 && Case[ idx ].m_ParameterId; idx++ )
+    {
+        const BenchVerifyCase* pCase = &Case[ idx ];
+
+        if ( pCase->m_Name )
+        {
+            WCHAR name[ BENCH_NAME_MAX ];
+            ULONG namesize = BenchFormatName( name, pCase->m_Name, 0, 0 );
+
+            BenchAppendParam(
+                pFilter->m_Params,
+                pCase->m_ParameterId,
+                pCase->m_Operation,
+                pCase->m_Flags,
+                1,
+                name,
+                namesize
+                );
+        }
+        else
+        {
+            ULONG width = sizeof( ULONG );
+            std::vector<ULONG64> values;
+
+            for ( ULONG value = 0; value < pCase->m_Count; value++ )
+            {
+                values.push_back( pCase->m_Values[ value ] );
+            }
+
+            if ( PARAMETER_REQUESTOR_PROCESS_ID == pCase->m_ParameterId )
+            {
+                width = sizeof( HANDLE );
+                for ( ULONG value = 0; value < pCase->m_Count; value++ )
+                {
+                    values[ value ] = BENCH_PID_BASE + values[ value ] * 4;
+                }
+            }
+
+            BenchVerifyAppendValues(
+                pFilter->m_Params,
+                pCase->m_ParameterId,
+                pCase->m_Operation,
+                pCase->m_Flags,
+                width,
+                values
+                );
+        }
+
+        pFilter->m_ParamsCount++;
+    }
+
+    NTSTATUS status = BenchVerifyBuildChecks( pFilter );
+    if ( !NT_SUCCESS( status ) )
+    {
+        BenchVerifyDeleteFilter( pFilter );
+
+        return status;
+    }
+
+    *Filter = pFilter;
+
+    return STATUS_SUCCESS;
+}
+
+__checkReturn
+NTSTATUS
+BenchVerifyDispatch (
+    __in BOOLEAN Chained,
+    __out PULONG Mismatches
+    )
+{
+    FiltersStorage* storages[ BENCH_VERIFY_STORAGES ] = { NULL };
+    std::vector<PBenchVerifyFilter> filters;
+
+    *Mismatches = 0;
+
+    NTSTATUS status = BenchVerifyCreateStorages( storages );
+
+    // the cases and more dispatched siblings - hits are fewer than children
+    ULONG count = sizeof( gDispatchCases ) / sizeof( gDispatchCases[0] );
+
+    for ( ULONG idx = 0; idx < count + BENCH_VERIFY_SIBLINGS && NT_SUCCESS( status ); idx++ )
+    {
+        BenchVerifyCase sibling[ 2 ] = {
+            { PARAMETER_REQUESTOR_PROCESS_ID, FltOp_equ, FltFlags_None, 1, { 4 + idx - count } }
+            };
+
+        PBenchVerifyFilter pFilter;
+        status = BenchVerifyCaseFilter(
+            idx < count ? gDispatchCases[ idx ] : sibling,
+            (UCHAR) ( 1 + idx ),
+            &pFilter
+            );
+
+        if ( NT_SUCCESS( status ) )
+        {
+            filters.push_back( pFilter );
+        }
+    }
+
+    if ( NT_SUCCESS( status ) )
+    {
+        status = BenchVerifyAdd( storages, filters, Chained );
+    }
+
+    // process id 40 is found by no check
+    static const ULONG pids[] = { 0, 1, 2, 3, 40 };
+
+    for ( ULONG idx = 0; idx < BENCH_VERIFY_CASE_EVENTS && NT_SUCCESS( status ); idx++ )
+    {
+        BenchVerifyEventParams event;
+        ULONG value = idx;
+
+        event.m_Absent = 0;
+
+        ULONG pid = value % ( sizeof( pids ) / sizeof( pids[0] ) + 1 );
+        value /= sizeof( pids ) / sizeof( pids[0] ) + 1;
+
+        if ( pid < sizeof( pids ) / sizeof( pids[0] ) )
+        {
+            event.m_ProcessId = UlongToHandle( BENCH_PID_BASE + pids[ pid ] * 4 );
+        }
+        else
+        {
+            event.m_Absent |= Id2Bit( PARAMETER_REQUESTOR_PROCESS_ID );
+        }
+
+        event.m_DesiredAccess = value % 4;
+        value /= 4;
+
+        if ( !event.m_DesiredAccess )
+        {
+            event.m_Absent |= Id2Bit( PARAMETER_DESIRED_ACCESS );
+        }
+
+        event.m_CreateOptions = value % 3;
+        value /= 3;
+
+        if ( !event.m_CreateOptions )
+        {
+            event.m_Absent |= Id2Bit( PARAMETER_CREATE_OPTIONS );
+        }
+
+        event.m_FileNameSize = BenchFormatName(
+            event.m_FileName,
+            "\\Device\\HarddiskVolume1\\Users\\dir%u\\file.ex%u",
+            1 + value % 3,
+            value % 3 ? 0 : 1
+            );
+
+        if ( 2 == value % 3 )
+        {
+            event.m_Absent |= Id2Bit( PARAMETER_FILE_NAME );
+        }
+
+        // second time from the cache
+        for ( ULONG repeat = 0; repeat < 2; repeat++ )
+        {
+            if ( !BenchVerifyCompare( storages, filters, &event ) )
+            {
+                fprintf( stderr, "dispatch cases, %s: event %u\n", Chained ? "chain" : "one by one", idx );
+                (*Mismatches)++;
+            }
+        }
+    }
+
+    for ( ULONG storage = 0; storage < BENCH_VERIFY_STORAGES; storage++ )
+    {
+        delete storages[ storage ];
+    }
+
+    for ( size_t idx = 0; idx < filters.size(); idx++ )
+    {
+        BenchVerifyDeleteFilter( filters[ idx ] );
+    }
+
+    return status;
+}
+
+// checks of filters added by Update are indexed by next Commit - Match
+// between them must evaluate them one by one
+__checkReturn
+NTSTATUS
+BenchVerifyPending (
+    __in ULONG Kind,
+    __in const char* KindName,
+    __in ULONG Seed,
+    __out PULONG Mismatches
+    )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    ULONG seed = Seed;
+
+    LIST_ENTRY checks;
+    InitializeListHead( &checks );
+
+    std::vector<PBenchVerifyFilter> filters;
+    std::vector<BenchVerifyEventParams> events( BENCH_VERIFY_EVENTS );
+
+    FltBitmap active;
+    FltRetired retired;
+    FltRetiredInit( &retired );
+
+    *Mismatches = 0;
+
+    for ( ULONG idx = 0; idx < BENCH_VERIFY_EVENTS; idx++ )
+    {
+        BenchVerifyGenerateEvent( &seed, &events[ idx ] );
+    }
+
+    FilterDag* pDag = new ( PagedPool, FilterDag::m_AllocTag ) FilterDag;
+    if ( !pDag )
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    status = active.Resize( BENCH_PENDING_FILTERS );
+    if ( NT_SUCCESS( status ) )
+    {
+        active.SetAll();
+    }
+
+    for (
+        ULONG position = 0;
+        position < BENCH_PENDING_FILTERS && NT_SUCCESS( status ) && *Mismatches < BENCH_VERIFY_REPORTED;
+        position++
+        )
+    {
+        // the kind first, another check of any kind for some
+        PBenchVerifyFilter pFilter = new BenchVerifyFilter;
+        filters.push_back( pFilter );
+
+        pFilter->m_ParamsCount = 1 + BenchRandom( &seed ) % 2;
+        pFilter->m_GroupId = 1;
+        pFilter->m_Verdict = VERDICT_DENY;
+        pFilter->m_WishMask = Id2Bit( PARAMETER_FILE_NAME );
+        pFilter->m_ProcessId = UlongToHandle( BENCH_OWNER_PID );
+
+        BenchVerifyBuildParam( &seed, Kind, pFilter->m_Params );
+        if ( pFilter->m_ParamsCount > 1 )
+        {
+            BenchVerifyBuildParam( &seed, BENCH_VERIFY_ANY, pFilter->m_Params );
+        }
+
+        status = BenchVerifyBuildChecks( pFilter );
+
+        // reference entries are the entries of the dag
+        for ( size_t idx = 0; idx < pFilter->m_Checks.size() && NT_SUCCESS( status ); idx++ )
+        {
+            InsertTailList( &checks, &pFilter->m_Checks[ idx ]->m_List );
+            status = pFilter->m_Checks[ idx ]->AddPosition( position );
+        }
+
+        if ( !NT_SUCCESS( status ) )
+        {
+            break;
+        }
+
+        if ( position < BENCH_PENDING_FIRST )
+        {
+            continue;
+        }
+
+        if ( BENCH_PENDING_FIRST == position || pDag->NeedsCompile( position + 1 ) )
+        {
+            status = pDag->Compile( &checks, &active, position + 1 );
+        }
+        else
+        {
+            std::vector<ParamCheckEntry*> chain( pFilter->m_Checks );
+
+            status = pDag->Update( position + 1, position, (ULONG) chain.size(), &chain[0] );
+            if ( !NT_SUCCESS( status ) )
+            {
+                // image is full
+                status = pDag->Compile( &checks, &active, position + 1 );
+            }
+        }
+
+        // a few filters wait for Commit
+        for ( ULONG commit = 0; commit < 2 && NT_SUCCESS( status ); commit++ )
+        {
+            for ( ULONG idx = 0; idx < BENCH_PENDING_EVENTS && NT_SUCCESS( status ); idx++ )
+            {
+                PBenchVerifyEventParams pParams = &events[ BenchRandom( &seed ) % BENCH_VERIFY_EVENTS ];
+                BenchVerifyEvent event( pParams );
+                BenchVerifyEvent reference( pParams );
+
+                FltBitmap filtersbitmap;
+                ULONG matched;
+                PARAMS_MASK fetched;
+
+                status = filtersbitmap.Resize( position + 1 );
+                if ( NT_SUCCESS( status ) )
+                {
+                    filtersbitmap.SetAll();
+                    status = pDag->Match( &event, &filtersbitmap, &matched, &fetched );
+                }
+
+                for ( ULONG filter = 0; filter <= position && NT_SUCCESS( status ); filter++ )
+                {
+                    BOOLEAN bMatched = !filtersbitmap.Test( filter );
+                    if ( bMatched == BenchVerifyMatch( filters[ filter ], &reference ) )
+                    {
+                        continue;
+                    }
+
+                    fprintf(
+                        stderr,
+                        "pending %s, seed %u: filter %u of %u %s, list walk %s\n",
+                        KindName,
+                        Seed,
+                        filter,
+                        position + 1,
+                        bMatched ? "matched" : "not matched",
+                        bMatched ? "not matched" : "matched"
+                        );
+
+                    (*Mismatches)++;
+                    break;
+                }
+            }
+
+            if ( NT_SUCCESS( status ) && ( commit || BenchRandom( &seed ) % 4 ) )
+            {
+                break;
+            }
+
+            if ( NT_SUCCESS( status ) )
+            {
+                status = pDag->Commit( &retired );
+            }
+        }
+    }
+
+    if ( !NT_SUCCESS( status ) )
+    {
+        fprintf( stderr, "pending %s, seed %u: failed 0x%x\n", KindName, Seed, status );
+    }
+
+    delete pDag;
+    FltRetiredRelease( &retired );
+
+    for ( size_t idx = 0; idx < filters.size(); idx++ )
+    {
+        BenchVerifyDeleteFilter( filters[ idx ] );
+    }
+
+    return status;
+}
+
+int
+RunVerify (
+    __in PBenchOptions Options
+    )
+{
+    ULONG mismatches = 0;
+
+    for ( ULONG chained = 0; chained < 2; chained++ )
+    {
+        ULONG casemismatches;
+        NTSTATUS status = BenchVerifyDispatch( chained ? TRUE : FALSE, &casemismatches );
+        if ( !NT_SUCCESS( status ) )
+        {
+            fprintf( stderr, "dispatch cases failed 0x%x\n", status );
+            return 1;
+        }
+
+        mismatches += casemismatches;
+    }
+
+    // masks, prefixes and ordered checks wait in levels
+    static const ULONG kinds[] = { BENCH_VERIFY_PATTERN, BENCH_VERIFY_PREFIX, BENCH_VERIFY_ORDERED };
+    static const char* kindnames[] = { "masks", "prefixes", "ordered" };
+
+    for ( ULONG kind = 0; kind < sizeof( kinds ) / sizeof( kinds[0] ); kind++ )
+    {
+        for ( ULONG set = 0; set < BENCH_VERIFY_SETS; set++ )
+        {
+            ULONG pendingmismatches;
+            NTSTATUS status = BenchVerifyPending(
+                kinds[ kind ],
+                kindnames[ kind ],
+                Options->m_Seed + set,
+                &pendingmismatches
+                );
+
+            if ( !NT_SUCCESS( status ) )
+            {
+                return 1;
+            }
+
+            mismatches += pendingmismatches;
+        }
+    }
+
+    for ( ULONG set = 0; set < BENCH_VERIFY_SETS; set++ )
+    {
+        ULONG setmismatches;
+        NTSTATUS status = BenchVerifySet( Options->m_Seed + set, Options, &setmismatches );
+        if ( !NT_SUCCESS( status ) )
+        {
+            return 1;
+        }
+
+        mismatches += setmismatches;
+    }
+
+    printf(
+        "%u sets, %u events each: %u mismatches\n",
+        BENCH_VERIFY_SETS,
+        Options->m_EventsCount,
+        mismatches
+        );
+
+    return mismatches ? 1 : 0;
+}
+
+void
+Usage (
+    )
+{
+    printf(
+        "usage: fltbench [verdict|scale|threads|load|values|box|groups|slab|grow|verify]\n"
+        "                [options]\n"
+        "  verdict                     small sets, 16..256 filters (default)\n"
+        "  scale                       GetVerdict cost from 256 to 64k filters\n"
+        "  threads                     verdicts/sec from 1 to 64 threads,\n"
+        "                              mixed set of 256 filters by default\n"
+        "  load                        filter by filter vs one chain,\n"
+        "                              1k to 100k filters\n"
+        "  values                      one equ check of 1 to 100k values,\n"
+        "                              in a box item and in a filter\n"
+        "  box                         box of 16 to 5k extension masks\n"
+        "                              referenced by one filter\n"
+        "  groups                      1, 16 and 255 groups of filters all\n"
+        "                              matching, 1024 filters by default,\n"
+        "                              cache misses per event\n"
+        "  slab                        event allocations from pool and from\n"
+        "                              slab, 1 to 64 threads\n"
+        "  grow                        scale, last 1/16 of filters added one\n"
+        "                              by one after the rest is compiled\n"
+        "  verify                      random sets changed by chains, filter\n"
+        "                              by filter and cleanup, verdicts with\n"
+        "                              cache on and off against the list walk\n"
+        "  -k <equ|and|pattern|mixed|range|prefix>\n"
+        "                              filter kind (default - all)\n"
+        "  -f <count>                  filters per set (default - sweep),\n"
+        "                              upper bound of the sweep for scale,\n"
+        "                              values of the check for values,\n"
+        "                              masks of the box for box,\n"
+        "                              filters of the set for groups,\n"
+        "                              first chain for verify (default 64)\n"
+        "  -g <count>                  groups, 1..255 (default 16)\n"
+        "  -e <count>                  events per run (default 200000,\n"
+        "                              20000 for scale and grow, 4096 per\n"
+        "                              set for verify)\n"
+        "  -s <seed>                   random seed\n"
+        "  -t <count>                  threads upper bound (default 64),\n"
+        "                              for threads and slab\n"
+        "  -c <0|1>                    threads: writer adds and cleans filters\n"
+        "  -m <0|1>                    verdict cache (default 1, 0 for scale,\n"
+        "                              grow, values, box and groups)\n"
+        );
+}
+
+int
+main (
+    int argc,
+    char* argv[]
+    )
+{
+    BenchOptions options;
+    options.m_Mode = BenchMode_Verdict;
+    options.m_Kind = BenchKind_Max;
+    options.m_FiltersCount = 0;
+    options.m_GroupsCount = 16;
+    options.m_EventsCount = 0;
+    options.m_Seed = 1;
+    options.m_ThreadsCount = BENCH_THREADS_MAX;
+    options.m_Churn = FALSE;
+    options.m_Cache = BENCH_CACHE_DEFAULT;
+
+    int arg = 1;
+    if ( arg < argc && argv[ arg ][0] != '-' )
+    {
+        options.m_Mode = BenchMode_Max;
+        for ( ULONG mode = 0; mode < BenchMode_Max; mode++ )
+        {
+            if ( !strcmp( argv[ arg ], gModeNames[ mode ] ) )
+            {
+                options.m_Mode = mode;
+            }
+        }
+
+        if ( BenchMode_Max == options.m_Mode )
+        {
+            Usage();
+            return 1;
+        }
+
+        arg++;
+    }
+
+    for ( ; arg < argc; arg++ )
+    {
+        if ( arg + 1 >= argc || argv[ arg ][0] != '-' )
+        {
+            Usage();
+            return 1;
+        }
+
+        const char* value = argv[ ++arg ];
+
+        switch ( argv[ arg - 1 ][1] )
+        {
+        case 'k':
+            options.m_Kind = BenchKind_Max + 1;
+            for ( ULONG kind = 0; kind < BenchKind_Max; kind++ )
+            {
+                if ( !strcmp( value, gKindNames[ kind ] ) )
+                {
+                    options.m_Kind = kind;
+                }
+            }
+            break;
+
+        case 'f':
+            options.m_FiltersCount = strtoul( value, NULL, 0 );
+            break;
+
+        case 'g':
+            options.m_GroupsCount = strtoul( value, NULL, 0 );
+            break;
+
+        case 'e':
+            options.m_EventsCount = strtoul( value, NULL, 0 );
+            break;
+
+        case 's':
+            options.m_Seed = strtoul( value, NULL, 0 );
+            break;
+
+        case 't':
+            options.m_ThreadsCount = strtoul( value, NULL, 0 );
+            break;
+
+        case 'c':
+            options.m_Churn = strtoul( value, NULL, 0 ) ? TRUE : FALSE;
+            break;
+
+        case 'm':
+            options.m_Cache = strtoul( value, NULL, 0 ) ? TRUE : FALSE;
+            break;
+
+        default:
+            Usage();
+            return 1;
+        }
+    }
+
+    if (
+        options.m_Kind > BenchKind_Max
+        ||
+        !options.m_GroupsCount
+        ||
+        options.m_GroupsCount > 255
+        ||
+        !options.m_ThreadsCount
+        ||
+        options.m_ThreadsCount > BENCH_THREADS_MAX
+        )
+    {
+        Usage();
+        return 1;
+    }
+
+    if ( !options.m_EventsCount )
+    {
+        options.m_EventsCount = 200000;
+        if ( BenchMode_Scale == options.m_Mode || BenchMode_Grow == options.m_Mode )
+        {
+            options.m_EventsCount = 20000;
+        }
+        else if ( BenchMode_Verify == options.m_Mode )
+        {
+            options.m_EventsCount = 4096;
+        }
+    }
+
+    if ( BenchMode_Verify == options.m_Mode && !options.m_FiltersCount )
+    {
+        options.m_FiltersCount = 64;
+    }
+
+    if ( BENCH_CACHE_DEFAULT == options.m_Cache )
+    {
+        // scale, values, box and groups measure evaluation cost
+        options.m_Cache = TRUE;
+        if (
+            BenchMode_Scale == options.m_Mode
+            ||
+            BenchMode_Grow == options.m_Mode
+            ||
+            BenchMode_Values == options.m_Mode
+            ||
+            BenchMode_Box == options.m_Mode
+            ||
+            BenchMode_Groups == options.m_Mode
+            )
+        {
+            options.m_Cache = FALSE;
+        }
+    }
+
+    NTSTATUS status = UmHostStart();
+    if ( !NT_SUCCESS( status ) )
+    {
+        fprintf( stderr, "host start failed 0x%x\n", status );
+        return 1;
+    }
+
+    int result;
+    switch ( options.m_Mode )
+    {
+    case BenchMode_Scale:
+    case BenchMode_Grow:
+        result = RunScale( &options );
+        break;
+
+    case BenchMode_Threads:
+        result = RunThreads( &options );
+        break;
+
+    case BenchMode_Load:
+        result = RunLoad( &options );
+        break;
+
+    case BenchMode_Values:
+        result = RunValues( &options );
+        break;
+
+    case BenchMode_Box:
+        result = RunBox( &options );
+        break;
+
+    case BenchMode_Groups:
+        result = RunGroups( &options );
+        break;
+
+    case BenchMode_Slab:
+        result = RunSlab( &options );
+        break;
+
+    case BenchMode_Verify:
+        result = RunVerify( &options );
+        break;
+
+    default:
+        result = RunVerdict( &options );
+        break;
+    }
+
+    UmHostStop();
+
+    return result;
+}
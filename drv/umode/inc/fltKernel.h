@@ -0,0 +1,825 @@
+//!
+//    \description - user mode replacement of fltKernel.h for the portable
+//                   engine build (drv/umode). Only the subset used by
+//                   fltsystem, memmgr and processhelper is provided.
+//!
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+//////////////////////////////////////////////////////////////////////////
+// compiler
+
+#define NTAPI
+#define FLTAPI
+#define NTSYSAPI
+#define _cdecl
+#define __cdecl
+#define UNALIGNED
+#define FORCEINLINE             static inline __attribute__((always_inline))
+#define DECLSPEC_ALIGN( _x )    __attribute__((aligned( _x )))
+#define DECLSPEC_CACHEALIGN     DECLSPEC_ALIGN( SYSTEM_CACHE_ALIGNMENT_SIZE )
+#define SYSTEM_CACHE_ALIGNMENT_SIZE 64
+
+#define __int64                 long long
+
+#define __debugbreak()          UmDebugBreak()
+
+// structured exception handling: one __try block per function, __leave
+// jumps to the __finally block. Standard C++ headers use __try as well and
+// have to be included before this file.
+#undef __try
+#undef __leave
+#undef __finally
+
+#define __try
+#define __leave                 goto __um_finally
+#define __finally               __um_finally: __attribute__((unused));
+#define AbnormalTermination()   FALSE
+
+//////////////////////////////////////////////////////////////////////////
+// sal
+
+#define __in
+#define __in_opt
+#define __out
+#define __out_opt
+#define __inout
+#define __inout_opt
+#define __deref_out
+#define __deref_out_opt
+#define __checkReturn
+#define __post_invalid
+#define __in_bcount( _x )
+#define __in_bcount_opt( _x )
+#define __inout_bcount( _x )
+#define __in_ecount( _x )
+#define __out_ecount( _x )
+#define __out_ecount_opt( _x )
+#define __inout_ecount( _x )
+#define __out_bcount_part_opt( _x, _y )
+#define __drv_when( _cond, _annotes )
+#define __drv_valueIs( _x )
+#define __drv_freesMem( _x )
+
+//////////////////////////////////////////////////////////////////////////
+// types
+
+typedef void                VOID, *PVOID;
+typedef char                CHAR, *PCHAR;
+typedef unsigned char       UCHAR, *PUCHAR;
+typedef short               SHORT, *PSHORT;
+typedef unsigned short      USHORT, *PUSHORT;
+typedef int                 LONG, *PLONG;
+typedef unsigned int        ULONG, *PULONG;
+typedef long long           LONGLONG, *PLONGLONG;
+typedef unsigned long long  ULONGLONG, *PULONGLONG;
+typedef unsigned long long  ULONG64, *PULONG64;
+typedef long long           LONG64, *PLONG64;
+typedef ULONG               CLONG;
+typedef intptr_t            LONG_PTR, *PLONG_PTR;
+typedef uintptr_t           ULONG_PTR, *PULONG_PTR;
+typedef size_t              SIZE_T, *PSIZE_T;
+typedef UCHAR               BOOLEAN, *PBOOLEAN;
+typedef unsigned short      WCHAR, *PWCHAR, *PWCH, *PWSTR;
+typedef const WCHAR         *PCWSTR;
+typedef LONG                NTSTATUS;
+typedef PVOID               HANDLE, *PHANDLE;
+typedef ULONG               ACCESS_MASK;
+typedef PVOID               PSID;
+typedef PVOID               PEPROCESS;
+typedef PVOID               PETHREAD;
+
+#define TRUE                1
+#define FALSE               0
+
+typedef union _LARGE_INTEGER
+{
+    struct {
+        ULONG   LowPart;
+        LONG    HighPart;
+    };
+    LONGLONG    QuadPart;
+} LARGE_INTEGER, *PLARGE_INTEGER;
+
+typedef struct _LUID
+{
+    ULONG       LowPart;
+    LONG        HighPart;
+} LUID, *PLUID;
+
+typedef struct _GUID
+{
+    ULONG       Data1;
+    USHORT      Data2;
+    USHORT      Data3;
+    UCHAR       Data4[8];
+} GUID, *LPGUID;
+
+#define IsEqualGUID( _a, _b ) ( !memcmp( &( _a ), &( _b ), sizeof( GUID ) ) )
+
+typedef struct _UNICODE_STRING
+{
+    USHORT      Length;
+    USHORT      MaximumLength;
+    PWCH        Buffer;
+} UNICODE_STRING, *PUNICODE_STRING;
+
+typedef struct _LIST_ENTRY
+{
+    struct _LIST_ENTRY* Flink;
+    struct _LIST_ENTRY* Blink;
+} LIST_ENTRY, *PLIST_ENTRY;
+
+typedef enum _POOL_TYPE
+{
+    NonPagedPool,
+    PagedPool,
+} POOL_TYPE;
+
+typedef enum _MODE
+{
+    KernelMode,
+    UserMode,
+} MODE;
+
+typedef char KPROCESSOR_MODE;
+
+//////////////////////////////////////////////////////////////////////////
+// status
+
+#define STATUS_SUCCESS                  ((NTSTATUS)0x00000000L)
+#define STATUS_UNSUCCESSFUL             ((NTSTATUS)0xC0000001L)
+#define STATUS_NOT_IMPLEMENTED          ((NTSTATUS)0xC0000002L)
+#define STATUS_INVALID_PARAMETER        ((NTSTATUS)0xC000000DL)
+#define STATUS_ACCESS_DENIED            ((NTSTATUS)0xC0000022L)
+#define STATUS_BUFFER_TOO_SMALL         ((NTSTATUS)0xC0000023L)
+#define STATUS_QUOTA_EXCEEDED           ((NTSTATUS)0xC0000044L)
+#define STATUS_DELETE_PENDING           ((NTSTATUS)0xC0000056L)
+#define STATUS_INSUFFICIENT_RESOURCES   ((NTSTATUS)0xC000009AL)
+#define STATUS_NOT_SUPPORTED            ((NTSTATUS)0xC00000BBL)
+#define STATUS_INVALID_PARAMETER_2      ((NTSTATUS)0xC00000F0L)
+#define STATUS_INSUFF_SERVER_RESOURCES  ((NTSTATUS)0xC0000205L)
+#define STATUS_NOT_FOUND                ((NTSTATUS)0xC0000225L)
+#define STATUS_ALREADY_REGISTERED       ((NTSTATUS)0xC0000718L)
+#define STATUS_UNHANDLED_EXCEPTION      ((NTSTATUS)0xC0000144L)
+
+#define NT_SUCCESS( _status )           ( ( (NTSTATUS) ( _status ) ) >= 0 )
+
+//////////////////////////////////////////////////////////////////////////
+// helpers
+
+#define UNREFERENCED_PARAMETER( _p )    ( (void) ( _p ) )
+#define ARGUMENT_PRESENT( _p )          ( ( _p ) != NULL )
+
+#define FIELD_OFFSET( _type, _field )   ( (LONG) offsetof( _type, _field ) )
+#define CONTAINING_RECORD( _address, _type, _field ) \
+    ( (_type*) ( (PUCHAR) ( _address ) - offsetof( _type, _field ) ) )
+
+#define ALIGN_UP_BY( _length, _alignment ) \
+    ( ( (ULONG_PTR) ( _length ) + ( _alignment ) - 1 ) & ~( (ULONG_PTR) ( _alignment ) - 1 ) )
+
+#define Add2Ptr( _p, _i )               ( (PVOID) ( (PUCHAR) ( _p ) + ( _i ) ) )
+#define FlagOn( _f, _sf )               ( ( _f ) & ( _sf ) )
+#define BooleanFlagOn( _f, _sf )        ( (BOOLEAN) ( FlagOn( _f, _sf ) != 0 ) )
+#define SetFlag( _f, _sf )              ( ( _f ) |= ( _sf ) )
+#define ClearFlag( _f, _sf )            ( ( _f ) &= ~( _sf ) )
+
+#ifndef min
+#define min( _a, _b )                   ( ( ( _a ) < ( _b ) ) ? ( _a ) : ( _b ) )
+#endif // min
+
+#ifndef max
+#define max( _a, _b )                   ( ( ( _a ) > ( _b ) ) ? ( _a ) : ( _b ) )
+#endif // max
+
+#define UlongToHandle( _ul )            ( (HANDLE) (ULONG_PTR) ( _ul ) )
+#define HandleToUlong( _h )             ( (ULONG) (ULONG_PTR) ( _h ) )
+
+#define RtlCopyMemory( _d, _s, _l )     memcpy( ( _d ), ( _s ), ( _l ) )
+#define RtlMoveMemory( _d, _s, _l )     memmove( ( _d ), ( _s ), ( _l ) )
+#define RtlZeroMemory( _d, _l )         memset( ( _d ), 0, ( _l ) )
+#define RtlFillMemory( _d, _l, _f )     memset( ( _d ), ( _f ), ( _l ) )
+#define RtlEqualMemory( _d, _s, _l )    ( !memcmp( ( _d ), ( _s ), ( _l ) ) )
+
+#ifdef DBG
+#define ASSERT( _exp ) \
+    ( ( !( _exp ) ) ? UmAssertFailed( #_exp, __FILE__, __LINE__ ) : (void) 0 )
+#else
+#define ASSERT( _exp )                  ( (void) 0 )
+#endif // DBG
+
+void
+UmAssertFailed (
+    const char* Expression,
+    const char* File,
+    int Line
+    );
+
+void
+UmDebugBreak (
+    );
+
+SIZE_T
+RtlCompareMemory (
+    const void* Source1,
+    const void* Source2,
+    SIZE_T Length
+    );
+
+//////////////////////////////////////////////////////////////////////////
+// lists
+
+FORCEINLINE
+void
+InitializeListHead (
+    __out PLIST_ENTRY ListHead
+    )
+{
+    ListHead->Flink = ListHead->Blink = ListHead;
+}
+
+FORCEINLINE
+BOOLEAN
+IsListEmpty (
+    __in const LIST_ENTRY* ListHead
+    )
+{
+    return (BOOLEAN) ( ListHead->Flink == ListHead );
+}
+
+FORCEINLINE
+BOOLEAN
+RemoveEntryList (
+    __in PLIST_ENTRY Entry
+    )
+{
+    PLIST_ENTRY Blink = Entry->Blink;
+    PLIST_ENTRY Flink = Entry->Flink;
+
+    Blink->Flink = Flink;
+    Flink->Blink = Blink;
+
+    return (BOOLEAN) ( Flink == Blink );
+}
+
+FORCEINLINE
+PLIST_ENTRY
+RemoveHeadList (
+    __inout PLIST_ENTRY ListHead
+    )
+{
+    PLIST_ENTRY Entry = ListHead->Flink;
+    RemoveEntryList( Entry );
+
+    return Entry;
+}
+
+FORCEINLINE
+void
+InsertTailList (
+    __inout PLIST_ENTRY ListHead,
+    __inout PLIST_ENTRY Entry
+    )
+{
+    PLIST_ENTRY Blink = ListHead->Blink;
+
+    Entry->Flink = ListHead;
+    Entry->Blink = Blink;
+    Blink->Flink = Entry;
+    ListHead->Blink = Entry;
+}
+
+FORCEINLINE
+void
+InsertHeadList (
+    __inout PLIST_ENTRY ListHead,
+    __inout PLIST_ENTRY Entry
+    )
+{
+    PLIST_ENTRY Flink = ListHead->Flink;
+
+    Entry->Flink = Flink;
+    Entry->Blink = ListHead;
+    Flink->Blink = Entry;
+    ListHead->Flink = Entry;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// interlocked
+
+FORCEINLINE
+LONG
+InterlockedIncrement (
+    __inout LONG volatile* Addend
+    )
+{
+    return __atomic_add_fetch( Addend, 1, __ATOMIC_SEQ_CST );
+}
+
+FORCEINLINE
+LONG
+InterlockedDecrement (
+    __inout LONG volatile* Addend
+    )
+{
+    return __atomic_sub_fetch( Addend, 1, __ATOMIC_SEQ_CST );
+}
+
+FORCEINLINE
+LONG
+InterlockedExchangeAdd (
+    __inout LONG volatile* Addend,
+    __in LONG Value
+    )
+{
+    return __atomic_fetch_add( Addend, Value, __ATOMIC_SEQ_CST );
+}
+
+FORCEINLINE
+LONG64
+InterlockedExchangeAdd64 (
+    __inout LONG64 volatile* Addend,
+    __in LONG64 Value
+    )
+{
+    return __atomic_fetch_add( Addend, Value, __ATOMIC_SEQ_CST );
+}
+
+FORCEINLINE
+LONG
+InterlockedExchange (
+    __inout LONG volatile* Target,
+    __in LONG Value
+    )
+{
+    return __atomic_exchange_n( Target, Value, __ATOMIC_SEQ_CST );
+}
+
+FORCEINLINE
+LONG
+InterlockedCompareExchange (
+    __inout LONG volatile* Destination,
+    __in LONG Exchange,
+    __in LONG Comperand
+    )
+{
+    __atomic_compare_exchange_n(
+        Destination,
+        &Comperand,
+        Exchange,
+        FALSE,
+        __ATOMIC_SEQ_CST,
+        __ATOMIC_SEQ_CST
+        );
+
+    return Comperand;
+}
+
+FORCEINLINE
+LONG
+InterlockedOr (
+    __inout LONG volatile* Destination,
+    __in LONG Value
+    )
+{
+    return __atomic_fetch_or( Destination, Value, __ATOMIC_SEQ_CST );
+}
+
+FORCEINLINE
+LONG
+InterlockedAnd (
+    __inout LONG volatile* Destination,
+    __in LONG Value
+    )
+{
+    return __atomic_fetch_and( Destination, Value, __ATOMIC_SEQ_CST );
+}
+
+FORCEINLINE
+PVOID
+InterlockedExchangePointer (
+    __inout PVOID volatile* Target,
+    __in_opt PVOID Value
+    )
+{
+    return __atomic_exchange_n( Target, Value, __ATOMIC_SEQ_CST );
+}
+
+FORCEINLINE
+PVOID
+InterlockedCompareExchangePointer (
+    __inout PVOID volatile* Destination,
+    __in_opt PVOID Exchange,
+    __in_opt PVOID Comperand
+    )
+{
+    __atomic_compare_exchange_n(
+        Destination,
+        &Comperand,
+        Exchange,
+        FALSE,
+        __ATOMIC_SEQ_CST,
+        __ATOMIC_SEQ_CST
+        );
+
+    return Comperand;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// pool
+
+PVOID
+ExAllocatePoolWithTag (
+    __in POOL_TYPE PoolType,
+    __in SIZE_T NumberOfBytes,
+    __in ULONG Tag
+    );
+
+void
+ExFreePool (
+    __in PVOID P
+    );
+
+#define ExFreePoolWithTag( _p, _tag ) ExFreePool( _p )
+
+// keeps up to Depth freed blocks linked through their first pointer.
+// Spin lock instead of SLIST - the engine keeps a list per processor
+typedef struct _PAGED_LOOKASIDE_LIST
+{
+    volatile LONG       Lock;
+    USHORT              Depth;
+    USHORT              Count;
+    PVOID               ListHead;
+    SIZE_T              Size;
+    ULONG               Tag;
+} PAGED_LOOKASIDE_LIST, *PPAGED_LOOKASIDE_LIST;
+
+// Allocate and Free routines are not supported, pass NULL
+void
+ExInitializePagedLookasideList (
+    __out PPAGED_LOOKASIDE_LIST Lookaside,
+    __in_opt PVOID Allocate,
+    __in_opt PVOID Free,
+    __in ULONG Flags,
+    __in SIZE_T Size,
+    __in ULONG Tag,
+    __in USHORT Depth
+    );
+
+void
+ExDeletePagedLookasideList (
+    __inout PPAGED_LOOKASIDE_LIST Lookaside
+    );
+
+PVOID
+ExAllocateFromPagedLookasideList (
+    __inout PPAGED_LOOKASIDE_LIST Lookaside
+    );
+
+void
+ExFreeToPagedLookasideList (
+    __inout PPAGED_LOOKASIDE_LIST Lookaside,
+    __in PVOID Entry
+    );
+
+//////////////////////////////////////////////////////////////////////////
+// synchronization
+
+typedef struct _EX_PUSH_LOCK
+{
+    PVOID       m_Lock;     // pthread_rwlock_t*
+} EX_PUSH_LOCK, *PEX_PUSH_LOCK;
+
+void
+FltInitializePushLock (
+    __out PEX_PUSH_LOCK PushLock
+    );
+
+void
+FltDeletePushLock (
+    __in PEX_PUSH_LOCK PushLock
+    );
+
+void
+FltAcquirePushLockExclusive (
+    __inout PEX_PUSH_LOCK PushLock
+    );
+
+void
+FltAcquirePushLockShared (
+    __inout PEX_PUSH_LOCK PushLock
+    );
+
+void
+FltReleasePushLock (
+    __inout PEX_PUSH_LOCK PushLock
+    );
+
+typedef struct _EX_RUNDOWN_REF
+{
+    volatile ULONG_PTR  Count;  // references * 2 | rundown active
+} EX_RUNDOWN_REF, *PEX_RUNDOWN_REF;
+
+void
+ExInitializeRundownProtection (
+    __out PEX_RUNDOWN_REF RunRef
+    );
+
+void
+ExReInitializeRundownProtection (
+    __out PEX_RUNDOWN_REF RunRef
+    );
+
+BOOLEAN
+ExAcquireRundownProtection (
+    __inout PEX_RUNDOWN_REF RunRef
+    );
+
+void
+ExReleaseRundownProtection (
+    __inout PEX_RUNDOWN_REF RunRef
+    );
+
+void
+ExWaitForRundownProtectionRelease (
+    __inout PEX_RUNDOWN_REF RunRef
+    );
+
+void
+ExRundownCompleted (
+    __inout PEX_RUNDOWN_REF RunRef
+    );
+
+ULONG
+KeGetCurrentProcessorNumber (
+    );
+
+#define KeMemoryBarrier()       __atomic_thread_fence( __ATOMIC_SEQ_CST )
+#define YieldProcessor()        __builtin_ia32_pause()
+
+NTSTATUS
+KeDelayExecutionThread (
+    __in KPROCESSOR_MODE WaitMode,
+    __in BOOLEAN Alertable,
+    __in PLARGE_INTEGER Interval
+    );
+
+ULONG
+KeQueryActiveProcessorCount (
+    __out_opt PVOID ActiveProcessors
+    );
+
+//////////////////////////////////////////////////////////////////////////
+// bitmap
+
+typedef struct _RTL_BITMAP
+{
+    ULONG       SizeOfBitMap;
+    PULONG      Buffer;
+} RTL_BITMAP, *PRTL_BITMAP;
+
+void
+RtlInitializeBitMap (
+    __out PRTL_BITMAP BitMapHeader,
+    __in PULONG BitMapBuffer,
+    __in ULONG SizeOfBitMap
+    );
+
+void
+RtlClearAllBits (
+    __in PRTL_BITMAP BitMapHeader
+    );
+
+void
+RtlSetAllBits (
+    __in PRTL_BITMAP BitMapHeader
+    );
+
+void
+RtlSetBit (
+    __in PRTL_BITMAP BitMapHeader,
+    __in ULONG BitNumber
+    );
+
+void
+RtlClearBit (
+    __in PRTL_BITMAP BitMapHeader,
+    __in ULONG BitNumber
+    );
+
+BOOLEAN
+RtlTestBit (
+    __in PRTL_BITMAP BitMapHeader,
+    __in ULONG BitNumber
+    );
+
+#define RtlCheckBit( _bmh, _bp ) RtlTestBit( ( _bmh ), ( _bp ) )
+
+ULONG
+RtlFindClearBits (
+    __in PRTL_BITMAP BitMapHeader,
+    __in ULONG NumberToFind,
+    __in ULONG HintIndex
+    );
+
+ULONG
+RtlFindSetBits (
+    __in PRTL_BITMAP BitMapHeader,
+    __in ULONG NumberToFind,
+    __in ULONG HintIndex
+    );
+
+ULONG
+RtlNumberOfSetBits (
+    __in PRTL_BITMAP BitMapHeader
+    );
+
+//////////////////////////////////////////////////////////////////////////
+// generic table
+
+typedef enum _RTL_GENERIC_COMPARE_RESULTS
+{
+    GenericLessThan,
+    GenericGreaterThan,
+    GenericEqual
+} RTL_GENERIC_COMPARE_RESULTS;
+
+struct _RTL_AVL_TABLE;
+
+typedef
+RTL_GENERIC_COMPARE_RESULTS
+NTAPI
+RTL_AVL_COMPARE_ROUTINE (
+    __in struct _RTL_AVL_TABLE *Table,
+    __in PVOID FirstStruct,
+    __in PVOID SecondStruct
+    );
+
+typedef RTL_AVL_COMPARE_ROUTINE *PRTL_AVL_COMPARE_ROUTINE;
+
+typedef
+PVOID
+NTAPI
+RTL_AVL_ALLOCATE_ROUTINE (
+    __in struct _RTL_AVL_TABLE *Table,
+    __in CLONG ByteSize
+    );
+
+typedef RTL_AVL_ALLOCATE_ROUTINE *PRTL_AVL_ALLOCATE_ROUTINE;
+
+typedef
+void
+NTAPI
+RTL_AVL_FREE_ROUTINE (
+    __in struct _RTL_AVL_TABLE *Table,
+    __in PVOID Buffer
+    );
+
+typedef RTL_AVL_FREE_ROUTINE *PRTL_AVL_FREE_ROUTINE;
+
+// sorted element vector with the RTL_AVL_TABLE contract
+typedef struct _RTL_AVL_TABLE
+{
+    PVOID*                      m_Elements;
+    ULONG                       m_Capacity;
+    ULONG                       NumberGenericTableElements;
+    ULONG                       m_RestartKey;
+    PRTL_AVL_COMPARE_ROUTINE    CompareRoutine;
+    PRTL_AVL_ALLOCATE_ROUTINE   AllocateRoutine;
+    PRTL_AVL_FREE_ROUTINE       FreeRoutine;
+    PVOID                       TableContext;
+} RTL_AVL_TABLE, *PRTL_AVL_TABLE;
+
+void
+RtlInitializeGenericTableAvl (
+    __out PRTL_AVL_TABLE Table,
+    __in PRTL_AVL_COMPARE_ROUTINE CompareRoutine,
+    __in PRTL_AVL_ALLOCATE_ROUTINE AllocateRoutine,
+    __in PRTL_AVL_FREE_ROUTINE FreeRoutine,
+    __in_opt PVOID TableContext
+    );
+
+PVOID
+RtlInsertElementGenericTableAvl (
+    __in PRTL_AVL_TABLE Table,
+    __in PVOID Buffer,
+    __in CLONG BufferSize,
+    __out_opt PBOOLEAN NewElement
+    );
+
+BOOLEAN
+RtlDeleteElementGenericTableAvl (
+    __in PRTL_AVL_TABLE Table,
+    __in PVOID Buffer
+    );
+
+PVOID
+RtlLookupElementGenericTableAvl (
+    __in PRTL_AVL_TABLE Table,
+    __in PVOID Buffer
+    );
+
+PVOID
+RtlEnumerateGenericTableAvl (
+    __in PRTL_AVL_TABLE Table,
+    __in BOOLEAN Restart
+    );
+
+PVOID
+RtlEnumerateGenericTableWithoutSplayingAvl (
+    __in PRTL_AVL_TABLE Table,
+    __inout PVOID* RestartKey
+    );
+
+ULONG
+RtlNumberGenericTableElementsAvl (
+    __in PRTL_AVL_TABLE Table
+    );
+
+//////////////////////////////////////////////////////////////////////////
+// strings
+
+#define RtlInitEmptyUnicodeString( _ucStr, _buf, _bufSize ) \
+    ( ( _ucStr )->Buffer = ( _buf ), \
+      ( _ucStr )->Length = 0, \
+      ( _ucStr )->MaximumLength = (USHORT) ( _bufSize ) )
+
+WCHAR
+RtlUpcaseUnicodeChar (
+    __in WCHAR SourceCharacter
+    );
+
+NTSTATUS
+RtlUpcaseUnicodeString (
+    __inout PUNICODE_STRING DestinationString,
+    __in PUNICODE_STRING SourceString,
+    __in BOOLEAN AllocateDestinationString
+    );
+
+void
+RtlFreeUnicodeString (
+    __inout PUNICODE_STRING UnicodeString
+    );
+
+//////////////////////////////////////////////////////////////////////////
+// processes
+
+#define NTDDI_WIN6  0x06000000
+#define NTDDI_WIN7  0x06010000
+
+#ifndef NTDDI_VERSION
+#define NTDDI_VERSION NTDDI_WIN7
+#endif // NTDDI_VERSION
+
+typedef struct _PS_CREATE_NOTIFY_INFO
+{
+    SIZE_T      Size;
+    HANDLE      ParentProcessId;
+} PS_CREATE_NOTIFY_INFO, *PPS_CREATE_NOTIFY_INFO;
+
+typedef
+void
+( NTAPI *PCREATE_PROCESS_NOTIFY_ROUTINE ) (
+    __in HANDLE ParentId,
+    __in HANDLE ProcessId,
+    __in BOOLEAN Create
+    );
+
+typedef
+void
+( NTAPI *PCREATE_PROCESS_NOTIFY_ROUTINE_EX ) (
+    __inout PEPROCESS Process,
+    __in HANDLE ProcessId,
+    __in_opt PPS_CREATE_NOTIFY_INFO CreateInfo
+    );
+
+NTSTATUS
+PsSetCreateProcessNotifyRoutine (
+    __in PCREATE_PROCESS_NOTIFY_ROUTINE NotifyRoutine,
+    __in BOOLEAN Remove
+    );
+
+NTSTATUS
+PsSetCreateProcessNotifyRoutineEx (
+    __in PCREATE_PROCESS_NOTIFY_ROUTINE_EX NotifyRoutine,
+    __in BOOLEAN Remove
+    );
+
+HANDLE
+PsGetCurrentProcessId (
+    );
+
+//////////////////////////////////////////////////////////////////////////
+// tracing
+
+#define TRACE_LEVEL_CRITICAL        1
+#define TRACE_LEVEL_ERROR           2
+#define TRACE_LEVEL_WARNING         3
+#define TRACE_LEVEL_INFORMATION     4
+#define TRACE_LEVEL_VERBOSE         5
+
+#define DoTraceEx( _level, _flags, ... ) ( (void) 0 )
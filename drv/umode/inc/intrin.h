@@ -0,0 +1,40 @@
+//!
+//    \description - user mode replacement of the MSVC intrin.h subset
+//                   used by the engine.
+//!
+
+#pragma once
+
+FORCEINLINE
+BOOLEAN
+_BitScanForward (
+    __out PULONG Index,
+    __in ULONG Mask
+    )
+{
+    if ( !Mask )
+    {
+        return FALSE;
+    }
+
+    *Index = __builtin_ctz( Mask );
+
+    return TRUE;
+}
+
+FORCEINLINE
+BOOLEAN
+_BitScanForward64 (
+    __out PULONG Index,
+    __in ULONG64 Mask
+    )
+{
+    if ( !Mask )
+    {
+        return FALSE;
+    }
+
+    *Index = __builtin_ctzll( Mask );
+
+    return TRUE;
+}
@@ -0,0 +1,5 @@
+//!
+//    \description - user mode replacement, see fltKernel.h
+//!
+
+#pragma once
@@ -0,0 +1,3 @@
+// user mode replacement of poppack.h
+
+#pragma pack( pop )
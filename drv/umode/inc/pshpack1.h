@@ -0,0 +1,3 @@
+// user mode replacement of pshpack1.h
+
+#pragma pack( push, 1 )
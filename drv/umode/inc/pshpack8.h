@@ -0,0 +1,3 @@
+// user mode replacement of pshpack8.h
+
+#pragma pack( push, 8 )
@@ -0,0 +1,109 @@
+#include "../inc/commonkrnl.h"
+#include "../inc/memmgr.h"
+#include "../inc/processhelper.h"
+#include "umhost.h"
+
+typedef struct _UmGlobals
+{
+    FilteringSystem*        m_FilteringSystem;
+    ProcessHelper*          m_ProcessHelper;
+} UmGlobals;
+
+UmGlobals gUmHost = { 0 };
+
+extern PCREATE_PROCESS_NOTIFY_ROUTINE gUmProcessNotify;
+
+__checkReturn
+NTSTATUS
+UmHostStart (
+    )
+{
+    ASSERT( !gUmHost.m_ProcessHelper );
+
+    NTSTATUS status = MemSlabInitialize();
+    if ( !NT_SUCCESS( status ) )
+    {
+        return status;
+    }
+
+    gUmHost.m_ProcessHelper = new (
+        PagedPool,
+        ProcessHelper::m_AllocTag
+        ) ProcessHelper;
+
+    if ( !gUmHost.m_ProcessHelper )
+    {
+        UmHostStop();
+
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    gUmHost.m_FilteringSystem = new (
+        PagedPool,
+        FilteringSystem::m_AllocTag
+        ) FilteringSystem;
+
+    if ( !gUmHost.m_FilteringSystem )
+    {
+        UmHostStop();
+
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+void
+UmHostStop (
+    )
+{
+    FREE_OBJECT( gUmHost.m_FilteringSystem );
+    FREE_OBJECT( gUmHost.m_ProcessHelper );
+
+    MemSlabDestroy();
+}
+
+ProcessHelper*
+UmHostGetProcessHelper (
+    )
+{
+    return gUmHost.m_ProcessHelper;
+}
+
+FilteringSystem*
+UmHostGetFilteringSystem (
+    )
+{
+    return gUmHost.m_FilteringSystem;
+}
+
+void
+UmHostNotifyProcess (
+    __in HANDLE ProcessId,
+    __in BOOLEAN Create
+    )
+{
+    if ( gUmProcessNotify )
+    {
+        gUmProcessNotify( NULL, ProcessId, Create );
+    }
+}
+
+void
+RegisterProcess (
+    HANDLE ProcessId
+    )
+{
+    NTSTATUS status = gUmHost.m_ProcessHelper->RegisterProcessItem( ProcessId );
+
+    ASSERT( NT_SUCCESS( status ) );
+    UNREFERENCED_PARAMETER( status );
+}
+
+void
+UnregisterProcess (
+    HANDLE ProcessId
+    )
+{
+    gUmHost.m_ProcessHelper->UnregisterProcessItem( ProcessId );
+}
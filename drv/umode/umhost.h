@@ -0,0 +1,32 @@
+//!
+//    \description - user mode host of the filtering engine. Plays the part
+//                   of DriverEntry/DriverUnload for the portable build.
+//!
+
+#pragma once
+
+#include "../inc/fltsystem.h"
+
+__checkReturn
+NTSTATUS
+UmHostStart (
+    );
+
+void
+UmHostStop (
+    );
+
+ProcessHelper*
+UmHostGetProcessHelper (
+    );
+
+FilteringSystem*
+UmHostGetFilteringSystem (
+    );
+
+// deliver process create/exit notification as PsSetCreateProcessNotifyRoutine does
+void
+UmHostNotifyProcess (
+    __in HANDLE ProcessId,
+    __in BOOLEAN Create
+    );
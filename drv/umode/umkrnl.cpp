@@ -0,0 +1,948 @@
+//!
+//    \description - user mode implementation of the kernel routines
+//                   declared in umode/inc/fltKernel.h
+//!
+
+#include "../inc/commonkrnl.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+//////////////////////////////////////////////////////////////////////////
+// common
+
+void
+UmAssertFailed (
+    const char* Expression,
+    const char* File,
+    int Line
+    )
+{
+    fprintf( stderr, "ASSERT( %s ) failed at %s:%d\n", Expression, File, Line );
+    abort();
+}
+
+void
+UmDebugBreak (
+    )
+{
+    // kernel build breaks into debugger, here it is only a marker point
+}
+
+SIZE_T
+RtlCompareMemory (
+    const void* Source1,
+    const void* Source2,
+    SIZE_T Length
+    )
+{
+    const UCHAR* p1 = (const UCHAR*) Source1;
+    const UCHAR* p2 = (const UCHAR*) Source2;
+
+    SIZE_T idx = 0;
+    while ( idx < Length && p1[ idx ] == p2[ idx ] )
+    {
+        idx++;
+    }
+
+    return idx;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// pool
+
+PVOID
+ExAllocatePoolWithTag (
+    __in POOL_TYPE PoolType,
+    __in SIZE_T NumberOfBytes,
+    __in ULONG Tag
+    )
+{
+    UNREFERENCED_PARAMETER( PoolType );
+    UNREFERENCED_PARAMETER( Tag );
+
+    return malloc( NumberOfBytes );
+}
+
+void
+ExFreePool (
+    __in PVOID P
+    )
+{
+    free( P );
+}
+
+// kernel adjusts depth by hit rate, here it is fixed
+#define UM_LOOKASIDE_DEPTH      256
+
+void
+UmLookasideLockp (
+    __inout PPAGED_LOOKASIDE_LIST Lookaside
+    )
+{
+    // owner may be preempted - give up the processor instead of spinning
+    while ( InterlockedCompareExchange( &Lookaside->Lock, 1, 0 ) )
+    {
+        sched_yield();
+    }
+}
+
+void
+UmLookasideUnlockp (
+    __inout PPAGED_LOOKASIDE_LIST Lookaside
+    )
+{
+    __atomic_store_n( &Lookaside->Lock, 0, __ATOMIC_RELEASE );
+}
+
+void
+ExInitializePagedLookasideList (
+    __out PPAGED_LOOKASIDE_LIST Lookaside,
+    __in_opt PVOID Allocate,
+    __in_opt PVOID Free,
+    __in ULONG Flags,
+    __in SIZE_T Size,
+    __in ULONG Tag,
+    __in USHORT Depth
+    )
+{
+    ASSERT( !Allocate && !Free );
+    ASSERT( Size >= sizeof( PVOID ) );
+
+    UNREFERENCED_PARAMETER( Allocate );
+    UNREFERENCED_PARAMETER( Free );
+    UNREFERENCED_PARAMETER( Flags );
+
+    Lookaside->Lock = 0;
+    Lookaside->Depth = Depth ? Depth : UM_LOOKASIDE_DEPTH;
+    Lookaside->Count = 0;
+    Lookaside->ListHead = NULL;
+    Lookaside->Size = Size;
+    Lookaside->Tag = Tag;
+}
+
+void
+ExDeletePagedLookasideList (
+    __inout PPAGED_LOOKASIDE_LIST Lookaside
+    )
+{
+    while ( Lookaside->ListHead )
+    {
+        PVOID entry = Lookaside->ListHead;
+        Lookaside->ListHead = *(PVOID*) entry;
+
+        free( entry );
+    }
+
+    Lookaside->Count = 0;
+}
+
+PVOID
+ExAllocateFromPagedLookasideList (
+    __inout PPAGED_LOOKASIDE_LIST Lookaside
+    )
+{
+    UmLookasideLockp( Lookaside );
+
+    PVOID entry = Lookaside->ListHead;
+    if ( entry )
+    {
+        Lookaside->ListHead = *(PVOID*) entry;
+        Lookaside->Count--;
+    }
+
+    UmLookasideUnlockp( Lookaside );
+
+    if ( !entry )
+    {
+        entry = ExAllocatePoolWithTag( PagedPool, Lookaside->Size, Lookaside->Tag );
+    }
+
+    return entry;
+}
+
+void
+ExFreeToPagedLookasideList (
+    __inout PPAGED_LOOKASIDE_LIST Lookaside,
+    __in PVOID Entry
+    )
+{
+    UmLookasideLockp( Lookaside );
+
+    if ( Lookaside->Count < Lookaside->Depth )
+    {
+        *(PVOID*) Entry = Lookaside->ListHead;
+        Lookaside->ListHead = Entry;
+        Lookaside->Count++;
+
+        Entry = NULL;
+    }
+
+    UmLookasideUnlockp( Lookaside );
+
+    if ( Entry )
+    {
+        ExFreePool( Entry );
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// synchronization
+
+void
+FltInitializePushLock (
+    __out PEX_PUSH_LOCK PushLock
+    )
+{
+    pthread_rwlock_t* pLock = (pthread_rwlock_t*) malloc( sizeof( pthread_rwlock_t ) );
+    if ( !pLock )
+    {
+        abort();
+    }
+
+    pthread_rwlock_init( pLock, NULL );
+    PushLock->m_Lock = pLock;
+}
+
+void
+FltDeletePushLock (
+    __in PEX_PUSH_LOCK PushLock
+    )
+{
+    pthread_rwlock_t* pLock = (pthread_rwlock_t*) PushLock->m_Lock;
+    if ( !pLock )
+    {
+        return;
+    }
+
+    pthread_rwlock_destroy( pLock );
+    free( pLock );
+
+    PushLock->m_Lock = NULL;
+}
+
+void
+FltAcquirePushLockExclusive (
+    __inout PEX_PUSH_LOCK PushLock
+    )
+{
+    pthread_rwlock_wrlock( (pthread_rwlock_t*) PushLock->m_Lock );
+}
+
+void
+FltAcquirePushLockShared (
+    __inout PEX_PUSH_LOCK PushLock
+    )
+{
+    pthread_rwlock_rdlock( (pthread_rwlock_t*) PushLock->m_Lock );
+}
+
+void
+FltReleasePushLock (
+    __inout PEX_PUSH_LOCK PushLock
+    )
+{
+    pthread_rwlock_unlock( (pthread_rwlock_t*) PushLock->m_Lock );
+}
+
+#define _RUNDOWN_ACTIVE     1
+#define _RUNDOWN_INCREMENT  2
+
+void
+ExInitializeRundownProtection (
+    __out PEX_RUNDOWN_REF RunRef
+    )
+{
+    RunRef->Count = 0;
+}
+
+void
+ExReInitializeRundownProtection (
+    __out PEX_RUNDOWN_REF RunRef
+    )
+{
+    __atomic_store_n( &RunRef->Count, 0, __ATOMIC_SEQ_CST );
+}
+
+BOOLEAN
+ExAcquireRundownProtection (
+    __inout PEX_RUNDOWN_REF RunRef
+    )
+{
+    ULONG_PTR value = __atomic_load_n( &RunRef->Count, __ATOMIC_RELAXED );
+
+    while ( TRUE )
+    {
+        if ( FlagOn( value, _RUNDOWN_ACTIVE ) )
+        {
+            return FALSE;
+        }
+
+        if ( __atomic_compare_exchange_n(
+            &RunRef->Count,
+            &value,
+            value + _RUNDOWN_INCREMENT,
+            TRUE,
+            __ATOMIC_ACQUIRE,
+            __ATOMIC_RELAXED
+            ) )
+        {
+            return TRUE;
+        }
+    }
+}
+
+void
+ExReleaseRundownProtection (
+    __inout PEX_RUNDOWN_REF RunRef
+    )
+{
+    __atomic_sub_fetch( &RunRef->Count, _RUNDOWN_INCREMENT, __ATOMIC_RELEASE );
+}
+
+void
+ExWaitForRundownProtectionRelease (
+    __inout PEX_RUNDOWN_REF RunRef
+    )
+{
+    __atomic_fetch_or( &RunRef->Count, _RUNDOWN_ACTIVE, __ATOMIC_SEQ_CST );
+
+    while ( __atomic_load_n( &RunRef->Count, __ATOMIC_ACQUIRE ) != _RUNDOWN_ACTIVE )
+    {
+        sched_yield();
+    }
+}
+
+void
+ExRundownCompleted (
+    __inout PEX_RUNDOWN_REF RunRef
+    )
+{
+    __atomic_store_n( &RunRef->Count, _RUNDOWN_ACTIVE, __ATOMIC_SEQ_CST );
+}
+
+ULONG
+KeGetCurrentProcessorNumber (
+    )
+{
+    int cpu = sched_getcpu();
+    if ( cpu < 0 )
+    {
+        return 0;
+    }
+
+    return (ULONG) cpu;
+}
+
+NTSTATUS
+KeDelayExecutionThread (
+    __in KPROCESSOR_MODE WaitMode,
+    __in BOOLEAN Alertable,
+    __in PLARGE_INTEGER Interval
+    )
+{
+    UNREFERENCED_PARAMETER( WaitMode );
+    UNREFERENCED_PARAMETER( Alertable );
+
+    // relative intervals only, 100ns units
+    LONGLONG interval = Interval->QuadPart < 0 ? -Interval->QuadPart : 0;
+    usleep( (useconds_t) ( interval / 10 ) );
+
+    return STATUS_SUCCESS;
+}
+
+ULONG
+KeQueryActiveProcessorCount (
+    __out_opt PVOID ActiveProcessors
+    )
+{
+    UNREFERENCED_PARAMETER( ActiveProcessors );
+
+    long count = sysconf( _SC_NPROCESSORS_CONF );
+    if ( count < 1 )
+    {
+        return 1;
+    }
+
+    return (ULONG) count;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// bitmap
+
+void
+RtlInitializeBitMap (
+    __out PRTL_BITMAP BitMapHeader,
+    __in PULONG BitMapBuffer,
+    __in ULONG SizeOfBitMap
+    )
+{
+    BitMapHeader->SizeOfBitMap = SizeOfBitMap;
+    BitMapHeader->Buffer = BitMapBuffer;
+}
+
+void
+RtlClearAllBits (
+    __in PRTL_BITMAP BitMapHeader
+    )
+{
+    RtlZeroMemory(
+        BitMapHeader->Buffer,
+        ( ( BitMapHeader->SizeOfBitMap + 31 ) / 32 ) * sizeof( ULONG )
+        );
+}
+
+void
+RtlSetAllBits (
+    __in PRTL_BITMAP BitMapHeader
+    )
+{
+    RtlFillMemory(
+        BitMapHeader->Buffer,
+        ( ( BitMapHeader->SizeOfBitMap + 31 ) / 32 ) * sizeof( ULONG ),
+        0xff
+        );
+}
+
+void
+RtlSetBit (
+    __in PRTL_BITMAP BitMapHeader,
+    __in ULONG BitNumber
+    )
+{
+    ASSERT( BitNumber < BitMapHeader->SizeOfBitMap );
+
+    BitMapHeader->Buffer[ BitNumber / 32 ] |= 1u << ( BitNumber % 32 );
+}
+
+void
+RtlClearBit (
+    __in PRTL_BITMAP BitMapHeader,
+    __in ULONG BitNumber
+    )
+{
+    ASSERT( BitNumber < BitMapHeader->SizeOfBitMap );
+
+    BitMapHeader->Buffer[ BitNumber / 32 ] &= ~( 1u << ( BitNumber % 32 ) );
+}
+
+BOOLEAN
+RtlTestBit (
+    __in PRTL_BITMAP BitMapHeader,
+    __in ULONG BitNumber
+    )
+{
+    ASSERT( BitNumber < BitMapHeader->SizeOfBitMap );
+
+    return (BOOLEAN) ( ( BitMapHeader->Buffer[ BitNumber / 32 ] >> ( BitNumber % 32 ) ) & 1 );
+}
+
+ULONG
+RtlFindBitInRangep (
+    __in PRTL_BITMAP BitMapHeader,
+    __in ULONG From,
+    __in ULONG To,
+    __in BOOLEAN Set
+    )
+{
+    ULONG idx = From;
+
+    while ( idx < To )
+    {
+        ULONG word = BitMapHeader->Buffer[ idx / 32 ];
+        if ( !Set )
+        {
+            word = ~word;
+        }
+
+        word &= 0xffffffff << ( idx % 32 );
+        if ( word )
+        {
+            ULONG found = ( idx & ~31 ) + __builtin_ctz( word );
+
+            return found < To ? found : 0xffffffff;
+        }
+
+        idx = ( idx & ~31 ) + 32;
+    }
+
+    return 0xffffffff;
+}
+
+ULONG
+RtlFindBitsp (
+    __in PRTL_BITMAP BitMapHeader,
+    __in ULONG NumberToFind,
+    __in ULONG HintIndex,
+    __in BOOLEAN Set
+    )
+{
+    ULONG size = BitMapHeader->SizeOfBitMap;
+
+    if ( !NumberToFind || NumberToFind > size )
+    {
+        return 0xffffffff;
+    }
+
+    if ( HintIndex >= size )
+    {
+        HintIndex = 0;
+    }
+
+    if ( NumberToFind == 1 )
+    {
+        ULONG found = RtlFindBitInRangep( BitMapHeader, HintIndex, size, Set );
+        if ( found == 0xffffffff )
+        {
+            found = RtlFindBitInRangep( BitMapHeader, 0, HintIndex, Set );
+        }
+
+        return found;
+    }
+
+    // scan from hint to the end, then wrap around as RTL does
+    ULONG run = 0;
+    for ( ULONG idx = HintIndex; idx < size; idx++ )
+    {
+        run = ( RtlTestBit( BitMapHeader, idx ) == Set ) ? run + 1 : 0;
+        if ( run == NumberToFind )
+        {
+            return idx + 1 - NumberToFind;
+        }
+    }
+
+    run = 0;
+    for ( ULONG idx = 0; idx < size; idx++ )
+    {
+        run = ( RtlTestBit( BitMapHeader, idx ) == Set ) ? run + 1 : 0;
+        if ( run == NumberToFind )
+        {
+            return idx + 1 - NumberToFind;
+        }
+    }
+
+    return 0xffffffff;
+}
+
+ULONG
+RtlFindClearBits (
+    __in PRTL_BITMAP BitMapHeader,
+    __in ULONG NumberToFind,
+    __in ULONG HintIndex
+    )
+{
+    return RtlFindBitsp( BitMapHeader, NumberToFind, HintIndex, FALSE );
+}
+
+ULONG
+RtlFindSetBits (
+    __in PRTL_BITMAP BitMapHeader,
+    __in ULONG NumberToFind,
+    __in ULONG HintIndex
+    )
+{
+    return RtlFindBitsp( BitMapHeader, NumberToFind, HintIndex, TRUE );
+}
+
+ULONG
+RtlNumberOfSetBits (
+    __in PRTL_BITMAP BitMapHeader
+    )
+{
+    ULONG count = 0;
+    ULONG words = ( BitMapHeader->SizeOfBitMap + 31 ) / 32;
+
+    for ( ULONG idx = 0; idx < words; idx++ )
+    {
+        ULONG word = BitMapHeader->Buffer[ idx ];
+        if ( idx == words - 1 && BitMapHeader->SizeOfBitMap % 32 )
+        {
+            word &= ( 1u << ( BitMapHeader->SizeOfBitMap % 32 ) ) - 1;
+        }
+
+        count += __builtin_popcount( word );
+    }
+
+    return count;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// generic table
+
+void
+RtlInitializeGenericTableAvl (
+    __out PRTL_AVL_TABLE Table,
+    __in PRTL_AVL_COMPARE_ROUTINE CompareRoutine,
+    __in PRTL_AVL_ALLOCATE_ROUTINE AllocateRoutine,
+    __in PRTL_AVL_FREE_ROUTINE FreeRoutine,
+    __in_opt PVOID TableContext
+    )
+{
+    RtlZeroMemory( Table, sizeof( RTL_AVL_TABLE ) );
+
+    Table->CompareRoutine = CompareRoutine;
+    Table->AllocateRoutine = AllocateRoutine;
+    Table->FreeRoutine = FreeRoutine;
+    Table->TableContext = TableContext;
+}
+
+// returns position of the element or insert position
+BOOLEAN
+RtlGenericTableSearchp (
+    __in PRTL_AVL_TABLE Table,
+    __in PVOID Buffer,
+    __out PULONG Position
+    )
+{
+    ULONG low = 0;
+    ULONG high = Table->NumberGenericTableElements;
+
+    while ( low < high )
+    {
+        ULONG mid = ( low + high ) / 2;
+
+        RTL_GENERIC_COMPARE_RESULTS result = Table->CompareRoutine(
+            Table,
+            Buffer,
+            Table->m_Elements[ mid ]
+            );
+
+        if ( GenericEqual == result )
+        {
+            *Position = mid;
+            return TRUE;
+        }
+
+        if ( GenericLessThan == result )
+        {
+            high = mid;
+        }
+        else
+        {
+            low = mid + 1;
+        }
+    }
+
+    *Position = low;
+
+    return FALSE;
+}
+
+PVOID
+RtlInsertElementGenericTableAvl (
+    __in PRTL_AVL_TABLE Table,
+    __in PVOID Buffer,
+    __in CLONG BufferSize,
+    __out_opt PBOOLEAN NewElement
+    )
+{
+    ULONG position;
+
+    if ( NewElement )
+    {
+        *NewElement = FALSE;
+    }
+
+    if ( RtlGenericTableSearchp( Table, Buffer, &position ) )
+    {
+        return Table->m_Elements[ position ];
+    }
+
+    if ( Table->NumberGenericTableElements == Table->m_Capacity )
+    {
+        ULONG capacity = Table->m_Capacity ? Table->m_Capacity * 2 : 8;
+        PVOID* pElements = (PVOID*) ExAllocatePoolWithTag(
+            PagedPool,
+            capacity * sizeof( PVOID ),
+            'taSA'
+            );
+
+        if ( !pElements )
+        {
+            return NULL;
+        }
+
+        if ( Table->m_Elements )
+        {
+            RtlCopyMemory(
+                pElements,
+                Table->m_Elements,
+                Table->NumberGenericTableElements * sizeof( PVOID )
+                );
+
+            ExFreePool( Table->m_Elements );
+        }
+
+        Table->m_Elements = pElements;
+        Table->m_Capacity = capacity;
+    }
+
+    PVOID pElement = Table->AllocateRoutine( Table, BufferSize );
+    if ( !pElement )
+    {
+        return NULL;
+    }
+
+    RtlCopyMemory( pElement, Buffer, BufferSize );
+
+    RtlMoveMemory(
+        &Table->m_Elements[ position + 1 ],
+        &Table->m_Elements[ position ],
+        ( Table->NumberGenericTableElements - position ) * sizeof( PVOID )
+        );
+
+    Table->m_Elements[ position ] = pElement;
+    Table->NumberGenericTableElements++;
+
+    if ( NewElement )
+    {
+        *NewElement = TRUE;
+    }
+
+    return pElement;
+}
+
+BOOLEAN
+RtlDeleteElementGenericTableAvl (
+    __in PRTL_AVL_TABLE Table,
+    __in PVOID Buffer
+    )
+{
+    ULONG position;
+
+    if ( !RtlGenericTableSearchp( Table, Buffer, &position ) )
+    {
+        return FALSE;
+    }
+
+    PVOID pElement = Table->m_Elements[ position ];
+
+    Table->NumberGenericTableElements--;
+    RtlMoveMemory(
+        &Table->m_Elements[ position ],
+        &Table->m_Elements[ position + 1 ],
+        ( Table->NumberGenericTableElements - position ) * sizeof( PVOID )
+        );
+
+    Table->FreeRoutine( Table, pElement );
+
+    if ( !Table->NumberGenericTableElements )
+    {
+        ExFreePool( Table->m_Elements );
+        Table->m_Elements = NULL;
+        Table->m_Capacity = 0;
+    }
+
+    return TRUE;
+}
+
+PVOID
+RtlLookupElementGenericTableAvl (
+    __in PRTL_AVL_TABLE Table,
+    __in PVOID Buffer
+    )
+{
+    ULONG position;
+
+    if ( !RtlGenericTableSearchp( Table, Buffer, &position ) )
+    {
+        return NULL;
+    }
+
+    return Table->m_Elements[ position ];
+}
+
+PVOID
+RtlEnumerateGenericTableAvl (
+    __in PRTL_AVL_TABLE Table,
+    __in BOOLEAN Restart
+    )
+{
+    if ( Restart )
+    {
+        Table->m_RestartKey = 0;
+    }
+
+    if ( Table->m_RestartKey >= Table->NumberGenericTableElements )
+    {
+        return NULL;
+    }
+
+    return Table->m_Elements[ Table->m_RestartKey++ ];
+}
+
+PVOID
+RtlEnumerateGenericTableWithoutSplayingAvl (
+    __in PRTL_AVL_TABLE Table,
+    __inout PVOID* RestartKey
+    )
+{
+    // key is the next position, NULL starts from the first element
+    ULONG_PTR position = (ULONG_PTR) *RestartKey;
+
+    if ( position >= Table->NumberGenericTableElements )
+    {
+        return NULL;
+    }
+
+    *RestartKey = (PVOID) ( position + 1 );
+
+    return Table->m_Elements[ position ];
+}
+
+ULONG
+RtlNumberGenericTableElementsAvl (
+    __in PRTL_AVL_TABLE Table
+    )
+{
+    return Table->NumberGenericTableElements;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// strings
+
+WCHAR
+RtlUpcaseUnicodeChar (
+    __in WCHAR SourceCharacter
+    )
+{
+    WCHAR ch = SourceCharacter;
+
+    if ( ch < 'a' )
+    {
+        return ch;
+    }
+
+    if ( ch <= 'z' )
+    {
+        return ch - ( 'a' - 'A' );
+    }
+
+    // latin-1, greek and cyrillic blocks of the nls upcase table
+    if ( ( ch >= 0x00e0 && ch <= 0x00fe && ch != 0x00f7 )
+        ||
+        ( ch >= 0x03b1 && ch <= 0x03cb && ch != 0x03c2 )
+        ||
+        ( ch >= 0x0430 && ch <= 0x044f ) )
+    {
+        return ch - 0x20;
+    }
+
+    if ( ch >= 0x0450 && ch <= 0x045f )
+    {
+        return ch - 0x50;
+    }
+
+    if ( ch == 0x00ff )
+    {
+        return 0x0178;
+    }
+
+    return ch;
+}
+
+NTSTATUS
+RtlUpcaseUnicodeString (
+    __inout PUNICODE_STRING DestinationString,
+    __in PUNICODE_STRING SourceString,
+    __in BOOLEAN AllocateDestinationString
+    )
+{
+    if ( AllocateDestinationString )
+    {
+        DestinationString->Buffer = (PWCH) ExAllocatePoolWithTag(
+            PagedPool,
+            SourceString->Length ? SourceString->Length : sizeof( WCHAR ),
+            'suSA'
+            );
+
+        if ( !DestinationString->Buffer )
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        DestinationString->MaximumLength = SourceString->Length;
+    }
+    else if ( DestinationString->MaximumLength < SourceString->Length )
+    {
+        return STATUS_BUFFER_TOO_SMALL;
+    }
+
+    ULONG count = SourceString->Length / sizeof( WCHAR );
+    for ( ULONG idx = 0; idx < count; idx++ )
+    {
+        DestinationString->Buffer[ idx ] = RtlUpcaseUnicodeChar( SourceString->Buffer[ idx ] );
+    }
+
+    DestinationString->Length = SourceString->Length;
+
+    return STATUS_SUCCESS;
+}
+
+void
+RtlFreeUnicodeString (
+    __inout PUNICODE_STRING UnicodeString
+    )
+{
+    if ( UnicodeString->Buffer )
+    {
+        ExFreePool( UnicodeString->Buffer );
+    }
+
+    RtlInitEmptyUnicodeString( UnicodeString, NULL, 0 );
+}
+
+//////////////////////////////////////////////////////////////////////////
+// processes
+
+PCREATE_PROCESS_NOTIFY_ROUTINE gUmProcessNotify = NULL;
+
+NTSTATUS
+PsSetCreateProcessNotifyRoutine (
+    __in PCREATE_PROCESS_NOTIFY_ROUTINE NotifyRoutine,
+    __in BOOLEAN Remove
+    )
+{
+    if ( Remove )
+    {
+        if ( gUmProcessNotify != NotifyRoutine )
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        gUmProcessNotify = NULL;
+
+        return STATUS_SUCCESS;
+    }
+
+    if ( gUmProcessNotify )
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    gUmProcessNotify = NotifyRoutine;
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+PsSetCreateProcessNotifyRoutineEx (
+    __in PCREATE_PROCESS_NOTIFY_ROUTINE_EX NotifyRoutine,
+    __in BOOLEAN Remove
+    )
+{
+    UNREFERENCED_PARAMETER( NotifyRoutine );
+    UNREFERENCED_PARAMETER( Remove );
+
+    return STATUS_NOT_SUPPORTED;
+}
+
+HANDLE
+PsGetCurrentProcessId (
+    )
+{
+    return UlongToHandle( getpid() );
+}
@@ -103,6 +103,8 @@ typedef enum _NOTIFY_ID
     ntfcom_Activate      = 011,
     ntfcom_FiltersChain  = 050,
     ntfcom_IoSupport     = 060,
+    ntfcom_Quotas        = 070,
+    ntfcom_Statistics    = 071,
     
     // object's commands
     ntfcom_PrepareIO     = 100 // result struct
@@ -126,6 +128,39 @@ typedef struct _NC_IOPREPARE
     LARGE_INTEGER       m_IoSize;
 } NC_IOPREPARE, *PNC_IOPREPARE;
 
+// ntfcom_Quotas input. Limits of the driver (Parameters key of the
+// service) can only be lowered: 0 or a greater value - the limit.
+// Filters and boxes over a quota fail with STATUS_QUOTA_EXCEEDED, ones
+// added before stay
+typedef struct _NC_QUOTAS
+{
+    ULONG               m_Filters;
+    ULONG               m_Boxes;
+    ULONG64             m_PolicyBytes;          // params of filters and boxes
+} NC_QUOTAS, *PNC_QUOTAS;
+
+// ntfcom_Statistics output - usage of the client's filters
+typedef struct _NC_STATISTICS
+{
+    NC_QUOTAS           m_Quotas;               // in effect, 0 - not limited
+
+    // charged against quotas
+    ULONG               m_Filters;
+    ULONG               m_Boxes;
+    ULONG64             m_PolicyBytes;
+    ULONG64             m_Rejected;             // requests over a quota
+
+    // memory held by the driver, estimated
+    ULONG               m_Sets;                 // operations with filters
+    ULONG               m_Params;               // distinct checks
+    ULONG64             m_FiltersBytes;
+    ULONG64             m_ParamsBytes;
+    ULONG64             m_PositionsBytes;       // filters of each check
+    ULONG64             m_CompiledBytes;
+    ULONG64             m_BoxesBytes;
+    ULONG64             m_CacheBytes;
+} NC_STATISTICS, *PNC_STATISTICS;
+
 // filters structures
 //        ,  
 //     r3
@@ -174,7 +209,7 @@ typedef struct _FLTBOX
 typedef enum ChainOperation
 {
     _fltchain_add       = 0,
-    _fltchain_del       = 1,
+    _fltchain_del       = 1,    // not supported - chain fails
     _fltbox_create      = 2,
     _fltbox_release     = 3,
 };
@@ -186,10 +221,14 @@ typedef struct _CHAIN_ENTRY
     {
         FILTER          m_Filter[1];    // _fltchain_add
         ULONG           m_Id[1];        // _fltchain_del
-        FLTBOX          m_Box[1];       // _fltbox_create
+        FLTBOX          m_Box[1];       // _fltbox_create, _fltbox_release
     };
 } CHAIN_ENTRY,*PCHAIN_ENTRY;
 
+// entries go one after another, each starts aligned as CHAIN_ENTRY.
+// Chain is applied as a whole: filters and boxes of all entries are
+// changed or none of them. Output is ULONG per entry - filter id, box
+// position or 0 for released box
 typedef struct _FILTERS_CHAIN
 {
     ULONG               m_Count;
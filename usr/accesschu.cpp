@@ -614,6 +614,67 @@ Nc_Command (
     return hResult;
 }
 
+HRESULT
+Nc_SetQuotas (
+    __in PCOMMUNICATIONS CommPort,
+    __in PNC_QUOTAS Quotas
+    )
+{
+    assert( CommPort );
+    assert( Quotas );
+
+    char buffer[ FIELD_OFFSET( NOTIFY_COMMAND, m_Data ) + sizeof( NC_QUOTAS ) ];
+
+    ZeroMemory( buffer, sizeof( buffer ) );
+
+    PNOTIFY_COMMAND pCommand = (PNOTIFY_COMMAND) buffer;
+    pCommand->m_Command = ntfcom_Quotas;
+    RtlCopyMemory( pCommand->m_Data, Quotas, sizeof( NC_QUOTAS ) );
+
+    DWORD returned = 0;
+    HRESULT hResult = FilterSendMessage (
+        CommPort->m_hPort,
+        pCommand,
+        sizeof( buffer ),
+        NULL,
+        0,
+        &returned
+        );
+
+    return hResult;
+}
+
+HRESULT
+Nc_QueryStatistics (
+    __in PCOMMUNICATIONS CommPort,
+    __out PNC_STATISTICS Statistics
+    )
+{
+    assert( CommPort );
+    assert( Statistics );
+
+    NOTIFY_COMMAND command;
+    ZeroMemory( &command, sizeof( NOTIFY_COMMAND) );
+    command.m_Command = ntfcom_Statistics;
+
+    DWORD returned = 0;
+    HRESULT hResult = FilterSendMessage (
+        CommPort->m_hPort,
+        &command,
+        sizeof( NOTIFY_COMMAND),
+        Statistics,
+        sizeof( NC_STATISTICS ),
+        &returned
+        );
+
+    if ( SUCCEEDED( hResult ) && returned != sizeof( NC_STATISTICS ) )
+    {
+        hResult = E_UNEXPECTED;
+    }
+
+    return hResult;
+}
+
 __checkReturn
 HRESULT
 Nc_ExecuteObjectRequest (
@@ -1101,6 +1162,21 @@ main (
             __leave;
         }
 
+        NC_STATISTICS statistics;
+        hResult = Nc_QueryStatistics( &Comm, &statistics );
+        if ( SUCCEEDED( hResult ) )
+        {
+            printf(
+                "Filters %d of %d, boxes %d of %d, policy bytes %I64u of %I64u\n",
+                statistics.m_Filters,
+                statistics.m_Quotas.m_Filters,
+                statistics.m_Boxes,
+                statistics.m_Quotas.m_Boxes,
+                statistics.m_PolicyBytes,
+                statistics.m_Quotas.m_PolicyBytes
+                );
+        }
+
         for ( int thc = 0; thc < THREAD_MAXCOUNT_WAITERS; thc++ )
         {
             hThreads[thc] = CreateThread ( NULL, 0, WaiterThread, &Comm, 0, &ThreadsId[thc] );